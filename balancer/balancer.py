@@ -12,6 +12,8 @@ import pickle
 from http.server import HTTPServer, BaseHTTPRequestHandler
 import urllib3
 
+from placement import ConsistentHashStorageAssigner
+
 urllib3.disable_warnings(urllib3.exceptions.InsecureRequestWarning)
 
 clients_file = './clients.pkl'
@@ -26,6 +28,9 @@ class Storage:
     def get_url(self):
         return f"https://{self.ip}:{self.port}/ping"
 
+    def key(self):
+        return f"{self.ip}:{self.port}"
+
     def ping(self):
         try:
             response = requests.get(self.get_url(), verify=False)
@@ -39,6 +44,17 @@ class Storage:
             print(f"Error pinging storage {self.ip}:{self.port}: {e}")
             return False
 
+    def get_stats(self):
+        try:
+            response = requests.get(f"https://{self.ip}:{self.port}/stats", verify=False, timeout=5)
+            if response.status_code == 200:
+                return response.json()
+            print(f"Storage {self.ip}:{self.port} did not return stats: {response.text}.")
+            return None
+        except (requests.RequestException, ValueError) as e:
+            print(f"Error getting stats of storage {self.ip}:{self.port}: {e}")
+            return None
+
     def create_client(self, client_id):
         try:
             url = f"https://{self.ip}:{self.port}/create_client"
@@ -94,7 +110,7 @@ class HTTPHandler(BaseHTTPRequestHandler):
             return
 
         client_id = login
-        assigned_storage = self.server.assign_storage()
+        assigned_storage = self.server.assign_storage(client_id)
         if not assigned_storage:
             self.send_response(500)
             self.end_headers()
@@ -191,20 +207,11 @@ def run_health_checks(active_storages, inactive_storages, interval=60):
 
         time.sleep(interval)
 
-class RoundRobinStorageAssigner:
-    def __init__(self, storages):
-        self.storages = storages
-        self.current_index = 0
-
-    def get_next_storage(self):
-        if not self.storages:
-            return None
-
-        storage = self.storages[self.current_index]
-
-        self.current_index = (self.current_index + 1) % len(self.storages)
-
-        return storage
+def run_stats_refresh(storage_assigner, interval=10):
+    while True:
+        time.sleep(interval)
+        weights = storage_assigner.refresh()
+        print(f"Refreshed storage placement weights: {weights}")
 
 def run(args, active_storages):
     inactive_storages = []
@@ -215,9 +222,11 @@ def run(args, active_storages):
     httpd = HTTPServer((args.address, args.port), HTTPHandler)
     httpd.socket = context.wrap_socket(httpd.socket, server_side=True)
 
-    storage_assigner = RoundRobinStorageAssigner(active_storages)
-    def assign_storage():
-        return storage_assigner.get_next_storage()
+    storage_assigner = ConsistentHashStorageAssigner(
+        active_storages, min_free_fraction=args.min_free_fraction, hot_requests_per_s=args.hot_rps)
+    storage_assigner.refresh()
+    def assign_storage(client_id):
+        return storage_assigner.get_storage(client_id)
     httpd.assign_storage = assign_storage
 
     server_thread = threading.Thread(target=httpd.serve_forever)
@@ -230,6 +239,10 @@ def run(args, active_storages):
     health_check_thread.daemon = True
     health_check_thread.start()
 
+    stats_thread = threading.Thread(target=run_stats_refresh, args=(storage_assigner, args.stats_interval))
+    stats_thread.daemon = True
+    stats_thread.start()
+
     signal.signal(signal.SIGINT, signal_handler_factory(httpd))
 
     try:
@@ -247,6 +260,9 @@ def parse_cl_args():
     parser.add_argument('-c', '--certificate', help='path to certificate file', type=str, required=True)
     parser.add_argument('-k', '--key', help='path to key file', type=str, required=True)
     parser.add_argument('-y', '--yaml', help='path to YAML config file for storages', type=str, required=True)
+    parser.add_argument('--stats-interval', help='seconds between refreshes of the storage stats', type=float, default=10)
+    parser.add_argument('--min-free-fraction', help='storages with less free capacity get no new clients', type=float, default=0.05)
+    parser.add_argument('--hot-rps', help='storages serving more requests per second get no new clients, 0 disables', type=float, default=0)
     return parser.parse_args()
 
 
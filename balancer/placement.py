@@ -0,0 +1,129 @@
+import bisect
+import hashlib
+import threading
+
+# Points the node with the largest weight gets on the ring, the others get
+# proportionally fewer. More points spread the keys more evenly.
+POINTS_PER_NODE = 160
+
+# Nodes with less than this fraction of their capacity free get no new
+# partitions.
+MIN_FREE_FRACTION = 0.05
+
+
+def hash_key(key):
+    return int.from_bytes(hashlib.sha1(key.encode('utf-8')).digest()[:8], 'big')
+
+
+def capacity_weight(stats, min_free_fraction=MIN_FREE_FRACTION, hot_requests_per_s=0):
+    """Placement weight of a node from its /stats report: the bytes it has free.
+
+    The capacity is the node capacity limit if it has one, its data disk
+    otherwise. The weight is 0 if the node must not get new partitions: it
+    is a read-only replica, above its high watermark or nearly full, or it
+    serves more than hot_requests_per_s requests per second (0 disables that
+    check).
+    """
+    if stats.get('read_only') or stats.get('above_high_watermark'):
+        return 0
+    if hot_requests_per_s and stats.get('requests_per_s', 0) > hot_requests_per_s:
+        return 0
+
+    capacity = stats.get('capacity_bytes', 0)
+    if capacity:
+        total = capacity
+        free = max(capacity - stats.get('usage', {}).get('bytes', 0), 0)
+    else:
+        disk = stats.get('disk', {})
+        total = disk.get('total_bytes', 0)
+        free = disk.get('available_bytes', 0)
+    if total == 0 or free < total * min_free_fraction:
+        return 0
+    return free
+
+
+class ConsistentHashRing:
+    """Consistent hash ring of weighted nodes.
+
+    Every node gets a number of points on the ring proportional to its
+    weight. A key belongs to the node of the first point following the hash
+    of the key, so adding or removing a node, or changing its weight, only
+    moves the keys of the points that changed.
+    """
+
+    def __init__(self, weights, points_per_node=POINTS_PER_NODE):
+        """weights maps node names to weights, nodes of weight 0 are left out"""
+        ring = []
+        max_weight = max(weights.values(), default=0)
+        for node, weight in weights.items():
+            if weight <= 0:
+                continue
+            points = max(1, round(points_per_node * weight / max_weight))
+            ring.extend((hash_key(f"{node}#{i}"), node) for i in range(points))
+        ring.sort()
+        self.points = [point for point, _ in ring]
+        self.nodes = [node for _, node in ring]
+
+    def iter_nodes(self, key):
+        """nodes in the order they own key: its node first, then the ones to
+        fail over to"""
+        seen = set()
+        start = bisect.bisect(self.points, hash_key(key))
+        for i in range(len(self.points)):
+            node = self.nodes[(start + i) % len(self.points)]
+            if node not in seen:
+                seen.add(node)
+                yield node
+
+    def get_node(self, key):
+        return next(self.iter_nodes(key), None)
+
+
+class ConsistentHashStorageAssigner:
+    """Places new clients on storages by consistent hashing of their id.
+
+    The ring is weighted by the free capacity the storages report on /stats
+    and rebuilt by refresh(), so hot or nearly full storages stop getting
+    new partitions. Storages without stats, e.g. running an older server,
+    get the average weight of the others. A client whose storage is down
+    goes to the next storage on the ring.
+    """
+
+    def __init__(self, storages, min_free_fraction=MIN_FREE_FRACTION, hot_requests_per_s=0):
+        """storages is the list of healthy storages, kept up to date by the
+        health checks"""
+        self.storages = storages
+        self.min_free_fraction = min_free_fraction
+        self.hot_requests_per_s = hot_requests_per_s
+        self.ring = ConsistentHashRing({})
+        self.lock = threading.Lock()
+
+    def refresh(self):
+        """fetch the stats of the healthy storages and rebuild the ring,
+        returns the weights"""
+        weights = {}
+        unknown = []
+        for storage in list(self.storages):
+            stats = storage.get_stats()
+            if stats is None:
+                unknown.append(storage.key())
+            else:
+                weights[storage.key()] = capacity_weight(
+                    stats, self.min_free_fraction, self.hot_requests_per_s)
+        known = [weight for weight in weights.values() if weight > 0]
+        for key in unknown:
+            weights[key] = sum(known) / len(known) if known else 1
+
+        ring = ConsistentHashRing(weights)
+        with self.lock:
+            self.ring = ring
+        return weights
+
+    def get_storage(self, client_id):
+        with self.lock:
+            ring = self.ring
+        healthy = {storage.key(): storage for storage in list(self.storages)}
+        for key in ring.iter_nodes(client_id):
+            if key in healthy:
+                return healthy[key]
+        return None
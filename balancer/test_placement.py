@@ -0,0 +1,143 @@
+import unittest
+
+from placement import ConsistentHashRing, ConsistentHashStorageAssigner, capacity_weight
+
+KEYS = [f"client-{i}" for i in range(10000)]
+
+
+def stats(capacity_bytes=0, used_bytes=0, **kwargs):
+    return dict({'capacity_bytes': capacity_bytes, 'usage': {'bytes': used_bytes}}, **kwargs)
+
+
+class FakeStorage:
+    def __init__(self, name, stats=None):
+        self.name = name
+        self.stats = stats
+
+    def key(self):
+        return self.name
+
+    def get_stats(self):
+        return self.stats
+
+
+class ConsistentHashRingTest(unittest.TestCase):
+    def assignment(self, ring):
+        return {key: ring.get_node(key) for key in KEYS}
+
+    def test_empty_ring_has_no_node(self):
+        self.assertIsNone(ConsistentHashRing({}).get_node("client"))
+        self.assertIsNone(ConsistentHashRing({'a': 0}).get_node("client"))
+
+    def test_adding_a_node_only_moves_keys_to_it(self):
+        before = self.assignment(ConsistentHashRing({'a': 1, 'b': 1, 'c': 1}))
+        after = self.assignment(ConsistentHashRing({'a': 1, 'b': 1, 'c': 1, 'd': 1}))
+
+        moved = [key for key in KEYS if before[key] != after[key]]
+        self.assertTrue(all(after[key] == 'd' for key in moved))
+        self.assertAlmostEqual(len(moved) / len(KEYS), 1 / 4, delta=0.05)
+
+    def test_removing_a_node_only_moves_its_keys(self):
+        before = self.assignment(ConsistentHashRing({'a': 1, 'b': 1, 'c': 1, 'd': 1}))
+        after = self.assignment(ConsistentHashRing({'a': 1, 'b': 1, 'c': 1}))
+
+        moved = [key for key in KEYS if before[key] != after[key]]
+        self.assertEqual(moved, [key for key in KEYS if before[key] == 'd'])
+
+    def test_keys_are_spread_by_weight(self):
+        placement = self.assignment(ConsistentHashRing({'small': 1, 'large': 3}))
+
+        share = sum(node == 'large' for node in placement.values()) / len(KEYS)
+        self.assertAlmostEqual(share, 3 / 4, delta=0.05)
+
+    def test_weight_change_moves_few_keys(self):
+        before = self.assignment(ConsistentHashRing({'a': 100, 'b': 100}))
+        after = self.assignment(ConsistentHashRing({'a': 100, 'b': 90}))
+
+        moved = [key for key in KEYS if before[key] != after[key]]
+        self.assertTrue(all(before[key] == 'b' and after[key] == 'a' for key in moved))
+        self.assertLess(len(moved) / len(KEYS), 0.1)
+
+    def test_fail_over_order_lists_every_node_once(self):
+        ring = ConsistentHashRing({'a': 1, 'b': 2, 'c': 3})
+
+        nodes = list(ring.iter_nodes("client"))
+        self.assertEqual(sorted(nodes), ['a', 'b', 'c'])
+        self.assertEqual(nodes[0], ring.get_node("client"))
+
+
+class CapacityWeightTest(unittest.TestCase):
+    def test_free_capacity(self):
+        self.assertEqual(capacity_weight(stats(1000, 300)), 700)
+
+    def test_disk_without_capacity_limit(self):
+        disk = {'disk': {'total_bytes': 1000, 'available_bytes': 400}}
+        self.assertEqual(capacity_weight(disk), 400)
+
+    def test_full_nodes_get_nothing(self):
+        self.assertEqual(capacity_weight(stats(1000, 960)), 0)
+        self.assertEqual(capacity_weight(stats(1000, 1200)), 0)
+        self.assertEqual(capacity_weight({}), 0)
+
+    def test_unavailable_nodes_get_nothing(self):
+        self.assertEqual(capacity_weight(stats(1000, 0, read_only=True)), 0)
+        self.assertEqual(capacity_weight(stats(1000, 0, above_high_watermark=True)), 0)
+
+    def test_hot_nodes_get_nothing(self):
+        hot = stats(1000, 0, requests_per_s=500)
+        self.assertEqual(capacity_weight(hot), 1000)
+        self.assertEqual(capacity_weight(hot, hot_requests_per_s=100), 0)
+
+
+class ConsistentHashStorageAssignerTest(unittest.TestCase):
+    def test_no_storage_before_refresh(self):
+        assigner = ConsistentHashStorageAssigner([FakeStorage('a', stats(1000))])
+        self.assertIsNone(assigner.get_storage("client"))
+
+    def test_refresh_weights_by_free_capacity(self):
+        storages = [FakeStorage('a', stats(1000, 750)), FakeStorage('b', stats(1000, 250))]
+        assigner = ConsistentHashStorageAssigner(storages)
+
+        self.assertEqual(assigner.refresh(), {'a': 250, 'b': 750})
+        placement = [assigner.get_storage(key).key() for key in KEYS]
+        self.assertAlmostEqual(placement.count('b') / len(KEYS), 3 / 4, delta=0.05)
+
+    def test_placement_is_stable(self):
+        storages = [FakeStorage(name, stats(1000)) for name in 'abc']
+        assigner = ConsistentHashStorageAssigner(storages)
+        assigner.refresh()
+
+        before = [assigner.get_storage(key) for key in KEYS]
+        assigner.refresh()
+        self.assertEqual([assigner.get_storage(key) for key in KEYS], before)
+
+    def test_full_storage_gets_no_clients(self):
+        storages = [FakeStorage('a', stats(1000, 990)), FakeStorage('b', stats(1000))]
+        assigner = ConsistentHashStorageAssigner(storages)
+        assigner.refresh()
+
+        self.assertTrue(all(assigner.get_storage(key).key() == 'b' for key in KEYS[:100]))
+
+    def test_storage_without_stats_gets_average_weight(self):
+        storages = [FakeStorage('a', stats(1000, 800)), FakeStorage('b', stats(1000, 400)),
+                    FakeStorage('old')]
+        assigner = ConsistentHashStorageAssigner(storages)
+
+        self.assertEqual(assigner.refresh()['old'], 400)
+
+    def test_unhealthy_storage_fails_over(self):
+        storages = [FakeStorage(name, stats(1000)) for name in 'abc']
+        assigner = ConsistentHashStorageAssigner(storages)
+        assigner.refresh()
+        before = {key: assigner.get_storage(key).key() for key in KEYS}
+
+        storages.pop(0)
+        for key in KEYS:
+            storage = assigner.get_storage(key).key()
+            self.assertNotEqual(storage, 'a')
+            if before[key] != 'a':
+                self.assertEqual(storage, before[key])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "partition/backend.hpp"
+#include "partition/checksum.hpp"
+#include "partition/in_memory_partition.hpp"
+#include "partition/on_disk_partition.hpp"
+#include "partition/partition.hpp"
+#include "storage.hpp"
+
+namespace bench::storage {
+
+namespace {
+using namespace cppfs::storage;
+
+constexpr auto kValidUUID = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+constexpr size_t kReadChunkSize = 4096;
+
+/// Output stream that drops everything written to it, so read benchmarks
+/// measure the backend rather than the destination buffer
+class NullBuffer final : public std::streambuf {
+ protected:
+  int_type overflow(int_type c) override { return c; }
+
+  std::streamsize xsputn(char const* /*s*/, std::streamsize n) override {
+    return n;
+  }
+};
+
+template <typename Manager>
+std::unique_ptr<Manager> CreateManager() {
+  if constexpr (std::is_same_v<Manager, OnDiskPartitionManager>) {
+    return std::make_unique<Manager>(std::filesystem::temp_directory_path() /
+                                     "cppfs-bench");
+  } else {
+    return std::make_unique<Manager>();
+  }
+}
+
+/// Storage with a single empty partition
+template <typename Manager>
+class BenchStorage {
+ public:
+  BenchStorage() : storage_(CreateManager<Manager>()) { Reset(); }
+
+  ~BenchStorage() {
+    storage_.Clear();
+    storage_.GetManager().GetReclaimer().WaitIdle();
+    if constexpr (std::is_same_v<Manager, OnDiskPartitionManager>) {
+      std::filesystem::remove_all(storage_.GetManager().GetRootPath());
+    }
+  }
+
+  BenchStorage(BenchStorage const&) = delete;
+  BenchStorage& operator=(BenchStorage const&) = delete;
+
+  /// drop all data and start over with an empty partition
+  void Reset() {
+    storage_.Clear();
+    partition_ = storage_.CreatePartition(kValidUUID).value();
+  }
+
+  Manager& GetManager() { return storage_.GetManager(); }
+
+  Storage<Manager>& GetStorage() { return storage_; }
+
+  Partition* GetPartition() { return partition_; }
+
+  Directory* GetRoot() { return partition_->OpenRoot(); }
+
+ private:
+  Storage<Manager> storage_;
+  Partition* partition_{nullptr};
+};
+
+/// create chain of @c depth nested directories, return path of the deepest
+std::string CreateNestedDirectories(Directory* dir, int64_t depth) {
+  std::string path;
+  for (int64_t i = 0; i < depth; ++i) {
+    std::string const name = "d" + std::to_string(i);
+    dir = dir->CreateDirectory(name).value();
+    path += "/" + name;
+  }
+  return path.empty() ? "/" : path;
+}
+
+template <typename Manager>
+void BM_Open(benchmark::State& state) {
+  BenchStorage<Manager> storage;
+  std::string const dir_path =
+      CreateNestedDirectories(storage.GetRoot(), state.range(0));
+  Directory* dir = storage.GetPartition()->OpenDir(dir_path).value();
+  static_cast<void>(dir->StoreRegularFile("file", std::string(16, 'x')));
+  std::filesystem::path const file_path = dir_path + "/file";
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(storage.GetPartition()->Open(file_path));
+  }
+  state.counters["depth"] = static_cast<double>(state.range(0));
+}
+
+template <typename Manager>
+void BM_StoreRegularFile(benchmark::State& state) {
+  /* stored files can't be removed, so start over periodically to keep the
+   * memory and disk footprint of the benchmark bounded */
+  constexpr int64_t kStoresPerPartition = 64;
+
+  BenchStorage<Manager> storage;
+  auto const file_size = static_cast<size_t>(state.range(0));
+  std::string const payload(file_size, 'x');
+  Directory* root = storage.GetRoot();
+  int64_t stored = 0;
+
+  for (auto _ : state) {
+    if (stored == kStoresPerPartition) {
+      state.PauseTiming();
+      storage.Reset();
+      root = storage.GetRoot();
+      stored = 0;
+      state.ResumeTiming();
+    }
+    benchmark::DoNotOptimize(root->StoreRegularFile(
+        "f" + std::to_string(stored++), std::string{payload}));
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(file_size));
+}
+
+/// Overwrite a few bytes in the middle of a deduplicated in-memory file. The
+/// chunks are split again only until their boundaries line up with the old
+/// ones, so the time doesn't depend on the size of the file.
+void BM_DedupPositionalWrite(benchmark::State& state) {
+  auto const file_size = static_cast<size_t>(state.range(0));
+  InMemoryPartitionManager manager{{}, {}, {.enabled = true}};
+  Directory* root = manager.CreatePartition(*PartitionId::Parse(kValidUUID))
+                        .value()
+                        ->OpenRoot();
+  std::mt19937 generator{1};
+  std::string payload(file_size, '\0');
+  for (char& c : payload) c = static_cast<char>(generator());
+  RegularFile* file =
+      root->StoreRegularFile("file", std::move(payload)).value();
+  std::string const data(64, 'x');
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(file->PositionalWrite(file_size / 2, data));
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(data.size()));
+}
+
+template <typename Manager>
+void BM_PositionalRead(benchmark::State& state) {
+  static std::unique_ptr<BenchStorage<Manager>> storage;
+  static RegularFile* file = nullptr;
+  auto const file_size = static_cast<size_t>(state.range(0));
+  if (state.thread_index() == 0) {
+    storage = std::make_unique<BenchStorage<Manager>>();
+    file = storage->GetRoot()
+               ->StoreRegularFile("file", std::string(file_size, 'x'))
+               .value();
+  }
+
+  NullBuffer buffer;
+  std::ostream out{&buffer};
+  size_t const chunk = std::min<size_t>(file_size, kReadChunkSize);
+  size_t offset = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(file->PositionalRead(out, offset, chunk));
+    offset = offset + 2 * chunk > file_size ? 0 : offset + chunk;
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(chunk));
+
+  if (state.thread_index() == 0) {
+    file = nullptr;
+    storage.reset();
+  }
+}
+
+/// reads of on-disk files without checksums, the baseline of the verified
+/// reads in BM_PositionalRead
+void BM_UncheckedPositionalRead(benchmark::State& state) {
+  BenchStorage<OnDiskPartitionManager> storage;
+  auto const file_size = static_cast<size_t>(state.range(0));
+  static_cast<void>(
+      storage.GetRoot()->StoreRegularFile("file", std::string(file_size, 'x')));
+  std::filesystem::remove_all(storage.GetManager().GetRootPath() /
+                              OnDiskPartitionManager::kChecksumDirName);
+  RegularFile* file = storage.GetPartition()->OpenRegularFile("/file").value();
+
+  NullBuffer buffer;
+  std::ostream out{&buffer};
+  size_t const chunk = std::min<size_t>(file_size, kReadChunkSize);
+  size_t offset = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(file->PositionalRead(out, offset, chunk));
+    offset = offset + 2 * chunk > file_size ? 0 : offset + chunk;
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(chunk));
+}
+
+/// CRC32C throughput, with the crc32 instruction if range(1) is 1
+void BM_Crc32c(benchmark::State& state) {
+  std::string const data(static_cast<size_t>(state.range(0)), 'x');
+  bool const hardware = state.range(1) == 1;
+  if (hardware && !HasHardwareCrc32c()) {
+    state.SkipWithError("no crc32 instruction");
+    return;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hardware ? Crc32c(data) : Crc32cPortable(data));
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(data.size()));
+}
+
+template <typename Manager>
+void BM_GetDirEntries(benchmark::State& state) {
+  static std::unique_ptr<BenchStorage<Manager>> storage;
+  static Directory* dir = nullptr;
+  if (state.thread_index() == 0) {
+    storage = std::make_unique<BenchStorage<Manager>>();
+    dir = storage->GetRoot();
+    for (int64_t i = 0; i < state.range(0); ++i) {
+      static_cast<void>(
+          dir->StoreRegularFile("f" + std::to_string(i), std::string(16, 'x')));
+    }
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dir->GetDirEntries());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+
+  if (state.thread_index() == 0) {
+    dir = nullptr;
+    storage.reset();
+  }
+}
+
+template <typename Manager>
+void BM_GetSize(benchmark::State& state) {
+  BenchStorage<Manager> storage;
+  Directory* dir = storage.GetRoot();
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    static_cast<void>(
+        dir->StoreRegularFile("f" + std::to_string(i), std::string(16, 'x')));
+  }
+  RegularFile* file =
+      dir->StoreRegularFile("file", std::string(4096, 'x')).value();
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dir->GetSize());
+    benchmark::DoNotOptimize(file->GetSize());
+  }
+  state.counters["width"] = static_cast<double>(state.range(0));
+}
+
+template <typename Manager>
+void BM_LookupPartition(benchmark::State& state) {
+  Storage<Manager> storage{CreateManager<Manager>()};
+  std::vector<std::string> uuids;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    uuids.push_back(GeneratePartitionId().ToString());
+    static_cast<void>(storage.CreatePartition(uuids.back()));
+  }
+
+  size_t next = 0;
+  for (auto _ : state) {
+    /* requests name partitions by the text form */
+    benchmark::DoNotOptimize(storage.LookupPartition(uuids[next]));
+    next = next + 1 == uuids.size() ? 0 : next + 1;
+  }
+  state.counters["partitions"] = static_cast<double>(state.range(0));
+
+  storage.Clear();
+  storage.GetManager().GetReclaimer().WaitIdle();
+  if constexpr (std::is_same_v<Manager, OnDiskPartitionManager>) {
+    std::filesystem::remove_all(storage.GetManager().GetRootPath());
+  }
+}
+
+/// how a request reaches the partition and the file of the backend
+enum class Dispatch {
+  /// through the abstract interfaces, with a dynamic_cast of the file
+  kVirtual,
+  /// through the final types of the backend
+  kStatic,
+};
+
+/// the lookups and the read of a `/cat` of a small file at path depth
+/// range(0)
+template <typename Manager, Dispatch kDispatch>
+void BM_CatDispatch(benchmark::State& state) {
+  constexpr size_t kFileSize = 64;
+
+  BenchStorage<Manager> storage;
+  std::string const dir_path =
+      CreateNestedDirectories(storage.GetRoot(), state.range(0));
+  Directory* dir = storage.GetPartition()->OpenDir(dir_path).value();
+  static_cast<void>(dir->StoreRegularFile("file", std::string(kFileSize, 'x')));
+  std::filesystem::path const file_path = dir_path + "/file";
+
+  NullBuffer buffer;
+  std::ostream out{&buffer};
+  for (auto _ : state) {
+    auto* partition = storage.GetStorage().LookupPartition(kValidUUID).value();
+    if constexpr (kDispatch == Dispatch::kVirtual) {
+      /* the routes only knew the partition by its interface */
+      Partition* base = partition;
+      benchmark::DoNotOptimize(base);
+      File* file = base->Open(file_path).value();
+      auto* reg_file = dynamic_cast<RegularFile*>(file);
+      benchmark::DoNotOptimize(reg_file->GetVersion());
+      benchmark::DoNotOptimize(reg_file->PositionalRead(out, 0, kFileSize));
+    } else {
+      auto* reg_file =
+          OpenBackendRegularFile<Manager>(*partition, file_path).value();
+      benchmark::DoNotOptimize(reg_file->GetVersion());
+      benchmark::DoNotOptimize(reg_file->PositionalRead(out, 0, kFileSize));
+    }
+  }
+  state.counters["depth"] = static_cast<double>(state.range(0));
+}
+
+}  // namespace
+
+/* path depth */
+BENCHMARK_TEMPLATE(BM_Open, InMemoryPartitionManager)->RangeMultiplier(4)
+    ->Range(1, 64);
+BENCHMARK_TEMPLATE(BM_Open, OnDiskPartitionManager)->RangeMultiplier(4)
+    ->Range(1, 64);
+
+/* file size */
+BENCHMARK_TEMPLATE(BM_StoreRegularFile, InMemoryPartitionManager)
+    ->RangeMultiplier(16)
+    ->Range(16, 1 << 20);
+BENCHMARK_TEMPLATE(BM_StoreRegularFile, OnDiskPartitionManager)
+    ->RangeMultiplier(16)
+    ->Range(16, 1 << 20);
+
+/* file size */
+BENCHMARK(BM_DedupPositionalWrite)->RangeMultiplier(16)->Range(64 << 10,
+                                                               64 << 20);
+
+/* file size x thread count */
+BENCHMARK_TEMPLATE(BM_PositionalRead, InMemoryPartitionManager)
+    ->RangeMultiplier(16)
+    ->Range(4 << 10, 16 << 20)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_PositionalRead, OnDiskPartitionManager)
+    ->RangeMultiplier(16)
+    ->Range(4 << 10, 16 << 20)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+/* file size */
+BENCHMARK(BM_UncheckedPositionalRead)->RangeMultiplier(16)->Range(4 << 10,
+                                                                  16 << 20);
+
+/* data size x hardware */
+BENCHMARK(BM_Crc32c)->ArgsProduct({{64, 4096, 1 << 20}, {0, 1}});
+
+/* directory width x thread count */
+BENCHMARK_TEMPLATE(BM_GetDirEntries, InMemoryPartitionManager)
+    ->RangeMultiplier(10)
+    ->Range(10, 10000)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_GetDirEntries, OnDiskPartitionManager)
+    ->RangeMultiplier(10)
+    ->Range(10, 10000)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+/* directory width */
+BENCHMARK_TEMPLATE(BM_GetSize, InMemoryPartitionManager)->RangeMultiplier(10)
+    ->Range(10, 10000);
+BENCHMARK_TEMPLATE(BM_GetSize, OnDiskPartitionManager)->RangeMultiplier(10)
+    ->Range(10, 10000);
+
+/* path depth */
+BENCHMARK_TEMPLATE(BM_CatDispatch, InMemoryPartitionManager, Dispatch::kVirtual)
+    ->RangeMultiplier(4)
+    ->Range(1, 16);
+BENCHMARK_TEMPLATE(BM_CatDispatch, InMemoryPartitionManager, Dispatch::kStatic)
+    ->RangeMultiplier(4)
+    ->Range(1, 16);
+
+/* partition count */
+BENCHMARK_TEMPLATE(BM_LookupPartition, InMemoryPartitionManager)
+    ->RangeMultiplier(10)
+    ->Range(10, 10000);
+BENCHMARK_TEMPLATE(BM_LookupPartition, OnDiskPartitionManager)
+    ->RangeMultiplier(10)
+    ->Range(10, 10000);
+
+}  // namespace bench::storage
@@ -0,0 +1,358 @@
+#include "loadgen.hpp"
+
+#include <atomic>
+#include <format>
+#include <memory>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <boost/json.hpp>
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib.h"
+
+namespace cppfs::loadgen {
+
+namespace {
+using Clock = std::chrono::steady_clock;
+using storage::Counter;
+using storage::LatencyHistogram;
+
+constexpr time_t kConnectionTimeoutS = 5;
+constexpr time_t kReadTimeoutS = 30;
+
+/// State shared by all connections of a run
+struct Run {
+  LoadgenConfig const& config;
+  OperationMix mix;
+  ZipfGenerator zipf;
+  std::vector<std::string> uuids;
+  /// directory created in every partition for the files and directories
+  /// written by this run
+  std::string write_dir;
+  std::string payload;
+
+  Clock::time_point measure_begin;
+  Clock::time_point measure_end;
+  std::atomic<bool> stop{false};
+
+  std::array<LatencyHistogram, kOperations> latency;
+  std::array<Counter, kOperations> errors;
+  LatencyHistogram total_latency;
+  Counter total_errors;
+
+  void Record(Operation operation, Clock::time_point begin,
+              Clock::time_point end, bool ok) {
+    if (begin < measure_begin || begin >= measure_end) return;
+    auto const index = static_cast<size_t>(operation);
+    latency[index].Record(end - begin);
+    total_latency.Record(end - begin);
+    if (!ok) {
+      errors[index].Inc();
+      total_errors.Inc();
+    }
+  }
+};
+
+std::unique_ptr<httplib::SSLClient> Connect(LoadgenConfig const& config) {
+  auto client = std::make_unique<httplib::SSLClient>(config.host, config.port);
+  client->set_keep_alive(true);
+  client->set_connection_timeout(kConnectionTimeoutS);
+  client->set_read_timeout(kReadTimeoutS);
+  if (config.ca_cert.empty()) {
+    client->enable_server_certificate_verification(false);
+  } else {
+    client->set_ca_cert_path(config.ca_cert.c_str());
+  }
+  return client;
+}
+
+Error RequestError(std::string_view route, httplib::Result const& res) {
+  if (!res) {
+    return Error{ErrorEnum::kInternalServerError,
+                 std::format("{} failed: {}", route,
+                             httplib::to_string(res.error()))};
+  }
+  return Error{ErrorEnum::kInternalServerError,
+               std::format("{} returned {}: {}", route, res->status,
+                           res->body)};
+}
+
+tl::expected<std::string, Error> CreateClient(httplib::Client& client,
+                                              std::string const& client_id) {
+  std::string const body =
+      boost::json::serialize(boost::json::object{{"client_id", client_id}});
+  httplib::Result res = client.Post("/create_client", body, "application/json");
+  if (!res || res->status != httplib::OK_200) {
+    return tl::unexpected(RequestError("/create_client", res));
+  }
+
+  std::error_code ec;
+  boost::json::value const value = boost::json::parse(res->body, ec);
+  if (ec || !value.is_object() || !value.as_object().contains("uuid")) {
+    return tl::unexpected(
+        Error{ErrorEnum::kInvalidInput,
+              std::format("/create_client returned '{}'", res->body)});
+  }
+  return std::string{value.at("uuid").as_string().c_str()};
+}
+
+std::string FileName(uint64_t file) { return std::format("f{}", file); }
+
+/// create partition @c index with its files and the write directory
+tl::expected<std::string, Error> PreparePartition(httplib::Client& client,
+                                                  Run const& run,
+                                                  size_t index) {
+  auto uuid = CreateClient(client, std::format("loadgen-{}", index));
+  if (!uuid.has_value()) return uuid;
+
+  httplib::Result res = client.Post(
+      "/mkdir", httplib::Params{
+                    {"uuid", *uuid}, {"at", "/"}, {"dir", run.write_dir}});
+  if (!res || res->status != httplib::OK_200) {
+    return tl::unexpected(RequestError("/mkdir", res));
+  }
+
+  for (size_t file = 0; file < run.config.files; ++file) {
+    res = client.Post("/store", httplib::Params{{"uuid", *uuid},
+                                                {"dir", "/"},
+                                                {"file", FileName(file)},
+                                                {"data", run.payload}});
+    /* files are left in place by previous runs with the same client ids */
+    if (!res || (res->status != httplib::OK_200 &&
+                 res->status != httplib::BadRequest_400)) {
+      return tl::unexpected(RequestError("/store", res));
+    }
+  }
+  return uuid;
+}
+
+tl::expected<void, Error> Prepare(Run& run) {
+  run.uuids.resize(run.config.partitions);
+  std::atomic<size_t> next_partition{0};
+  std::vector<std::optional<Error>> errors(run.config.connections);
+  {
+    std::vector<std::jthread> threads;
+    for (size_t i = 0; i < run.config.connections; ++i) {
+      threads.emplace_back([&run, &next_partition, &error = errors[i]] {
+        std::unique_ptr<httplib::SSLClient> client = Connect(run.config);
+        for (size_t index = next_partition++; index < run.config.partitions;
+             index = next_partition++) {
+          auto uuid = PreparePartition(*client, run, index);
+          if (!uuid.has_value()) {
+            error = std::move(uuid.error());
+            return;
+          }
+          run.uuids[index] = std::move(*uuid);
+        }
+      });
+    }
+  }
+  for (auto& error : errors) {
+    if (error.has_value()) return tl::unexpected(std::move(*error));
+  }
+  return {};
+}
+
+/// issue single request, return true on success
+bool Issue(httplib::Client& client, Run& run, Operation operation,
+           std::mt19937_64& rng, std::string const& unique_name) {
+  LoadgenConfig const& config = run.config;
+  uint64_t const key =
+      ScrambleKey(run.zipf(rng), config.partitions * config.files);
+  std::string const& uuid = run.uuids[key / config.files];
+  std::string const write_dir = "/" + run.write_dir;
+
+  httplib::Result res;
+  switch (operation) {
+    case Operation::kLs:
+      res = client.Get("/ls", httplib::Params{{"uuid", uuid}, {"path", "/"}},
+                       httplib::Headers{});
+      break;
+    case Operation::kCat:
+      res = client.Get(
+          "/cat",
+          httplib::Params{{"uuid", uuid},
+                          {"path", "/" + FileName(key % config.files)}},
+          httplib::Headers{});
+      return res && res->status == httplib::OK_200 &&
+             res->body.size() == config.file_size;
+    case Operation::kStore:
+      res = client.Post("/store", httplib::Params{{"uuid", uuid},
+                                                  {"dir", write_dir},
+                                                  {"file", unique_name},
+                                                  {"data", run.payload}});
+      break;
+    case Operation::kMkdir:
+      res = client.Post("/mkdir", httplib::Params{{"uuid", uuid},
+                                                  {"at", write_dir},
+                                                  {"dir", unique_name}});
+      break;
+    case Operation::kCount:
+      return false;
+  }
+  return res && res->status == httplib::OK_200;
+}
+
+void RunConnection(Run& run, size_t connection) {
+  LoadgenConfig const& config = run.config;
+  std::mt19937_64 rng{config.seed + connection};
+  std::unique_ptr<httplib::SSLClient> client = Connect(config);
+  uint64_t sequence = 0;
+  auto next_name = [&] { return std::format("{}-{}", connection, sequence++); };
+
+  if (config.mode == LoadMode::kClosed) {
+    while (!run.stop.load(std::memory_order_relaxed)) {
+      Operation const operation = run.mix.Pick(rng);
+      Clock::time_point const begin = Clock::now();
+      bool const ok = Issue(*client, run, operation, rng, next_name());
+      run.Record(operation, begin, Clock::now(), ok);
+    }
+    return;
+  }
+
+  /* Open loop: Poisson arrivals at the connection's share of the rate. The
+   * latency is measured from the scheduled send time, so a slow server is
+   * charged for the requests queued behind a slow one (no coordinated
+   * omission). */
+  double const rate = config.rate / static_cast<double>(config.connections);
+  std::exponential_distribution<double> interarrival{rate};
+  auto scheduled = Clock::now();
+  while (true) {
+    scheduled += std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>{interarrival(rng)});
+    if (scheduled >= run.measure_end) break;
+    std::this_thread::sleep_until(scheduled);
+
+    Operation const operation = run.mix.Pick(rng);
+    bool const ok = Issue(*client, run, operation, rng, next_name());
+    run.Record(operation, scheduled, Clock::now(), ok);
+  }
+}
+
+OperationReport MakeReport(LatencyHistogram const& latency,
+                           Counter const& errors) {
+  return OperationReport{.errors = errors.Value(),
+                         .latency = latency.GetSnapshot()};
+}
+
+double ToMilliseconds(std::chrono::nanoseconds duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}  // namespace
+
+double LoadReport::GetThroughput() const {
+  if (duration.count() == 0) return 0;
+  return static_cast<double>(total.latency.count) /
+         std::chrono::duration<double>(duration).count();
+}
+
+tl::expected<LoadReport, Error> RunLoad(LoadgenConfig const& config) {
+  if (config.connections == 0 || config.partitions == 0 || config.files == 0 ||
+      config.file_size == 0) {
+    return tl::unexpected(Error{
+        ErrorEnum::kInvalidInput,
+        "connections, partitions, files and file size must be positive"});
+  }
+  if (config.zipf_theta < 0 || config.zipf_theta >= 1) {
+    return tl::unexpected(
+        Error{ErrorEnum::kInvalidInput, "Zipf theta must be in [0, 1)"});
+  }
+  if (config.mode == LoadMode::kOpen && config.rate <= 0) {
+    return tl::unexpected(
+        Error{ErrorEnum::kInvalidInput, "Open loop mode requires rate > 0"});
+  }
+  tl::expected<OperationMix, Error> mix = OperationMix::Parse(config.mix);
+  if (!mix.has_value()) return tl::unexpected(std::move(mix.error()));
+
+  std::mt19937_64 rng{config.seed};
+  auto run = std::make_unique<Run>(
+      config, *mix, ZipfGenerator{config.partitions * config.files,
+                                  config.zipf_theta});
+  run->write_dir = std::format("loadgen-{:016x}", std::random_device{}() ^
+                                                      rng());
+  run->payload.resize(config.file_size);
+  std::uniform_int_distribution<int> letter{'a', 'z'};
+  for (char& c : run->payload) c = static_cast<char>(letter(rng));
+
+  if (auto prepared = Prepare(*run); !prepared.has_value()) {
+    return tl::unexpected(std::move(prepared.error()));
+  }
+
+  Clock::time_point const begin = Clock::now();
+  run->measure_begin = begin + std::chrono::seconds{config.warmup_s};
+  run->measure_end =
+      run->measure_begin + std::chrono::seconds{config.duration_s};
+  {
+    std::vector<std::jthread> threads;
+    for (size_t i = 0; i < config.connections; ++i) {
+      threads.emplace_back([&run, i] { RunConnection(*run, i); });
+    }
+    std::this_thread::sleep_until(run->measure_end);
+    run->stop = true;
+  }
+
+  LoadReport report;
+  report.duration = run->measure_end - run->measure_begin;
+  for (size_t i = 0; i < kOperations; ++i) {
+    report.operations[i] = MakeReport(run->latency[i], run->errors[i]);
+  }
+  report.total = MakeReport(run->total_latency, run->total_errors);
+  return report;
+}
+
+std::string ReportToText(LoadReport const& report) {
+  std::string text = std::format(
+      "{:<8} {:>10} {:>8} {:>10} {:>10} {:>10} {:>10}\n", "op", "requests",
+      "errors", "mean ms", "p50 ms", "p99 ms", "p999 ms");
+  auto append_row = [&text](std::string_view name, OperationReport const& op) {
+    auto const& latency = op.latency;
+    double const mean =
+        latency.count == 0 ? 0
+                           : ToMilliseconds(std::chrono::nanoseconds{
+                                 latency.sum_ns / latency.count});
+    text += std::format(
+        "{:<8} {:>10} {:>8} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}\n", name,
+        latency.count, op.errors, mean, ToMilliseconds(latency.Quantile(0.5)),
+        ToMilliseconds(latency.Quantile(0.99)),
+        ToMilliseconds(latency.Quantile(0.999)));
+  };
+  for (size_t i = 0; i < kOperations; ++i) {
+    if (report.operations[i].latency.count == 0) continue;
+    append_row(OperationToString(static_cast<Operation>(i)),
+               report.operations[i]);
+  }
+  append_row("total", report.total);
+  text += std::format("throughput: {:.1f} req/s over {:.1f} s\n",
+                      report.GetThroughput(),
+                      std::chrono::duration<double>(report.duration).count());
+  return text;
+}
+
+std::string ReportToJson(LoadReport const& report) {
+  auto to_json = [](OperationReport const& op) {
+    return boost::json::object{
+        {"requests", op.latency.count},
+        {"errors", op.errors},
+        {"p50_ms", ToMilliseconds(op.latency.Quantile(0.5))},
+        {"p99_ms", ToMilliseconds(op.latency.Quantile(0.99))},
+        {"p999_ms", ToMilliseconds(op.latency.Quantile(0.999))},
+    };
+  };
+  boost::json::object operations;
+  for (size_t i = 0; i < kOperations; ++i) {
+    operations[OperationToString(static_cast<Operation>(i))] =
+        to_json(report.operations[i]);
+  }
+  return boost::json::serialize(boost::json::object{
+      {"duration_s", std::chrono::duration<double>(report.duration).count()},
+      {"throughput", report.GetThroughput()},
+      {"operations", std::move(operations)},
+      {"total", to_json(report.total)},
+  });
+}
+
+}  // namespace cppfs::loadgen
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <tl/expected.hpp>
+
+#include "metrics/metrics.hpp"
+#include "workload.hpp"
+
+namespace cppfs::loadgen {
+
+/// How requests are issued
+enum class LoadMode : uint8_t {
+  /// each connection sends the next request as soon as the previous one
+  /// completes, throughput is whatever the server sustains
+  kClosed,
+  /// requests are sent at a fixed average rate independent of the server,
+  /// latency includes the time a request waited for its scheduled send
+  kOpen,
+};
+
+struct LoadgenConfig {
+  std::string host{"127.0.0.1"};
+  int port{4443};
+  /// verify server certificate against this CA, skip verification if empty
+  std::filesystem::path ca_cert;
+
+  LoadMode mode{LoadMode::kClosed};
+  /// keep-alive connections, each served by its own thread
+  size_t connections{16};
+  /// total requests per second in the open-loop mode
+  double rate{1000};
+  uint32_t duration_s{30};
+  uint32_t warmup_s{5};
+
+  std::string mix{"ls=40,cat=40,store=15,mkdir=5"};
+  /// partitions created via /create_client
+  size_t partitions{64};
+  /// files stored in every partition before the run
+  size_t files{256};
+  size_t file_size{4096};
+  /// skew of the key popularity, 0 for uniform
+  double zipf_theta{0.99};
+  uint64_t seed{42};
+};
+
+struct OperationReport {
+  uint64_t errors{0};
+  storage::LatencyHistogram::Snapshot latency;
+};
+
+struct LoadReport {
+  std::chrono::nanoseconds duration{0};
+  std::array<OperationReport, kOperations> operations;
+  OperationReport total;
+
+  /// completed requests per second
+  double GetThroughput() const;
+};
+
+/// prepare partitions and run the load described by @c config
+tl::expected<LoadReport, Error> RunLoad(LoadgenConfig const& config);
+
+/// human-readable summary
+std::string ReportToText(LoadReport const& report);
+/// machine-readable summary, to be compared between runs
+std::string ReportToJson(LoadReport const& report);
+
+}  // namespace cppfs::loadgen
@@ -0,0 +1,80 @@
+#include <CLI/CLI.hpp>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "loadgen.hpp"
+
+using Config = cppfs::loadgen::LoadgenConfig;
+using cppfs::loadgen::LoadMode;
+
+int main(int argc, char** argv) {
+  CLI::App app{"Load generator for the storage server"};
+
+  Config config;
+  std::filesystem::path json_out;
+
+  app.add_option("-a,--address", config.host, "Storage server address")
+      ->capture_default_str();
+  app.add_option("-p,--port", config.port, "Storage server port")
+      ->capture_default_str()
+      ->check(CLI::Range(1, 65535));
+  app.add_option("--ca-cert", config.ca_cert,
+                 "Verify server certificate against this CA")
+      ->check(CLI::ExistingFile);
+
+  std::map<std::string, LoadMode> const modes{{"closed", LoadMode::kClosed},
+                                              {"open", LoadMode::kOpen}};
+  app.add_option("-m,--mode", config.mode,
+                 "closed: next request once the previous completes, "
+                 "open: fixed request rate")
+      ->transform(CLI::CheckedTransformer(modes, CLI::ignore_case))
+      ->capture_default_str();
+  app.add_option("-c,--connections", config.connections,
+                 "Keep-alive connections")
+      ->capture_default_str();
+  app.add_option("-r,--rate", config.rate,
+                 "Total requests per second in the open mode")
+      ->capture_default_str();
+  app.add_option("-d,--duration", config.duration_s, "Measured seconds")
+      ->capture_default_str();
+  app.add_option("-w,--warmup", config.warmup_s,
+                 "Seconds of load before measuring")
+      ->capture_default_str();
+
+  app.add_option("--mix", config.mix, "Operation weights")
+      ->capture_default_str();
+  app.add_option("--partitions", config.partitions,
+                 "Partitions created via /create_client")
+      ->capture_default_str();
+  app.add_option("--files", config.files, "Files stored in every partition")
+      ->capture_default_str();
+  app.add_option("--file-size", config.file_size, "Size of stored files")
+      ->capture_default_str();
+  app.add_option("--zipf-theta", config.zipf_theta,
+                 "Skew of file popularity, 0 for uniform")
+      ->capture_default_str()
+      ->check(CLI::Range(0.0, 0.9999));
+  app.add_option("--seed", config.seed, "Random seed")->capture_default_str();
+  app.add_option("--json-out", json_out, "Write the report as JSON");
+
+  try {
+    app.parse(argc, argv);
+  } catch (const CLI::ParseError& e) {
+    return app.exit(e);
+  }
+
+  auto report = cppfs::loadgen::RunLoad(config);
+  if (!report.has_value()) {
+    std::cerr << report.error().message << "\n";
+    return EXIT_FAILURE;
+  }
+
+  std::cout << cppfs::loadgen::ReportToText(*report);
+  if (!json_out.empty()) {
+    std::ofstream(json_out) << cppfs::loadgen::ReportToJson(*report) << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,130 @@
+#include "workload.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <format>
+#include <string>
+
+namespace cppfs::loadgen {
+
+namespace {
+
+double Zeta(uint64_t n, double theta) {
+  double sum = 0;
+  for (uint64_t i = 1; i <= n; ++i) {
+    sum += 1.0 / std::pow(static_cast<double>(i), theta);
+  }
+  return sum;
+}
+
+}  // namespace
+
+std::string_view OperationToString(Operation operation) {
+  switch (operation) {
+    case Operation::kLs:
+      return "ls";
+    case Operation::kCat:
+      return "cat";
+    case Operation::kStore:
+      return "store";
+    case Operation::kMkdir:
+      return "mkdir";
+    case Operation::kCount:
+      break;
+  }
+  return "unknown";
+}
+
+tl::expected<OperationMix, Error> OperationMix::Parse(std::string_view spec) {
+  OperationMix mix;
+  while (!spec.empty()) {
+    size_t const item_end = std::min(spec.find(','), spec.size());
+    std::string_view const item = spec.substr(0, item_end);
+    spec.remove_prefix(std::min(item_end + 1, spec.size()));
+
+    size_t const eq = item.find('=');
+    if (eq == std::string_view::npos) {
+      return tl::unexpected(Error{
+          ErrorEnum::kInvalidInput,
+          std::format("Expected 'operation=weight', got '{}'", item)});
+    }
+    std::string_view const name = item.substr(0, eq);
+    std::string_view const weight_str = item.substr(eq + 1);
+
+    size_t index = 0;
+    while (index < kOperations &&
+           OperationToString(static_cast<Operation>(index)) != name) {
+      ++index;
+    }
+    if (index == kOperations) {
+      return tl::unexpected(Error{ErrorEnum::kInvalidInput,
+                                  std::format("Unknown operation '{}'", name)});
+    }
+
+    uint32_t weight = 0;
+    auto const [ptr, ec] = std::from_chars(
+        weight_str.data(), weight_str.data() + weight_str.size(), weight);
+    if (ec != std::errc{} || ptr != weight_str.data() + weight_str.size()) {
+      return tl::unexpected(Error{
+          ErrorEnum::kInvalidInput,
+          std::format("Invalid weight '{}' of '{}'", weight_str, name)});
+    }
+    mix.total_ += weight - mix.weights_[index];
+    mix.weights_[index] = weight;
+  }
+
+  if (mix.total_ == 0) {
+    return tl::unexpected(
+        Error{ErrorEnum::kInvalidInput, "Operation mix has zero total weight"});
+  }
+  return mix;
+}
+
+Operation OperationMix::Pick(std::mt19937_64& rng) const {
+  uint32_t value =
+      std::uniform_int_distribution<uint32_t>{0, total_ - 1}(rng);
+  for (size_t i = 0; i < kOperations; ++i) {
+    if (value < weights_[i]) return static_cast<Operation>(i);
+    value -= weights_[i];
+  }
+  return Operation::kLs;
+}
+
+ZipfGenerator::ZipfGenerator(uint64_t n, double theta)
+    : n_(n), theta_(theta) {
+  if (n_ < 3 || theta_ == 0) return;
+
+  alpha_ = 1.0 / (1.0 - theta_);
+  zetan_ = Zeta(n_, theta_);
+  half_pow_theta_ = std::pow(0.5, theta_);
+  double const zeta2 = 1.0 + half_pow_theta_;
+  eta_ = (1.0 - std::pow(2.0 / static_cast<double>(n_), 1.0 - theta_)) /
+         (1.0 - zeta2 / zetan_);
+}
+
+uint64_t ZipfGenerator::operator()(std::mt19937_64& rng) const {
+  if (n_ < 3 || theta_ == 0) {
+    return std::uniform_int_distribution<uint64_t>{0, n_ - 1}(rng);
+  }
+
+  double const u = std::uniform_real_distribution<double>{0.0, 1.0}(rng);
+  double const uz = u * zetan_;
+  if (uz < 1.0) return 0;
+  if (uz < 1.0 + half_pow_theta_) return 1;
+  auto const rank = static_cast<uint64_t>(
+      static_cast<double>(n_) * std::pow(eta_ * u - eta_ + 1, alpha_));
+  return std::min(rank, n_ - 1);
+}
+
+uint64_t ScrambleKey(uint64_t rank, uint64_t n) {
+  /* 64-bit FNV-1a over the bytes of the rank */
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < 8; ++i) {
+    hash ^= (rank >> (i * 8)) & 0xff;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash % n;
+}
+
+}  // namespace cppfs::loadgen
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <string_view>
+#include <tl/expected.hpp>
+
+#include "error_types.h"
+
+namespace cppfs::loadgen {
+
+using storage::Error;
+using storage::ErrorEnum;
+
+/// Storage requests issued by the load generator
+enum class Operation : uint8_t {
+  kLs,
+  kCat,
+  kStore,
+  kMkdir,
+  kCount,
+};
+
+inline constexpr size_t kOperations = static_cast<size_t>(Operation::kCount);
+
+std::string_view OperationToString(Operation operation);
+
+///
+/// Relative weights of operations in the generated load.
+///
+class OperationMix {
+ public:
+  /// parse mix like `ls=40,cat=40,store=15,mkdir=5`, omitted operations get
+  /// zero weight
+  static tl::expected<OperationMix, Error> Parse(std::string_view spec);
+
+  uint32_t GetWeight(Operation operation) const {
+    return weights_[static_cast<size_t>(operation)];
+  }
+
+  /// pick random operation according to the weights
+  Operation Pick(std::mt19937_64& rng) const;
+
+ private:
+  std::array<uint32_t, kOperations> weights_{};
+  uint32_t total_{0};
+};
+
+///
+/// Generates ranks in [0, n) following Zipf's law, rank 0 being the most
+/// popular one.
+///
+/// Uses the rejection-free method from Gray et al., "Quickly Generating
+/// Billion-Record Synthetic Databases" (the one used by YCSB). Construction
+/// is O(n), generation is O(1). @c theta of 0 gives uniform distribution.
+///
+class ZipfGenerator {
+ public:
+  /// @c theta must be in [0, 1)
+  ZipfGenerator(uint64_t n, double theta);
+
+  uint64_t operator()(std::mt19937_64& rng) const;
+
+ private:
+  uint64_t n_;
+  double theta_;
+  double alpha_{0};
+  double zetan_{0};
+  double eta_{0};
+  double half_pow_theta_{0};
+};
+
+/// Map Zipf rank to a key in [0, n) so that popular keys are spread over the
+/// key space instead of being adjacent (i.e. not all in the same partition)
+uint64_t ScrambleKey(uint64_t rank, uint64_t n);
+
+}  // namespace cppfs::loadgen
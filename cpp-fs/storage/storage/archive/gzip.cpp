@@ -0,0 +1,74 @@
+#include "archive/gzip.hpp"
+
+#include <format>
+#include <zlib.h>
+
+namespace cppfs::storage {
+
+namespace {
+
+/// deflate window bits, plus 16 for the gzip header and trailer
+constexpr int kGzipWindowBits = 15 + 16;
+constexpr int kMemoryLevel = 8;
+/// output is produced in pieces of this size
+constexpr size_t kOutputBytes = 64 * 1024;
+
+}  // namespace
+
+void GzipCompressor::StreamDeleter::operator()(z_stream_s* stream) const {
+  deflateEnd(stream);
+  delete stream;
+}
+
+GzipCompressor::GzipCompressor(int level) {
+  auto stream = std::make_unique<z_stream_s>();
+  if (deflateInit2(stream.get(), level, Z_DEFLATED, kGzipWindowBits,
+                   kMemoryLevel, Z_DEFAULT_STRATEGY) == Z_OK) {
+    stream_.reset(stream.release());
+  }
+}
+
+GzipCompressor::~GzipCompressor() = default;
+
+tl::expected<std::string, Error> GzipCompressor::Compress(
+    std::string_view data) {
+  return Deflate(data, Z_NO_FLUSH);
+}
+
+tl::expected<std::string, Error> GzipCompressor::Finish() {
+  auto output = Deflate({}, Z_FINISH);
+  stream_.reset();
+  return output;
+}
+
+tl::expected<std::string, Error> GzipCompressor::Deflate(std::string_view data,
+                                                         int flush) {
+  if (stream_ == nullptr) {
+    return tl::unexpected(Error{ErrorEnum::kInternalServerError,
+                                "Gzip stream isn't initialized"});
+  }
+  /* zlib doesn't modify the input, its pointer just isn't const */
+  stream_->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream_->avail_in = static_cast<uInt>(data.size());
+
+  std::string output;
+  int result = Z_OK;
+  do {
+    size_t const written = output.size();
+    output.resize(written + kOutputBytes);
+    stream_->next_out = reinterpret_cast<Bytef*>(output.data() + written);
+    stream_->avail_out = static_cast<uInt>(kOutputBytes);
+    result = deflate(stream_.get(), flush);
+    if (result == Z_STREAM_ERROR) {
+      return tl::unexpected(
+          Error{ErrorEnum::kInternalServerError,
+                std::format("Gzip compression failed: {}",
+                            stream_->msg != nullptr ? stream_->msg : "")});
+    }
+    output.resize(written + kOutputBytes - stream_->avail_out);
+  } while (stream_->avail_out == 0 ||
+           (flush == Z_FINISH && result != Z_STREAM_END));
+  return output;
+}
+
+}  // namespace cppfs::storage
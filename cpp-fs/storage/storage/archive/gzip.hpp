@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+
+#include "error_types.h"
+
+struct z_stream_s;
+
+namespace cppfs::storage {
+
+///
+/// Streaming gzip compression of a response body.
+///
+/// Input is compressed as it is added, the output may lag behind it as
+/// deflate buffers a window of the input. Finish() flushes the rest and the
+/// gzip trailer.
+///
+class GzipCompressor {
+ public:
+  /// zlib compression @c level from 1 (fastest) to 9 (smallest)
+  explicit GzipCompressor(int level = 6);
+  ~GzipCompressor();
+
+  GzipCompressor(GzipCompressor const&) = delete;
+  GzipCompressor& operator=(GzipCompressor const&) = delete;
+
+  /// compressed output available after adding @c data
+  tl::expected<std::string, Error> Compress(std::string_view data);
+
+  /// the rest of the compressed output, the compressor can't be used after
+  tl::expected<std::string, Error> Finish();
+
+ private:
+  tl::expected<std::string, Error> Deflate(std::string_view data, int flush);
+
+  struct StreamDeleter {
+    void operator()(z_stream_s* stream) const;
+  };
+
+  std::unique_ptr<z_stream_s, StreamDeleter> stream_;
+};
+
+}  // namespace cppfs::storage
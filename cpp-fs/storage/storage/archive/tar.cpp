@@ -0,0 +1,291 @@
+#include "archive/tar.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <format>
+#include <utility>
+
+namespace cppfs::storage {
+
+namespace {
+using namespace std::string_view_literals;
+
+/// fields of the ustar header, offset and length
+struct Field {
+  size_t offset;
+  size_t length;
+};
+
+constexpr Field kName{0, 100};
+constexpr Field kMode{100, 8};
+constexpr Field kUid{108, 8};
+constexpr Field kGid{116, 8};
+constexpr Field kSize{124, 12};
+constexpr Field kMtime{136, 12};
+constexpr Field kChecksum{148, 8};
+constexpr size_t kTypeOffset = 156;
+constexpr Field kMagic{257, 6};
+constexpr Field kVersion{263, 2};
+constexpr Field kPrefix{345, 155};
+
+/// largest size of the 11 octal digits of the size field
+constexpr uint64_t kMaxOctalSize = (uint64_t{1} << 33) - 1;
+
+Error InvalidArchive(std::string_view what) {
+  return Error{ErrorEnum::kInvalidInput,
+               std::format("Invalid tar archive: {}", what)};
+}
+
+/// the text of a field, up to its first NUL
+std::string_view GetString(char const* header, Field field) {
+  std::string_view value{header + field.offset, field.length};
+  return value.substr(0, value.find('\0'));
+}
+
+/// octal number padded with spaces or NULs, or a base-256 number with the
+/// high bit of the first byte set for values that don't fit
+tl::expected<uint64_t, Error> GetNumber(char const* header, Field field) {
+  auto const* bytes =
+      reinterpret_cast<unsigned char const*>(header + field.offset);
+  uint64_t value = 0;
+  if ((bytes[0] & 0x80) != 0) {
+    value = bytes[0] & 0x7f;
+    for (size_t i = 1; i < field.length; ++i) {
+      if (value > (UINT64_MAX >> 8)) {
+        return tl::unexpected(InvalidArchive("number out of range"));
+      }
+      value = value << 8 | bytes[i];
+    }
+    return value;
+  }
+
+  std::string_view text{header + field.offset, field.length};
+  size_t const begin = text.find_first_not_of(" \0"sv);
+  if (begin == std::string_view::npos) return 0;
+  text = text.substr(begin);
+  text = text.substr(0, text.find_first_of(" \0"sv));
+  auto [ptr, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value, 8);
+  if (ec != std::errc{} || ptr != text.data() + text.size()) {
+    return tl::unexpected(InvalidArchive("malformed number in header"));
+  }
+  return value;
+}
+
+/// the checksum is the sum of the header bytes with the checksum field
+/// taken as spaces
+uint64_t ComputeChecksum(char const* header) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < TarReader::kBlockSize; ++i) {
+    bool const in_field =
+        i >= kChecksum.offset && i < kChecksum.offset + kChecksum.length;
+    sum += in_field ? ' ' : static_cast<unsigned char>(header[i]);
+  }
+  return sum;
+}
+
+tl::expected<void, Error> VerifyChecksum(char const* header) {
+  auto const stored = GetNumber(header, kChecksum);
+  if (!stored) return tl::unexpected(stored.error());
+  if (ComputeChecksum(header) != *stored) {
+    return tl::unexpected(InvalidArchive("header checksum mismatch"));
+  }
+  return {};
+}
+
+/// plain and contiguous files, and the pre-POSIX NUL type
+bool IsRegularFile(char type) {
+  return type == '0' || type == '\0' || type == '7';
+}
+
+size_t RoundUpToBlock(uint64_t size) {
+  return static_cast<size_t>((size + TarReader::kBlockSize - 1) /
+                             TarReader::kBlockSize * TarReader::kBlockSize);
+}
+
+/// @c value as a NUL-terminated octal number filling @c field
+void PutNumber(std::string& header, Field field, uint64_t value) {
+  std::string const digits = std::format("{:0{}o}", value, field.length - 1);
+  header.replace(field.offset, digits.size(), digits);
+}
+
+void PutString(std::string& header, Field field, std::string_view value) {
+  value = value.substr(0, field.length);
+  header.replace(field.offset, value.size(), value);
+}
+
+/// ustar header block of an entry of @c type
+std::string EncodeBlock(char type, std::string_view name, uint64_t size,
+                        int64_t mtime, uint64_t mode) {
+  std::string header(TarReader::kBlockSize, '\0');
+  PutString(header, kName, name);
+  PutNumber(header, kMode, mode);
+  PutNumber(header, kUid, 0);
+  PutNumber(header, kGid, 0);
+  PutNumber(header, kSize, size);
+  PutNumber(header, kMtime,
+            static_cast<uint64_t>(std::max<int64_t>(mtime, 0)));
+  header[kTypeOffset] = type;
+  PutString(header, kMagic, "ustar");
+  PutString(header, kVersion, "00");
+  /* six digits, a NUL and a space */
+  std::string const checksum =
+      std::format("{:06o}", ComputeChecksum(header.data()));
+  header.replace(kChecksum.offset, checksum.size(), checksum);
+  header[kChecksum.offset + 7] = ' ';
+  return header;
+}
+
+/// pax record "<length> <key>=<value>\n", the length counts its own digits
+std::string EncodePaxRecord(std::string_view key, std::string_view value) {
+  size_t const size = key.size() + value.size() + 3;
+  size_t length = size + std::to_string(size).size();
+  length = size + std::to_string(length).size();
+  return std::format("{} {}={}\n", length, key, value);
+}
+
+}  // namespace
+
+TarReader::TarReader(size_t max_entry_size)
+    : max_entry_size_(max_entry_size) {}
+
+tl::expected<std::optional<TarEntry>, Error> TarReader::Next() {
+  while (!done_ && GetPending() >= kBlockSize) {
+    char const* header = buffer_.data() + offset_;
+    if (std::all_of(header, header + kBlockSize,
+                    [](char c) { return c == '\0'; })) {
+      done_ = true;
+      break;
+    }
+    if (auto verified = VerifyChecksum(header); !verified) {
+      return tl::unexpected(verified.error());
+    }
+
+    char const type = header[kTypeOffset];
+    bool const is_extension = type == 'x' || type == 'g' || type == 'L';
+    auto header_size = GetNumber(header, kSize);
+    if (!header_size) return tl::unexpected(header_size.error());
+    uint64_t const size = !is_extension && next_size_.has_value()
+                              ? *next_size_
+                              : *header_size;
+    if (size > max_entry_size_) {
+      return tl::unexpected(Error{
+          ErrorEnum::kInvalidInput,
+          std::format("Tar entry of {} bytes is larger than the limit of {}",
+                      size, max_entry_size_)});
+    }
+    /* only the directories and the files carry their contents, the size of
+       links and devices is meaningless */
+    size_t const data_size =
+        IsRegularFile(type) || is_extension ? static_cast<size_t>(size) : 0;
+    size_t const entry_size = kBlockSize + RoundUpToBlock(data_size);
+    if (GetPending() < entry_size) break;
+
+    std::string_view const data{header + kBlockSize, data_size};
+    TarEntry entry;
+    if (type == 'x') {
+      if (auto parsed = ParsePaxRecords(data); !parsed) {
+        return tl::unexpected(parsed.error());
+      }
+    } else if (type == 'L') {
+      next_path_ = std::string{data.substr(0, data.find('\0'))};
+    } else if (type != 'g') {
+      entry.type = IsRegularFile(type) ? TarEntry::Type::kRegularFile
+                   : type == '5'       ? TarEntry::Type::kDirectory
+                                       : TarEntry::Type::kOther;
+      if (next_path_.has_value()) {
+        entry.path = std::move(*next_path_);
+      } else {
+        std::string_view const prefix = GetString(header, kPrefix);
+        bool const is_ustar = GetString(header, kMagic).starts_with("ustar");
+        if (is_ustar && !prefix.empty()) {
+          entry.path = std::format("{}/{}", prefix, GetString(header, kName));
+        } else {
+          entry.path = GetString(header, kName);
+        }
+      }
+      if (entry.type == TarEntry::Type::kRegularFile) entry.data = data;
+      next_path_.reset();
+      next_size_.reset();
+    }
+
+    offset_ += entry_size;
+    /* drop consumed entries once they make up most of the buffer */
+    if (offset_ > buffer_.size() / 2) {
+      buffer_.erase(0, offset_);
+      offset_ = 0;
+    }
+    if (!is_extension) return entry;
+  }
+  return std::nullopt;
+}
+
+tl::expected<void, Error> TarReader::ParsePaxRecords(
+    std::string_view records) {
+  /* records are "<length> <key>=<value>\n", the length counts the whole
+     record */
+  while (!records.empty()) {
+    size_t length = 0;
+    auto [ptr, ec] = std::from_chars(
+        records.data(), records.data() + records.size(), length);
+    size_t const prefix = static_cast<size_t>(ptr - records.data());
+    if (ec != std::errc{} || length <= prefix + 1 || length > records.size() ||
+        *ptr != ' ' || records[length - 1] != '\n') {
+      return tl::unexpected(InvalidArchive("malformed pax record"));
+    }
+    std::string_view const record =
+        records.substr(prefix + 1, length - prefix - 2);
+    records.remove_prefix(length);
+
+    size_t const equals = record.find('=');
+    if (equals == std::string_view::npos) {
+      return tl::unexpected(InvalidArchive("malformed pax record"));
+    }
+    std::string_view const key = record.substr(0, equals);
+    std::string_view const value = record.substr(equals + 1);
+    if (key == "path") {
+      next_path_ = std::string{value};
+    } else if (key == "size") {
+      uint64_t size = 0;
+      auto [end, size_ec] =
+          std::from_chars(value.data(), value.data() + value.size(), size);
+      if (size_ec != std::errc{} || end != value.data() + value.size()) {
+        return tl::unexpected(InvalidArchive("malformed pax size"));
+      }
+      next_size_ = size;
+    }
+  }
+  return {};
+}
+
+std::string EncodeTarHeader(TarEntry::Type type, std::string_view path,
+                            uint64_t size, int64_t mtime) {
+  assert(type != TarEntry::Type::kOther);
+  bool const is_directory = type == TarEntry::Type::kDirectory;
+  std::string records;
+  if (path.size() > kName.length) {
+    records += EncodePaxRecord("path", path);
+  }
+  if (size > kMaxOctalSize) {
+    records += EncodePaxRecord("size", std::to_string(size));
+  }
+
+  std::string header;
+  if (!records.empty()) {
+    header = EncodeBlock('x', "PaxHeader", records.size(), mtime, 0644);
+    header += records;
+    header.append(GetTarPadding(records.size()), '\0');
+  }
+  /* readers without pax support get the path truncated */
+  header += EncodeBlock(is_directory ? '5' : '0', path,
+                        size > kMaxOctalSize ? 0 : size, mtime,
+                        is_directory ? 0755 : 0644);
+  return header;
+}
+
+size_t GetTarPadding(uint64_t size) {
+  return RoundUpToBlock(size) - static_cast<size_t>(size);
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+
+#include "error_types.h"
+
+namespace cppfs::storage {
+
+struct TarEntry {
+  enum class Type {
+    kRegularFile,
+    kDirectory,
+    /// links, devices and fifos, which partitions can't hold
+    kOther,
+  };
+
+  Type type{Type::kRegularFile};
+  /// path as stored in the archive
+  std::string path{};
+  /// contents of a regular file
+  std::string data{};
+};
+
+///
+/// Incremental reader of tar archives, fed the archive as it arrives.
+///
+/// Reads ustar archives with the pax extensions for long paths and large
+/// sizes, and the GNU long names; global pax headers are ignored. An entry
+/// is returned once its contents are complete, so the reader holds at most
+/// one entry in memory, and entries larger than the limit are rejected.
+///
+class TarReader {
+ public:
+  static constexpr size_t kBlockSize = 512;
+  static constexpr size_t kDefaultMaxEntrySize = size_t{1} << 30;
+
+  explicit TarReader(size_t max_entry_size = kDefaultMaxEntrySize);
+
+  void Feed(std::string_view data) { buffer_.append(data); }
+
+  /// next complete entry, nullopt if more data is needed or the end of the
+  /// archive was read
+  tl::expected<std::optional<TarEntry>, Error> Next();
+
+  /// true once the end-of-archive block was read, data after it is ignored
+  bool IsDone() const { return done_; }
+
+  /// bytes of an incomplete entry left in the buffer
+  size_t GetPending() const { return buffer_.size() - offset_; }
+
+ private:
+  /// take the attributes of the next entry from pax records
+  tl::expected<void, Error> ParsePaxRecords(std::string_view records);
+
+  size_t const max_entry_size_;
+  std::string buffer_;
+  size_t offset_{0};
+  bool done_{false};
+  /// set by a pax or GNU long name header for the entry following it
+  std::optional<std::string> next_path_;
+  std::optional<uint64_t> next_size_;
+};
+
+/// header of a tar entry with @c size bytes of contents modified at
+/// @c mtime, preceded by a pax header for paths and sizes ustar can't hold.
+/// Directory paths end with a slash. Only regular files and directories can
+/// be encoded.
+std::string EncodeTarHeader(TarEntry::Type type, std::string_view path,
+                            uint64_t size, int64_t mtime);
+
+/// NUL bytes padding @c size bytes of contents to a whole block
+size_t GetTarPadding(uint64_t size);
+
+}  // namespace cppfs::storage
@@ -0,0 +1,192 @@
+#include "archive/tar_export.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <sstream>
+#include <utility>
+
+#include "archive/tar.hpp"
+
+namespace cppfs::storage {
+
+namespace {
+
+/// two zero blocks end an archive
+constexpr size_t kEndOfArchiveBytes = 2 * TarReader::kBlockSize;
+
+}  // namespace
+
+TarExporter::TarExporter(Partition* partition, std::filesystem::path root,
+                         TarExportConfig config)
+    : partition_(partition),
+      root_(std::move(root)),
+      config_(config),
+      mtime_(std::chrono::system_clock::to_time_t(
+          std::chrono::system_clock::now())) {
+  readers_.reserve(config_.readers);
+  for (size_t i = 0; i < config_.readers; ++i) {
+    readers_.emplace_back([this] { RunReader(); });
+  }
+}
+
+TarExporter::~TarExporter() { Stop(); }
+
+tl::expected<std::string, Error> TarExporter::Next(size_t max_bytes) {
+  std::string data;
+  while (data.empty() || data.size() < max_bytes) {
+    if (auto planned = Plan(); !planned) {
+      return tl::unexpected(planned.error());
+    }
+
+    std::unique_ptr<Piece> piece;
+    {
+      std::unique_lock lock{mutex_};
+      if (pieces_.empty()) break;
+      if (!readers_.empty()) {
+        read_.wait(lock, [this] { return pieces_.front()->ready; });
+      }
+      piece = std::move(pieces_.front());
+      pieces_.pop_front();
+      if (next_read_ != 0) --next_read_;
+      if (!readers_.empty() && piece->file != nullptr) {
+        buffered_bytes_ -= piece->size;
+        readable_.notify_all();
+      }
+    }
+    if (!piece->ready) ReadPiece(*piece);
+    if (piece->error.has_value()) return tl::unexpected(*piece->error);
+    planned_bytes_ -= piece->size;
+    data += piece->data;
+  }
+  return data;
+}
+
+tl::expected<void, Error> TarExporter::Plan() {
+  while (!walked_ && planned_bytes_ < config_.max_read_ahead_bytes) {
+    auto planned = PlanEntry();
+    if (!planned) return tl::unexpected(planned.error());
+    if (!*planned) {
+      walked_ = true;
+      AddPiece(Piece{.data = std::string(kEndOfArchiveBytes, '\0')});
+    }
+  }
+  return {};
+}
+
+tl::expected<bool, Error> TarExporter::PlanEntry() {
+  if (!started_) {
+    started_ = true;
+    /* the root itself isn't an entry */
+    pending_dirs_.emplace_back();
+  }
+
+  while (next_entry_ == entries_.size()) {
+    if (pending_dirs_.empty()) return false;
+    dir_path_ = std::move(pending_dirs_.back());
+    pending_dirs_.pop_back();
+    auto dir = partition_->OpenDir(root_ / dir_path_);
+    if (!dir) return tl::unexpected(dir.error());
+    entries_ = dir.value()->GetDirEntries();
+    next_entry_ = 0;
+  }
+
+  Directory::DirEntry const& entry = entries_[next_entry_++];
+  std::filesystem::path const path = dir_path_ / entry.name;
+  ++exported_;
+  if (entry.type == FileType::Directory) {
+    pending_dirs_.push_back(path);
+    AddPiece(Piece{.data = EncodeTarHeader(TarEntry::Type::kDirectory,
+                                           path.string() + "/", 0, mtime_)});
+    return true;
+  }
+
+  auto file = partition_->OpenRegularFile(root_ / path);
+  if (!file) return tl::unexpected(file.error());
+  auto size = GetDataSize(**file);
+  if (!size) {
+    return tl::unexpected(
+        Error{ErrorEnum::kInternalServerError,
+              std::format("Cannot read file '{}'", path.string())});
+  }
+  AddPiece(Piece{.data = EncodeTarHeader(TarEntry::Type::kRegularFile,
+                                         path.string(), *size, mtime_)});
+  for (uint64_t offset = 0; offset < *size; offset += config_.read_bytes) {
+    AddPiece(Piece{.file = *file,
+                   .offset = offset,
+                   .size = static_cast<size_t>(std::min<uint64_t>(
+                       config_.read_bytes, *size - offset))});
+  }
+  if (size_t const padding = GetTarPadding(*size); padding != 0) {
+    AddPiece(Piece{.data = std::string(padding, '\0')});
+  }
+  return true;
+}
+
+void TarExporter::AddPiece(Piece piece) {
+  if (piece.file == nullptr) {
+    piece.size = piece.data.size();
+    piece.ready = true;
+  }
+  planned_bytes_ += piece.size;
+  std::lock_guard const lock{mutex_};
+  pieces_.push_back(std::make_unique<Piece>(std::move(piece)));
+  readable_.notify_one();
+}
+
+void TarExporter::RunReader() {
+  std::unique_lock lock{mutex_};
+  while (!stopping_) {
+    /* headers are ready when planned */
+    while (next_read_ < pieces_.size() && pieces_[next_read_]->ready) {
+      ++next_read_;
+    }
+    /* the piece to be sent next is read even if the read-ahead is full */
+    bool const can_read =
+        next_read_ < pieces_.size() &&
+        (next_read_ == 0 || buffered_bytes_ < config_.max_read_ahead_bytes);
+    if (!can_read) {
+      readable_.wait(lock);
+      continue;
+    }
+
+    Piece* const piece = pieces_[next_read_++].get();
+    buffered_bytes_ += piece->size;
+    lock.unlock();
+    ReadPiece(*piece);
+    lock.lock();
+    piece->ready = true;
+    read_.notify_all();
+  }
+}
+
+void TarExporter::Stop() {
+  {
+    std::lock_guard const lock{mutex_};
+    stopping_ = true;
+  }
+  readable_.notify_all();
+  for (std::thread& reader : readers_) reader.join();
+  readers_.clear();
+}
+
+void TarExporter::ReadPiece(Piece& piece) {
+  /* a file that shrank since its header was sent reads short */
+  size_t const file_size = piece.file->GetSize();
+  size_t const available =
+      file_size > piece.offset
+          ? std::min(piece.size, file_size - static_cast<size_t>(piece.offset))
+          : 0;
+  std::ostringstream out;
+  if (available != 0 &&
+      piece.file->PositionalRead(out, piece.offset, available) < 0) {
+    piece.error = Error{ErrorEnum::kInternalServerError,
+                        std::format("Cannot read {} bytes at offset {}",
+                                    available, piece.offset)};
+    return;
+  }
+  piece.data = std::move(out).str();
+  piece.data.resize(piece.size, '\0');
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tl/expected.hpp>
+#include <vector>
+
+#include "error_types.h"
+#include "partition/partition.hpp"
+
+namespace cppfs::storage {
+
+struct TarExportConfig {
+  /// threads reading files ahead of the stream, 0 reads them on the thread
+  /// taking the stream, for backends that aren't thread-safe
+  size_t readers{4};
+  /// bytes of the archive prepared ahead of the stream
+  size_t max_read_ahead_bytes{16 << 20};
+  /// files are read in pieces of at most this size
+  size_t read_bytes{1 << 20};
+};
+
+///
+/// Streams a directory subtree of a partition as a tar archive.
+///
+/// The tree is walked lazily, every directory before its entries, and the
+/// files are read in pieces by a pool of readers while earlier parts of the
+/// archive are sent. At most about @c max_read_ahead_bytes of the archive
+/// are held in memory, whatever the size of the tree or of its files.
+/// Entries are named by their path below the subtree root. A file shrinking
+/// while it is sent is padded with NULs to the size its header announced.
+///
+class TarExporter {
+ public:
+  TarExporter(Partition* partition, std::filesystem::path root,
+              TarExportConfig config = {});
+  ~TarExporter();
+
+  TarExporter(TarExporter const&) = delete;
+  TarExporter& operator=(TarExporter const&) = delete;
+
+  /// next part of the archive of about @c max_bytes, at least one piece
+  /// unless the whole archive was returned, empty after that
+  tl::expected<std::string, Error> Next(size_t max_bytes);
+
+  /// directories and files exported so far
+  size_t GetExported() const { return exported_; }
+
+ private:
+  /// consecutive bytes of the archive, a header or a range of a file
+  struct Piece {
+    std::string data{};
+    /// file the data is read from, nullptr if the data is ready
+    RegularFile* file{nullptr};
+    uint64_t offset{0};
+    size_t size{0};
+    bool ready{false};
+    std::optional<Error> error{};
+  };
+
+  /// plan the pieces of the next entries until the read-ahead is full
+  tl::expected<void, Error> Plan();
+
+  /// plan the pieces of the next entry, false once the walk is done
+  tl::expected<bool, Error> PlanEntry();
+
+  void AddPiece(Piece piece);
+  void RunReader();
+  void Stop();
+  static void ReadPiece(Piece& piece);
+
+  Partition* const partition_;
+  std::filesystem::path const root_;
+  TarExportConfig const config_;
+  /// modification time of all entries, the time of the export
+  int64_t const mtime_;
+
+  /* walk, on the thread taking the stream */
+  bool started_{false};
+  bool walked_{false};
+  /// directories whose entries weren't listed yet, relative to the root
+  std::vector<std::filesystem::path> pending_dirs_;
+  std::filesystem::path dir_path_;
+  std::vector<Directory::DirEntry> entries_;
+  size_t next_entry_{0};
+  size_t exported_{0};
+  /// bytes of the planned pieces not sent yet
+  uint64_t planned_bytes_{0};
+
+  std::mutex mutex_;
+  /// signalled when a reader may be able to take the next piece
+  std::condition_variable readable_;
+  /// signalled when a reader is done with a piece
+  std::condition_variable read_;
+  /// planned pieces in archive order, not sent yet
+  std::deque<std::unique_ptr<Piece>> pieces_;
+  /// index in @c pieces_ of the first piece no reader took
+  size_t next_read_{0};
+  /// bytes of the pieces taken by the readers and not sent yet
+  uint64_t buffered_bytes_{0};
+  bool stopping_{false};
+  std::vector<std::thread> readers_;
+};
+
+}  // namespace cppfs::storage
@@ -0,0 +1,242 @@
+#include "archive/tar_import.hpp"
+
+#include <format>
+#include <utility>
+
+namespace cppfs::storage {
+
+namespace {
+
+/// components of the path of an archive entry below the target directory,
+/// leading slashes and "." are dropped
+tl::expected<std::vector<std::string>, Error> SplitEntryPath(
+    std::string const& path) {
+  std::vector<std::string> components;
+  for (auto const& part : std::filesystem::path{path}) {
+    std::string component = part.string();
+    if (component.empty() || component == "." || component == "/") continue;
+    if (component == "..") {
+      return tl::unexpected(Error{
+          ErrorEnum::kInvalidInput,
+          std::format("Tar entry '{}' is outside of the target directory",
+                      path)});
+    }
+    components.push_back(std::move(component));
+  }
+  return components;
+}
+
+/// relative path of the first @c count of @c components
+std::string JoinComponents(std::vector<std::string> const& components,
+                           size_t count) {
+  std::string key;
+  for (size_t i = 0; i < count; ++i) {
+    if (i != 0) key += '/';
+    key += components[i];
+  }
+  return key;
+}
+
+}  // namespace
+
+TarImporter::TarImporter(Partition* partition, std::string uuid,
+                         std::filesystem::path target, ChangeFeed* feed,
+                         TarImportConfig config)
+    : partition_(partition),
+      uuid_(std::move(uuid)),
+      target_(std::move(target)),
+      feed_(feed),
+      config_(config) {
+  writers_.reserve(config_.writers);
+  for (size_t i = 0; i < config_.writers; ++i) {
+    writers_.emplace_back([this] { RunWriter(); });
+  }
+}
+
+TarImporter::~TarImporter() { Stop(); }
+
+tl::expected<void, Error> TarImporter::Feed(std::string_view data) {
+  {
+    std::lock_guard const lock{mutex_};
+    if (error_.has_value()) return tl::unexpected(*error_);
+  }
+  reader_.Feed(data);
+  while (true) {
+    auto entry = reader_.Next();
+    if (!entry) {
+      Fail(entry.error());
+      return tl::unexpected(entry.error());
+    }
+    if (!entry->has_value()) return {};
+    if (auto imported = Import(std::move(**entry)); !imported) {
+      Fail(imported.error());
+      return tl::unexpected(imported.error());
+    }
+  }
+}
+
+tl::expected<TarImporter::Stats, Error> TarImporter::Finish() {
+  /* like tar, accept archives missing the end-of-archive blocks */
+  if (!reader_.IsDone() && reader_.GetPending() != 0) {
+    Fail(Error{ErrorEnum::kInvalidInput, "Archive is truncated"});
+  }
+  Stop();
+  std::lock_guard const lock{mutex_};
+  if (error_.has_value()) return tl::unexpected(*error_);
+  return stats_;
+}
+
+tl::expected<void, Error> TarImporter::Import(TarEntry entry) {
+  if (entry.type == TarEntry::Type::kOther) {
+    std::lock_guard const lock{mutex_};
+    ++stats_.skipped;
+    return {};
+  }
+  auto components = SplitEntryPath(entry.path);
+  if (!components) return tl::unexpected(components.error());
+  if (entry.type == TarEntry::Type::kDirectory) {
+    auto dir = MakeDirs(*components, components->size());
+    if (!dir) return tl::unexpected(dir.error());
+    return {};
+  }
+
+  if (components->empty()) {
+    return tl::unexpected(
+        Error{ErrorEnum::kInvalidInput,
+              std::format("Tar entry '{}' isn't a file name", entry.path)});
+  }
+  size_t const depth = components->size() - 1;
+  auto dir = MakeDirs(*components, depth);
+  if (!dir) return tl::unexpected(dir.error());
+  PendingFile file{.dir = *dir,
+                   .dir_path = GetPartitionPath(JoinComponents(*components,
+                                                               depth)),
+                   .name = std::move(components->back()),
+                   .data = std::move(entry.data)};
+  if (writers_.empty()) return Store(std::move(file));
+  return Enqueue(std::move(file));
+}
+
+tl::expected<Directory*, Error> TarImporter::MakeDirs(
+    std::vector<std::string> const& components, size_t count) {
+  std::string key;
+  Directory* dir = nullptr;
+  if (auto found = dirs_.find(key); found != dirs_.end()) {
+    dir = found->second;
+  } else {
+    auto target = partition_->OpenDir(target_);
+    if (!target) return tl::unexpected(target.error());
+    dir = *target;
+    dirs_.emplace(key, dir);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    std::string const parent_path = GetPartitionPath(key);
+    if (!key.empty()) key += '/';
+    key += components[i];
+    if (auto found = dirs_.find(key); found != dirs_.end()) {
+      dir = found->second;
+      continue;
+    }
+
+    auto created = dir->CreateDirectory(components[i]);
+    if (created) {
+      dir = *created;
+      {
+        std::lock_guard const lock{mutex_};
+        ++stats_.directories;
+      }
+      if (feed_ != nullptr) {
+        auto recorded = feed_->Append(Change{.op = ChangeOp::kCreateDirectory,
+                                             .partition = uuid_,
+                                             .path = parent_path,
+                                             .name = components[i]});
+        if (!recorded) return tl::unexpected(recorded.error());
+      }
+    } else if (created.error().code == ErrorEnum::kAlreadyExists) {
+      /* archives list directories the target may already have */
+      auto existing = partition_->OpenDir(GetPartitionPath(key));
+      if (!existing) return tl::unexpected(existing.error());
+      dir = *existing;
+    } else {
+      return tl::unexpected(created.error());
+    }
+    dirs_.emplace(key, dir);
+  }
+  return dir;
+}
+
+std::string TarImporter::GetPartitionPath(std::string const& key) const {
+  return key.empty() ? target_.string() : (target_ / key).string();
+}
+
+tl::expected<void, Error> TarImporter::Store(PendingFile file) {
+  size_t const size = file.data.size();
+  /* the contents are moved into the partition, keep a copy for replicas */
+  std::string change_data = feed_ != nullptr ? file.data : std::string{};
+  auto stored = file.dir->StoreRegularFile(file.name, std::move(file.data));
+  if (!stored) return tl::unexpected(stored.error());
+  if (feed_ != nullptr) {
+    auto recorded = feed_->Append(Change{.op = ChangeOp::kStoreRegularFile,
+                                         .partition = uuid_,
+                                         .path = std::move(file.dir_path),
+                                         .name = std::move(file.name),
+                                         .data = std::move(change_data)});
+    if (!recorded) return tl::unexpected(recorded.error());
+  }
+  std::lock_guard const lock{mutex_};
+  ++stats_.files;
+  stats_.bytes += size;
+  return {};
+}
+
+tl::expected<void, Error> TarImporter::Enqueue(PendingFile file) {
+  std::unique_lock lock{mutex_};
+  drained_.wait(lock, [this] {
+    return error_.has_value() || queue_.empty() ||
+           queued_bytes_ < config_.max_queued_bytes;
+  });
+  if (error_.has_value()) return tl::unexpected(*error_);
+  queued_bytes_ += file.data.size();
+  queue_.push_back(std::move(file));
+  queued_.notify_one();
+  return {};
+}
+
+void TarImporter::RunWriter() {
+  std::unique_lock lock{mutex_};
+  while (true) {
+    queued_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    /* the queue is drained before the writers stop */
+    if (queue_.empty()) return;
+    PendingFile file = std::move(queue_.front());
+    queue_.pop_front();
+    queued_bytes_ -= file.data.size();
+    drained_.notify_all();
+
+    lock.unlock();
+    if (auto stored = Store(std::move(file)); !stored) Fail(stored.error());
+    lock.lock();
+  }
+}
+
+void TarImporter::Fail(Error error) {
+  std::lock_guard const lock{mutex_};
+  if (error_.has_value()) return;
+  error_ = std::move(error);
+  queue_.clear();
+  queued_bytes_ = 0;
+  drained_.notify_all();
+}
+
+void TarImporter::Stop() {
+  {
+    std::lock_guard const lock{mutex_};
+    stopping_ = true;
+  }
+  queued_.notify_all();
+  for (std::thread& writer : writers_) writer.join();
+  writers_.clear();
+}
+
+}  // namespace cppfs::storage
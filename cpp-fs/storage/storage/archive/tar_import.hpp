@@ -0,0 +1,121 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tl/expected.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "archive/tar.hpp"
+#include "error_types.h"
+#include "partition/partition.hpp"
+#include "replication/change_feed.hpp"
+
+namespace cppfs::storage {
+
+struct TarImportConfig {
+  /// threads storing the files, 0 stores them on the thread feeding the
+  /// archive, for backends that aren't thread-safe
+  size_t writers{8};
+  /// bytes of parsed files waiting for a writer, feeding the archive blocks
+  /// above it
+  size_t max_queued_bytes{64 << 20};
+};
+
+///
+/// Expands a tar archive into a directory of a partition while the archive
+/// is received.
+///
+/// The thread feeding the archive parses it and creates the directories,
+/// the regular files are handed to a pool of writers, so storing many small
+/// files overlaps with receiving and parsing the rest of the archive.
+/// Directories missing from the archive are created as needed, existing
+/// ones are reused. Links and special files are skipped, paths leaving the
+/// target directory are rejected. Every mutation is recorded in the change
+/// feed, if any. The first error stops the import, entries stored before it
+/// are kept.
+///
+class TarImporter {
+ public:
+  struct Stats {
+    size_t directories{0};
+    size_t files{0};
+    uint64_t bytes{0};
+    /// entries of types partitions can't hold
+    size_t skipped{0};
+  };
+
+  /// expand the archive into the existing directory @c target of
+  /// @c partition, which is partition @c uuid of the change feed
+  TarImporter(Partition* partition, std::string uuid,
+              std::filesystem::path target, ChangeFeed* feed,
+              TarImportConfig config = {});
+  ~TarImporter();
+
+  TarImporter(TarImporter const&) = delete;
+  TarImporter& operator=(TarImporter const&) = delete;
+
+  /// import the entries completed by the next chunk @c data of the archive
+  tl::expected<void, Error> Feed(std::string_view data);
+
+  /// wait for the queued files to be stored, fails if the archive is
+  /// truncated
+  tl::expected<Stats, Error> Finish();
+
+ private:
+  /// regular file waiting for a writer
+  struct PendingFile {
+    Directory* dir{nullptr};
+    /// path of @c dir from the partition root
+    std::string dir_path{};
+    std::string name{};
+    std::string data{};
+  };
+
+  tl::expected<void, Error> Import(TarEntry entry);
+
+  /// directory at @c components below the target, created if missing
+  tl::expected<Directory*, Error> MakeDirs(
+      std::vector<std::string> const& components, size_t count);
+
+  /// path of the directory at @c key below the target from the partition
+  /// root
+  std::string GetPartitionPath(std::string const& key) const;
+
+  tl::expected<void, Error> Store(PendingFile file);
+  /// queue @c file for the writers, waits while the queue is full
+  tl::expected<void, Error> Enqueue(PendingFile file);
+  void RunWriter();
+  void Fail(Error error);
+  void Stop();
+
+  Partition* const partition_;
+  std::string const uuid_;
+  std::filesystem::path const target_;
+  ChangeFeed* const feed_;
+  TarImportConfig const config_;
+  TarReader reader_;
+  /// directories below the target by their relative path, "" is the target
+  std::unordered_map<std::string, Directory*> dirs_;
+
+  std::mutex mutex_;
+  /// signalled when a file is queued or the import stops
+  std::condition_variable queued_;
+  /// signalled when a file leaves the queue
+  std::condition_variable drained_;
+  std::deque<PendingFile> queue_;
+  size_t queued_bytes_{0};
+  bool stopping_{false};
+  std::optional<Error> error_;
+  Stats stats_;
+  std::vector<std::thread> writers_;
+};
+
+}  // namespace cppfs::storage
@@ -11,8 +11,32 @@ enum class ErrorEnum {
   kOutOfMemory,
   kDirectory,
   kInternalServerError,
+  kRateLimited,
+  kReadOnly,
 };
 
+inline std::string ErrorEnumToString(ErrorEnum code) {
+  switch (code) {
+    case ErrorEnum::kInvalidInput:
+      return "InvalidInput";
+    case ErrorEnum::kNotFound:
+      return "NotFound";
+    case ErrorEnum::kAlreadyExists:
+      return "AlreadyExists";
+    case ErrorEnum::kOutOfMemory:
+      return "OutOfMemory";
+    case ErrorEnum::kDirectory:
+      return "Directory";
+    case ErrorEnum::kInternalServerError:
+      return "InternalServerError";
+    case ErrorEnum::kRateLimited:
+      return "RateLimited";
+    case ErrorEnum::kReadOnly:
+      return "ReadOnly";
+  }
+  return "Unknown";
+}
+
 struct Error {
   ErrorEnum code;
   std::string message;
@@ -4,12 +4,7 @@
 
 #include "server/server.hpp"
 
-struct Config {
-  std::string ip_address;
-  int port;
-  std::string cert_path;
-  std::string key_path;
-};
+using Config = cppfs::storage::ServerConfig;
 
 Config parse_arguments(int argc, char** argv) {
   CLI::App app{"SSL Server Configuration"};
@@ -32,8 +27,160 @@ Config parse_arguments(int argc, char** argv) {
       ->required()
       ->check(CLI::ExistingFile);
 
+  app.add_option("--backend", config.backend,
+                 "Partition backend, the in-memory one keeps no data across "
+                 "restarts")
+      ->check(CLI::IsMember({"on_disk", "in_memory"}))
+      ->capture_default_str();
+
+  app.add_option("-d,--data-dir", config.data_dir,
+                 "Root directory of on-disk partitions")
+      ->capture_default_str();
+
+  app.add_option("--volume", config.volumes,
+                 "Another directory to spread new partitions across, "
+                 "repeatable");
+
+  app.add_option("--trace-sample-rate", config.trace_sample_rate,
+                 "Trace every N-th request of a worker thread, 0 to disable")
+      ->capture_default_str();
+
+  app.add_option("--tls-session-cache-size", config.tls_session_cache_size,
+                 "Sessions kept for TLS session id resumption")
+      ->capture_default_str();
+
+  app.add_option("--tls-ticket-key-rotation", config.tls_ticket_key_rotation_s,
+                 "Seconds between TLS session ticket key rotations")
+      ->capture_default_str()
+      ->check(CLI::PositiveNumber);
+
+  app.add_option("--plain-address", config.plain_address,
+                 "IP Address of the plain HTTP listener")
+      ->capture_default_str()
+      ->check(CLI::ValidIPV4);
+
+  app.add_option("--plain-port", config.plain_port,
+                 "Serve plain HTTP on this port for trusted local proxies, "
+                 "0 to disable")
+      ->capture_default_str()
+      ->check(CLI::Range(0, 65535));
+
+  app.add_option("--quota-bytes", config.partition_quota.bytes,
+                 "Bytes a partition may store, 0 for unlimited")
+      ->capture_default_str();
+
+  app.add_option("--quota-files", config.partition_quota.files,
+                 "Files a partition may contain, 0 for unlimited")
+      ->capture_default_str();
+
+  app.add_option("--quota-dirs", config.partition_quota.directories,
+                 "Directories a partition may contain, 0 for unlimited")
+      ->capture_default_str();
+
+  app.add_option("--node-capacity-bytes", config.node_capacity_bytes,
+                 "Bytes all partitions may store together, 0 for unlimited")
+      ->capture_default_str();
+
+  app.add_option("--high-watermark", config.high_watermark,
+                 "Fraction of the node capacity above which writes are shed")
+      ->capture_default_str()
+      ->check(CLI::Range(0.0, 1.0));
+
+  app.add_option("--reclaim-files-per-s", config.reclaim_files_per_s,
+                 "Files of destroyed partitions removed per second in the "
+                 "background, 0 for unlimited")
+      ->capture_default_str()
+      ->check(CLI::NonNegativeNumber);
+
+  app.add_option("--scrub-bytes-per-s", config.scrub_bytes_per_s,
+                 "Bytes of file data verified against their checksums per "
+                 "second in the background, 0 disables scrubbing")
+      ->capture_default_str()
+      ->check(CLI::NonNegativeNumber);
+
+  app.add_option("--scrub-interval-s", config.scrub_interval_s,
+                 "Seconds between two scrubs of all partitions")
+      ->capture_default_str();
+
+  app.add_flag("--dedup", config.dedup,
+               "Store identical file payloads once, shared by all partitions");
+
+  app.add_option("--file-handle-idle-s", config.file_handle_idle_s,
+                 "Seconds after which an unused file handle is closed")
+      ->capture_default_str()
+      ->check(CLI::PositiveNumber);
+
+  app.add_option("--max-file-handles", config.max_file_handles_per_client,
+                 "File handles a partition may hold open at once")
+      ->capture_default_str();
+
+  app.add_option("--untar-writers", config.untar_writers,
+                 "Threads storing the files of an archive uploaded to "
+                 "/untar, the in-memory backend always uses one")
+      ->capture_default_str();
+
+  app.add_option("--archive-readers", config.archive_readers,
+                 "Threads reading files ahead of an /archive download, the "
+                 "in-memory backend always reads on the sending thread")
+      ->capture_default_str();
+
+  app.add_option("--scheduler-concurrency", config.scheduler_concurrency,
+                 "Partition requests executed at once, 0 disables fair "
+                 "scheduling")
+      ->capture_default_str();
+
+  app.add_option("--tenant-weight", config.tenant_weights,
+                 "Scheduling weight of a partition, e.g. "
+                 "--tenant-weight <uuid> 4");
+
+  app.add_option("--rate-limit-rps", config.rate_limit_rps,
+                 "Requests per second of a partition, 0 for unlimited")
+      ->capture_default_str()
+      ->check(CLI::NonNegativeNumber);
+
+  app.add_option("--rate-limit-bytes", config.rate_limit_bytes_per_s,
+                 "Payload bytes per second of a partition, 0 for unlimited")
+      ->capture_default_str()
+      ->check(CLI::NonNegativeNumber);
+
+  app.add_option("--rate-limit-burst", config.rate_limit_burst_s,
+                 "Seconds of traffic a partition may burst after being idle")
+      ->capture_default_str()
+      ->check(CLI::PositiveNumber);
+
+  app.add_flag("--change-feed", config.change_feed,
+               "Record mutations for replicas in <data-dir>/changes.log");
+
+  app.add_option("--replicate-from", config.replicate_from,
+                 "host:port of the primary, makes this node a read-only "
+                 "replica");
+
+  app.add_option("--replication-token", config.replication_token,
+                 "Shared secret of the replication endpoints, required by "
+                 "--change-feed and --replicate-from");
+
+  app.add_option("--replication-ca-cert", config.replication_ca_cert,
+                 "CA certificate to verify the primary with, the system CA "
+                 "store by default")
+      ->check(CLI::ExistingFile);
+
   app.parse(argc, argv);
 
+  /* the feed holds the data and client bindings of every partition */
+  if ((config.change_feed || !config.replicate_from.empty()) &&
+      config.replication_token.empty()) {
+    throw CLI::ValidationError(
+        "--replication-token",
+        "is required with --change-feed and --replicate-from");
+  }
+
+  for (auto const& [uuid, weight] : config.tenant_weights) {
+    if (weight <= 0) {
+      throw CLI::ValidationError("--tenant-weight",
+                                 "weight of " + uuid + " must be positive");
+    }
+  }
+
   return config;
 }
 
@@ -45,8 +192,19 @@ int main(int argc, char** argv) {
     std::cout << "Port: " << config.port << "\n";
     std::cout << "Certificate Path: " << config.cert_path << "\n";
     std::cout << "Key Path: " << config.key_path << "\n";
-    cppfs::storage::StartFS(config.ip_address, config.port, config.cert_path,
-                            config.key_path);
+    std::cout << "Backend: " << config.backend << "\n";
+    std::cout << "Data Directory: " << config.data_dir << "\n";
+    for (auto const& volume : config.volumes) {
+      std::cout << "Volume: " << volume << "\n";
+    }
+    if (config.plain_port != 0) {
+      std::cout << "Plain HTTP: " << config.plain_address << ":"
+                << config.plain_port << "\n";
+    }
+    if (!config.replicate_from.empty()) {
+      std::cout << "Replicating from: " << config.replicate_from << "\n";
+    }
+    cppfs::storage::StartFS(config);
   } catch (const CLI::ParseError& e) {
     return CLI::App().exit(e);  // Handles parsing errors
   }
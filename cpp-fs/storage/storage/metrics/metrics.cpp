@@ -0,0 +1,290 @@
+#include "metrics/metrics.hpp"
+
+#include <format>
+
+namespace cppfs::storage {
+
+namespace {
+
+/// Bucket boundaries exported to Prometheus, in seconds. The fine-grained
+/// buckets of LatencyHistogram are folded into these on scrape.
+constexpr std::array kExportedBoundaries = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+    0.05,   0.1,     0.25,   0.5,   1.0,    2.5,   5.0,  10.0,
+};
+
+constexpr std::array kExportedQuantiles = {0.5, 0.9, 0.99, 0.999};
+
+constexpr double kNanosecondsPerSecond = 1e9;
+
+double ToSeconds(uint64_t ns) {
+  return static_cast<double>(ns) / kNanosecondsPerSecond;
+}
+
+std::string EscapeLabelValue(std::string_view value) {
+  std::string escaped;
+  escaped.reserve(value.size());
+  for (char c : value) {
+    if (c == '\\' || c == '"') escaped += '\\';
+    if (c == '\n') {
+      escaped += "\\n";
+      continue;
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+/// match request @c path against @c pattern where `:name` matches a segment
+bool MatchPattern(std::string_view pattern, std::string_view path) {
+  while (!pattern.empty() && !path.empty()) {
+    if (pattern.front() == ':') {
+      size_t const pattern_end = pattern.find('/');
+      size_t const path_end = path.find('/');
+      if (path_end == 0) return false;
+      pattern.remove_prefix(std::min(pattern_end, pattern.size()));
+      path.remove_prefix(std::min(path_end, path.size()));
+      continue;
+    }
+    if (pattern.front() != path.front()) return false;
+    pattern.remove_prefix(1);
+    path.remove_prefix(1);
+  }
+  return pattern.empty() && path.empty();
+}
+
+/// seconds of @c time since the epoch of the steady clock
+uint64_t SecondOf(std::chrono::steady_clock::time_point time) {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+                                   time.time_since_epoch())
+                                   .count());
+}
+
+constexpr uint64_t kCountBits = 32;
+constexpr uint64_t kCountMask = (uint64_t{1} << kCountBits) - 1;
+
+}  // namespace
+
+void RateMeter::Mark(std::chrono::steady_clock::time_point now) {
+  uint64_t const second = SecondOf(now) & kCountMask;
+  std::atomic<uint64_t>& bucket = buckets_[second % buckets_.size()];
+  uint64_t value = bucket.load(std::memory_order_relaxed);
+  while (true) {
+    uint64_t const next = (value >> kCountBits) == second
+                              ? value + 1
+                              : (second << kCountBits) | 1;
+    if (bucket.compare_exchange_weak(value, next, std::memory_order_relaxed)) {
+      return;
+    }
+  }
+}
+
+double RateMeter::GetRate(std::chrono::steady_clock::time_point now) const {
+  uint64_t const second = SecondOf(now) & kCountMask;
+  uint64_t events = 0;
+  for (std::atomic<uint64_t> const& bucket : buckets_) {
+    uint64_t const value = bucket.load(std::memory_order_relaxed);
+    /* the bucket of the current second is still being filled */
+    uint64_t const age = (second - (value >> kCountBits)) & kCountMask;
+    if (age >= 1 && age <= static_cast<uint64_t>(kWindowS)) {
+      events += value & kCountMask;
+    }
+  }
+  return static_cast<double>(events) / kWindowS;
+}
+
+std::chrono::nanoseconds LatencyHistogram::Snapshot::Quantile(
+    double q) const {
+  if (count == 0) return std::chrono::nanoseconds{0};
+  auto const rank = static_cast<uint64_t>(q * static_cast<double>(count));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    seen += buckets[i];
+    if (seen > rank || seen == count) {
+      return std::chrono::nanoseconds{
+          static_cast<std::chrono::nanoseconds::rep>(BucketUpperBound(i))};
+    }
+  }
+  return std::chrono::nanoseconds{static_cast<std::chrono::nanoseconds::rep>(
+      BucketUpperBound(kBuckets - 1))};
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::GetSnapshot() const {
+  Snapshot snapshot;
+  snapshot.buckets.assign(kBuckets, 0);
+  for (Shard const& shard : shards_) {
+    for (size_t i = 0; i < kBuckets; ++i) {
+      uint64_t const value = shard.buckets[i].load(std::memory_order_relaxed);
+      snapshot.buckets[i] += value;
+      snapshot.count += value;
+    }
+    snapshot.sum_ns += shard.sum_ns.load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+void PrometheusWriter::Family(std::string_view name, std::string_view type,
+                              std::string_view help) {
+  text_ += std::format("# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+void PrometheusWriter::AppendName(std::string_view name,
+                                  Labels const& labels) {
+  text_ += name;
+  if (labels.empty()) return;
+  text_ += '{';
+  for (size_t i = 0; i < labels.size(); ++i) {
+    if (i != 0) text_ += ',';
+    text_ += std::format("{}=\"{}\"", labels[i].first,
+                         EscapeLabelValue(labels[i].second));
+  }
+  text_ += '}';
+}
+
+void PrometheusWriter::Sample(std::string_view name, Labels const& labels,
+                              double value) {
+  AppendName(name, labels);
+  text_ += std::format(" {}\n", value);
+}
+
+void PrometheusWriter::Sample(std::string_view name, Labels const& labels,
+                              uint64_t value) {
+  AppendName(name, labels);
+  text_ += std::format(" {}\n", value);
+}
+
+void PrometheusWriter::Sample(std::string_view name, Labels const& labels,
+                              int64_t value) {
+  AppendName(name, labels);
+  text_ += std::format(" {}\n", value);
+}
+
+void PrometheusWriter::Histogram(std::string_view name, Labels const& labels,
+                                 LatencyHistogram::Snapshot const& snapshot) {
+  std::string const bucket_name = std::format("{}_bucket", name);
+  uint64_t cumulative = 0;
+  size_t fine = 0;
+  for (double boundary : kExportedBoundaries) {
+    auto const boundary_ns =
+        static_cast<uint64_t>(boundary * kNanosecondsPerSecond);
+    while (fine < snapshot.buckets.size() &&
+           LatencyHistogram::BucketUpperBound(fine) <= boundary_ns) {
+      cumulative += snapshot.buckets[fine++];
+    }
+    Labels bucket_labels = labels;
+    bucket_labels.emplace_back("le", std::format("{}", boundary));
+    Sample(bucket_name, bucket_labels, cumulative);
+  }
+  Labels inf_labels = labels;
+  inf_labels.emplace_back("le", "+Inf");
+  Sample(bucket_name, inf_labels, snapshot.count);
+  Sample(std::format("{}_sum", name), labels, ToSeconds(snapshot.sum_ns));
+  Sample(std::format("{}_count", name), labels, snapshot.count);
+}
+
+MetricsRegistry::MetricsRegistry() {
+  auto& metrics = routes_.emplace_back(std::make_unique<RouteMetrics>());
+  metrics->route = "unmatched";
+  unmatched_ = metrics.get();
+}
+
+MetricsRegistry::RouteMetrics& MetricsRegistry::RegisterRoute(
+    std::string route, std::string backend) {
+  std::lock_guard const lock{mutex_};
+  auto& metrics = routes_.emplace_back(std::make_unique<RouteMetrics>());
+  metrics->route = std::move(route);
+  metrics->backend = std::move(backend);
+  if (metrics->route.find(':') == std::string::npos) {
+    static_routes_.emplace(metrics->route, metrics.get());
+  } else {
+    param_routes_.push_back(metrics.get());
+  }
+  return *metrics;
+}
+
+MetricsRegistry::RouteMetrics& MetricsRegistry::MatchRoute(
+    std::string_view path) {
+  if (auto it = static_routes_.find(path); it != static_routes_.end()) {
+    return *it->second;
+  }
+  for (RouteMetrics* metrics : param_routes_) {
+    if (MatchPattern(metrics->route, path)) return *metrics;
+  }
+  return *unmatched_;
+}
+
+void MetricsRegistry::AddCollector(Collector collector) {
+  std::lock_guard const lock{mutex_};
+  collectors_.push_back(std::move(collector));
+}
+
+std::string MetricsRegistry::RenderPrometheus() const {
+  std::lock_guard const lock{mutex_};
+  PrometheusWriter writer;
+
+  writer.Family("cppfs_http_request_duration_seconds", "histogram",
+                "Time spent in request handlers");
+  std::vector<LatencyHistogram::Snapshot> snapshots;
+  snapshots.reserve(routes_.size());
+  for (auto const& route : routes_) {
+    snapshots.push_back(route->latency.GetSnapshot());
+    writer.Histogram("cppfs_http_request_duration_seconds",
+                     {{"route", route->route}, {"backend", route->backend}},
+                     snapshots.back());
+  }
+
+  writer.Family("cppfs_http_request_duration_quantile_seconds", "gauge",
+                "Upper bound of request latency quantiles since start");
+  for (size_t i = 0; i < routes_.size(); ++i) {
+    for (double q : kExportedQuantiles) {
+      writer.Sample("cppfs_http_request_duration_quantile_seconds",
+                    {{"route", routes_[i]->route},
+                     {"backend", routes_[i]->backend},
+                     {"quantile", std::format("{}", q)}},
+                    std::chrono::duration<double>(snapshots[i].Quantile(q))
+                        .count());
+    }
+  }
+
+  writer.Family("cppfs_http_responses_total", "counter",
+                "Responses by route and status class");
+  for (auto const& route : routes_) {
+    for (size_t i = 0; i < route->responses.size(); ++i) {
+      writer.Sample("cppfs_http_responses_total",
+                    {{"route", route->route},
+                     {"backend", route->backend},
+                     {"code", std::format("{}xx", i + 1)}},
+                    route->responses[i].Value());
+    }
+  }
+
+  writer.Family("cppfs_http_requests_in_flight", "gauge",
+                "Requests currently being handled");
+  writer.Sample("cppfs_http_requests_in_flight", {}, in_flight_.Value());
+
+  writer.Family("cppfs_errors_total", "counter",
+                "Errors reported to clients by internal error code");
+  for (size_t i = 0; i < errors_.size(); ++i) {
+    writer.Sample("cppfs_errors_total",
+                  {{"code", ErrorEnumToString(static_cast<ErrorEnum>(i))}},
+                  errors_[i].Value());
+  }
+
+  writer.Family("cppfs_storage_read_bytes_total", "counter",
+                "Bytes of file data served to clients");
+  writer.Sample("cppfs_storage_read_bytes_total", {}, bytes_read_.Value());
+  writer.Family("cppfs_storage_written_bytes_total", "counter",
+                "Bytes of file data stored by clients");
+  writer.Sample("cppfs_storage_written_bytes_total", {},
+                bytes_written_.Value());
+
+  for (Collector const& collector : collectors_) collector(writer);
+  return writer.GetText();
+}
+
+MetricsRegistry& GlobalMetrics() {
+  static MetricsRegistry metrics;
+  return metrics;
+}
+
+}  // namespace cppfs::storage
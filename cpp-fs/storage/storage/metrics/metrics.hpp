@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "error_types.h"
+
+namespace cppfs::storage {
+
+namespace detail {
+
+/// Number of independent slots per metric. Threads are spread over the slots
+/// so that concurrent updates don't bounce the same cache line.
+inline constexpr size_t kMetricShards = 16;
+
+inline size_t ThisThreadShard() {
+  static std::atomic<size_t> next_shard{0};
+  thread_local size_t const shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+  return shard;
+}
+
+}  // namespace detail
+
+/// Monotonic counter, an update is a single relaxed increment
+class Counter {
+ public:
+  void Inc(uint64_t value = 1) {
+    shards_[detail::ThisThreadShard()].value.fetch_add(
+        value, std::memory_order_relaxed);
+  }
+
+  uint64_t Value() const {
+    uint64_t sum = 0;
+    for (Shard const& shard : shards_) {
+      sum += shard.value.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> value{0};
+  };
+
+  std::array<Shard, detail::kMetricShards> shards_{};
+};
+
+/// Value that can go up and down, e.g. number of in-flight requests
+class Gauge {
+ public:
+  void Add(int64_t value) {
+    shards_[detail::ThisThreadShard()].value.fetch_add(
+        value, std::memory_order_relaxed);
+  }
+
+  int64_t Value() const {
+    int64_t sum = 0;
+    for (Shard const& shard : shards_) {
+      sum += shard.value.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<int64_t> value{0};
+  };
+
+  std::array<Shard, detail::kMetricShards> shards_{};
+};
+
+///
+/// Rate of events over the last few seconds.
+///
+/// Events are counted in per-second buckets of a ring. A bucket packs the
+/// second it counts in its upper half and the count in its lower half, so
+/// marking an event is a single compare-and-swap that also recycles a bucket
+/// left over from an earlier lap of the ring.
+///
+class RateMeter {
+ public:
+  /// complete seconds the rate is averaged over
+  static constexpr int64_t kWindowS = 10;
+
+  void Mark(std::chrono::steady_clock::time_point now);
+
+  /// events per second over the last @c kWindowS complete seconds
+  double GetRate(std::chrono::steady_clock::time_point now) const;
+
+ private:
+  std::array<std::atomic<uint64_t>, kWindowS + 1> buckets_{};
+};
+
+///
+/// Log-linear (HDR-style) histogram of durations in nanoseconds.
+///
+/// Every power-of-two range is split into 8 linear sub-buckets, so the
+/// relative error of any recorded value is below 12.5%. Recording is a bucket
+/// index computation and two relaxed increments on the thread's own shard.
+///
+class LatencyHistogram {
+ public:
+  static constexpr unsigned kSubBucketBits = 3;
+  static constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+  /// values above 2^40ns (~18 minutes) are clamped into the last bucket
+  static constexpr unsigned kMaxExponent = 40;
+  static constexpr size_t kBuckets =
+      (kMaxExponent - kSubBucketBits + 1) * kSubBuckets;
+
+  struct Snapshot {
+    std::vector<uint64_t> buckets;
+    uint64_t count{0};
+    uint64_t sum_ns{0};
+
+    /// upper bound of the @c q quantile (0 <= q <= 1)
+    std::chrono::nanoseconds Quantile(double q) const;
+  };
+
+  void Record(std::chrono::nanoseconds duration) {
+    auto const value = static_cast<uint64_t>(
+        std::max<std::chrono::nanoseconds::rep>(duration.count(), 0));
+    Shard& shard = shards_[detail::ThisThreadShard()];
+    shard.buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    shard.sum_ns.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  Snapshot GetSnapshot() const;
+
+  static constexpr size_t BucketIndex(uint64_t value) {
+    if (value < kSubBuckets) return static_cast<size_t>(value);
+    auto const msb = static_cast<unsigned>(std::bit_width(value) - 1);
+    if (msb >= kMaxExponent) return kBuckets - 1;
+    unsigned const shift = msb - kSubBucketBits;
+    auto const sub = static_cast<size_t>(value >> shift) & (kSubBuckets - 1);
+    return (shift + 1) * kSubBuckets + sub;
+  }
+
+  /// exclusive upper bound of values falling into bucket @c index
+  static constexpr uint64_t BucketUpperBound(size_t index) {
+    if (index < kSubBuckets) return index + 1;
+    size_t const shift = index / kSubBuckets - 1;
+    return (kSubBuckets + index % kSubBuckets + 1) << shift;
+  }
+
+ private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<uint64_t>, kBuckets> buckets{};
+    std::atomic<uint64_t> sum_ns{0};
+  };
+
+  std::array<Shard, detail::kMetricShards> shards_{};
+};
+
+/// Accumulates metrics in the Prometheus text exposition format
+class PrometheusWriter {
+ public:
+  using Labels = std::vector<std::pair<std::string_view, std::string>>;
+
+  /// emit `# HELP` and `# TYPE` lines, once per metric family
+  void Family(std::string_view name, std::string_view type,
+              std::string_view help);
+
+  void Sample(std::string_view name, Labels const& labels, double value);
+  void Sample(std::string_view name, Labels const& labels, uint64_t value);
+  void Sample(std::string_view name, Labels const& labels, int64_t value);
+
+  void Histogram(std::string_view name, Labels const& labels,
+                 LatencyHistogram::Snapshot const& snapshot);
+
+  std::string const& GetText() const { return text_; }
+
+ private:
+  void AppendName(std::string_view name, Labels const& labels);
+
+  std::string text_;
+};
+
+///
+/// Process-wide set of server metrics.
+///
+/// Routes are registered once at startup, after that recording never takes a
+/// lock. Subsystems that keep their own statistics expose them through
+/// collectors which are only invoked when the metrics are scraped.
+///
+class MetricsRegistry {
+ public:
+  using Collector = std::function<void(PrometheusWriter&)>;
+
+  struct RouteMetrics {
+    std::string route;
+    std::string backend;
+    LatencyHistogram latency;
+    /// responses by status class: 1xx .. 5xx
+    std::array<Counter, 5> responses;
+
+    void Record(std::chrono::nanoseconds duration, int status) {
+      latency.Record(duration);
+      auto const status_class =
+          std::clamp<size_t>(static_cast<size_t>(status / 100), 1, 5);
+      responses[status_class - 1].Inc();
+    }
+  };
+
+  static constexpr size_t kErrorCodes =
+      static_cast<size_t>(ErrorEnum::kReadOnly) + 1;
+
+  MetricsRegistry();
+
+  /// register @c route pattern (e.g. `/partition/:id`) served by @c backend,
+  /// must be called before serving
+  RouteMetrics& RegisterRoute(std::string route, std::string backend);
+
+  /// find metrics of the route matching request @c path
+  RouteMetrics& MatchRoute(std::string_view path);
+
+  void AddCollector(Collector collector);
+
+  void RecordError(ErrorEnum code) {
+    errors_[static_cast<size_t>(code)].Inc();
+  }
+
+  Gauge& InFlight() { return in_flight_; }
+
+  /// rate of the requests started by the server
+  RateMeter& Requests() { return requests_; }
+
+  Counter& BytesRead() { return bytes_read_; }
+
+  Counter& BytesWritten() { return bytes_written_; }
+
+  std::string RenderPrometheus() const;
+
+ private:
+  std::vector<std::unique_ptr<RouteMetrics>> routes_;
+  std::unordered_map<std::string_view, RouteMetrics*> static_routes_;
+  std::vector<RouteMetrics*> param_routes_;
+  /// requests that didn't match any registered route
+  RouteMetrics* unmatched_;
+  std::vector<Collector> collectors_;
+  std::array<Counter, kErrorCodes> errors_;
+  Gauge in_flight_;
+  RateMeter requests_;
+  Counter bytes_read_;
+  Counter bytes_written_;
+  mutable std::mutex mutex_;
+};
+
+/// metrics of the running server
+MetricsRegistry& GlobalMetrics();
+
+}  // namespace cppfs::storage
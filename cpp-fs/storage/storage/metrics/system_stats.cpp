@@ -0,0 +1,72 @@
+#include "metrics/system_stats.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace cppfs::storage {
+
+namespace {
+
+constexpr uint64_t kBytesPerKiB = 1024;
+
+/// read `MemTotal` and `MemAvailable` from /proc/meminfo
+void ReadMemInfo(SystemStats& stats) {
+  std::ifstream meminfo("/proc/meminfo");
+  std::string key;
+  uint64_t value_kib = 0;
+  std::string unit;
+  while (meminfo >> key >> value_kib >> unit) {
+    if (key == "MemTotal:") {
+      stats.memory_total_bytes = value_kib * kBytesPerKiB;
+    } else if (key == "MemAvailable:") {
+      stats.memory_available_bytes = value_kib * kBytesPerKiB;
+      return;
+    }
+  }
+}
+
+/// resident pages are the second field of /proc/self/statm
+uint64_t ReadProcessRss() {
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size_pages = 0;
+  uint64_t resident_pages = 0;
+  if (!(statm >> size_pages >> resident_pages)) return 0;
+  long const page_size = ::sysconf(_SC_PAGESIZE);
+  return page_size > 0 ? resident_pages * static_cast<uint64_t>(page_size) : 0;
+}
+
+}  // namespace
+
+SystemStats ReadSystemStats(std::filesystem::path const& data_dir) {
+  return ReadSystemStats(std::vector<std::filesystem::path>{data_dir});
+}
+
+SystemStats ReadSystemStats(
+    std::vector<std::filesystem::path> const& data_dirs) {
+  SystemStats stats;
+  /* several directories may share a filesystem */
+  std::vector<dev_t> devices;
+  for (std::filesystem::path const& data_dir : data_dirs) {
+    struct stat st {};
+    if (::stat(data_dir.c_str(), &st) != 0 ||
+        std::ranges::find(devices, st.st_dev) != devices.end()) {
+      continue;
+    }
+    devices.push_back(st.st_dev);
+    std::error_code ec;
+    std::filesystem::space_info const space =
+        std::filesystem::space(data_dir, ec);
+    if (ec) continue;
+    stats.disk_total_bytes += space.capacity;
+    stats.disk_available_bytes += space.available;
+  }
+  ReadMemInfo(stats);
+  stats.process_rss_bytes = ReadProcessRss();
+  return stats;
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace cppfs::storage {
+
+/// Resources of the host the node runs on, 0 where unknown
+struct SystemStats {
+  uint64_t disk_total_bytes{0};
+  /// available to unprivileged users
+  uint64_t disk_available_bytes{0};
+  uint64_t memory_total_bytes{0};
+  /// estimate of the memory available without swapping (`MemAvailable`)
+  uint64_t memory_available_bytes{0};
+  /// resident set of the server process
+  uint64_t process_rss_bytes{0};
+};
+
+/// Read the host stats, the disk is the filesystem @c data_dir lives on.
+/// Takes a statvfs() call and two small reads from /proc, cheap enough to be
+/// polled by a balancer.
+SystemStats ReadSystemStats(std::filesystem::path const& data_dir);
+
+/// Read the host stats, the disk space is summed over the filesystems the
+/// @c data_dirs live on, each counted once.
+SystemStats ReadSystemStats(
+    std::vector<std::filesystem::path> const& data_dirs);
+
+}  // namespace cppfs::storage
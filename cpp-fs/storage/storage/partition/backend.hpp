@@ -0,0 +1,67 @@
+#pragma once
+
+#include <concepts>
+#include <filesystem>
+#include <tl/expected.hpp>
+#include <type_traits>
+
+#include "error_types.h"
+#include "partition.hpp"
+#include "partition_id.hpp"
+
+namespace cppfs::storage {
+
+///
+/// A partition manager together with the concrete types of its partitions,
+/// directories and regular files.
+///
+/// The types are final, so calls through pointers to them are dispatched
+/// statically and can be inlined; code templated on the manager, like the
+/// server routes, reaches the backend without virtual calls. The abstract
+/// interfaces stay for code that doesn't know the backend.
+///
+template <typename Manager>
+concept PartitionBackend =
+    std::derived_from<Manager, PartitionManager> &&
+    requires {
+      typename Manager::PartitionType;
+      typename Manager::DirectoryType;
+      typename Manager::RegularFileType;
+    } &&
+    std::derived_from<typename Manager::PartitionType, Partition> &&
+    std::derived_from<typename Manager::DirectoryType, Directory> &&
+    std::derived_from<typename Manager::RegularFileType, RegularFile> &&
+    std::is_final_v<typename Manager::PartitionType> &&
+    std::is_final_v<typename Manager::DirectoryType> &&
+    std::is_final_v<typename Manager::RegularFileType> &&
+    requires(Manager& manager, PartitionId const& id) {
+      {
+        manager.LookupPartition(id)
+      } -> std::same_as<typename Manager::PartitionType*>;
+    };
+
+template <PartitionBackend Manager>
+using PartitionOf = typename Manager::PartitionType;
+
+template <PartitionBackend Manager>
+using DirectoryOf = typename Manager::DirectoryType;
+
+template <PartitionBackend Manager>
+using RegularFileOf = typename Manager::RegularFileType;
+
+/// Partition::OpenDir() of a partition of @c Manager
+template <PartitionBackend Manager>
+tl::expected<DirectoryOf<Manager>*, Error> OpenBackendDir(
+    PartitionOf<Manager>& partition, std::filesystem::path const& path) {
+  return Partition::OpenAs<DirectoryOf<Manager>>(partition.Open(path), path);
+}
+
+/// Partition::OpenRegularFile() of a partition of @c Manager
+template <PartitionBackend Manager>
+tl::expected<RegularFileOf<Manager>*, Error> OpenBackendRegularFile(
+    PartitionOf<Manager>& partition, std::filesystem::path const& path) {
+  return Partition::OpenAs<RegularFileOf<Manager>>(partition.Open(path),
+                                                   path);
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,283 @@
+#include "partition/checksum.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <unistd.h>
+
+#include <boost/crc.hpp>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace cppfs::storage {
+
+namespace {
+
+using Crc32cTable = boost::crc_optimal<32, 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF,
+                                       true, true>;
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) uint32_t Crc32cSse42(std::string_view data,
+                                                       uint32_t crc) {
+  uint64_t state = ~crc;
+  char const* next = data.data();
+  size_t size = data.size();
+  for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, next, sizeof(word));
+    state = _mm_crc32_u64(state, word);
+    next += sizeof(word);
+  }
+  auto state32 = static_cast<uint32_t>(state);
+  for (; size > 0; --size) {
+    state32 = _mm_crc32_u8(state32, static_cast<uint8_t>(*next++));
+  }
+  return ~state32;
+}
+#endif
+
+using Crc32cFunction = uint32_t (*)(std::string_view, uint32_t);
+
+Crc32cFunction SelectCrc32c() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2")) return Crc32cSse42;
+#endif
+  return Crc32cPortable;
+}
+
+Crc32cFunction const kCrc32c = SelectCrc32c();
+
+constexpr size_t kChecksumSize = sizeof(uint32_t);
+
+size_t BlockCount(size_t size) {
+  return (size + kChecksumBlockSize - 1) / kChecksumBlockSize;
+}
+
+void StoreLittleEndian(uint32_t value, char* out) {
+  for (size_t i = 0; i < kChecksumSize; ++i) {
+    out[i] = static_cast<char>(value >> (8 * i));
+  }
+}
+
+uint32_t LoadLittleEndian(char const* in) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < kChecksumSize; ++i) {
+    value |= static_cast<uint32_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+  }
+  return value;
+}
+
+/// checksums of the blocks of @c data, serialized
+std::string EncodeChecksums(std::string_view data) {
+  std::string encoded(BlockCount(data.size()) * kChecksumSize, '\0');
+  for (size_t block = 0; block * kChecksumBlockSize < data.size(); ++block) {
+    StoreLittleEndian(
+        Crc32c(data.substr(block * kChecksumBlockSize, kChecksumBlockSize)),
+        encoded.data() + block * kChecksumSize);
+  }
+  return encoded;
+}
+
+bool WriteAllAt(int fd, std::string_view data, off_t offset) {
+  while (!data.empty()) {
+    ssize_t const rc = ::pwrite(fd, data.data(), data.size(), offset);
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data.remove_prefix(static_cast<size_t>(rc));
+    offset += rc;
+  }
+  return true;
+}
+
+/// read up to @c size bytes at @c offset, less only at the end of the file
+bool ReadAllAt(int fd, size_t offset, size_t size, std::string& out) {
+  out.resize(size);
+  size_t done = 0;
+  while (done < size) {
+    ssize_t const rc = ::pread(fd, out.data() + done, size - done,
+                               static_cast<off_t>(offset + done));
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    if (rc == 0) break;
+    done += static_cast<size_t>(rc);
+  }
+  out.resize(done);
+  return true;
+}
+
+}  // namespace
+
+uint32_t Crc32c(std::string_view data, uint32_t crc) {
+  return kCrc32c(data, crc);
+}
+
+uint32_t Crc32cPortable(std::string_view data, uint32_t crc) {
+  /* boost takes the register before the final xor, in unreflected order */
+  uint32_t state = ~crc;
+  uint32_t initial = 0;
+  for (int bit = 0; bit < 32; ++bit, state >>= 1) {
+    initial = (initial << 1) | (state & 1);
+  }
+  Crc32cTable table{initial};
+  table.process_bytes(data.data(), data.size());
+  return table.checksum();
+}
+
+bool HasHardwareCrc32c() {
+#if defined(__x86_64__)
+  return kCrc32c == Crc32cSse42;
+#else
+  return false;
+#endif
+}
+
+ChecksumCounters& GetChecksumCounters() {
+  static ChecksumCounters counters;
+  return counters;
+}
+
+void CollectChecksumMetrics(PrometheusWriter& writer) {
+  ChecksumCounters const& counters = GetChecksumCounters();
+  writer.Family("cppfs_checksum_verified_blocks_total", "counter",
+                "Data blocks whose checksum was verified");
+  writer.Sample("cppfs_checksum_verified_blocks_total", {},
+                counters.blocks_verified.Value());
+  writer.Family("cppfs_checksum_verified_bytes_total", "counter",
+                "Bytes of data verified against checksums");
+  writer.Sample("cppfs_checksum_verified_bytes_total", {},
+                counters.bytes_verified.Value());
+  writer.Family("cppfs_checksum_mismatches_total", "counter",
+                "Data blocks that didn't match their checksum");
+  writer.Sample("cppfs_checksum_mismatches_total", {{"source", "read"}},
+                counters.read_mismatches.Value());
+  writer.Sample("cppfs_checksum_mismatches_total", {{"source", "scrub"}},
+                counters.scrub_mismatches.Value());
+  writer.Family("cppfs_scrub_unchecked_files_total", "counter",
+                "Files the scrubber found without checksums");
+  writer.Sample("cppfs_scrub_unchecked_files_total", {},
+                counters.unchecked_files.Value());
+  writer.Family("cppfs_scrubbed_files_total", "counter",
+                "Files verified by the scrubber");
+  writer.Sample("cppfs_scrubbed_files_total", {},
+                counters.scrubbed_files.Value());
+  writer.Family("cppfs_scrubbed_bytes_total", "counter",
+                "Bytes verified by the scrubber");
+  writer.Sample("cppfs_scrubbed_bytes_total", {},
+                counters.scrubbed_bytes.Value());
+  writer.Family("cppfs_scrub_passes_total", "counter",
+                "Completed scrubs of all partitions");
+  writer.Sample("cppfs_scrub_passes_total", {}, counters.scrub_passes.Value());
+}
+
+void BlockChecksums::Rewrite(std::string_view data) const {
+  std::error_code ec;
+  std::filesystem::create_directories(sidecar_path_.parent_path(), ec);
+  int const fd = ::open(sidecar_path_.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) return Drop();
+  bool const written = WriteAllAt(fd, EncodeChecksums(data), 0);
+  ::close(fd);
+  if (!written) Drop();
+}
+
+void BlockChecksums::Update(int data_fd, size_t begin, size_t end) const {
+  /* files written before checksums were introduced stay unchecked */
+  int const fd = ::open(sidecar_path_.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) return;
+
+  /* the blocks overlapping [begin, end) are read back whole */
+  struct stat st{};
+  bool ok = ::fstat(data_fd, &st) == 0;
+  auto const size = static_cast<size_t>(st.st_size);
+  size_t const first = begin / kChecksumBlockSize;
+  size_t const aligned_begin = first * kChecksumBlockSize;
+  size_t const aligned_end =
+      std::min(BlockCount(end) * kChecksumBlockSize, size);
+  std::string data;
+  ok = ok &&
+       ReadAllAt(data_fd, aligned_begin,
+                 aligned_end > aligned_begin ? aligned_end - aligned_begin : 0,
+                 data) &&
+       WriteAllAt(fd, EncodeChecksums(data),
+                  static_cast<off_t>(first * kChecksumSize)) &&
+       ::ftruncate(fd, static_cast<off_t>(BlockCount(size) * kChecksumSize)) ==
+           0;
+  ::close(fd);
+  if (!ok) Drop();
+}
+
+void BlockChecksums::Drop() const {
+  std::error_code ec;
+  std::filesystem::remove(sidecar_path_, ec);
+  std::cerr << "Cannot write checksums '" << sidecar_path_.string()
+            << "', the file is left unchecked\n";
+}
+
+std::optional<std::vector<uint32_t>> BlockChecksums::Load(size_t first,
+                                                          size_t count) const {
+  int const fd = ::open(sidecar_path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return std::nullopt;
+  std::string encoded;
+  bool const read =
+      ReadAllAt(fd, first * kChecksumSize, count * kChecksumSize, encoded);
+  ::close(fd);
+  std::vector<uint32_t> checksums;
+  if (!read) return checksums;
+  checksums.reserve(encoded.size() / kChecksumSize);
+  for (size_t i = 0; i + kChecksumSize <= encoded.size(); i += kChecksumSize) {
+    checksums.push_back(LoadLittleEndian(encoded.data() + i));
+  }
+  return checksums;
+}
+
+BlockChecksums::Verification BlockChecksums::Verify(
+    size_t offset, std::string_view data) const {
+  size_t const first = offset / kChecksumBlockSize;
+  size_t const count = BlockCount(data.size());
+  auto const checksums = Load(first, count);
+  if (!checksums.has_value()) return Verification::kMissing;
+  if (checksums->size() < count) return Verification::kMismatch;
+
+  for (size_t block = 0; block < count; ++block) {
+    std::string_view const block_data =
+        data.substr(block * kChecksumBlockSize, kChecksumBlockSize);
+    if (Crc32c(block_data) != (*checksums)[block]) {
+      return Verification::kMismatch;
+    }
+  }
+  ChecksumCounters& counters = GetChecksumCounters();
+  counters.blocks_verified.Inc(count);
+  counters.bytes_verified.Inc(data.size());
+  return Verification::kOk;
+}
+
+BlockChecksums::Verification BlockChecksums::ReadVerified(
+    int data_fd, size_t offset, size_t size, std::string& out) const {
+  size_t const aligned_begin = offset / kChecksumBlockSize * kChecksumBlockSize;
+  size_t const aligned_end = BlockCount(offset + size) * kChecksumBlockSize;
+  std::string blocks;
+  Verification result = Verification::kMismatch;
+  for (int attempt = 0;
+       attempt < 2 && result == Verification::kMismatch; ++attempt) {
+    if (!ReadAllAt(data_fd, aligned_begin, aligned_end - aligned_begin,
+                   blocks)) {
+      return Verification::kIoError;
+    }
+    result = Verify(aligned_begin, blocks);
+  }
+  if (result == Verification::kMismatch) return result;
+  size_t const skip = offset - aligned_begin;
+  out.assign(blocks, std::min(skip, blocks.size()), size);
+  return result;
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "metrics/metrics.hpp"
+
+namespace cppfs::storage {
+
+/// CRC32C (Castagnoli) of @c data continuing @c crc, computed with the
+/// SSE4.2 crc32 instruction when the CPU has it and with a table otherwise
+uint32_t Crc32c(std::string_view data, uint32_t crc = 0);
+
+/// table-driven CRC32C, the fallback of Crc32c()
+uint32_t Crc32cPortable(std::string_view data, uint32_t crc = 0);
+
+/// true if Crc32c() uses the crc32 instruction
+bool HasHardwareCrc32c();
+
+/// data covered by a single checksum
+inline constexpr size_t kChecksumBlockSize = 4096;
+
+struct ChecksumCounters {
+  Counter blocks_verified;
+  Counter bytes_verified;
+  /// blocks whose data didn't match the checksum, found by reads
+  Counter read_mismatches;
+  /// ... and by the scrubber
+  Counter scrub_mismatches;
+  /// files without checksums, written before checksums were introduced
+  Counter unchecked_files;
+  Counter scrubbed_files;
+  Counter scrubbed_bytes;
+  Counter scrub_passes;
+};
+
+/// process-wide checksum statistics
+ChecksumCounters& GetChecksumCounters();
+
+void CollectChecksumMetrics(PrometheusWriter& writer);
+
+///
+/// Per-block CRC32C checksums of a data file, kept in a sidecar file.
+///
+/// The sidecar holds a little-endian CRC32C for every kChecksumBlockSize
+/// block of the data file, the last block may be partial. The sidecar is
+/// updated after the data it covers is written, so a crash in between shows
+/// up as a mismatch of the blocks being written.
+///
+class BlockChecksums {
+ public:
+  enum class Verification {
+    kOk,
+    kMismatch,
+    /// the file has no checksums, the data is returned unverified
+    kMissing,
+    kIoError,
+  };
+
+  explicit BlockChecksums(std::filesystem::path sidecar_path)
+      : sidecar_path_(std::move(sidecar_path)) {}
+
+  /// replace the checksums with the ones of @c data, the whole file.
+  /// Checksums that can't be written are removed, leaving the file
+  /// unchecked rather than failing its reads.
+  void Rewrite(std::string_view data) const;
+
+  /// recompute the checksums of the blocks of @c data_fd overlapping
+  /// [@c begin, @c end) and fit the sidecar to the size of the file
+  void Update(int data_fd, size_t begin, size_t end) const;
+
+  /// verify @c data read at block aligned @c offset, @c data ends at a block
+  /// boundary or at the end of the file
+  Verification Verify(size_t offset, std::string_view data) const;
+
+  /// read [@c offset, @c offset + @c size) of @c data_fd into @c out and
+  /// verify the blocks it overlaps, once more if a concurrent write got in
+  /// between
+  Verification ReadVerified(int data_fd, size_t offset, size_t size,
+                            std::string& out) const;
+
+  std::filesystem::path const& GetPath() const { return sidecar_path_; }
+
+ private:
+  /// checksums of @c count blocks from block @c first, fewer if the sidecar
+  /// ends before; nullopt if there is no sidecar
+  std::optional<std::vector<uint32_t>> Load(size_t first, size_t count) const;
+
+  void Drop() const;
+
+  std::filesystem::path sidecar_path_;
+};
+
+}  // namespace cppfs::storage
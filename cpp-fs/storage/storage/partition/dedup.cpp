@@ -0,0 +1,272 @@
+#include "partition/dedup.hpp"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+
+namespace cppfs::storage {
+
+namespace {
+
+/// random values of the bytes for the gear rolling hash, from splitmix64
+constexpr std::array<uint64_t, 256> kGear = [] {
+  std::array<uint64_t, 256> gear{};
+  uint64_t state = 0;
+  for (uint64_t& value : gear) {
+    state += 0x9e3779b97f4a7c15;
+    uint64_t mixed = state;
+    mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111eb;
+    value = mixed ^ (mixed >> 31);
+  }
+  return gear;
+}();
+
+/// a boundary follows a byte where these 13 bits of the hash are zero, once
+/// every 8 KiB on average. The upper bits depend on the last 64 bytes.
+constexpr uint64_t kBoundaryMask = ((uint64_t{1} << 13) - 1) << 51;
+
+/// length of the chunk at the start of @c data
+size_t NextChunkSize(std::string_view data) {
+  if (data.size() <= kMinChunkSize) return data.size();
+  size_t const end = std::min(data.size(), kMaxChunkSize);
+  uint64_t hash = 0;
+  for (size_t i = kMinChunkSize; i < end; ++i) {
+    hash = (hash << 1) + kGear[static_cast<uint8_t>(data[i])];
+    if ((hash & kBoundaryMask) == 0) return i + 1;
+  }
+  return end;
+}
+
+std::string ToHex(ContentHash const& hash) {
+  std::string hex;
+  hex.reserve(2 * hash.size());
+  for (uint8_t byte : hash) {
+    std::format_to(std::back_inserter(hex), "{:02x}", byte);
+  }
+  return hex;
+}
+
+bool WriteFile(std::filesystem::path const& path, std::string_view data) {
+  std::ofstream file(path, std::ios::binary);
+  file.write(data.data(), static_cast<std::streamsize>(data.size()));
+  file.close();
+  return !file.fail();
+}
+
+bool ReadFile(std::filesystem::path const& path, std::string& data) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  data.assign(std::istreambuf_iterator<char>{file},
+              std::istreambuf_iterator<char>{});
+  return !file.bad();
+}
+
+}  // namespace
+
+ContentHash HashContent(std::string_view data) {
+  ContentHash hash{};
+  static_cast<void>(EVP_Digest(data.data(), data.size(), hash.data(), nullptr,
+                               EVP_sha256(), nullptr));
+  return hash;
+}
+
+std::vector<std::string_view> SplitChunks(std::string_view data) {
+  std::vector<std::string_view> chunks;
+  while (!data.empty()) {
+    size_t const size = NextChunkSize(data);
+    chunks.push_back(data.substr(0, size));
+    data.remove_prefix(size);
+  }
+  return chunks;
+}
+
+void CollectDedupMetrics(PrometheusWriter& writer, DedupStats const& stats,
+                         std::string_view backend) {
+  std::string const backend_label{backend};
+  writer.Family("cppfs_dedup_chunks", "gauge",
+                "Distinct chunks stored by the deduplicating store");
+  writer.Sample("cppfs_dedup_chunks", {{"backend", backend_label}},
+                stats.chunks);
+  writer.Family("cppfs_dedup_bytes", "gauge",
+                "Bytes stored by the deduplicating store, once per chunk, "
+                "and bytes of the files referencing them");
+  writer.Sample("cppfs_dedup_bytes",
+                {{"backend", backend_label}, {"kind", "stored"}},
+                stats.stored_bytes);
+  writer.Sample("cppfs_dedup_bytes",
+                {{"backend", backend_label}, {"kind", "logical"}},
+                stats.logical_bytes);
+  writer.Family("cppfs_dedup_ratio", "gauge",
+                "Logical bytes per stored byte, 1 without duplicates");
+  writer.Sample("cppfs_dedup_ratio", {{"backend", backend_label}},
+                stats.stored_bytes == 0
+                    ? 1.0
+                    : static_cast<double>(stats.logical_bytes) /
+                          static_cast<double>(stats.stored_bytes));
+}
+
+std::vector<ChunkStore::Chunk> ChunkStore::Store(std::string_view data) {
+  std::vector<Chunk> chunks;
+  for (std::string_view const chunk : SplitChunks(data)) {
+    chunks.push_back(Intern(chunk));
+  }
+  return chunks;
+}
+
+ChunkStore::Chunk ChunkStore::Intern(std::string_view data) {
+  ContentHash const hash = HashContent(data);
+  std::lock_guard const lock{mutex_};
+  auto [it, inserted] = chunks_.try_emplace(hash);
+  if (inserted) {
+    it->second = std::make_unique<Entry>(Entry{.data = std::string{data}});
+    stored_bytes_ += data.size();
+  }
+  ++it->second->references;
+  logical_bytes_ += data.size();
+  /* the deleter drops the reference, not the data */
+  return Chunk{&it->second->data,
+               [this, hash](std::string const*) { Release(hash); }};
+}
+
+void ChunkStore::Release(ContentHash const& hash) {
+  std::lock_guard const lock{mutex_};
+  auto it = chunks_.find(hash);
+  size_t const size = it->second->data.size();
+  logical_bytes_ -= size;
+  if (--it->second->references > 0) return;
+  stored_bytes_ -= size;
+  chunks_.erase(it);
+}
+
+DedupStats ChunkStore::GetStats() const {
+  std::lock_guard const lock{mutex_};
+  return {.chunks = chunks_.size(),
+          .stored_bytes = stored_bytes_,
+          .logical_bytes = logical_bytes_};
+}
+
+BlobStore::BlobStore(std::filesystem::path root, DedupConfig config)
+    : root_(std::move(root)), config_(config) {
+  Collect();
+}
+
+std::filesystem::path BlobStore::TempPath() {
+  return root_ / std::format(".tmp.{}.{}", ::getpid(),
+                             temp_files_.fetch_add(1));
+}
+
+bool BlobStore::Link(std::filesystem::path const& path,
+                     std::string_view data) {
+  if (!config_.enabled) return false;
+  std::filesystem::path const blob = root_ / ToHex(HashContent(data));
+  auto const size = static_cast<int64_t>(data.size());
+  std::shared_lock const lock{mutex_};
+  std::error_code ec;
+  std::filesystem::create_directories(root_, ec);
+
+  std::filesystem::path const temp = TempPath();
+  if (::access(blob.c_str(), F_OK) != 0) {
+    if (!WriteFile(temp, data)) {
+      std::filesystem::remove(temp, ec);
+      return false;
+    }
+    /* unlike rename, link doesn't replace a blob stored concurrently */
+    if (::link(temp.c_str(), blob.c_str()) == 0) {
+      chunks_.Add(1);
+      stored_bytes_.Add(size);
+    }
+    std::filesystem::remove(temp, ec);
+  }
+
+  /* linked under a temporary name, the rename replaces an existing file
+     atomically */
+  if (::link(blob.c_str(), temp.c_str()) != 0) return false;
+  std::filesystem::rename(temp, path, ec);
+  if (ec) {
+    std::filesystem::remove(temp, ec);
+    return false;
+  }
+  logical_bytes_.Add(size);
+  return true;
+}
+
+bool BlobStore::IsShared(std::filesystem::path const& path) {
+  struct stat st{};
+  return ::stat(path.c_str(), &st) == 0 && st.st_nlink > 1;
+}
+
+bool BlobStore::Unshare(std::filesystem::path const& path) {
+  struct stat st{};
+  if (::stat(path.c_str(), &st) != 0 || st.st_nlink <= 1) return true;
+
+  std::shared_lock const lock{mutex_};
+  std::error_code ec;
+  std::filesystem::create_directories(root_, ec);
+  std::string data;
+  std::filesystem::path const temp = TempPath();
+  if (!ReadFile(path, data) || !WriteFile(temp, data)) {
+    std::filesystem::remove(temp, ec);
+    return false;
+  }
+  std::filesystem::rename(temp, path, ec);
+  if (ec) {
+    std::filesystem::remove(temp, ec);
+    return false;
+  }
+  auto const size = static_cast<int64_t>(data.size());
+  logical_bytes_.Add(-size);
+
+  /* the blob isn't needed anymore if this was its last file */
+  std::filesystem::path const blob = root_ / ToHex(HashContent(data));
+  struct stat blob_st{};
+  if (::stat(blob.c_str(), &blob_st) == 0 && blob_st.st_ino == st.st_ino &&
+      blob_st.st_nlink == 1 && std::filesystem::remove(blob, ec)) {
+    chunks_.Add(-1);
+    stored_bytes_.Add(-size);
+  }
+  return true;
+}
+
+void BlobStore::Collect() {
+  std::unique_lock const lock{mutex_};
+  DedupStats stats;
+  std::error_code ec;
+  for (auto it = std::filesystem::directory_iterator(root_, ec);
+       !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+    struct stat st{};
+    if (::lstat(it->path().c_str(), &st) != 0) continue;
+    /* no file links to it, or left over from an interrupted write */
+    if (st.st_nlink <= 1) {
+      std::error_code remove_ec;
+      std::filesystem::remove(it->path(), remove_ec);
+      continue;
+    }
+    auto const size = static_cast<uint64_t>(st.st_size);
+    ++stats.chunks;
+    stats.stored_bytes += size;
+    stats.logical_bytes += size * (st.st_nlink - 1);
+  }
+  chunks_.Add(static_cast<int64_t>(stats.chunks) - chunks_.Value());
+  stored_bytes_.Add(static_cast<int64_t>(stats.stored_bytes) -
+                    stored_bytes_.Value());
+  logical_bytes_.Add(static_cast<int64_t>(stats.logical_bytes) -
+                     logical_bytes_.Value());
+}
+
+DedupStats BlobStore::GetStats() const {
+  /* the gauges are updated without a lock, one may be behind another */
+  auto const value = [](Gauge const& gauge) {
+    return static_cast<uint64_t>(std::max<int64_t>(gauge.Value(), 0));
+  };
+  return {.chunks = value(chunks_),
+          .stored_bytes = value(stored_bytes_),
+          .logical_bytes = value(logical_bytes_)};
+}
+
+}  // namespace cppfs::storage
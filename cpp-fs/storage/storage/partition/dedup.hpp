@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "metrics/metrics.hpp"
+
+namespace cppfs::storage {
+
+struct DedupConfig {
+  /// store identical payloads once, shared by all partitions of the node
+  bool enabled{false};
+};
+
+/// SHA-256 of a payload, identical payloads are detected by their hash
+using ContentHash = std::array<uint8_t, 32>;
+
+ContentHash HashContent(std::string_view data);
+
+struct ContentHashHasher {
+  size_t operator()(ContentHash const& hash) const {
+    /* the hash is uniformly distributed already */
+    size_t value;
+    std::memcpy(&value, hash.data(), sizeof(value));
+    return value;
+  }
+};
+
+/// content-defined chunks are at least this large, except the last one
+inline constexpr size_t kMinChunkSize = 2 << 10;
+/// ... and at most
+inline constexpr size_t kMaxChunkSize = 64 << 10;
+
+/// split @c data into chunks of about 8 KiB on average. The boundaries
+/// depend on the content since the start of the chunk only, so an insertion
+/// changes the chunks around it and the data after it is chunked as before.
+std::vector<std::string_view> SplitChunks(std::string_view data);
+
+struct DedupStats {
+  /// distinct chunks or payloads stored
+  uint64_t chunks{0};
+  /// bytes stored once per distinct chunk
+  uint64_t stored_bytes{0};
+  /// bytes of all files referencing the chunks
+  uint64_t logical_bytes{0};
+};
+
+void CollectDedupMetrics(PrometheusWriter& writer, DedupStats const& stats,
+                         std::string_view backend);
+
+///
+/// Refcounted store of content-defined chunks, shared by the in-memory
+/// partitions of a node.
+///
+/// Every chunk is kept once, however many files contain it. A file holds a
+/// reference to each of its chunks, a chunk is freed with its last
+/// reference. The store must outlive the references.
+///
+class ChunkStore {
+ public:
+  /// a reference to a stored chunk
+  using Chunk = std::shared_ptr<std::string const>;
+
+  ChunkStore() = default;
+
+  ChunkStore(ChunkStore const&) = delete;
+  ChunkStore& operator=(ChunkStore const&) = delete;
+
+  /// split @c data into chunks and store the ones not stored yet
+  std::vector<Chunk> Store(std::string_view data);
+
+  DedupStats GetStats() const;
+
+ private:
+  struct Entry {
+    std::string data;
+    uint64_t references{0};
+  };
+
+  Chunk Intern(std::string_view data);
+  void Release(ContentHash const& hash);
+
+  mutable std::mutex mutex_;
+  /// entries are boxed, references point to their data
+  std::unordered_map<ContentHash, std::unique_ptr<Entry>, ContentHashHasher>
+      chunks_;
+  uint64_t stored_bytes_{0};
+  uint64_t logical_bytes_{0};
+};
+
+///
+/// Content-addressed store of the payloads of on-disk files.
+///
+/// The files stay plain files, a file whose payload is stored already is a
+/// hard link to the stored copy `<root>/<hash>`, so the data is kept once
+/// and the link count is the reference count. Files are unshared, given a
+/// copy of their own, before they are modified in place. Blobs no file links
+/// to anymore are removed by Collect().
+///
+class BlobStore {
+ public:
+  /// with dedup disabled files are still unshared before modifications,
+  /// they may have been linked while it was enabled
+  BlobStore(std::filesystem::path root, DedupConfig config = {});
+
+  BlobStore(BlobStore const&) = delete;
+  BlobStore& operator=(BlobStore const&) = delete;
+
+  /// replace @c path with a link to the blob holding @c data, false if dedup
+  /// is disabled or the link failed and the caller has to write the file
+  bool Link(std::filesystem::path const& path, std::string_view data);
+
+  /// give @c path a copy of its data if it is linked to a blob, false if
+  /// the copy failed
+  bool Unshare(std::filesystem::path const& path);
+
+  /// true if @c path shares its data with other files
+  static bool IsShared(std::filesystem::path const& path);
+
+  /// remove the blobs no file links to and recount the stats
+  void Collect();
+
+  DedupStats GetStats() const;
+
+  std::filesystem::path const& GetRootPath() const { return root_; }
+
+ private:
+  /// unique name in the store for a file being written
+  std::filesystem::path TempPath();
+
+  std::filesystem::path const root_;
+  DedupConfig const config_;
+  /// links and copies are made under a shared lock, Collect() removes the
+  /// unlinked blobs and temporary files under an exclusive one
+  std::shared_mutex mutex_;
+  std::atomic<uint64_t> temp_files_{0};
+  Gauge chunks_;
+  Gauge stored_bytes_;
+  Gauge logical_bytes_;
+};
+
+}  // namespace cppfs::storage
@@ -1,26 +1,65 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <format>
-#include <numeric>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <tl/expected.hpp>
 #include <unistd.h>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "dedup.hpp"
 #include "error_types.h"
 #include "partition.hpp"
+#include "reclaimer.hpp"
 
 namespace cppfs::storage {
 
-class InMemoryRegularFile : public RegularFile {
+namespace detail {
+
+/// new version of a file, the tags are unique within the process and, as
+/// they start at the current time, larger than the tags of earlier runs
+inline FileVersion NextVersion() {
+  static std::atomic<uint64_t> next_tag{static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count())};
+  return {.tag = next_tag.fetch_add(1, std::memory_order_relaxed),
+          .modified = std::chrono::system_clock::now()};
+}
+
+}  // namespace detail
+
+class InMemoryRegularFile final : public RegularFile {
  public:
-  explicit InMemoryRegularFile(std::string&& data) : data_(std::move(data)) {}
+  /// with a @c chunk_store the data is kept as a list of chunks shared with
+  /// the other files of the store
+  explicit InMemoryRegularFile(std::string&& data,
+                               UsageTracker* usage = nullptr,
+                               ChunkStore* chunk_store = nullptr)
+      : RegularFile(usage), chunk_store_(chunk_store) {
+    if (chunk_store_ == nullptr) {
+      data_ = std::move(data);
+    } else {
+      AppendChunks(data);
+    }
+  }
+
+  size_t GetSize() const override { return GetDataSize() + 1; }
 
-  size_t GetSize() const override { return data_.size() + 1; }
+  FileVersion GetVersion() const override { return version_; }
 
   ssize_t Seek(size_t offset) override {
     if (offset >= GetSize()) {
@@ -35,7 +74,7 @@ class InMemoryRegularFile : public RegularFile {
     if (offset_ + nbytes > GetSize()) {
       return -1;
     }
-    out << std::string_view{data_}.substr(offset_, nbytes);
+    WriteRange(out, offset_, nbytes);
     return 0;
   }
 
@@ -44,77 +83,384 @@ class InMemoryRegularFile : public RegularFile {
     if (offset + nbytes > GetSize()) {
       return -1;
     }
-    out << std::string_view{data_}.substr(offset, nbytes);
+    WriteRange(out, offset, nbytes);
     return 0;
   }
 
+  tl::expected<void, Error> PositionalWrite(size_t offset,
+                                            std::string_view data) override {
+    size_t const size = GetDataSize();
+    size_t const end = offset + data.size();
+    if (end > size) {
+      if (auto reserved = ReserveBytes(end - size); !reserved) {
+        return tl::unexpected(reserved.error());
+      }
+    }
+    ModifyTail(offset, end, [&](std::string& tail, size_t tail_begin) {
+      if (end - tail_begin > tail.size()) tail.resize(end - tail_begin, '\0');
+      auto const write_begin = static_cast<std::ptrdiff_t>(offset - tail_begin);
+      std::copy(data.begin(), data.end(), tail.begin() + write_begin);
+    });
+    version_ = detail::NextVersion();
+    return {};
+  }
+
+  tl::expected<size_t, Error> Append(std::string_view data) override {
+    size_t const offset = GetDataSize();
+    if (auto written = PositionalWrite(offset, data); !written) {
+      return tl::unexpected(written.error());
+    }
+    return offset;
+  }
+
+  tl::expected<void, Error> Truncate(size_t size) override {
+    size_t const old_size = GetDataSize();
+    if (size > old_size) {
+      if (auto reserved = ReserveBytes(size - old_size); !reserved) {
+        return tl::unexpected(reserved.error());
+      }
+    } else {
+      ReleaseBytes(old_size - size);
+    }
+    ModifyTail(std::min(size, old_size), std::numeric_limits<size_t>::max(),
+               [size](std::string& tail, size_t tail_begin) {
+                 tail.resize(size - tail_begin, '\0');
+               });
+    version_ = detail::NextVersion();
+    return {};
+  }
+
  private:
+  size_t GetDataSize() const {
+    if (chunk_store_ == nullptr) return data_.size();
+    return chunk_ends_.empty() ? 0 : chunk_ends_.back();
+  }
+
+  /// index of the chunk containing @c offset
+  size_t FindChunk(size_t offset) const {
+    return static_cast<size_t>(
+        std::upper_bound(chunk_ends_.begin(), chunk_ends_.end(), offset) -
+        chunk_ends_.begin());
+  }
+
+  void WriteRange(std::ostream& out, size_t offset, size_t nbytes) const {
+    if (chunk_store_ == nullptr) {
+      out << std::string_view{data_}.substr(offset, nbytes);
+      return;
+    }
+    for (size_t i = FindChunk(offset); i < chunks_.size() && nbytes > 0; ++i) {
+      size_t const chunk_begin = i == 0 ? 0 : chunk_ends_[i - 1];
+      std::string_view const part =
+          std::string_view{*chunks_[i]}.substr(offset - chunk_begin, nbytes);
+      out << part;
+      offset += part.size();
+      nbytes -= part.size();
+    }
+  }
+
+  /// call @c modify(tail, tail_begin) with the data from @c tail_begin <=
+  /// @c offset on, the whole data of a file without chunks. @c modify may
+  /// only change the data in [@c offset, @c end) and past its end. Chunked
+  /// data is split again from the chunk containing @c offset until a
+  /// boundary past @c end lines up with an old one, the chunks before and
+  /// after keep their boundaries.
+  template <typename Modify>
+  void ModifyTail(size_t offset, size_t end, Modify modify) {
+    if (chunk_store_ == nullptr) {
+      modify(data_, 0);
+      return;
+    }
+    /* the last chunk ends with the data rather than at a boundary, appends
+       continue it */
+    size_t const old_chunks = chunks_.size();
+    size_t const first =
+        std::min(FindChunk(offset), old_chunks == 0 ? 0 : old_chunks - 1);
+    size_t const tail_begin = first == 0 ? 0 : chunk_ends_[first - 1];
+    size_t next = std::min(std::max(FindChunk(end), first) + 1, old_chunks);
+    std::string tail;
+    for (size_t i = first; i < next; ++i) tail += *chunks_[i];
+    modify(tail, tail_begin);
+
+    /* boundaries depend on the data since the previous one only, once a
+       boundary past the modified data is an old one the old chunks follow */
+    size_t kept = old_chunks;
+    size_t split = tail.size();
+    size_t split_from = 0;
+    while (true) {
+      bool const at_end = next == old_chunks;
+      std::vector<std::string_view> const chunks =
+          SplitChunks(std::string_view{tail}.substr(split_from));
+      size_t boundary = split_from;
+      for (size_t i = 0; i < chunks.size() && kept == old_chunks; ++i) {
+        /* the last chunk may end with the tail rather than at a boundary */
+        if (i + 1 == chunks.size() && !at_end) break;
+        boundary += chunks[i].size();
+        size_t const position = tail_begin + boundary;
+        auto const old_ends =
+            std::span{chunk_ends_}.subspan(first, next - first);
+        auto const old = std::ranges::lower_bound(old_ends, position);
+        if (position >= end && old != old_ends.end() && *old == position) {
+          kept = first + static_cast<size_t>(old - old_ends.begin()) + 1;
+          split = boundary;
+        }
+      }
+      if (at_end || kept != old_chunks) break;
+      split_from = boundary;
+      tail += *chunks_[next++];
+    }
+
+    std::vector<ChunkStore::Chunk> split_chunks =
+        chunk_store_->Store(std::string_view{tail}.substr(0, split));
+    auto const kept_begin = static_cast<std::ptrdiff_t>(kept);
+    std::vector<ChunkStore::Chunk> kept_chunks(
+        std::make_move_iterator(chunks_.begin() + kept_begin),
+        std::make_move_iterator(chunks_.end()));
+    std::vector<size_t> const kept_ends(chunk_ends_.begin() + kept_begin,
+                                        chunk_ends_.end());
+    chunks_.resize(first);
+    chunk_ends_.resize(first);
+    size_t chunk_end = tail_begin;
+    for (ChunkStore::Chunk& chunk : split_chunks) {
+      chunk_end += chunk->size();
+      chunk_ends_.push_back(chunk_end);
+      chunks_.push_back(std::move(chunk));
+    }
+    chunks_.insert(chunks_.end(), std::make_move_iterator(kept_chunks.begin()),
+                   std::make_move_iterator(kept_chunks.end()));
+    chunk_ends_.insert(chunk_ends_.end(), kept_ends.begin(), kept_ends.end());
+  }
+
+  void AppendChunks(std::string_view data) {
+    size_t end = GetDataSize();
+    for (ChunkStore::Chunk& chunk : chunk_store_->Store(data)) {
+      end += chunk->size();
+      chunk_ends_.push_back(end);
+      chunks_.push_back(std::move(chunk));
+    }
+  }
+
+  ChunkStore* chunk_store_;
+  /// data of a file without chunk store
   std::string data_;
+  std::vector<ChunkStore::Chunk> chunks_;
+  /// offset of the end of every chunk
+  std::vector<size_t> chunk_ends_;
   size_t offset_{};
+  FileVersion version_{detail::NextVersion()};
 };
 
-class InMemoryDirectory : public Directory {
+///
+/// Directory kept in flat arrays: the names of the entries in one string
+/// pool, the entries in a packed array in creation order and an
+/// open-addressing table of entry indices for lookups by name. A listing is
+/// a linear scan of the array. An entry costs its name, 24 bytes and about
+/// two 4-byte slots of the table on top of the child itself.
+///
+class InMemoryDirectory final : public Directory {
  public:
-  explicit InMemoryDirectory() = default;
+  /// @c usage of the partition the directory belongs to, nullptr for a
+  /// standalone directory. Files are deduplicated in @c chunk_store, if any.
+  /// New entries are added to @c index and recorded in @c watch, if any,
+  /// under @c path, the path of the directory from the partition root.
+  explicit InMemoryDirectory(UsageTracker* usage = nullptr,
+                             ChunkStore* chunk_store = nullptr,
+                             NameIndex* index = nullptr,
+                             WatchLog* watch = nullptr,
+                             std::string path = "/")
+      : usage_(usage),
+        chunk_store_(chunk_store),
+        index_(index),
+        watch_(watch),
+        path_(std::move(path)) {}
 
   tl::expected<RegularFile*, Error> StoreRegularFile(
       std::string const& name, std::string&& data) override {
-    auto reg_file_unique =
-        std::make_unique<InMemoryRegularFile>(std::move(data));
-    auto reg_file_ptr = reg_file_unique.get();
-    auto [it, inserted] = entries_.emplace(name, std::move(reg_file_unique));
-    if (!inserted)
-      return tl::unexpected(
-          Error{ErrorEnum::kAlreadyExists,
-                std::format("Cannot store regular file '{}'", name)});
+    if (auto checked = CheckNewEntry(name, "regular file"); !checked) {
+      return tl::unexpected(checked.error());
+    }
+    if (auto reserved = Reserve({.bytes = data.size(), .files = 1});
+        !reserved) {
+      return tl::unexpected(reserved.error());
+    }
 
+    auto reg_file_unique = std::make_unique<InMemoryRegularFile>(
+        std::move(data), usage_, chunk_store_);
+    auto reg_file_ptr = reg_file_unique.get();
+    AddEntry(name, FileType::Regular, std::move(reg_file_unique));
+    version_ = detail::NextVersion();
+    std::string path = JoinIndexPath(path_, name);
+    if (index_ != nullptr) index_->Add(path, FileType::Regular);
+    if (watch_ != nullptr) {
+      watch_->Record(WatchEvent::Kind::kStoreRegularFile, std::move(path));
+    }
     return reg_file_ptr;
   }
 
   tl::expected<Directory*, Error> CreateDirectory(
       std::string const& name) override {
-    auto dir_unique = std::make_unique<InMemoryDirectory>();
-    auto dir_ptr = dir_unique.get();
-    auto [it, inserted] = entries_.emplace(name, std::move(dir_unique));
-    if (!inserted)
-      return tl::unexpected(
-          Error{ErrorEnum::kAlreadyExists,
-                std::format("Cannot store directory '{}'", name)});
+    if (auto checked = CheckNewEntry(name, "directory"); !checked) {
+      return tl::unexpected(checked.error());
+    }
+    if (auto reserved = Reserve({.directories = 1}); !reserved) {
+      return tl::unexpected(reserved.error());
+    }
 
+    std::string path = JoinIndexPath(path_, name);
+    if (index_ != nullptr) index_->Add(path, FileType::Directory);
+    if (watch_ != nullptr) {
+      watch_->Record(WatchEvent::Kind::kCreateDirectory, path);
+    }
+    auto dir_unique = std::make_unique<InMemoryDirectory>(
+        usage_, chunk_store_, index_, watch_, std::move(path));
+    auto dir_ptr = dir_unique.get();
+    AddEntry(name, FileType::Directory, std::move(dir_unique));
+    version_ = detail::NextVersion();
     return dir_ptr;
   }
 
   std::vector<DirEntry> GetDirEntries() const override {
     std::vector<DirEntry> entries;
     entries.reserve(entries_.size());
-    std::transform(entries_.cbegin(), entries_.cend(),
-                   std::back_inserter(entries), [](auto const& entry) {
-                     auto const& [name, file] = entry;
-                     return DirEntry{name, file->GetType(), file->GetSize()};
-                   });
+    for (Entry const& entry : entries_) {
+      entries.push_back(
+          {std::string{GetName(entry)}, entry.type, GetEntrySize(entry)});
+    }
     return entries;
   }
 
-  std::unordered_map<std::string, std::unique_ptr<File>> const&
-  GetInMemoryEntries() const {
-    return entries_;
-  };
+  /// the listing changes with the entries, the sizes of the files and the
+  /// entries of the subdirectories
+  FileVersion GetVersion() const override {
+    FileVersion version = version_;
+    for (Entry const& entry : entries_) {
+      FileVersion const entry_version =
+          entry.type == FileType::Regular
+              ? static_cast<InMemoryRegularFile const*>(entry.file.get())
+                    ->GetVersion()
+              : static_cast<InMemoryDirectory const*>(entry.file.get())
+                    ->version_;
+      if (entry_version.tag > version.tag) version = entry_version;
+    }
+    return version;
+  }
 
+  /// entry @c name, nullptr if there is none
+  File* Lookup(std::string_view name) const {
+    if (slots_.empty()) return nullptr;
+    size_t const mask = slots_.size() - 1;
+    for (size_t slot = HashName(name) & mask;; slot = (slot + 1) & mask) {
+      uint32_t const index = slots_[slot];
+      if (index == kEmptySlot) return nullptr;
+      if (GetName(entries_[index]) == name) return entries_[index].file.get();
+    }
+  }
+
+  /// memory held by the directory itself, not by its entries
   size_t GetSize() const override {
-    return std::accumulate(entries_.cbegin(), entries_.cend(), 0UL,
-                           [](size_t acc, auto const& entry) {
-                             auto const& [name, file] = entry;
-                             return acc + name.capacity() + sizeof(file);
-                           });
+    return names_.capacity() + entries_.capacity() * sizeof(Entry) +
+           slots_.capacity() * sizeof(uint32_t);
   }
 
  private:
-  std::unordered_map<std::string, std::unique_ptr<File>> entries_{};
+  struct Entry {
+    /// name in the pool
+    uint32_t name_offset;
+    uint32_t name_size;
+    FileType type;
+    /// an InMemoryRegularFile or InMemoryDirectory, as per @c type
+    std::unique_ptr<File> file;
+  };
+
+  /// the pool and the entries are indexed with 32 bits, this one is free
+  static constexpr uint32_t kEmptySlot = std::numeric_limits<uint32_t>::max();
+  static constexpr size_t kMinSlots = 8;
+
+  static size_t HashName(std::string_view name) {
+    return std::hash<std::string_view>{}(name);
+  }
+
+  /// the children are of known final types, their sizes are read without
+  /// virtual calls
+  static size_t GetEntrySize(Entry const& entry) {
+    if (entry.type == FileType::Regular) {
+      return static_cast<InMemoryRegularFile const*>(entry.file.get())
+          ->GetSize();
+    }
+    return static_cast<InMemoryDirectory const*>(entry.file.get())->GetSize();
+  }
+
+  std::string_view GetName(Entry const& entry) const {
+    return std::string_view{names_}.substr(entry.name_offset, entry.name_size);
+  }
+
+  tl::expected<void, Error> CheckNewEntry(std::string const& name,
+                                          std::string_view what) const {
+    if (Lookup(name) != nullptr) {
+      return tl::unexpected(
+          Error{ErrorEnum::kAlreadyExists,
+                std::format("Cannot store {} '{}'", what, name)});
+    }
+    if (names_.size() + name.size() > kEmptySlot ||
+        entries_.size() + 1 >= kEmptySlot) {
+      return tl::unexpected(
+          Error{ErrorEnum::kOutOfMemory,
+                std::format("Directory is full, cannot store {} '{}'", what,
+                            name)});
+    }
+    return {};
+  }
+
+  void AddEntry(std::string_view name, FileType type,
+                std::unique_ptr<File> file) {
+    /* at most 3/4 of the slots are used, probes stay short */
+    if (4 * (entries_.size() + 1) > 3 * slots_.size()) {
+      Rehash(std::max(2 * slots_.size(), kMinSlots));
+    }
+    entries_.push_back({.name_offset = static_cast<uint32_t>(names_.size()),
+                        .name_size = static_cast<uint32_t>(name.size()),
+                        .type = type,
+                        .file = std::move(file)});
+    names_ += name;
+    Insert(static_cast<uint32_t>(entries_.size() - 1));
+  }
+
+  void Insert(uint32_t index) {
+    size_t const mask = slots_.size() - 1;
+    size_t slot = HashName(GetName(entries_[index])) & mask;
+    while (slots_[slot] != kEmptySlot) slot = (slot + 1) & mask;
+    slots_[slot] = index;
+  }
+
+  void Rehash(size_t slot_count) {
+    slots_.assign(slot_count, kEmptySlot);
+    for (uint32_t index = 0; index < entries_.size(); ++index) Insert(index);
+  }
+
+  tl::expected<void, Error> Reserve(Usage const& delta) {
+    if (usage_ == nullptr) return {};
+    return usage_->Reserve(delta);
+  }
+
+  UsageTracker* usage_;
+  ChunkStore* chunk_store_;
+  NameIndex* index_;
+  WatchLog* watch_;
+  std::string path_;
+  /// names of the entries, back to back
+  std::string names_;
+  std::vector<Entry> entries_;
+  /// indices into @c entries_ by the hash of the name, a power of two
+  std::vector<uint32_t> slots_;
+  /// changes with the entries
+  FileVersion version_{detail::NextVersion()};
 };
 
 class InMemoryPartition final : public Partition {
  public:
-  explicit InMemoryPartition() = default;
+  explicit InMemoryPartition(Quota quota = {}, NodeUsage* node_usage = nullptr,
+                             ChunkStore* chunk_store = nullptr)
+      : Partition(quota, node_usage),
+        root_(&GetUsage(), chunk_store, &GetNameIndex(), &GetWatchLog()) {}
 
   tl::expected<File*, Error> Open(std::filesystem::path const& path) override {
     if (path.is_absolute()) {
@@ -135,18 +481,17 @@ class InMemoryPartition final : public Partition {
     }
 
     for (auto it = path.begin(); it != path.end(); ++it) {
-      for (auto const& [name, file] : dir->GetInMemoryEntries()) {
-        if (name != it->string()) continue;
-        if (std::next(it) == path.end()) return file.get();
-        if (file->GetType() == FileType::Regular) {
-          return tl::unexpected(Error{
-              ErrorEnum::kDirectory,
-              std::format("Expected directory, but received regular file '{}'",
-                          name)});
-        }
-        dir = static_cast<InMemoryDirectory*>(file.get());
-        break;
+      std::string const name = it->string();
+      File* file = dir->Lookup(name);
+      if (file == nullptr) break;
+      if (std::next(it) == path.end()) return file;
+      if (file->GetType() == FileType::Regular) {
+        return tl::unexpected(Error{
+            ErrorEnum::kDirectory,
+            std::format("Expected directory, but received regular file '{}'",
+                        name)});
       }
+      dir = static_cast<InMemoryDirectory*>(file);
     }
     return tl::unexpected(
         Error{ErrorEnum::kNotFound,
@@ -154,35 +499,99 @@ class InMemoryPartition final : public Partition {
   }
 
  private:
-  InMemoryDirectory root_{};
+  InMemoryDirectory root_;
 };
 
 class InMemoryPartitionManager final : public PartitionManager {
  public:
-  bool ContainsPartition(std::string const& uuid) const final {
-    return partitions_.contains(uuid);
+  static constexpr auto kName = "in_memory";
+  /// partitions and files aren't locked, mutations must not run
+  /// concurrently with other accesses
+  static constexpr bool kThreadSafe = false;
+
+  using PartitionType = InMemoryPartition;
+  using DirectoryType = InMemoryDirectory;
+  using RegularFileType = InMemoryRegularFile;
+
+  /// with dedup enabled identical chunks of the files of all partitions are
+  /// stored once, the quotas still count the bytes of every file
+  explicit InMemoryPartitionManager(UsageLimits const& limits = {},
+                                    ReclaimerConfig const& reclaim = {},
+                                    DedupConfig const& dedup = {})
+      : quota_(limits.partition_quota),
+        node_usage_(limits.node_capacity_bytes, limits.high_watermark),
+        reclaimer_(reclaim) {
+    if (dedup.enabled) chunk_store_.emplace();
   }
 
-  Partition* LookupPartition(std::string const& uuid) final {
-    auto it = partitions_.find(uuid);
+  bool ContainsPartition(PartitionId const& id) const final {
+    return partitions_.contains(id);
+  }
+
+  InMemoryPartition* LookupPartition(PartitionId const& id) final {
+    auto it = partitions_.find(id);
     return it == partitions_.end() ? nullptr : &it->second;
   }
 
   tl::expected<Partition*, Error> CreatePartition(
-      std::string const& uuid) final {
-    assert(!ContainsPartition(uuid));
-    auto [it, _] = partitions_.try_emplace(uuid);
+      PartitionId const& id) final {
+    assert(!ContainsPartition(id));
+    auto [it, _] = partitions_.try_emplace(
+        id, quota_, &node_usage_,
+        chunk_store_.has_value() ? &*chunk_store_ : nullptr);
     return &it->second;
   }
 
-  void DestroyPartition(std::string const& uuid) final {
-    partitions_.erase(uuid);
+  /// the partition is freed in the background
+  void DestroyPartition(PartitionId const& id) final {
+    auto node = partitions_.extract(id);
+    if (node.empty()) return;
+    Usage const usage = node.mapped().GetUsage().GetUsage();
+    reclaimer_.Destroy(std::move(node), usage);
+  }
+
+  std::optional<PartitionId> LookupClient(
+      std::string const& client_id) const final {
+    auto it = clients_.find(client_id);
+    if (it == clients_.end()) return std::nullopt;
+    return it->second;
+  }
+
+  tl::expected<void, Error> BindClient(std::string const& client_id,
+                                       PartitionId const& id) final {
+    clients_.insert_or_assign(client_id, id);
+    return {};
   }
 
-  void Clear() final { partitions_.clear(); }
+  void Clear() final {
+    reclaimer_.Destroy(std::exchange(partitions_, {}), node_usage_.GetUsage());
+    clients_.clear();
+  }
+
+  NodeUsage const& GetNodeUsage() const final { return node_usage_; }
+
+  size_t GetPartitionCount() const final { return partitions_.size(); }
+
+  Reclaimer& GetReclaimer() { return reclaimer_; }
+
+  /// zero without dedup
+  DedupStats GetDedupStats() const {
+    return chunk_store_.has_value() ? chunk_store_->GetStats() : DedupStats{};
+  }
 
  private:
-  std::unordered_map<std::string, InMemoryPartition> partitions_;
+  Quota const quota_;
+  /// declared before the partitions, which release their usage on
+  /// destruction
+  NodeUsage node_usage_;
+  /// outlives the partitions, their files reference its chunks
+  std::optional<ChunkStore> chunk_store_;
+  /// declared after the node usage, partitions still queued release their
+  /// usage when the reclaimer is destroyed
+  Reclaimer reclaimer_;
+  std::unordered_map<PartitionId, InMemoryPartition, PartitionId::Hash>
+      partitions_;
+  std::unordered_map<std::string, PartitionId> clients_;
 };
 
 };  // namespace cppfs::storage
@@ -0,0 +1,269 @@
+#include "partition/manifest.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+
+#include <boost/crc.hpp>
+
+namespace cppfs::storage {
+
+namespace {
+
+/// Record layout (host byte order):
+/// [crc32:u32][op:u8][table:u8][key_len:u16][value_len:u32][key][value]
+/// The checksum covers everything after the crc field.
+constexpr size_t kCrcSize = sizeof(uint32_t);
+constexpr size_t kHeaderSize =
+    kCrcSize + 2 * sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t);
+
+uint32_t Checksum(char const* data, size_t size) {
+  boost::crc_32_type crc;
+  crc.process_bytes(data, size);
+  return crc.checksum();
+}
+
+template <typename T>
+T LoadAt(std::string const& buffer, size_t offset) {
+  T value;
+  std::memcpy(&value, buffer.data() + offset, sizeof(T));
+  return value;
+}
+
+template <typename T>
+void StoreAt(std::string& buffer, size_t offset, T value) {
+  std::memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+Error ErrnoError(std::string_view what, std::filesystem::path const& path) {
+  return Error{ErrorEnum::kInternalServerError,
+               std::format("Manifest {} failed for '{}': {}", what,
+                           path.string(), std::strerror(errno))};
+}
+
+tl::expected<void, Error> WriteAll(int fd, std::string const& data,
+                                   std::filesystem::path const& path) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t const rc =
+        ::write(fd, data.data() + written, data.size() - written);
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      return tl::unexpected(ErrnoError("write", path));
+    }
+    written += static_cast<size_t>(rc);
+  }
+  if (::fdatasync(fd) != 0) {
+    return tl::unexpected(ErrnoError("fdatasync", path));
+  }
+  return {};
+}
+
+}  // namespace
+
+Manifest::Manifest(std::filesystem::path path) : path_(std::move(path)) {
+  Load();
+  fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "cannot open manifest " + path_.string());
+  }
+  if (auto compacted = CompactLocked(); !compacted) {
+    throw std::runtime_error(compacted.error().message);
+  }
+}
+
+Manifest::~Manifest() {
+  if (fd_ >= 0) ::close(fd_);
+}
+
+bool Manifest::Contains(Table table, std::string_view key) const {
+  std::shared_lock const lock{mutex_};
+  return GetIndex(table).contains(std::string{key});
+}
+
+std::optional<std::string> Manifest::Get(Table table,
+                                         std::string_view key) const {
+  std::shared_lock const lock{mutex_};
+  Index const& index = GetIndex(table);
+  auto it = index.find(std::string{key});
+  if (it == index.end()) return std::nullopt;
+  return it->second;
+}
+
+size_t Manifest::Size(Table table) const {
+  std::shared_lock const lock{mutex_};
+  return GetIndex(table).size();
+}
+
+void Manifest::ForEach(
+    Table table, std::function<void(std::string const& key,
+                                    std::string const& value)> const& fn) const {
+  std::shared_lock const lock{mutex_};
+  for (auto const& [key, value] : GetIndex(table)) fn(key, value);
+}
+
+tl::expected<void, Error> Manifest::Put(Table table, std::string_view key,
+                                        std::string_view value) {
+  if (key.size() > std::numeric_limits<uint16_t>::max() ||
+      value.size() > std::numeric_limits<uint32_t>::max()) {
+    return tl::unexpected(Error{
+        ErrorEnum::kInvalidInput,
+        std::format("Manifest record is too large (key: {}, value: {})",
+                    key.size(), value.size())});
+  }
+  std::string const record = EncodeRecord(Op::kPut, table, key, value);
+  std::unique_lock const lock{mutex_};
+  if (auto appended = Append(record); !appended) return appended;
+  GetIndex(table).insert_or_assign(std::string{key}, std::string{value});
+  /* compaction is best-effort: the record above is already durable */
+  static_cast<void>(CompactLocked());
+  return {};
+}
+
+tl::expected<void, Error> Manifest::Erase(Table table, std::string_view key) {
+  std::string const record = EncodeRecord(Op::kErase, table, key, {});
+  std::unique_lock const lock{mutex_};
+  Index& index = GetIndex(table);
+  auto it = index.find(std::string{key});
+  if (it == index.end()) return {};
+  if (auto appended = Append(record); !appended) return appended;
+  index.erase(it);
+  static_cast<void>(CompactLocked());
+  return {};
+}
+
+tl::expected<void, Error> Manifest::Clear() {
+  std::unique_lock const lock{mutex_};
+  for (Index& index : tables_) index.clear();
+  return RewriteLocked();
+}
+
+size_t Manifest::GetRecordCount() const {
+  std::shared_lock const lock{mutex_};
+  return records_;
+}
+
+std::string Manifest::EncodeRecord(Op op, Table table, std::string_view key,
+                                   std::string_view value) {
+  std::string record(kHeaderSize + key.size() + value.size(), '\0');
+  StoreAt(record, kCrcSize, static_cast<uint8_t>(op));
+  StoreAt(record, kCrcSize + 1, static_cast<uint8_t>(table));
+  StoreAt(record, kCrcSize + 2, static_cast<uint16_t>(key.size()));
+  StoreAt(record, kCrcSize + 4, static_cast<uint32_t>(value.size()));
+  std::copy(key.begin(), key.end(), record.begin() + kHeaderSize);
+  std::copy(value.begin(), value.end(),
+            record.begin() + static_cast<std::ptrdiff_t>(kHeaderSize +
+                                                         key.size()));
+  StoreAt(record, 0,
+          Checksum(record.data() + kCrcSize, record.size() - kCrcSize));
+  return record;
+}
+
+size_t Manifest::LiveRecordCount() const {
+  size_t live = 0;
+  for (Index const& index : tables_) live += index.size();
+  return live;
+}
+
+void Manifest::Load() {
+  std::string buffer;
+  {
+    std::ifstream file(path_, std::ios::binary);
+    if (!file) return;
+    buffer.assign(std::istreambuf_iterator<char>(file),
+                  std::istreambuf_iterator<char>());
+  }
+
+  size_t offset = 0;
+  while (offset + kHeaderSize <= buffer.size()) {
+    auto const op = static_cast<Op>(LoadAt<uint8_t>(buffer, offset + kCrcSize));
+    auto const table = LoadAt<uint8_t>(buffer, offset + kCrcSize + 1);
+    auto const key_len = LoadAt<uint16_t>(buffer, offset + kCrcSize + 2);
+    auto const value_len = LoadAt<uint32_t>(buffer, offset + kCrcSize + 4);
+    size_t const record_size = kHeaderSize + key_len + value_len;
+    if (offset + record_size > buffer.size()) break;
+    if (Checksum(buffer.data() + offset + kCrcSize, record_size - kCrcSize) !=
+        LoadAt<uint32_t>(buffer, offset)) {
+      break;
+    }
+    if (table >= kTablesCount || (op != Op::kPut && op != Op::kErase)) break;
+
+    std::string key = buffer.substr(offset + kHeaderSize, key_len);
+    Index& index = tables_[table];
+    if (op == Op::kPut) {
+      index.insert_or_assign(
+          std::move(key),
+          buffer.substr(offset + kHeaderSize + key_len, value_len));
+    } else {
+      index.erase(key);
+    }
+    ++records_;
+    offset += record_size;
+  }
+
+  if (offset != buffer.size()) {
+    /* drop the torn tail so that new records are appended after valid ones */
+    std::filesystem::resize_file(path_, offset);
+  }
+}
+
+tl::expected<void, Error> Manifest::Append(std::string const& record) {
+  if (auto written = WriteAll(fd_, record, path_); !written) return written;
+  ++records_;
+  return {};
+}
+
+tl::expected<void, Error> Manifest::CompactLocked() {
+  size_t const live = LiveRecordCount();
+  if (records_ < kCompactionMinRecords || records_ < 2 * live) return {};
+  return RewriteLocked();
+}
+
+tl::expected<void, Error> Manifest::RewriteLocked() {
+  std::string snapshot;
+  for (size_t table = 0; table < kTablesCount; ++table) {
+    for (auto const& [key, value] : tables_[table]) {
+      snapshot += EncodeRecord(Op::kPut, static_cast<Table>(table), key, value);
+    }
+  }
+
+  std::filesystem::path tmp_path = path_;
+  tmp_path += ".tmp";
+  int const tmp_fd = ::open(tmp_path.c_str(),
+                            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (tmp_fd < 0) return tl::unexpected(ErrnoError("compaction", tmp_path));
+  if (auto written = WriteAll(tmp_fd, snapshot, tmp_path); !written) {
+    ::close(tmp_fd);
+    return written;
+  }
+  ::close(tmp_fd);
+
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path_, ec);
+  if (ec) {
+    return tl::unexpected(
+        Error{ErrorEnum::kInternalServerError,
+              std::format("Manifest compaction failed for '{}': {}",
+                          path_.string(), ec.message())});
+  }
+
+  int const fd =
+      ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) return tl::unexpected(ErrnoError("open", path_));
+  ::close(fd_);
+  fd_ = fd;
+  records_ = LiveRecordCount();
+  return {};
+}
+
+}  // namespace cppfs::storage
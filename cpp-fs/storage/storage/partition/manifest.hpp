@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+#include <unordered_map>
+
+#include "error_types.h"
+
+namespace cppfs::storage {
+
+///
+/// Small embedded key/value log that persists partition manager metadata.
+///
+/// Every mutation is appended to the log as a single record and applied to
+/// an in-memory hash index, so lookups never touch the filesystem. The log is
+/// replayed on startup; a torn or corrupted tail (e.g. after a crash in the
+/// middle of an append) is truncated. Once the log grows much larger than the
+/// live data it is compacted into a fresh snapshot.
+///
+class Manifest {
+ public:
+  /// Independent key spaces stored in the same log
+  enum class Table : uint8_t {
+    kPartitions = 0,
+    kClients = 1,
+  };
+
+  /// open manifest at @c path, creating an empty one if it doesn't exist
+  explicit Manifest(std::filesystem::path path);
+  ~Manifest();
+
+  Manifest(Manifest const&) = delete;
+  Manifest& operator=(Manifest const&) = delete;
+
+  bool Contains(Table table, std::string_view key) const;
+  std::optional<std::string> Get(Table table, std::string_view key) const;
+  size_t Size(Table table) const;
+
+  void ForEach(Table table,
+               std::function<void(std::string const& key,
+                                  std::string const& value)> const& fn) const;
+
+  /// insert or overwrite @c key and persist the change
+  tl::expected<void, Error> Put(Table table, std::string_view key,
+                                std::string_view value = {});
+  /// erase @c key and persist the change, no-op if @c key is absent
+  tl::expected<void, Error> Erase(Table table, std::string_view key);
+  /// erase every key of every table, the log is rewritten empty
+  tl::expected<void, Error> Clear();
+
+  /// number of records in the log, including overwritten and erased ones
+  size_t GetRecordCount() const;
+
+  std::filesystem::path const& GetPath() const { return path_; }
+
+ private:
+  enum class Op : uint8_t {
+    kPut = 1,
+    kErase = 2,
+  };
+
+  using Index = std::unordered_map<std::string, std::string>;
+
+  static constexpr size_t kTablesCount = 2;
+  /// don't bother compacting tiny logs
+  static constexpr size_t kCompactionMinRecords = 1024;
+
+  static std::string EncodeRecord(Op op, Table table, std::string_view key,
+                                  std::string_view value);
+
+  Index& GetIndex(Table table) { return tables_[static_cast<size_t>(table)]; }
+
+  Index const& GetIndex(Table table) const {
+    return tables_[static_cast<size_t>(table)];
+  }
+
+  size_t LiveRecordCount() const;
+  void Load();
+  tl::expected<void, Error> Append(std::string const& record);
+  tl::expected<void, Error> CompactLocked();
+  /// replace the log with a snapshot of the live records
+  tl::expected<void, Error> RewriteLocked();
+
+  std::filesystem::path path_;
+  int fd_{-1};
+  size_t records_{0};
+  Index tables_[kTablesCount];
+  mutable std::shared_mutex mutex_;
+};
+
+}  // namespace cppfs::storage
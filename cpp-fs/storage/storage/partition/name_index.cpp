@@ -0,0 +1,132 @@
+#include "partition/name_index.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+namespace cppfs::storage {
+
+namespace {
+
+/// match the pattern element at @c pos against @c c, @c pos is moved past
+/// the element on a match
+bool MatchElement(std::string_view pattern, size_t& pos, char c) {
+  char const element = pattern[pos];
+  if (element == '?') {
+    ++pos;
+    return true;
+  }
+  if (element == '\\' && pos + 1 < pattern.size()) {
+    if (pattern[pos + 1] != c) return false;
+    pos += 2;
+    return true;
+  }
+  if (element == '[') {
+    size_t i = pos + 1;
+    bool const negated =
+        i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+    if (negated) ++i;
+    size_t const first = i;
+    bool matched = false;
+    /* a ']' right after the '[' is part of the set */
+    for (; i < pattern.size() && (pattern[i] != ']' || i == first); ++i) {
+      char const low = pattern[i];
+      char high = low;
+      if (i + 2 < pattern.size() && pattern[i + 1] == '-' &&
+          pattern[i + 2] != ']') {
+        high = pattern[i + 2];
+        i += 2;
+      }
+      if (low <= c && c <= high) matched = true;
+    }
+    if (i < pattern.size()) {
+      if (matched == negated) return false;
+      pos = i + 1;
+      return true;
+    }
+    /* an unterminated set is a literal '[' */
+  }
+  if (element != c) return false;
+  ++pos;
+  return true;
+}
+
+/// the part of @c pattern before its first special character, all matching
+/// names start with it
+std::string_view LiteralPrefix(std::string_view pattern) {
+  return pattern.substr(0, std::min(pattern.find_first_of("*?[\\"),
+                                    pattern.size()));
+}
+
+std::string_view FileName(std::string_view path) {
+  size_t const slash = path.rfind('/');
+  return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+}  // namespace
+
+bool GlobMatch(std::string_view pattern, std::string_view name) {
+  size_t pos = 0;
+  size_t matched = 0;
+  /* on a mismatch the last star takes one more character and the rest of
+     the pattern is matched again from there */
+  size_t star = std::string_view::npos;
+  size_t star_matched = 0;
+  while (matched < name.size()) {
+    if (pos < pattern.size()) {
+      if (pattern[pos] == '*') {
+        star = ++pos;
+        star_matched = matched;
+        continue;
+      }
+      if (MatchElement(pattern, pos, name[matched])) {
+        ++matched;
+        continue;
+      }
+    }
+    if (star == std::string_view::npos) return false;
+    pos = star;
+    matched = ++star_matched;
+  }
+  while (pos < pattern.size() && pattern[pos] == '*') ++pos;
+  return pos == pattern.size();
+}
+
+void NameIndex::Add(std::string_view path, FileType type) {
+  Key key{std::string{FileName(path)}, std::string{path}};
+  std::unique_lock const lock{mutex_};
+  entries_.try_emplace(std::move(key), type);
+}
+
+NameIndex::Page NameIndex::Find(Query const& query) const {
+  bool const is_glob = !query.glob.empty();
+  std::string_view const prefix =
+      is_glob ? LiteralPrefix(query.glob) : std::string_view{query.prefix};
+  size_t const limit = std::max<size_t>(query.limit, 1);
+
+  std::shared_lock const lock{mutex_};
+  auto it = entries_.lower_bound(Key{std::string{prefix}, {}});
+  if (!query.after.empty()) {
+    Key const after{std::string{FileName(query.after)}, query.after};
+    if (it != entries_.end() && !(after < it->first)) {
+      it = entries_.upper_bound(after);
+    }
+  }
+
+  Page page;
+  for (; it != entries_.end() && it->first.first.starts_with(prefix); ++it) {
+    if (is_glob && !GlobMatch(query.glob, it->first.first)) continue;
+    if (page.entries.size() == limit) {
+      page.next = page.entries.back().path;
+      break;
+    }
+    page.entries.push_back({.path = it->first.second, .type = it->second});
+  }
+  return page;
+}
+
+size_t NameIndex::GetSize() const {
+  std::shared_lock const lock{mutex_};
+  return entries_.size();
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cppfs::storage {
+
+/// see partition.hpp, which includes this header
+enum class FileType;
+
+/// true if @c name matches the shell pattern @c pattern: `*` matches any
+/// characters, `?` a single one, `[abc]`, `[a-z]` and `[!a-z]` one of a set,
+/// `\` escapes the next character
+bool GlobMatch(std::string_view pattern, std::string_view name);
+
+///
+/// Index of the files of a partition by name, for searches over the whole
+/// tree without walking it.
+///
+/// Entries are sorted by name and path, so a prefix query is a range scan
+/// and a glob query scans the range of its literal prefix. The directories
+/// of a partition add their entries as they are created, the on-disk
+/// backend indexes the existing files when it loads a partition.
+///
+class NameIndex {
+ public:
+  struct Entry {
+    /// path from the partition root, e.g. `/dir/file`
+    std::string path;
+    FileType type;
+  };
+
+  struct Query {
+    /// names starting with @c prefix, ignored if @c glob is set
+    std::string prefix{};
+    /// names matching a shell pattern
+    std::string glob{};
+    /// continue after the entry with this path, from the previous page
+    std::string after{};
+    size_t limit{100};
+  };
+
+  struct Page {
+    std::vector<Entry> entries;
+    /// `after` of the next page, empty on the last page
+    std::string next;
+  };
+
+  /// index @c path, a path from the partition root; adding it again is a
+  /// no-op
+  void Add(std::string_view path, FileType type);
+
+  Page Find(Query const& query) const;
+
+  size_t GetSize() const;
+
+ private:
+  /// name, path
+  using Key = std::pair<std::string, std::string>;
+
+  mutable std::shared_mutex mutex_;
+  std::map<Key, FileType> entries_;
+};
+
+/// path of the entry @c name in the directory with path @c dir_path
+inline std::string JoinIndexPath(std::string_view dir_path,
+                                 std::string_view name) {
+  std::string path{dir_path};
+  if (!path.ends_with('/')) path += '/';
+  path += name;
+  return path;
+}
+
+}  // namespace cppfs::storage
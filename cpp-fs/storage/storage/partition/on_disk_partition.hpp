@@ -1,26 +1,122 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
 #include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <sys/stat.h>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <tl/expected.hpp>
 #include <unistd.h>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "checksum.hpp"
+#include "dedup.hpp"
 #include "error_types.h"
+#include "manifest.hpp"
+#include "metrics/metrics.hpp"
 #include "partition.hpp"
+#include "reclaimer.hpp"
+#include "scrubber.hpp"
+#include "usage.hpp"
 
 namespace cppfs::storage {
 
-class OnDiskRegularFile : public RegularFile {
+namespace detail {
+
+/// write all of @c data to @c fd at @c offset, at the file offset of @c fd
+/// if @c offset is negative
+inline bool WriteAll(int fd, std::string_view data, off_t offset = -1) {
+  while (!data.empty()) {
+    ssize_t const rc =
+        offset < 0 ? ::write(fd, data.data(), data.size())
+                   : ::pwrite(fd, data.data(), data.size(), offset);
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data.remove_prefix(static_cast<size_t>(rc));
+    if (offset >= 0) offset += rc;
+  }
+  return true;
+}
+
+/// set the modification time of @c path to the precise current time, the
+/// kernel stamps writes with a coarse clock and the time is part of the
+/// version of the file
+inline void TouchFile(std::filesystem::path const& path) {
+  struct timespec now{};
+  ::clock_gettime(CLOCK_REALTIME, &now);
+  struct timespec const times[2] = {{.tv_sec = 0, .tv_nsec = UTIME_OMIT},
+                                    now};
+  static_cast<void>(::utimensat(AT_FDCWD, path.c_str(), times, 0));
+}
+
+inline uint64_t MixVersion(uint64_t tag, uint64_t value) {
+  tag ^= value + 0x9e3779b97f4a7c15 + (tag << 6) + (tag >> 2);
+  tag ^= tag >> 31;
+  return tag * 0xbf58476d1ce4e5b9;
+}
+
+/// fold the metadata of a file into @c version, the tag changes whenever the
+/// file is replaced, resized or written to
+inline void AddStatVersion(FileVersion& version, struct stat const& st) {
+  std::chrono::system_clock::time_point const modified{
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::seconds{st.st_mtim.tv_sec} +
+          std::chrono::nanoseconds{st.st_mtim.tv_nsec})};
+  version.tag = MixVersion(version.tag, static_cast<uint64_t>(st.st_ino));
+  version.tag = MixVersion(version.tag, static_cast<uint64_t>(st.st_size));
+  version.tag = MixVersion(
+      version.tag, static_cast<uint64_t>(modified.time_since_epoch().count()));
+  version.modified = std::max(version.modified, modified);
+}
+
+}  // namespace detail
+
+class OnDiskRegularFile final : public RegularFile {
  public:
-  explicit OnDiskRegularFile(std::filesystem::path path)
-      : file_path_(std::move(path)) {}
+  /// @c checksums_path is the sidecar with the block checksums of the file,
+  /// empty for a file without checksums. A file linked to a blob of
+  /// @c blobs is unshared before it is modified.
+  explicit OnDiskRegularFile(std::filesystem::path path,
+                             UsageTracker* usage = nullptr,
+                             std::filesystem::path checksums_path = {},
+                             BlobStore* blobs = nullptr)
+      : RegularFile(usage), file_path_(std::move(path)), blobs_(blobs) {
+    if (!checksums_path.empty()) checksums_.emplace(std::move(checksums_path));
+  }
 
   size_t GetSize() const override {
     return std::filesystem::file_size(file_path_);
   }
 
+  /// a single stat() of the file
+  FileVersion GetVersion() const override {
+    FileVersion version;
+    struct stat st{};
+    if (::stat(file_path_.c_str(), &st) == 0) {
+      detail::AddStatVersion(version, st);
+    }
+    return version;
+  }
+
   ssize_t Seek(size_t offset) override {
     if (offset >= GetSize()) {
       return -1;
@@ -31,20 +127,17 @@ class OnDiskRegularFile : public RegularFile {
   }
 
   ssize_t Read(std::ostream& out, size_t nbytes) override {
-    std::ifstream file(file_path_, std::ios::binary);
-    if (!file) return -1;
-
-    file.seekg(static_cast<std::streamoff>(offset_));
-    std::vector<char> buffer(nbytes);
-    file.read(buffer.data(), static_cast<std::streamsize>(nbytes));
-
-    out.write(buffer.data(), file.gcount());
-    offset_ += static_cast<size_t>(file.gcount());
-    return file.gcount();
+    ssize_t const read = PositionalRead(out, offset_, nbytes);
+    if (read > 0) offset_ += static_cast<size_t>(read);
+    return read;
   }
 
+  /// the blocks read are verified against their checksums, a mismatch fails
+  /// the read
   ssize_t PositionalRead(std::ostream& out, size_t offset,
                          size_t nbytes) override {
+    if (checksums_.has_value()) return VerifiedRead(out, offset, nbytes);
+
     std::ifstream file(file_path_, std::ios::binary);
     if (!file) return -1;
 
@@ -56,45 +149,255 @@ class OnDiskRegularFile : public RegularFile {
     return file.gcount();
   }
 
+  tl::expected<void, Error> PositionalWrite(size_t offset,
+                                            std::string_view data) override {
+    if (auto unshared = Unshare(); !unshared) {
+      return tl::unexpected(unshared.error());
+    }
+    size_t const size = GetSize();
+    size_t const end = offset + data.size();
+    size_t const growth = end > size ? end - size : 0;
+    if (auto reserved = ReserveBytes(growth); !reserved) {
+      return tl::unexpected(reserved.error());
+    }
+
+    /* read back to recompute the checksums of partially written blocks */
+    int const fd = ::open(file_path_.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+      ReleaseBytes(growth);
+      return tl::unexpected(IoError("open"));
+    }
+    if (!detail::WriteAll(fd, data, static_cast<off_t>(offset))) {
+      Error error = IoError("write");
+      ::close(fd);
+      ReleaseBytes(growth);
+      return tl::unexpected(std::move(error));
+    }
+    /* a gap past the old end is filled with zeros */
+    if (checksums_.has_value()) {
+      checksums_->Update(fd, std::min(offset, size), end);
+    }
+    ::close(fd);
+    detail::TouchFile(file_path_);
+    return {};
+  }
+
+  tl::expected<size_t, Error> Append(std::string_view data) override {
+    if (auto unshared = Unshare(); !unshared) {
+      return tl::unexpected(unshared.error());
+    }
+    if (auto reserved = ReserveBytes(data.size()); !reserved) {
+      return tl::unexpected(reserved.error());
+    }
+
+    /* the offset of an O_APPEND descriptor ends up at the end of the data it
+       wrote, even if other descriptors append to the file concurrently */
+    int const fd = ::open(file_path_.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+    if (fd < 0) {
+      ReleaseBytes(data.size());
+      return tl::unexpected(IoError("open"));
+    }
+    off_t const end =
+        detail::WriteAll(fd, data) ? ::lseek(fd, 0, SEEK_CUR) : off_t{-1};
+    if (end < 0) {
+      Error error = IoError("append to");
+      ::close(fd);
+      ReleaseBytes(data.size());
+      return tl::unexpected(std::move(error));
+    }
+    if (checksums_.has_value()) {
+      checksums_->Update(fd, static_cast<size_t>(end) - data.size(),
+                         static_cast<size_t>(end));
+    }
+    ::close(fd);
+    detail::TouchFile(file_path_);
+    return static_cast<size_t>(end) - data.size();
+  }
+
+  tl::expected<void, Error> Truncate(size_t size) override {
+    if (auto unshared = Unshare(); !unshared) {
+      return tl::unexpected(unshared.error());
+    }
+    size_t const old_size = GetSize();
+    if (size > old_size) {
+      if (auto reserved = ReserveBytes(size - old_size); !reserved) {
+        return tl::unexpected(reserved.error());
+      }
+    }
+    if (::truncate(file_path_.c_str(), static_cast<off_t>(size)) != 0) {
+      Error error = IoError("truncate");
+      if (size > old_size) ReleaseBytes(size - old_size);
+      return tl::unexpected(std::move(error));
+    }
+    if (size < old_size) ReleaseBytes(old_size - size);
+    if (checksums_.has_value()) {
+      if (int const fd = ::open(file_path_.c_str(), O_RDONLY | O_CLOEXEC);
+          fd >= 0) {
+        checksums_->Update(fd, std::min(size, old_size), size);
+        ::close(fd);
+      }
+    }
+    detail::TouchFile(file_path_);
+    return {};
+  }
+
  private:
+  /// give the file a copy of its data before it's modified in place, the
+  /// data may be shared with other files
+  tl::expected<void, Error> Unshare() {
+    if (blobs_ == nullptr || blobs_->Unshare(file_path_)) return {};
+    return tl::unexpected(IoError("unshare"));
+  }
+
+  ssize_t VerifiedRead(std::ostream& out, size_t offset, size_t nbytes) {
+    int const fd = ::open(file_path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    std::string data;
+    auto const result = checksums_->ReadVerified(fd, offset, nbytes, data);
+    ::close(fd);
+    if (result == BlockChecksums::Verification::kMismatch) {
+      GetChecksumCounters().read_mismatches.Inc();
+      std::cerr << "Checksum mismatch in '" << file_path_.string()
+                << "' reading " << nbytes << " bytes at offset " << offset
+                << "\n";
+      return -1;
+    }
+    if (result == BlockChecksums::Verification::kIoError) return -1;
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<ssize_t>(data.size());
+  }
+
+  /// error of the last failed system call
+  Error IoError(std::string_view what) const {
+    return Error{ErrorEnum::kInternalServerError,
+                 std::format("Cannot {} file '{}': {}", what,
+                             file_path_.filename().string(),
+                             std::strerror(errno))};
+  }
+
   std::filesystem::path file_path_;
+  std::optional<BlockChecksums> checksums_;
+  BlobStore* blobs_;
   size_t offset_{0};
 };
 
-class OnDiskDirectory : public Directory {
+class OnDiskDirectory final : public Directory {
  public:
-  explicit OnDiskDirectory(std::filesystem::path path)
-      : dir_path_(std::move(path)) {}
+  /// @c usage of the partition the directory belongs to, nullptr for a
+  /// standalone directory. The checksums of the files are kept in
+  /// @c checksums_path, none if empty. Files are deduplicated in @c blobs,
+  /// if any. New entries are added to @c index and recorded in @c watch, if
+  /// any, under @c index_path, the path of the directory from the partition
+  /// root.
+  explicit OnDiskDirectory(std::filesystem::path path,
+                           UsageTracker* usage = nullptr,
+                           std::filesystem::path checksums_path = {},
+                           BlobStore* blobs = nullptr,
+                           NameIndex* index = nullptr,
+                           WatchLog* watch = nullptr,
+                           std::string index_path = "/")
+      : dir_path_(std::move(path)),
+        checksums_path_(std::move(checksums_path)),
+        usage_(usage),
+        blobs_(blobs),
+        index_(index),
+        watch_(watch),
+        index_path_(std::move(index_path)) {}
 
   tl::expected<RegularFile*, Error> StoreRegularFile(
       std::string const& name, std::string&& data) override {
     std::filesystem::path file_path = dir_path_ / name;
-    std::ofstream file(file_path, std::ios::binary);
-    if (!file) {
-      return tl::unexpected(
-          Error{ErrorEnum::kInternalServerError,
-                std::format("Failed to create file '{}'", name)});
+    /* an existing file is overwritten, only the size difference counts */
+    std::error_code ec;
+    bool const exists = std::filesystem::is_regular_file(file_path, ec);
+    uint64_t const old_size =
+        exists ? std::filesystem::file_size(file_path, ec) : 0;
+    Usage const reserved_usage{.bytes = data.size(), .files = exists ? 0U : 1U};
+    if (auto reserved = Reserve(reserved_usage); !reserved) {
+      return tl::unexpected(reserved.error());
     }
 
-    file << data;
-    file.close();
+    if (blobs_ == nullptr || !blobs_->Link(file_path, data)) {
+      /* truncating a linked file would change the files sharing its data */
+      if (exists && BlobStore::IsShared(file_path)) {
+        std::filesystem::remove(file_path, ec);
+      }
+      std::ofstream file(file_path, std::ios::binary);
+      if (!file) {
+        Release(reserved_usage);
+        return tl::unexpected(
+            Error{ErrorEnum::kInternalServerError,
+                  std::format("Failed to create file '{}'", name)});
+      }
+
+      file << data;
+      file.close();
+    }
+    std::filesystem::path checksums_path;
+    if (!checksums_path_.empty()) {
+      checksums_path = checksums_path_ / name;
+      BlockChecksums{checksums_path}.Rewrite(data);
+    }
+    detail::TouchFile(file_path);
+    Release({.bytes = old_size});
+    std::string index_path = JoinIndexPath(index_path_, name);
+    if (index_ != nullptr) index_->Add(index_path, FileType::Regular);
+    if (watch_ != nullptr) {
+      watch_->Record(WatchEvent::Kind::kStoreRegularFile,
+                     std::move(index_path));
+    }
 
-    files_.push_back(std::make_unique<OnDiskRegularFile>(file_path));
-    return files_.back().get();
+    auto file = std::make_unique<OnDiskRegularFile>(
+        file_path, usage_, std::move(checksums_path), blobs_);
+    std::lock_guard const lock{mutex_};
+    return files_.emplace_back(std::move(file)).get();
   }
 
   tl::expected<Directory*, Error> CreateDirectory(
       std::string const& name) override {
     std::filesystem::path new_dir_path = dir_path_ / name;
+    if (auto reserved = Reserve({.directories = 1}); !reserved) {
+      return tl::unexpected(reserved.error());
+    }
 
     if (!std::filesystem::create_directory(new_dir_path)) {
+      Release({.directories = 1});
       return tl::unexpected(
           Error{ErrorEnum::kAlreadyExists,
                 std::format("Cannot create directory '{}'", name)});
     }
 
-    directories_.push_back(std::make_unique<OnDiskDirectory>(new_dir_path));
-    return directories_.back().get();
+    detail::TouchFile(dir_path_);
+    std::string index_path = JoinIndexPath(index_path_, name);
+    if (index_ != nullptr) index_->Add(index_path, FileType::Directory);
+    if (watch_ != nullptr) {
+      watch_->Record(WatchEvent::Kind::kCreateDirectory, index_path);
+    }
+    auto dir = std::make_unique<OnDiskDirectory>(
+        new_dir_path, usage_,
+        checksums_path_.empty() ? std::filesystem::path{}
+                                : checksums_path_ / name,
+        blobs_, index_, watch_, std::move(index_path));
+    std::lock_guard const lock{mutex_};
+    return directories_.emplace_back(std::move(dir)).get();
+  }
+
+  /// stats the directory, which changes with its entries, and the files in
+  /// it, the listing shows their sizes
+  FileVersion GetVersion() const override {
+    FileVersion version;
+    struct stat st{};
+    if (::stat(dir_path_.c_str(), &st) != 0) return version;
+    detail::AddStatVersion(version, st);
+    std::error_code ec;
+    for (auto it = std::filesystem::directory_iterator(dir_path_, ec);
+         !ec && it != std::filesystem::directory_iterator();
+         it.increment(ec)) {
+      if (it->is_regular_file(ec) && ::stat(it->path().c_str(), &st) == 0) {
+        detail::AddStatVersion(version, st);
+      }
+    }
+    return version;
   }
 
   std::vector<DirEntry> GetDirEntries() const {
@@ -119,16 +422,63 @@ class OnDiskDirectory : public Directory {
   }
 
  private:
+  tl::expected<void, Error> Reserve(Usage const& delta) {
+    if (usage_ == nullptr) return {};
+    return usage_->Reserve(delta);
+  }
+
+  void Release(Usage const& delta) {
+    if (usage_ != nullptr) usage_->Release(delta);
+  }
+
   std::filesystem::path dir_path_;
+  std::filesystem::path checksums_path_;
+  UsageTracker* usage_;
+  BlobStore* blobs_;
+  NameIndex* index_;
+  WatchLog* watch_;
+  std::string index_path_;
+  /// guards the lists of opened files, entries are stored into a directory
+  /// from several threads
+  std::mutex mutex_;
   std::vector<std::unique_ptr<OnDiskDirectory>> directories_;
   std::vector<std::unique_ptr<OnDiskRegularFile>> files_;
 };
 
 class OnDiskPartition final : public Partition {
  public:
-  explicit OnDiskPartition(std::filesystem::path partition_path)
-      : partition_path_(std::move(partition_path)), root_(partition_path_) {
-    std::filesystem::create_directories(partition_path_);
+  /// usage of the existing partition data is computed and its files are
+  /// indexed once, on construction. The block checksums of the files are
+  /// kept under @c checksum_path, if not empty, identical files are
+  /// deduplicated in @c blobs, if any.
+  explicit OnDiskPartition(std::filesystem::path partition_path,
+                           Quota quota = {}, NodeUsage* node_usage = nullptr,
+                           std::filesystem::path checksum_path = {},
+                           BlobStore* blobs = nullptr)
+      : Partition(quota, node_usage),
+        partition_path_(std::move(partition_path)),
+        checksum_path_(std::move(checksum_path)),
+        blobs_(blobs),
+        root_(partition_path_, &GetUsage(), checksum_path_, blobs_,
+              &GetNameIndex(), &GetWatchLog()) {
+    Usage usage;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(
+             partition_path_, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+      std::string const index_path =
+          "/" + it->path().lexically_relative(partition_path_).string();
+      if (it->is_directory(ec)) {
+        ++usage.directories;
+        GetNameIndex().Add(index_path, FileType::Directory);
+      } else if (it->is_regular_file(ec)) {
+        ++usage.files;
+        usage.bytes += it->file_size(ec);
+        GetNameIndex().Add(index_path, FileType::Regular);
+      }
+    }
+    GetUsage().Add(usage);
   }
 
   tl::expected<File*, Error> Open(std::filesystem::path const& path) override {
@@ -149,13 +499,22 @@ class OnDiskPartition final : public Partition {
     }
 
     std::filesystem::path full_path = partition_path_ / path;
+    std::filesystem::path checksum_path =
+        checksum_path_.empty() ? std::filesystem::path{}
+                               : checksum_path_ / path;
 
     if (std::filesystem::is_directory(full_path)) {
-      directories_.push_back(std::make_unique<OnDiskDirectory>(full_path));
-      return directories_.back().get();
+      auto opened = std::make_unique<OnDiskDirectory>(
+          full_path, &GetUsage(), std::move(checksum_path), blobs_,
+          &GetNameIndex(), &GetWatchLog(),
+          "/" + path.lexically_normal().string());
+      std::lock_guard const lock{mutex_};
+      return directories_.emplace_back(std::move(opened)).get();
     } else if (std::filesystem::is_regular_file(full_path)) {
-      files_.push_back(std::make_unique<OnDiskRegularFile>(full_path));
-      return files_.back().get();
+      auto opened = std::make_unique<OnDiskRegularFile>(
+          full_path, &GetUsage(), std::move(checksum_path), blobs_);
+      std::lock_guard const lock{mutex_};
+      return files_.emplace_back(std::move(opened)).get();
     } else {
       return tl::unexpected(
           Error{ErrorEnum::kNotFound,
@@ -165,50 +524,448 @@ class OnDiskPartition final : public Partition {
 
  private:
   std::filesystem::path partition_path_;
+  std::filesystem::path checksum_path_;
+  BlobStore* blobs_;
+  /// guards the lists of opened files, concurrent requests open files
+  std::mutex mutex_;
   std::vector<std::unique_ptr<OnDiskDirectory>> directories_;
   std::vector<std::unique_ptr<OnDiskRegularFile>> files_;
   OnDiskDirectory root_;
 };
 
+///
+/// Keeps every partition in its own directory under the root path. The set of
+/// partitions and the client bindings are tracked by a manifest, so lookups
+/// don't touch the filesystem and startup doesn't walk the directory tree.
+///
 class OnDiskPartitionManager final : public PartitionManager {
  public:
-  bool ContainsPartition(std::string const& uuid) const final {
-    return std::filesystem::exists(root_path_ / uuid);
+  static constexpr auto kName = "on_disk";
+  /// partitions are loaded and the files opened concurrently
+  static constexpr bool kThreadSafe = true;
+
+  using PartitionType = OnDiskPartition;
+  using DirectoryType = OnDiskDirectory;
+  using RegularFileType = OnDiskRegularFile;
+  static constexpr auto kManifestFileName = "MANIFEST";
+  /// destroyed partitions wait here for the reclaimer
+  static constexpr auto kTrashDirName = ".trash";
+  /// block checksums of the files, a tree parallel to the partitions
+  static constexpr auto kChecksumDirName = ".checksums";
+  /// payloads shared by identical files
+  static constexpr auto kBlobDirName = ".blobs";
+  /// pause between two snapshots of the usage of the loaded partitions
+  static constexpr std::chrono::seconds kUsageSnapshotInterval{10};
+
+  /// hit/miss statistics of the partition object cache
+  struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+  };
+
+  /// partitions are loaded on first access. With a node capacity limit
+  /// the usage of every partition is kept in the manifest: the node usage
+  /// starts from these snapshots, a partition replaces its snapshot with
+  /// the usage of its data once loaded. The snapshots of the loaded
+  /// partitions are refreshed every @c kUsageSnapshotInterval, so after a
+  /// crash the usage of a partition not loaded since may miss the writes of
+  /// that interval. Partitions without a snapshot are loaded on startup.
+  ///
+  /// New partitions are placed in the root or one of the extra @c volumes,
+  /// whichever has the most space available; a partition stays on its
+  /// volume. The manifest and the checksums are kept in the root, every
+  /// volume has a trash and a blob store of its own.
+  explicit OnDiskPartitionManager(
+      std::filesystem::path root_path = "./partitions",
+      UsageLimits const& limits = {}, ReclaimerConfig const& reclaim = {},
+      ScrubberConfig const& scrub = {}, DedupConfig const& dedup = {},
+      std::vector<std::filesystem::path> const& volumes = {})
+      : root_path_(std::move(root_path)),
+        volumes_(ListVolumes(root_path_, volumes)),
+        quota_(limits.partition_quota),
+        node_usage_(limits.node_capacity_bytes, limits.high_watermark),
+        reclaimer_(reclaim),
+        scrubber_(volumes_, root_path_ / kChecksumDirName, scrub) {
+    OpenManifest();
+    for (std::filesystem::path const& volume : volumes_) {
+      std::filesystem::create_directories(volume);
+      blobs_.push_back(
+          std::make_unique<BlobStore>(volume / kBlobDirName, dedup));
+      /* partitions destroyed before a restart that weren't reclaimed yet */
+      std::error_code ec;
+      for (auto const& entry :
+           std::filesystem::directory_iterator(volume / kTrashDirName, ec)) {
+        reclaimer_.RemoveTree(entry.path());
+      }
+    }
+    if (limits.node_capacity_bytes == 0) return;
+    track_usage_ = true;
+    std::vector<PartitionId> unknown;
+    manifest_->ForEach(
+        Manifest::Table::kPartitions,
+        [this, &unknown](std::string const& uuid, std::string const& value) {
+          auto const id = PartitionId::Parse(uuid);
+          if (!id.has_value()) return;
+          if (auto usage = DecodeUsage(value); usage.has_value()) {
+            node_usage_.Add(*usage);
+            unloaded_usage_.emplace(*id, *usage);
+          } else {
+            unknown.push_back(*id);
+          }
+        });
+    /* partitions created before the snapshots were kept */
+    for (PartitionId const& id : unknown) {
+      EmplacePartition(id, FindVolume(id.ToString()));
+    }
+    usage_thread_ = std::thread([this] { RunUsageSnapshots(); });
   }
 
-  Partition* LookupPartition(std::string const& uuid) final {
-    if (ContainsPartition(uuid)) {
-      return &partitions_.try_emplace(uuid, root_path_ / uuid).first->second;
+  ~OnDiskPartitionManager() override {
+    {
+      std::lock_guard const lock{usage_thread_mutex_};
+      stopping_ = true;
     }
-    return nullptr;
+    usage_thread_cv_.notify_all();
+    if (usage_thread_.joinable()) usage_thread_.join();
+    if (track_usage_) PersistUsage();
+  }
+
+  /// the manifest and the partition directories use the text form of the
+  /// id
+  bool ContainsPartition(PartitionId const& id) const final {
+    return manifest_->Contains(Manifest::Table::kPartitions, id.ToString());
+  }
+
+  OnDiskPartition* LookupPartition(PartitionId const& id) final {
+    {
+      std::shared_lock const lock{mutex_};
+      if (auto it = partitions_.find(id); it != partitions_.end()) {
+        cache_hits_.Inc();
+        return &it->second;
+      }
+    }
+    if (!ContainsPartition(id)) return nullptr;
+
+    cache_misses_.Inc();
+    size_t const volume = FindVolume(id.ToString());
+    std::unique_lock const lock{mutex_};
+    return EmplacePartition(id, volume);
   }
 
   tl::expected<Partition*, Error> CreatePartition(
-      std::string const& uuid) final {
-    std::filesystem::path partition_path = root_path_ / uuid;
-    if (std::filesystem::create_directories(partition_path)) {
-      auto [it, _] = partitions_.try_emplace(uuid, partition_path);
-      return &it->second;
+      PartitionId const& id) final {
+    std::string const uuid = id.ToString();
+    size_t const volume = PickVolume();
+    std::filesystem::path partition_path = volumes_[volume] / uuid;
+    if (!std::filesystem::create_directories(partition_path)) {
+      return tl::unexpected(Error{
+          ErrorEnum::kInternalServerError,
+          std::format("Failed to create partition for UUID '{}'", uuid)});
     }
-    return tl::unexpected(
-        Error{ErrorEnum::kInternalServerError,
-              std::format("Failed to create partition for UUID '{}'", uuid)});
+    if (auto added = manifest_->Put(Manifest::Table::kPartitions, uuid,
+                                    track_usage_ ? EncodeUsage({}) : "");
+        !added) {
+      std::filesystem::remove_all(partition_path);
+      return tl::unexpected(added.error());
+    }
+
+    std::unique_lock const lock{mutex_};
+    return EmplacePartition(id, volume);
+  }
+
+  /// the partition directory is moved to the trash and removed in the
+  /// background
+  void DestroyPartition(PartitionId const& id) final {
+    std::string const uuid = id.ToString();
+    {
+      /* serialized with the usage snapshots, which mustn't put the
+         partition back */
+      std::unique_lock const lock{mutex_};
+      static_cast<void>(manifest_->Erase(Manifest::Table::kPartitions, uuid));
+      if (auto node = partitions_.extract(id); !node.empty()) {
+        reclaimer_.Destroy(std::move(node));
+      }
+      if (auto unloaded = unloaded_usage_.extract(id); !unloaded.empty()) {
+        node_usage_.Remove(unloaded.mapped());
+      }
+    }
+    size_t const volume = FindVolume(uuid);
+    MoveToTrash(volumes_[volume] / uuid, volume);
+    MoveToTrash(GetChecksumPath(uuid), 0);
+    /* blobs only the partition linked to */
+    reclaimer_.Schedule([this, volume] { blobs_[volume]->Collect(); });
   }
 
-  void DestroyPartition(std::string const& uuid) final {
-    std::filesystem::remove_all(root_path_ / uuid);
-    partitions_.erase(uuid);
+  std::optional<PartitionId> LookupClient(
+      std::string const& client_id) const final {
+    auto uuid = manifest_->Get(Manifest::Table::kClients, client_id);
+    if (!uuid.has_value()) return std::nullopt;
+    return PartitionId::Parse(*uuid);
   }
 
+  tl::expected<void, Error> BindClient(std::string const& client_id,
+                                       PartitionId const& id) final {
+    return manifest_->Put(Manifest::Table::kClients, client_id,
+                          id.ToString());
+  }
+
+  /// The manifest is emptied in place, it is read without the lock of the
+  /// partitions. Only the partition directories and their checksums are
+  /// trashed, the blob stores stay and collect the blobs the partitions
+  /// linked to.
   void Clear() final {
-    std::filesystem::remove_all(root_path_);
-    partitions_.clear();
+    std::unique_lock const lock{mutex_};
+    reclaimer_.Destroy(std::exchange(partitions_, {}));
+    for (auto const& [id, usage] : std::exchange(unloaded_usage_, {})) {
+      node_usage_.Remove(usage);
+    }
+    static_cast<void>(manifest_->Clear());
+    for (size_t volume = 0; volume < volumes_.size(); ++volume) {
+      std::error_code ec;
+      for (auto const& entry :
+           std::filesystem::directory_iterator(volumes_[volume], ec)) {
+        /* the data directory also holds the change feed of the node */
+        if (PartitionId::Parse(entry.path().filename().string())) {
+          MoveToTrash(entry.path(), volume);
+        }
+      }
+    }
+    std::error_code ec;
+    for (auto const& entry : std::filesystem::directory_iterator(
+             root_path_ / kChecksumDirName, ec)) {
+      MoveToTrash(entry.path(), 0);
+    }
+    reclaimer_.Schedule([this] { CollectBlobs(); });
+  }
+
+  std::filesystem::path const& GetRootPath() const { return root_path_; }
+
+  /// the root first, then the extra volumes
+  std::vector<std::filesystem::path> const& GetVolumes() const {
+    return volumes_;
+  }
+
+  CacheStats GetCacheStats() const {
+    return {cache_hits_.Value(), cache_misses_.Value()};
+  }
+
+  NodeUsage const& GetNodeUsage() const final { return node_usage_; }
+
+  Reclaimer& GetReclaimer() { return reclaimer_; }
+
+  Scrubber& GetScrubber() { return scrubber_; }
+
+  /// blob store of the root volume
+  BlobStore& GetBlobStore() { return *blobs_.front(); }
+
+  DedupStats GetDedupStats() const {
+    DedupStats total;
+    for (auto const& blobs : blobs_) {
+      DedupStats const stats = blobs->GetStats();
+      total.chunks += stats.chunks;
+      total.stored_bytes += stats.stored_bytes;
+      total.logical_bytes += stats.logical_bytes;
+    }
+    return total;
+  }
+
+  size_t GetPartitionCount() const final {
+    return manifest_->Size(Manifest::Table::kPartitions);
+  }
+
+  /// write the usage of the loaded partitions whose usage changed since
+  /// their last snapshot to the manifest
+  void PersistUsage() {
+    std::shared_lock const lock{mutex_};
+    for (auto& [id, partition] : partitions_) {
+      PersistUsage(id, partition.GetUsage().GetUsage());
+    }
   }
 
  private:
-  std::filesystem::path root_path_{
-      "./partitions"};
-  std::unordered_map<std::string, OnDiskPartition> partitions_;
+  /// @c root followed by the @c volumes not naming it or each other
+  static std::vector<std::filesystem::path> ListVolumes(
+      std::filesystem::path const& root,
+      std::vector<std::filesystem::path> const& volumes) {
+    std::vector<std::filesystem::path> list{root};
+    for (std::filesystem::path const& volume : volumes) {
+      /* `dir`, `dir/` and `dir/.` name the same volume */
+      auto const same = [&volume](std::filesystem::path const& listed) {
+        return (volume / "").lexically_normal() ==
+               (listed / "").lexically_normal();
+      };
+      if (std::ranges::none_of(list, same)) list.push_back(volume);
+    }
+    return list;
+  }
+
+  /// usage snapshots are kept as the manifest values of the partitions,
+  /// "<bytes> <files> <directories>"
+  static std::string EncodeUsage(Usage const& usage) {
+    return std::format("{} {} {}", usage.bytes, usage.files,
+                       usage.directories);
+  }
+
+  static std::optional<Usage> DecodeUsage(std::string_view value) {
+    Usage usage;
+    char const* ptr = value.data();
+    char const* const end = value.data() + value.size();
+    for (uint64_t* field : {&usage.bytes, &usage.files, &usage.directories}) {
+      if (field != &usage.bytes) {
+        if (ptr == end || *ptr != ' ') return std::nullopt;
+        ++ptr;
+      }
+      auto const [next, ec] = std::from_chars(ptr, end, *field);
+      if (ec != std::errc{}) return std::nullopt;
+      ptr = next;
+    }
+    if (ptr != end) return std::nullopt;
+    return usage;
+  }
+
+  /// snapshot @c usage of partition @c id unless it is current, must hold
+  /// the lock of the partitions
+  void PersistUsage(PartitionId const& id, Usage const& usage) {
+    std::string const uuid = id.ToString();
+    std::string const value = EncodeUsage(usage);
+    auto const persisted = manifest_->Get(Manifest::Table::kPartitions, uuid);
+    if (!persisted.has_value() || *persisted == value) return;
+    static_cast<void>(
+        manifest_->Put(Manifest::Table::kPartitions, uuid, value));
+  }
+
+  void RunUsageSnapshots() {
+    LowerThreadPriority();
+    std::unique_lock lock{usage_thread_mutex_};
+    while (!usage_thread_cv_.wait_for(lock, kUsageSnapshotInterval,
+                                      [this] { return stopping_; })) {
+      lock.unlock();
+      PersistUsage();
+      lock.lock();
+    }
+  }
+
+  std::filesystem::path GetChecksumPath(std::string const& uuid) const {
+    return root_path_ / kChecksumDirName / uuid;
+  }
+
+  /// index of the volume holding the directory of the partition, the root
+  /// if there is none
+  size_t FindVolume(std::string const& uuid) const {
+    for (size_t volume = 1; volume < volumes_.size(); ++volume) {
+      std::error_code ec;
+      if (std::filesystem::is_directory(volumes_[volume] / uuid, ec)) {
+        return volume;
+      }
+    }
+    return 0;
+  }
+
+  /// index of the volume with the most space available for a new partition
+  size_t PickVolume() const {
+    size_t picked = 0;
+    uintmax_t most_available = 0;
+    for (size_t volume = 0; volume < volumes_.size(); ++volume) {
+      std::error_code ec;
+      std::filesystem::space_info const space =
+          std::filesystem::space(volumes_[volume], ec);
+      if (!ec && space.available > most_available) {
+        picked = volume;
+        most_available = space.available;
+      }
+    }
+    return picked;
+  }
+
+  /// the partition object of @c id on @c volume, must hold the exclusive
+  /// lock or run before the manager is shared
+  OnDiskPartition* EmplacePartition(PartitionId const& id, size_t volume) {
+    std::string const uuid = id.ToString();
+    auto [it, inserted] = partitions_.try_emplace(
+        id, volumes_[volume] / uuid, quota_, &node_usage_,
+        GetChecksumPath(uuid), blobs_[volume].get());
+    if (inserted && track_usage_) {
+      /* the partition accounts the usage of its data now */
+      if (auto unloaded = unloaded_usage_.extract(id); !unloaded.empty()) {
+        node_usage_.Remove(unloaded.mapped());
+      }
+      PersistUsage(id, it->second.GetUsage().GetUsage());
+    }
+    return &it->second;
+  }
+
+  void CollectBlobs() {
+    for (auto const& blobs : blobs_) blobs->Collect();
+  }
+
+  /// unlink @c path from the partition tree of @c volume and hand it to the
+  /// reclaimer, trash and path are on the same filesystem
+  void MoveToTrash(std::filesystem::path const& path, size_t volume) {
+    std::filesystem::path const trash = volumes_[volume] / kTrashDirName;
+    std::error_code ec;
+    std::filesystem::create_directories(trash, ec);
+    /* names are unique across restarts, older entries may still be queued */
+    std::filesystem::path trash_path =
+        trash / std::format("{}.{}.{}", path.filename().string(),
+                            std::chrono::system_clock::now()
+                                .time_since_epoch()
+                                .count(),
+                            trashed_++);
+    std::filesystem::rename(path, trash_path, ec);
+    if (ec) {
+      if (!std::filesystem::exists(path)) return;
+      /* can't be moved, reclaim it in place */
+      trash_path = path;
+    }
+    reclaimer_.RemoveTree(std::move(trash_path));
+  }
+
+  void OpenManifest() {
+    std::filesystem::create_directories(root_path_);
+    std::filesystem::path manifest_path = root_path_ / kManifestFileName;
+    bool const is_new = !std::filesystem::exists(manifest_path);
+    manifest_ = std::make_unique<Manifest>(std::move(manifest_path));
+    if (!is_new) return;
+
+    /* one-time import of partitions created before the manifest existed */
+    for (auto const& entry : std::filesystem::directory_iterator(root_path_)) {
+      if (!entry.is_directory()) continue;
+      std::string const uuid = entry.path().filename().string();
+      if (uuid.starts_with('.')) continue;
+      static_cast<void>(manifest_->Put(Manifest::Table::kPartitions, uuid));
+    }
+  }
+
+  std::filesystem::path root_path_;
+  /// the root and the extra volumes the partitions are spread across
+  std::vector<std::filesystem::path> const volumes_;
+  Quota const quota_;
+  /// declared before the partitions, which release their usage on
+  /// destruction
+  NodeUsage node_usage_;
+  /// one per volume, links don't cross filesystems; outlive the reclaimer,
+  /// which collects them
+  std::vector<std::unique_ptr<BlobStore>> blobs_;
+  /// declared after the node usage, partitions still queued release their
+  /// usage when the reclaimer is destroyed
+  Reclaimer reclaimer_;
+  Scrubber scrubber_;
+  std::atomic<uint64_t> trashed_{0};
+  std::unique_ptr<Manifest> manifest_;
+  std::unordered_map<PartitionId, OnDiskPartition, PartitionId::Hash>
+      partitions_;
+  /// last persisted usage of the partitions that weren't loaded yet,
+  /// included in the node usage
+  std::unordered_map<PartitionId, Usage, PartitionId::Hash> unloaded_usage_;
+  mutable std::shared_mutex mutex_;
+  Counter cache_hits_;
+  Counter cache_misses_;
+  /// usage snapshots are kept if the node capacity is limited
+  bool track_usage_{false};
+  bool stopping_{false};
+  std::mutex usage_thread_mutex_;
+  std::condition_variable usage_thread_cv_;
+  std::thread usage_thread_;
 };
 
 };  // namespace cppfs::storage
@@ -1,15 +1,25 @@
 #pragma once
 
 #include <cassert>
+#include <chrono>
 #include <filesystem>
 #include <format>
+#include <mutex>
+#include <optional>
 #include <ostream>
 #include <shared_mutex>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <tl/expected.hpp>
+#include <type_traits>
 #include <unistd.h>
 
 #include "error_types.h"
+#include "name_index.hpp"
+#include "partition_id.hpp"
+#include "usage.hpp"
+#include "watch_log.hpp"
 
 namespace cppfs::storage {
 
@@ -29,6 +39,14 @@ inline std::string FileTypeToString(FileType type) {
   return "Unknown";
 }
 
+/// Validators of a file for conditional reads
+struct FileVersion {
+  /// changes whenever the data of a regular file or the listing of a
+  /// directory changes, 0 if unknown
+  uint64_t tag{0};
+  std::chrono::system_clock::time_point modified{};
+};
+
 class File {
  public:
   using Offset = ssize_t;
@@ -38,6 +56,9 @@ class File {
 
   virtual size_t GetSize() const = 0;
 
+  /// cheap to get, doesn't read the data of the file
+  virtual FileVersion GetVersion() const = 0;
+
   FileType GetType() const { return type_; }
 
  private:
@@ -46,15 +67,54 @@ class File {
 
 class RegularFile : public File {
  public:
-  RegularFile() : File(FileType::Regular) {}
+  /// size changes are accounted to @c usage of the partition the file belongs
+  /// to, nullptr for a standalone file
+  explicit RegularFile(UsageTracker* usage = nullptr)
+      : File(FileType::Regular), usage_(usage) {}
 
   virtual ssize_t Read(std::ostream& out, size_t nbytes) = 0;
   /* Works like lseek() with `SEEK_SET` flag */
   virtual ssize_t Seek(size_t offset) = 0;
   virtual ssize_t PositionalRead(std::ostream& out, size_t offset,
                                  size_t nbytes) = 0;
+
+  /// write @c data at @c offset, a gap past the end of the file is filled
+  /// with zeros
+  virtual tl::expected<void, Error> PositionalWrite(size_t offset,
+                                                    std::string_view data) = 0;
+  /// write @c data at the end of the file, returns the offset it was written
+  /// at
+  virtual tl::expected<size_t, Error> Append(std::string_view data) = 0;
+  /// shrink the file or extend it with zeros to @c size bytes
+  virtual tl::expected<void, Error> Truncate(size_t size) = 0;
+
+ protected:
+  tl::expected<void, Error> ReserveBytes(uint64_t bytes) {
+    if (usage_ == nullptr || bytes == 0) return {};
+    return usage_->Reserve({.bytes = bytes});
+  }
+
+  void ReleaseBytes(uint64_t bytes) {
+    if (usage_ != nullptr && bytes != 0) usage_->Release({.bytes = bytes});
+  }
+
+ private:
+  UsageTracker* usage_;
 };
 
+/// bytes of data of @c file. GetSize() may count a byte past the data, as
+/// the in-memory files do, so the last byte is read to tell.
+inline tl::expected<size_t, Error> GetDataSize(RegularFile& file) {
+  size_t const size = file.GetSize();
+  if (size == 0) return 0;
+  std::ostringstream last;
+  if (file.PositionalRead(last, size - 1, 1) < 0) {
+    return tl::unexpected(Error{ErrorEnum::kInternalServerError,
+                                "Cannot read the end of the file"});
+  }
+  return last.view().empty() ? size - 1 : size;
+}
+
 class Directory : public File {
  public:
   struct DirEntry {
@@ -74,8 +134,20 @@ class Directory : public File {
 
 class Partition {
  public:
+  explicit Partition(Quota quota = {}, NodeUsage* node_usage = nullptr)
+      : usage_(quota, node_usage) {}
+
   virtual ~Partition() = default;
 
+  /// resources consumed by the partition
+  UsageTracker& GetUsage() { return usage_; }
+
+  /// names of the files of the partition, for searches
+  NameIndex& GetNameIndex() { return index_; }
+
+  /// recent changes of the partition, for watchers
+  WatchLog& GetWatchLog() { return watch_; }
+
   /// open file relative to the partition root
   virtual tl::expected<File*, Error> Open(
       std::filesystem::path const& path) = 0;
@@ -87,37 +159,37 @@ class Partition {
   /// open directory relative to the partition root
   virtual tl::expected<Directory*, Error> OpenDir(
       std::filesystem::path const& path) {
-    tl::expected<File*, Error> file_expected = Open(path);
-    if (!file_expected.has_value())
-      return tl::unexpected{file_expected.error()};
-
-    File* file = file_expected.value();
-    auto dir = dynamic_cast<Directory*>(file);
-    if (dir == nullptr) {
-      return tl::unexpected(Error{
-          ErrorEnum::kDirectory,
-          std::format("Expected directory, but received regular file '{}'",
-                      path.filename().c_str())});
-    }
-    return dir;
+    return OpenAs<Directory>(Open(path), path);
   }
 
   /// open regular file relative to the partition root
   virtual tl::expected<RegularFile*, Error> OpenRegularFile(
       std::filesystem::path const& path) {
-    tl::expected<File*, Error> file_expected = Open(path);
-    if (!file_expected.has_value())
-      return tl::unexpected{file_expected.error()};
+    return OpenAs<RegularFile>(Open(path), path);
+  }
 
-    File* file = file_expected.value();
-    auto reg_file = dynamic_cast<RegularFile*>(file);
-    if (reg_file == nullptr) {
+  /// @c file opened at @c path as a @c T, which is Directory, RegularFile
+  /// or the type of the one or the other of a backend. The type of the file
+  /// is checked instead of a dynamic_cast, every backend has a single class
+  /// of each type.
+  template <typename T>
+  static tl::expected<T*, Error> OpenAs(tl::expected<File*, Error> file,
+                                        std::filesystem::path const& path) {
+    if (!file.has_value()) return tl::unexpected{file.error()};
+    constexpr bool kWantsDirectory = std::is_base_of_v<Directory, T>;
+    static_assert(kWantsDirectory || std::is_base_of_v<RegularFile, T>);
+    if (file.value()->GetType() == FileType::Directory) {
+      if constexpr (kWantsDirectory) return static_cast<T*>(file.value());
       return tl::unexpected(Error{
           ErrorEnum::kDirectory,
           std::format("Expected regular file, but received directory '{}'",
                       path.filename().c_str())});
     }
-    return reg_file;
+    if constexpr (!kWantsDirectory) return static_cast<T*>(file.value());
+    return tl::unexpected(Error{
+        ErrorEnum::kDirectory,
+        std::format("Expected directory, but received regular file '{}'",
+                    path.filename().c_str())});
   }
 
   Directory* OpenRoot() {
@@ -126,26 +198,70 @@ class Partition {
     return static_cast<Directory*>(root_file.value());
   }
 
+  /// held by a mutation of the partition until it is acknowledged
+  using WriteLock = std::shared_lock<std::shared_mutex>;
+
+  /// lock the partition for a mutation, nullopt while it is frozen
+  std::optional<WriteLock> BeginWrite() {
+    WriteLock lock{mutex_};
+    if (frozen_) return std::nullopt;
+    return lock;
+  }
+
+  /// reject further mutations, returns once the mutations in flight are
+  /// acknowledged so that all of them are in the change feed
+  void Freeze() {
+    std::unique_lock const lock{mutex_};
+    frozen_ = true;
+  }
+
+  void Unfreeze() {
+    std::unique_lock const lock{mutex_};
+    frozen_ = false;
+  }
+
+  bool IsFrozen() const {
+    std::shared_lock const lock{mutex_};
+    return frozen_;
+  }
+
  private:
   mutable std::shared_mutex mutex_;
+  bool frozen_{false};
+  UsageTracker usage_;
+  NameIndex index_;
+  WatchLog watch_;
 };
 
 class PartitionManager {
  public:
   virtual ~PartitionManager() = default;
 
-  /// check if partition with specified uuid exists
-  virtual bool ContainsPartition(std::string const& uuid) const = 0;
+  /// check if partition with specified id exists
+  virtual bool ContainsPartition(PartitionId const& id) const = 0;
 
   /// return partition if found, nullptr otherwise
-  virtual Partition* LookupPartition(std::string const& uuid) = 0;
+  virtual Partition* LookupPartition(PartitionId const& id) = 0;
   /// try to create new partition
   virtual tl::expected<Partition*, Error> CreatePartition(
-      std::string const& uuid) = 0;
+      PartitionId const& id) = 0;
+
+  virtual void DestroyPartition(PartitionId const& id) = 0;
+
+  /// return id of the partition bound to @c client_id, if any
+  virtual std::optional<PartitionId> LookupClient(
+      std::string const& client_id) const = 0;
+  /// bind @c client_id to partition @c id
+  virtual tl::expected<void, Error> BindClient(std::string const& client_id,
+                                               PartitionId const& id) = 0;
 
-  virtual void DestroyPartition(std::string const& uuid) = 0;
   /// clear all partition manager data
   virtual void Clear() = 0;
+
+  /// total usage of the partitions
+  virtual NodeUsage const& GetNodeUsage() const = 0;
+
+  virtual size_t GetPartitionCount() const = 0;
 };
 
 };  // namespace cppfs::storage
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace cppfs::storage {
+
+///
+/// Binary key of a partition, the 16 bytes of its UUID.
+///
+/// Requests name partitions by the canonical text form of the UUID
+/// (`xxxxxxxx-xxxx-Mxxx-Nxxx-xxxxxxxxxxxx`), which is parsed once when the
+/// request comes in. Managers key their maps on the binary form, hashing
+/// and comparing it as two 64-bit words.
+///
+class PartitionId {
+ public:
+  static constexpr size_t kSize = 16;
+  static constexpr size_t kTextSize = 36;
+
+  struct Hash {
+    size_t operator()(PartitionId const& id) const noexcept {
+      uint64_t words[2];
+      std::memcpy(words, id.bytes_.data(), kSize);
+      /* time based UUIDs differ in few bits, mix them over the whole word */
+      uint64_t const hash =
+          (words[0] ^ std::rotl(words[1], 32)) * 0x9e3779b97f4a7c15;
+      return static_cast<size_t>(hash ^ (hash >> 29));
+    }
+  };
+
+  constexpr PartitionId() = default;
+
+  explicit constexpr PartitionId(std::array<uint8_t, kSize> const& bytes)
+      : bytes_(bytes) {}
+
+  /// parse the canonical text form, hex digits may be of either case;
+  /// nullopt unless @c text is a UUID of version 1 to 5
+  static constexpr std::optional<PartitionId> Parse(
+      std::string_view text) noexcept {
+    if (text.size() != kTextSize) return std::nullopt;
+    PartitionId id;
+    size_t pos = 0;
+    for (size_t i = 0; i < kSize; ++i, pos += 2) {
+      if (pos == 8 || pos == 13 || pos == 18 || pos == 23) {
+        if (text[pos++] != '-') return std::nullopt;
+      }
+      int8_t const high = kHexValues[static_cast<uint8_t>(text[pos])];
+      int8_t const low = kHexValues[static_cast<uint8_t>(text[pos + 1])];
+      if ((high | low) < 0) return std::nullopt;
+      id.bytes_[i] = static_cast<uint8_t>(high << 4 | low);
+    }
+    auto const version = static_cast<uint8_t>(id.bytes_[6] >> 4);
+    if (version < 1 || version > 5) return std::nullopt;
+    return id;
+  }
+
+  /// canonical lowercase text form
+  std::string ToString() const {
+    static constexpr std::string_view kDigits = "0123456789abcdef";
+    std::string text;
+    text.reserve(kTextSize);
+    for (size_t i = 0; i < kSize; ++i) {
+      if (i == 4 || i == 6 || i == 8 || i == 10) text += '-';
+      text += kDigits[bytes_[i] >> 4];
+      text += kDigits[bytes_[i] & 0xf];
+    }
+    return text;
+  }
+
+  constexpr std::array<uint8_t, kSize> const& GetBytes() const {
+    return bytes_;
+  }
+
+  friend constexpr bool operator==(PartitionId const&,
+                                   PartitionId const&) = default;
+
+ private:
+  /// value of every character as a hex digit, -1 for non-digits
+  static constexpr std::array<int8_t, 256> kHexValues = [] {
+    std::array<int8_t, 256> values{};
+    values.fill(-1);
+    for (size_t digit = 0; digit < 10; ++digit) {
+      values['0' + digit] = static_cast<int8_t>(digit);
+    }
+    for (size_t digit = 0; digit < 6; ++digit) {
+      values['a' + digit] = static_cast<int8_t>(10 + digit);
+      values['A' + digit] = static_cast<int8_t>(10 + digit);
+    }
+    return values;
+  }();
+
+  std::array<uint8_t, kSize> bytes_{};
+};
+
+/// canonical text form of partition id @c text, whose hex digits may be of
+/// either case, or @c text itself if it isn't a valid id. Changes, handles
+/// and tenants name partitions by this form.
+inline std::string CanonicalUuid(std::string text) {
+  auto const id = PartitionId::Parse(text);
+  return id.has_value() ? id->ToString() : std::move(text);
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,200 @@
+#include "partition/reclaimer.hpp"
+
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace cppfs::storage {
+
+namespace {
+
+/// ioprio_set() constants, glibc has no wrapper for it
+constexpr int kIoprioWhoProcess = 1;
+constexpr int kIoprioClassIdle = 3;
+constexpr int kIoprioClassShift = 13;
+
+constexpr int kLowestNice = 19;
+
+}  // namespace
+
+void LowerThreadPriority() {
+  auto const tid = static_cast<id_t>(::syscall(SYS_gettid));
+  static_cast<void>(::setpriority(PRIO_PROCESS, tid, kLowestNice));
+  static_cast<void>(::syscall(SYS_ioprio_set, kIoprioWhoProcess, 0,
+                              kIoprioClassIdle << kIoprioClassShift));
+}
+
+Reclaimer::Reclaimer(ReclaimerConfig config)
+    : bucket_(config.files_per_s, config.files_per_s),
+      thread_([this] { Run(); }) {}
+
+Reclaimer::~Reclaimer() {
+  {
+    std::lock_guard const lock{mutex_};
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+  /* objects are freed by the destroying thread, trees are left in the trash */
+  jobs_.clear();
+}
+
+void Reclaimer::RemoveTree(std::filesystem::path path) {
+  Enqueue(Job{.tree = std::move(path)});
+}
+
+void Reclaimer::Schedule(std::function<void()> task) {
+  Enqueue(Job{.task = std::move(task)});
+}
+
+void Reclaimer::Enqueue(Job job) {
+  {
+    std::lock_guard const lock{mutex_};
+    jobs_.push_back(std::move(job));
+  }
+  cv_.notify_one();
+}
+
+void Reclaimer::WaitIdle() {
+  std::unique_lock lock{mutex_};
+  idle_cv_.wait(lock, [this] { return jobs_.empty() || stopped_; });
+}
+
+Reclaimer::Stats Reclaimer::GetStats() const {
+  std::lock_guard const lock{mutex_};
+  return {.pending = jobs_.size(),
+          .reclaimed = reclaimed_.Value(),
+          .files = files_.Value(),
+          .bytes = bytes_.Value()};
+}
+
+void Reclaimer::CollectMetrics(PrometheusWriter& writer,
+                               std::string_view backend) const {
+  Stats const stats = GetStats();
+  std::string const backend_label{backend};
+  writer.Family("cppfs_reclaim_pending", "gauge",
+                "Destroyed partitions whose data is not freed yet");
+  writer.Sample("cppfs_reclaim_pending", {{"backend", backend_label}},
+                stats.pending);
+  writer.Family("cppfs_reclaimed_total", "counter",
+                "Data of destroyed partitions freed in the background");
+  writer.Sample("cppfs_reclaimed_total",
+                {{"backend", backend_label}, {"resource", "partitions"}},
+                stats.reclaimed);
+  writer.Sample("cppfs_reclaimed_total",
+                {{"backend", backend_label}, {"resource", "files"}},
+                stats.files);
+  writer.Sample("cppfs_reclaimed_total",
+                {{"backend", backend_label}, {"resource", "bytes"}},
+                stats.bytes);
+}
+
+void Reclaimer::Run() {
+  LowerThreadPriority();
+  while (true) {
+    Job* job = nullptr;
+    {
+      std::unique_lock lock{mutex_};
+      cv_.wait(lock, [this] { return stopped_ || !jobs_.empty(); });
+      if (stopped_) break;
+      /* jobs are only appended, the front stays in place */
+      job = &jobs_.front();
+    }
+
+    if (job->task) {
+      job->task();
+    } else {
+      if (job->object) {
+        job->object.reset();
+        files_.Inc(job->usage.files);
+        bytes_.Inc(job->usage.bytes);
+      } else if (!RemoveTreeThrottled(job->tree)) {
+        break;
+      }
+      reclaimed_.Inc();
+    }
+
+    {
+      std::lock_guard const lock{mutex_};
+      if (stopped_) break;
+      jobs_.pop_front();
+    }
+    idle_cv_.notify_all();
+  }
+  idle_cv_.notify_all();
+}
+
+bool Reclaimer::RemoveTreeThrottled(std::filesystem::path const& root) {
+  struct Dir {
+    std::filesystem::path path;
+    /// the files were removed and the subdirectories queued
+    bool expanded{false};
+  };
+  std::error_code ec;
+  auto const status = std::filesystem::symlink_status(root, ec);
+  if (!std::filesystem::is_directory(status)) {
+    if (!Throttle()) return false;
+    uint64_t const size = std::filesystem::is_regular_file(status)
+                              ? std::filesystem::file_size(root, ec)
+                              : 0;
+    if (std::filesystem::remove(root, ec)) {
+      files_.Inc();
+      bytes_.Inc(size);
+    }
+    return true;
+  }
+
+  std::vector<Dir> stack;
+  stack.push_back({.path = root});
+  while (!stack.empty()) {
+    Dir& dir = stack.back();
+    if (dir.expanded) {
+      /* the subdirectories are gone, anything left is removed at once */
+      std::filesystem::remove_all(dir.path, ec);
+      stack.pop_back();
+      continue;
+    }
+
+    dir.expanded = true;
+    std::vector<std::filesystem::path> subdirs;
+    for (auto it = std::filesystem::directory_iterator(dir.path, ec);
+         !ec && it != std::filesystem::directory_iterator();
+         it.increment(ec)) {
+      if (it->is_directory(ec) && !it->is_symlink(ec)) {
+        subdirs.push_back(it->path());
+        continue;
+      }
+      if (!Throttle()) return false;
+      uint64_t const size = it->is_regular_file(ec) ? it->file_size(ec) : 0;
+      if (std::filesystem::remove(it->path(), ec)) {
+        files_.Inc();
+        bytes_.Inc(size);
+      }
+    }
+    if (ec) {
+      std::cerr << "Cannot reclaim '" << dir.path.string()
+                << "': " << ec.message() << "\n";
+      ec.clear();
+    }
+    /* `dir` is invalidated by the pushes */
+    for (auto& subdir : subdirs) stack.push_back({.path = std::move(subdir)});
+  }
+  return true;
+}
+
+bool Reclaimer::Throttle() {
+  while (true) {
+    auto const wait = bucket_.GetWaitTime(1);
+    std::unique_lock lock{mutex_};
+    if (stopped_) return false;
+    if (wait == TokenBucket::Clock::duration::zero()) break;
+    cv_.wait_for(lock, wait, [this] { return stopped_; });
+  }
+  bucket_.Charge(1);
+  return true;
+}
+
+}  // namespace cppfs::storage
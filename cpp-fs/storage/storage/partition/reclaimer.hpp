@@ -0,0 +1,104 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include "metrics/metrics.hpp"
+#include "scheduling/rate_limiter.hpp"
+#include "usage.hpp"
+
+namespace cppfs::storage {
+
+/// lower the CPU and I/O priority of the calling thread to idle, best effort,
+/// for background maintenance that shouldn't slow down requests
+void LowerThreadPriority();
+
+struct ReclaimerConfig {
+  /// files removed per second, 0 means unlimited
+  double files_per_s{0};
+};
+
+///
+/// Frees the data of destroyed partitions in the background.
+///
+/// Destroying a partition only unlinks it from its manager, e.g. moves its
+/// directory to the trash, and hands the data over to the reclaimer, so the
+/// request destroying it doesn't block on freeing millions of files. The
+/// reclaimer thread runs with idle CPU and I/O priority and removes files at
+/// a limited rate. Trees that weren't removed before shutdown stay in the
+/// trash, the manager hands them over again on the next start.
+///
+class Reclaimer {
+ public:
+  struct Stats {
+    /// jobs queued and not finished yet
+    uint64_t pending{0};
+    /// trees and objects freed
+    uint64_t reclaimed{0};
+    uint64_t files{0};
+    uint64_t bytes{0};
+  };
+
+  explicit Reclaimer(ReclaimerConfig config = {});
+  ~Reclaimer();
+
+  Reclaimer(Reclaimer const&) = delete;
+  Reclaimer& operator=(Reclaimer const&) = delete;
+
+  /// remove directory tree @c path
+  void RemoveTree(std::filesystem::path path);
+
+  /// destroy @c object, @c usage is the data it holds, reported in the stats
+  template <typename T>
+  void Destroy(T object, Usage const& usage = {}) {
+    Enqueue(Job{.object = std::make_shared<T>(std::move(object)),
+                .usage = usage});
+  }
+
+  /// run @c task in the background once the jobs queued so far are finished,
+  /// e.g. to clean up after the removal of trees
+  void Schedule(std::function<void()> task);
+
+  /// wait until all jobs queued so far are finished
+  void WaitIdle();
+
+  Stats GetStats() const;
+
+  void CollectMetrics(PrometheusWriter& writer, std::string_view backend) const;
+
+ private:
+  struct Job {
+    std::filesystem::path tree{};
+    std::shared_ptr<void> object{};
+    Usage usage{};
+    std::function<void()> task{};
+  };
+
+  void Enqueue(Job job);
+  void Run();
+  /// false if the reclaimer stopped before the tree was removed
+  bool RemoveTreeThrottled(std::filesystem::path const& root);
+  /// wait for the rate limit, false if the reclaimer is stopping
+  bool Throttle();
+
+  TokenBucket bucket_;
+  /// a job is taken off the queue once it is finished
+  std::deque<Job> jobs_;
+  bool stopped_{false};
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable idle_cv_;
+  Counter reclaimed_;
+  Counter files_;
+  Counter bytes_;
+  std::thread thread_;
+};
+
+}  // namespace cppfs::storage
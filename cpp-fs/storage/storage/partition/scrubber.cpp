@@ -0,0 +1,136 @@
+#include "partition/scrubber.hpp"
+
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+#include "partition/checksum.hpp"
+#include "partition/reclaimer.hpp"
+
+namespace cppfs::storage {
+
+namespace {
+
+/// data verified at once, between two rate limit checks
+constexpr size_t kScrubChunkSize = 16 * kChecksumBlockSize;
+
+}  // namespace
+
+Scrubber::Scrubber(std::vector<std::filesystem::path> data_roots,
+                   std::filesystem::path checksum_root, ScrubberConfig config)
+    : data_roots_(std::move(data_roots)),
+      checksum_root_(std::move(checksum_root)),
+      config_(config),
+      bucket_(config.bytes_per_s, static_cast<double>(kScrubChunkSize)) {
+  if (config_.bytes_per_s > 0) thread_ = std::thread([this] { Run(); });
+}
+
+Scrubber::~Scrubber() {
+  {
+    std::lock_guard const lock{mutex_};
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) thread_.join();
+}
+
+void Scrubber::Run() {
+  LowerThreadPriority();
+  while (true) {
+    PassStats const stats = ScrubPass();
+    if (stats.complete) GetChecksumCounters().scrub_passes.Inc();
+    std::unique_lock lock{mutex_};
+    if (cv_.wait_for(lock, config_.interval, [this] { return stopped_; })) {
+      return;
+    }
+  }
+}
+
+Scrubber::PassStats Scrubber::ScrubPass() {
+  PassStats stats;
+  for (std::filesystem::path const& data_root : data_roots_) {
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(data_root, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+      if (it.depth() == 0) {
+        /* partitions are the directories in the root, the dot directories
+           hold the trash, the checksums and the blobs */
+        if (!it->is_directory(ec) ||
+            it->path().filename().string().starts_with('.')) {
+          it.disable_recursion_pending();
+        }
+        continue;
+      }
+      if (!it->is_regular_file(ec)) continue;
+      if (!ScrubFile(data_root, it->path(), stats)) {
+        std::lock_guard const lock{mutex_};
+        if (stopped_) {
+          stats.complete = false;
+          return stats;
+        }
+      }
+    }
+  }
+  return stats;
+}
+
+bool Scrubber::ScrubFile(std::filesystem::path const& data_root,
+                         std::filesystem::path const& path,
+                         PassStats& stats) {
+  int const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  /* the partition may have been destroyed meanwhile */
+  if (fd < 0) return false;
+
+  BlockChecksums const checksums{checksum_root_ /
+                                 path.lexically_relative(data_root)};
+  ChecksumCounters& counters = GetChecksumCounters();
+  std::string chunk;
+  bool read = true;
+  for (size_t offset = 0;; offset += kScrubChunkSize) {
+    if (!Throttle(kScrubChunkSize)) {
+      read = false;
+      break;
+    }
+    auto const result =
+        checksums.ReadVerified(fd, offset, kScrubChunkSize, chunk);
+    if (result == BlockChecksums::Verification::kIoError) {
+      read = false;
+      break;
+    }
+    if (result == BlockChecksums::Verification::kMissing) {
+      counters.unchecked_files.Inc();
+      break;
+    }
+    if (result == BlockChecksums::Verification::kMismatch) {
+      ++stats.corrupted_files;
+      counters.scrub_mismatches.Inc();
+      std::cerr << "Checksum mismatch in '" << path.string()
+                << "' at offset " << offset << "\n";
+      break;
+    }
+    stats.bytes += chunk.size();
+    counters.scrubbed_bytes.Inc(chunk.size());
+    if (chunk.size() < kScrubChunkSize) break;
+  }
+  ::close(fd);
+  ++stats.files;
+  counters.scrubbed_files.Inc();
+  return read;
+}
+
+bool Scrubber::Throttle(size_t bytes) {
+  auto const tokens = static_cast<double>(bytes);
+  while (true) {
+    auto const wait = bucket_.GetWaitTime(tokens);
+    std::unique_lock lock{mutex_};
+    if (stopped_) return false;
+    if (wait == TokenBucket::Clock::duration::zero()) break;
+    cv_.wait_for(lock, wait, [this] { return stopped_; });
+  }
+  bucket_.Charge(tokens);
+  return true;
+}
+
+}  // namespace cppfs::storage
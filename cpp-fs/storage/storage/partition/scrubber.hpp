@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "scheduling/rate_limiter.hpp"
+
+namespace cppfs::storage {
+
+struct ScrubberConfig {
+  /// bytes verified per second, 0 disables the background scrubber
+  double bytes_per_s{0};
+  /// pause between two scrubs of all partitions
+  std::chrono::seconds interval{std::chrono::hours{24}};
+};
+
+///
+/// Verifies the data of on-disk partitions against their checksums in the
+/// background, so corruption of rarely read files is found before a client
+/// reads them or the last good replica is gone.
+///
+/// The scrubber walks every file under the data roots and checks it against
+/// its sidecar under the checksum root. It runs with idle CPU and I/O
+/// priority and reads at most the configured number of bytes per second.
+/// Mismatches are logged and counted in the checksum metrics.
+///
+class Scrubber {
+ public:
+  struct PassStats {
+    uint64_t files{0};
+    uint64_t bytes{0};
+    /// files with blocks that didn't match their checksums
+    uint64_t corrupted_files{0};
+    /// false if the scrubber was stopped before the pass was complete
+    bool complete{true};
+  };
+
+  /// partitions live in the directories under the @c data_roots, the
+  /// checksums of a file `<data_root>/<path>` in `<checksum_root>/<path>`
+  Scrubber(std::vector<std::filesystem::path> data_roots,
+           std::filesystem::path checksum_root, ScrubberConfig config = {});
+  ~Scrubber();
+
+  Scrubber(Scrubber const&) = delete;
+  Scrubber& operator=(Scrubber const&) = delete;
+
+  /// scrub all partitions once on the calling thread, for scrubbers without
+  /// a background thread
+  PassStats ScrubPass();
+
+ private:
+  void Run();
+  /// false if the file couldn't be read completely, e.g. it was removed
+  bool ScrubFile(std::filesystem::path const& data_root,
+                 std::filesystem::path const& path, PassStats& stats);
+  /// wait for the rate limit, false if the scrubber is stopping
+  bool Throttle(size_t bytes);
+
+  std::vector<std::filesystem::path> const data_roots_;
+  std::filesystem::path const checksum_root_;
+  ScrubberConfig const config_;
+  TokenBucket bucket_;
+  bool stopped_{false};
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread thread_;
+};
+
+}  // namespace cppfs::storage
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <format>
+#include <limits>
+#include <string_view>
+#include <tl/expected.hpp>
+
+#include "error_types.h"
+
+namespace cppfs::storage {
+
+/// Resources consumed by a partition or by all partitions of a node
+struct Usage {
+  uint64_t bytes{0};
+  uint64_t files{0};
+  uint64_t directories{0};
+};
+
+/// Per-partition limits, 0 means unlimited
+struct Quota {
+  uint64_t bytes{0};
+  uint64_t files{0};
+  uint64_t directories{0};
+};
+
+/// Usage limits of a partition manager
+struct UsageLimits {
+  Quota partition_quota{};
+  /// bytes all partitions may store together, 0 means unlimited
+  uint64_t node_capacity_bytes{0};
+  /// fraction of the node capacity above which new writes are shed
+  double high_watermark{0.9};
+};
+
+namespace detail {
+
+/// add @c delta to @c value unless the result would exceed @c limit
+inline bool TryAdd(std::atomic<uint64_t>& value, uint64_t delta,
+                   uint64_t limit) {
+  if (delta == 0) return true;
+  uint64_t current = value.load(std::memory_order_relaxed);
+  do {
+    if (limit != 0 && current + delta > limit) return false;
+  } while (!value.compare_exchange_weak(current, current + delta,
+                                        std::memory_order_relaxed));
+  return true;
+}
+
+}  // namespace detail
+
+///
+/// Total usage of the partitions of a node.
+///
+class NodeUsage {
+ public:
+  explicit NodeUsage(uint64_t capacity_bytes = 0, double high_watermark = 1.0)
+      : capacity_bytes_(capacity_bytes),
+        watermark_bytes_(static_cast<uint64_t>(
+            static_cast<double>(capacity_bytes) * high_watermark)) {}
+
+  Usage GetUsage() const {
+    return {bytes_.load(std::memory_order_relaxed),
+            files_.load(std::memory_order_relaxed),
+            directories_.load(std::memory_order_relaxed)};
+  }
+
+  uint64_t GetCapacityBytes() const { return capacity_bytes_; }
+
+  /// true if the node is close to its capacity and writes should be shed
+  bool IsAboveHighWatermark() const {
+    return capacity_bytes_ != 0 &&
+           bytes_.load(std::memory_order_relaxed) >= watermark_bytes_;
+  }
+
+  /// account @c usage of data no loaded partition tracks, e.g. the last
+  /// known usage of partitions that weren't loaded yet
+  void Add(Usage const& usage) {
+    bytes_.fetch_add(usage.bytes, std::memory_order_relaxed);
+    files_.fetch_add(usage.files, std::memory_order_relaxed);
+    directories_.fetch_add(usage.directories, std::memory_order_relaxed);
+  }
+
+  void Remove(Usage const& usage) {
+    bytes_.fetch_sub(usage.bytes, std::memory_order_relaxed);
+    files_.fetch_sub(usage.files, std::memory_order_relaxed);
+    directories_.fetch_sub(usage.directories, std::memory_order_relaxed);
+  }
+
+ private:
+  friend class UsageTracker;
+
+  uint64_t const capacity_bytes_;
+  uint64_t const watermark_bytes_;
+  std::atomic<uint64_t> bytes_{0};
+  std::atomic<uint64_t> files_{0};
+  std::atomic<uint64_t> directories_{0};
+};
+
+///
+/// Usage of a single partition.
+///
+/// Mutations reserve the resources they are about to consume before touching
+/// any data and release them if the mutation fails, so accounting is O(1)
+/// and a quota is never exceeded, even by concurrent writers. Usage is also
+/// added to the node totals and removed from them when the tracker (i.e. the
+/// partition) is destroyed.
+///
+class UsageTracker {
+ public:
+  explicit UsageTracker(Quota quota = {}, NodeUsage* node = nullptr)
+      : quota_(quota), node_(node) {}
+
+  ~UsageTracker() { RemoveFromNode(GetUsage()); }
+
+  UsageTracker(UsageTracker const&) = delete;
+  UsageTracker& operator=(UsageTracker const&) = delete;
+
+  /// account @c delta, fails with kOutOfMemory if it doesn't fit into the
+  /// partition quota or the node capacity
+  tl::expected<void, Error> Reserve(Usage const& delta) {
+    if (!detail::TryAdd(bytes_, delta.bytes, quota_.bytes)) {
+      return QuotaExceeded("bytes", bytes_, quota_.bytes);
+    }
+    if (!detail::TryAdd(files_, delta.files, quota_.files)) {
+      Sub(bytes_, delta.bytes);
+      return QuotaExceeded("files", files_, quota_.files);
+    }
+    if (!detail::TryAdd(directories_, delta.directories, quota_.directories)) {
+      Sub(bytes_, delta.bytes);
+      Sub(files_, delta.files);
+      return QuotaExceeded("directories", directories_, quota_.directories);
+    }
+    if (node_ != nullptr && !detail::TryAdd(node_->bytes_, delta.bytes,
+                                            node_->capacity_bytes_)) {
+      Sub(bytes_, delta.bytes);
+      Sub(files_, delta.files);
+      Sub(directories_, delta.directories);
+      return tl::unexpected(Error{
+          ErrorEnum::kOutOfMemory,
+          std::format("Node capacity of {} bytes exhausted",
+                      node_->capacity_bytes_)});
+    }
+    if (node_ != nullptr) {
+      node_->files_.fetch_add(delta.files, std::memory_order_relaxed);
+      node_->directories_.fetch_add(delta.directories,
+                                    std::memory_order_relaxed);
+    }
+    return {};
+  }
+
+  /// account @c delta regardless of the limits, used for data that already
+  /// exists (e.g. when an on-disk partition is loaded)
+  void Add(Usage const& delta) {
+    bytes_.fetch_add(delta.bytes, std::memory_order_relaxed);
+    files_.fetch_add(delta.files, std::memory_order_relaxed);
+    directories_.fetch_add(delta.directories, std::memory_order_relaxed);
+    if (node_ == nullptr) return;
+    node_->bytes_.fetch_add(delta.bytes, std::memory_order_relaxed);
+    node_->files_.fetch_add(delta.files, std::memory_order_relaxed);
+    node_->directories_.fetch_add(delta.directories,
+                                  std::memory_order_relaxed);
+  }
+
+  void Release(Usage const& delta) {
+    Sub(bytes_, delta.bytes);
+    Sub(files_, delta.files);
+    Sub(directories_, delta.directories);
+    RemoveFromNode(delta);
+  }
+
+  Usage GetUsage() const {
+    return {bytes_.load(std::memory_order_relaxed),
+            files_.load(std::memory_order_relaxed),
+            directories_.load(std::memory_order_relaxed)};
+  }
+
+  Quota const& GetQuota() const { return quota_; }
+
+  /// bytes that can still be stored in the partition
+  uint64_t GetAvailableBytes() const {
+    uint64_t available = std::numeric_limits<uint64_t>::max();
+    uint64_t const bytes = bytes_.load(std::memory_order_relaxed);
+    if (quota_.bytes != 0) {
+      available = quota_.bytes > bytes ? quota_.bytes - bytes : 0;
+    }
+    if (node_ != nullptr && node_->capacity_bytes_ != 0) {
+      uint64_t const node_bytes = node_->bytes_.load(std::memory_order_relaxed);
+      available = std::min(available, node_->capacity_bytes_ > node_bytes
+                                          ? node_->capacity_bytes_ - node_bytes
+                                          : 0);
+    }
+    return available;
+  }
+
+ private:
+  static void Sub(std::atomic<uint64_t>& value, uint64_t delta) {
+    value.fetch_sub(delta, std::memory_order_relaxed);
+  }
+
+  static tl::unexpected<Error> QuotaExceeded(std::string_view resource,
+                                             std::atomic<uint64_t> const& used,
+                                             uint64_t quota) {
+    return tl::unexpected(Error{
+        ErrorEnum::kOutOfMemory,
+        std::format("Partition quota of {} {} exceeded ({} used)", quota,
+                    resource, used.load(std::memory_order_relaxed))});
+  }
+
+  void RemoveFromNode(Usage const& delta) {
+    if (node_ == nullptr) return;
+    Sub(node_->bytes_, delta.bytes);
+    Sub(node_->files_, delta.files);
+    Sub(node_->directories_, delta.directories);
+  }
+
+  Quota const quota_;
+  NodeUsage* const node_;
+  std::atomic<uint64_t> bytes_{0};
+  std::atomic<uint64_t> files_{0};
+  std::atomic<uint64_t> directories_{0};
+};
+
+}  // namespace cppfs::storage
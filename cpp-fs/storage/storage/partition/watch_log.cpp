@@ -0,0 +1,68 @@
+#include "partition/watch_log.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace cppfs::storage {
+
+WatchLog::WatchLog(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)) {
+  events_.reserve(capacity_);
+}
+
+WatchLog::~WatchLog() {
+  std::unique_lock lock{mutex_};
+  closed_ = true;
+  changed_.notify_all();
+  changed_.wait(lock, [this] { return waiting_ == 0; });
+}
+
+uint64_t WatchLog::Record(WatchEvent::Kind kind, std::string path) {
+  std::lock_guard const lock{mutex_};
+  WatchEvent event{.sequence = ++last_sequence_,
+                   .kind = kind,
+                   .path = std::move(path)};
+  if (events_.size() < capacity_) {
+    events_.push_back(std::move(event));
+  } else {
+    events_[(event.sequence - 1) % capacity_] = std::move(event);
+  }
+  changed_.notify_all();
+  return last_sequence_;
+}
+
+WatchLog::Batch WatchLog::Read(uint64_t since,
+                               std::chrono::milliseconds wait) {
+  std::unique_lock lock{mutex_};
+  if (last_sequence_ == since && wait.count() > 0) {
+    ++waiting_;
+    changed_.wait_for(lock, wait,
+                      [&] { return closed_ || last_sequence_ != since; });
+    --waiting_;
+    /* the destructor may be waiting for the last reader */
+    if (closed_) changed_.notify_all();
+  }
+  return ReadLocked(since);
+}
+
+WatchLog::Batch WatchLog::ReadLocked(uint64_t since) const {
+  Batch batch{.last_sequence = last_sequence_};
+  uint64_t const first = last_sequence_ - events_.size() + 1;
+  uint64_t next = since + 1;
+  /* a sequence past the end is from before the log started over */
+  if (since > last_sequence_ || next < first) {
+    batch.gap = true;
+    next = first;
+  }
+  for (; next <= last_sequence_; ++next) {
+    batch.events.push_back(events_[(next - 1) % capacity_]);
+  }
+  return batch;
+}
+
+uint64_t WatchLog::GetLastSequence() const {
+  std::lock_guard const lock{mutex_};
+  return last_sequence_;
+}
+
+}  // namespace cppfs::storage
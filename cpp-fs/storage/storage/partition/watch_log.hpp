@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cppfs::storage {
+
+struct WatchEvent {
+  enum class Kind {
+    kCreateDirectory,
+    kStoreRegularFile,
+  };
+
+  uint64_t sequence{0};
+  Kind kind{Kind::kCreateDirectory};
+  /// path from the partition root, e.g. `/dir/file`
+  std::string path{};
+};
+
+inline std::string WatchEventKindToString(WatchEvent::Kind kind) {
+  switch (kind) {
+    case WatchEvent::Kind::kCreateDirectory:
+      return "mkdir";
+    case WatchEvent::Kind::kStoreRegularFile:
+      return "store";
+  }
+  return "unknown";
+}
+
+///
+/// Recent changes of a partition, for clients following it without polling
+/// its listings.
+///
+/// Every event gets the next sequence of the partition, starting at 1. Only
+/// the last events are kept in a ring buffer; a client that fell further
+/// behind is told about the gap and has to list the partition again. The
+/// log is kept in memory, sequences start over when a node restarts, which
+/// clients see as a gap as well.
+///
+class WatchLog {
+ public:
+  static constexpr size_t kDefaultCapacity = 1024;
+
+  struct Batch {
+    std::vector<WatchEvent> events{};
+    /// events following the requested sequence were dropped, or the log
+    /// started over
+    bool gap{false};
+    /// sequence to continue from
+    uint64_t last_sequence{0};
+  };
+
+  explicit WatchLog(size_t capacity = kDefaultCapacity);
+  /// wakes up the readers waiting for events and waits for them to leave
+  ~WatchLog();
+
+  WatchLog(WatchLog const&) = delete;
+  WatchLog& operator=(WatchLog const&) = delete;
+
+  /// append an event with the next sequence and return the sequence
+  uint64_t Record(WatchEvent::Kind kind, std::string path);
+
+  /// the kept events following @c since, waiting up to @c wait for one if
+  /// there are none yet
+  Batch Read(uint64_t since, std::chrono::milliseconds wait = {});
+
+  uint64_t GetLastSequence() const;
+
+ private:
+  Batch ReadLocked(uint64_t since) const;
+
+  size_t const capacity_;
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  /// event with sequence s at (s - 1) % capacity
+  std::vector<WatchEvent> events_;
+  uint64_t last_sequence_{0};
+  size_t waiting_{0};
+  bool closed_{false};
+};
+
+}  // namespace cppfs::storage
@@ -0,0 +1,374 @@
+#include "replication/change_feed.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+
+#include <boost/crc.hpp>
+
+namespace cppfs::storage {
+
+namespace {
+
+constexpr size_t kCrcSize = sizeof(uint32_t);
+constexpr size_t kOpOffset = kCrcSize;
+constexpr size_t kPartitionLenOffset = kOpOffset + sizeof(uint8_t);
+constexpr size_t kNameLenOffset = kPartitionLenOffset + sizeof(uint8_t);
+constexpr size_t kPathLenOffset = kNameLenOffset + sizeof(uint16_t);
+constexpr size_t kDataLenOffset = kPathLenOffset + sizeof(uint32_t);
+constexpr size_t kSequenceOffset = kDataLenOffset + sizeof(uint32_t);
+constexpr size_t kOffsetOffset = kSequenceOffset + sizeof(uint64_t);
+constexpr size_t kHeaderSize = kOffsetOffset + sizeof(uint64_t);
+
+/// fixed fields of the records of a change log version
+struct RecordLayout {
+  size_t header_size;
+  bool has_offset;
+};
+
+constexpr RecordLayout kRecordLayout{.header_size = kHeaderSize,
+                                     .has_offset = true};
+/// version 1 logs had no file header and no offset in their records
+constexpr RecordLayout kRecordLayoutV1{.header_size = kOffsetOffset,
+                                       .has_offset = false};
+
+/// The log starts with [magic][version:u32], followed by the records.
+constexpr std::string_view kLogMagic{"cppfslog"};
+constexpr uint32_t kLogVersion = 2;
+constexpr size_t kLogHeaderSize = kLogMagic.size() + sizeof(uint32_t);
+
+uint32_t Checksum(char const* data, size_t size) {
+  boost::crc_32_type crc;
+  crc.process_bytes(data, size);
+  return crc.checksum();
+}
+
+template <typename T>
+T LoadAt(char const* buffer, size_t offset) {
+  T value;
+  std::memcpy(&value, buffer + offset, sizeof(T));
+  return value;
+}
+
+template <typename T>
+void StoreAt(std::string& buffer, size_t offset, T value) {
+  std::memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+/// size of the record starting at @c header
+size_t RecordSize(char const* header, RecordLayout layout = kRecordLayout) {
+  return layout.header_size + LoadAt<uint8_t>(header, kPartitionLenOffset) +
+         LoadAt<uint16_t>(header, kNameLenOffset) +
+         LoadAt<uint32_t>(header, kPathLenOffset) +
+         LoadAt<uint32_t>(header, kDataLenOffset);
+}
+
+bool IsValidOp(uint8_t op) {
+  return op >= static_cast<uint8_t>(ChangeOp::kCreatePartition) &&
+         op <= static_cast<uint8_t>(ChangeOp::kTruncateRegularFile);
+}
+
+/// decode a complete record of @c size bytes
+tl::expected<Change, Error> DecodeRecord(char const* record, size_t size,
+                                         RecordLayout layout = kRecordLayout) {
+  if (Checksum(record + kCrcSize, size - kCrcSize) !=
+      LoadAt<uint32_t>(record, 0)) {
+    return tl::unexpected(
+        Error{ErrorEnum::kInternalServerError, "Change checksum mismatch"});
+  }
+  auto const op = LoadAt<uint8_t>(record, kOpOffset);
+  if (!IsValidOp(op)) {
+    return tl::unexpected(Error{ErrorEnum::kInternalServerError,
+                                std::format("Unknown change op {}", op)});
+  }
+
+  Change change{.sequence = LoadAt<uint64_t>(record, kSequenceOffset),
+                .op = static_cast<ChangeOp>(op)};
+  if (layout.has_offset) {
+    change.offset = LoadAt<uint64_t>(record, kOffsetOffset);
+  }
+  char const* field = record + layout.header_size;
+  auto take = [&field](std::string& out, size_t length) {
+    out.assign(field, length);
+    field += length;
+  };
+  take(change.partition, LoadAt<uint8_t>(record, kPartitionLenOffset));
+  take(change.path, LoadAt<uint32_t>(record, kPathLenOffset));
+  take(change.name, LoadAt<uint16_t>(record, kNameLenOffset));
+  take(change.data, LoadAt<uint32_t>(record, kDataLenOffset));
+  return change;
+}
+
+Error ErrnoError(std::string_view what, std::filesystem::path const& path) {
+  return Error{ErrorEnum::kInternalServerError,
+               std::format("Change log {} failed for '{}': {}", what,
+                           path.string(), std::strerror(errno))};
+}
+
+std::string EncodeLogHeader() {
+  std::string header(kLogHeaderSize, '\0');
+  std::copy(kLogMagic.begin(), kLogMagic.end(), header.begin());
+  StoreAt(header, kLogMagic.size(), kLogVersion);
+  return header;
+}
+
+/// Decode the records of @c file laid out as @c layout and pass every change
+/// and the size of its record to @c on_change, until @c on_change returns
+/// false or the end of the file. A torn or corrupt record ends the log.
+template <typename OnChange>
+void ReadRecords(std::istream& file, RecordLayout layout,
+                 OnChange&& on_change) {
+  std::string record;
+  while (true) {
+    record.resize(layout.header_size);
+    if (!file.read(record.data(),
+                   static_cast<std::streamsize>(layout.header_size))) {
+      break;
+    }
+    size_t const size = RecordSize(record.data(), layout);
+    record.resize(size);
+    if (!file.read(record.data() + layout.header_size,
+                   static_cast<std::streamsize>(size - layout.header_size))) {
+      break;
+    }
+    auto change = DecodeRecord(record.data(), size, layout);
+    if (!change || !on_change(*change, size)) break;
+  }
+}
+
+/// write all of @c data to @c fd
+bool WriteAll(int fd, std::string_view data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t const rc =
+        ::write(fd, data.data() + written, data.size() - written);
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    written += static_cast<size_t>(rc);
+  }
+  return true;
+}
+
+}  // namespace
+
+tl::expected<std::string, Error> EncodeChange(Change const& change) {
+  if (change.partition.size() > std::numeric_limits<uint8_t>::max() ||
+      change.name.size() > std::numeric_limits<uint16_t>::max() ||
+      change.path.size() > std::numeric_limits<uint32_t>::max() ||
+      change.data.size() > std::numeric_limits<uint32_t>::max()) {
+    return tl::unexpected(Error{
+        ErrorEnum::kInvalidInput,
+        std::format("Change of partition '{}' is too large to replicate",
+                    change.partition)});
+  }
+
+  std::string record(kHeaderSize + change.partition.size() +
+                         change.path.size() + change.name.size() +
+                         change.data.size(),
+                     '\0');
+  StoreAt(record, kOpOffset, static_cast<uint8_t>(change.op));
+  StoreAt(record, kPartitionLenOffset,
+          static_cast<uint8_t>(change.partition.size()));
+  StoreAt(record, kNameLenOffset, static_cast<uint16_t>(change.name.size()));
+  StoreAt(record, kPathLenOffset, static_cast<uint32_t>(change.path.size()));
+  StoreAt(record, kDataLenOffset, static_cast<uint32_t>(change.data.size()));
+  StoreAt(record, kSequenceOffset, change.sequence);
+  StoreAt(record, kOffsetOffset, change.offset);
+  auto out = record.begin() + static_cast<std::ptrdiff_t>(kHeaderSize);
+  for (std::string const* field :
+       {&change.partition, &change.path, &change.name, &change.data}) {
+    out = std::copy(field->begin(), field->end(), out);
+  }
+  StoreAt(record, 0,
+          Checksum(record.data() + kCrcSize, record.size() - kCrcSize));
+  return record;
+}
+
+tl::expected<std::optional<Change>, Error> ChangeDecoder::Next() {
+  if (GetPending() < kHeaderSize) return std::nullopt;
+  char const* header = buffer_.data() + offset_;
+  size_t const size = RecordSize(header);
+  if (GetPending() < size) return std::nullopt;
+
+  auto change = DecodeRecord(header, size);
+  if (!change) return tl::unexpected(change.error());
+  offset_ += size;
+  /* drop consumed records once they make up most of the buffer */
+  if (offset_ > buffer_.size() / 2) {
+    buffer_.erase(0, offset_);
+    offset_ = 0;
+  }
+  return std::move(change.value());
+}
+
+ChangeFeed::ChangeFeed(std::filesystem::path path) : path_(std::move(path)) {
+  Load();
+  fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "cannot open change log " + path_.string());
+  }
+}
+
+ChangeFeed::~ChangeFeed() {
+  if (fd_ >= 0) ::close(fd_);
+}
+
+tl::expected<uint64_t, Error> ChangeFeed::Append(Change change) {
+  std::unique_lock lock{mutex_};
+  change.sequence = offsets_.size() + 1;
+  auto record = EncodeChange(change);
+  if (!record) return tl::unexpected(record.error());
+
+  /* don't leave a partial or unsynced record the next append would follow */
+  auto fail = [this](std::string_view what) {
+    Error error = ErrnoError(what, path_);
+    static_cast<void>(::ftruncate(fd_, static_cast<off_t>(end_offset_)));
+    return tl::unexpected(std::move(error));
+  };
+  if (!WriteAll(fd_, *record)) return fail("write");
+  if (::fdatasync(fd_) != 0) return fail("fdatasync");
+
+  offsets_.push_back(end_offset_);
+  end_offset_ += record->size();
+  lock.unlock();
+  appended_.notify_all();
+  return change.sequence;
+}
+
+uint64_t ChangeFeed::GetLastSequence() const {
+  std::lock_guard const lock{mutex_};
+  return offsets_.size();
+}
+
+tl::expected<ChangeFeed::Batch, Error> ChangeFeed::Read(
+    uint64_t since, size_t max_bytes) const {
+  Batch batch;
+  uint64_t begin = 0;
+  uint64_t end = 0;
+  {
+    std::lock_guard const lock{mutex_};
+    if (since >= offsets_.size()) return batch;
+    begin = offsets_[since];
+    /* change with sequence n ends where change n + 1 starts */
+    auto change_end = [this](uint64_t sequence) {
+      return sequence < offsets_.size() ? offsets_[sequence] : end_offset_;
+    };
+    /* always include the first change, even if it exceeds max_bytes */
+    uint64_t last = since + 1;
+    while (last < offsets_.size() &&
+           change_end(last + 1) - begin <= max_bytes) {
+      ++last;
+    }
+    end = change_end(last);
+    batch.changes = last - since;
+    batch.last_sequence = last;
+  }
+
+  /* appended records are immutable, read them without holding the lock */
+  batch.data.resize(end - begin);
+  size_t read = 0;
+  while (read < batch.data.size()) {
+    ssize_t const rc = ::pread(fd_, batch.data.data() + read,
+                               batch.data.size() - read,
+                               static_cast<off_t>(begin + read));
+    if (rc < 0 && errno == EINTR) continue;
+    if (rc <= 0) return tl::unexpected(ErrnoError("read", path_));
+    read += static_cast<size_t>(rc);
+  }
+  return batch;
+}
+
+bool ChangeFeed::WaitForChanges(uint64_t since,
+                                std::chrono::milliseconds timeout) const {
+  std::unique_lock lock{mutex_};
+  return appended_.wait_for(lock, timeout,
+                            [&] { return offsets_.size() > since; });
+}
+
+void ChangeFeed::Load() {
+  std::ifstream file(path_, std::ios::binary);
+  std::string header(kLogHeaderSize, '\0');
+  if (!file || !file.read(header.data(), kLogHeaderSize) ||
+      !header.starts_with(kLogMagic)) {
+    file.close();
+    /* a new log, or one written before the log had a header */
+    Migrate();
+    return;
+  }
+  if (auto const version = LoadAt<uint32_t>(header.data(), kLogMagic.size());
+      version != kLogVersion) {
+    throw std::runtime_error(
+        std::format("Change log '{}' has format version {}, expected {}",
+                    path_.string(), version, kLogVersion));
+  }
+
+  end_offset_ = kLogHeaderSize;
+  ReadRecords(file, kRecordLayout, [this](Change const& change, size_t size) {
+    if (change.sequence != offsets_.size() + 1) return false;
+    offsets_.push_back(end_offset_);
+    end_offset_ += size;
+    return true;
+  });
+  file.close();
+
+  if (end_offset_ != std::filesystem::file_size(path_)) {
+    /* drop the torn tail so that new changes are appended after valid ones */
+    std::filesystem::resize_file(path_, end_offset_);
+  }
+}
+
+void ChangeFeed::Migrate() {
+  std::filesystem::path const migrated = path_.string() + ".migrating";
+  int const fd = ::open(migrated.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "cannot create change log " + migrated.string());
+  }
+  auto fail = [&](std::string_view what) {
+    int const error = errno;
+    ::close(fd);
+    std::filesystem::remove(migrated);
+    throw std::system_error(error, std::generic_category(),
+                            std::format("cannot {} change log {}", what,
+                                        migrated.string()));
+  };
+
+  std::string const header = EncodeLogHeader();
+  if (!WriteAll(fd, header)) fail("write");
+  end_offset_ = header.size();
+  bool written = true;
+  if (std::ifstream file(path_, std::ios::binary); file) {
+    ReadRecords(file, kRecordLayoutV1, [&](Change const& change, size_t) {
+      if (change.sequence != offsets_.size() + 1) return false;
+      auto record = EncodeChange(change);
+      written = record.has_value() && WriteAll(fd, *record);
+      if (!written) return false;
+      offsets_.push_back(end_offset_);
+      end_offset_ += record->size();
+      return true;
+    });
+  }
+  if (!written) fail("write");
+  if (::fsync(fd) != 0) fail("sync");
+  ::close(fd);
+  std::filesystem::rename(migrated, path_);
+  if (!offsets_.empty()) {
+    std::cerr << std::format(
+        "Migrated {} changes of change log '{}' to format version {}\n",
+        offsets_.size(), path_.string(), kLogVersion);
+  }
+}
+
+}  // namespace cppfs::storage
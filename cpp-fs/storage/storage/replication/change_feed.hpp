@@ -0,0 +1,130 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+#include <vector>
+
+#include "error_types.h"
+
+namespace cppfs::storage {
+
+/// Partition mutations replicated from a primary to its replicas
+enum class ChangeOp : uint8_t {
+  kCreatePartition = 1,
+  /// bind client @c name to partition
+  kBindClient = 2,
+  /// create directory @c name in directory @c path
+  kCreateDirectory = 3,
+  /// store @c data as regular file @c name in directory @c path
+  kStoreRegularFile = 4,
+  /// write @c data at @c offset of regular file @c name in directory @c path,
+  /// appends are recorded as writes at the offset they landed at
+  kWriteRegularFile = 5,
+  /// truncate regular file @c name in directory @c path to @c offset bytes
+  kTruncateRegularFile = 6,
+};
+
+struct Change {
+  uint64_t sequence{0};
+  ChangeOp op{ChangeOp::kCreatePartition};
+  std::string partition{};
+  std::string path{};
+  std::string name{};
+  std::string data{};
+  uint64_t offset{0};
+};
+
+/// Serialize @c change, the same encoding is used by the change log and by
+/// the replication endpoint.
+///
+/// Layout (host byte order):
+/// [crc32:u32][op:u8][partition_len:u8][name_len:u16][path_len:u32]
+/// [data_len:u32][sequence:u64][offset:u64][partition][path][name][data]
+/// The checksum covers everything after the crc field.
+tl::expected<std::string, Error> EncodeChange(Change const& change);
+
+///
+/// Incremental decoder of a stream of encoded changes.
+///
+class ChangeDecoder {
+ public:
+  void Feed(std::string_view data) { buffer_.append(data); }
+
+  /// next complete change, nullopt if more data is needed
+  tl::expected<std::optional<Change>, Error> Next();
+
+  /// bytes of an incomplete change left in the buffer
+  size_t GetPending() const { return buffer_.size() - offset_; }
+
+ private:
+  std::string buffer_;
+  size_t offset_{0};
+};
+
+///
+/// Durable, append-only log of the mutations of all partitions of a node.
+///
+/// Every change gets the next sequence number and is synced to disk before
+/// the mutation is acknowledged. Replicas pull the changes following the last
+/// sequence they applied, so a replica that was down catches up from where it
+/// left off. The log isn't truncated, so a new replica can bootstrap from the
+/// very first change.
+///
+/// The log starts with a header holding its format version. Logs of version
+/// 1, which had no header, are migrated when opened, logs of unknown
+/// versions are rejected.
+///
+class ChangeFeed {
+ public:
+  struct Batch {
+    /// encoded changes
+    std::string data;
+    size_t changes{0};
+    /// sequence of the last change in the batch
+    uint64_t last_sequence{0};
+  };
+
+  /// open the log at @c path, creating an empty one if it doesn't exist;
+  /// throws if the log can't be opened or has an unknown format version
+  explicit ChangeFeed(std::filesystem::path path);
+  ~ChangeFeed();
+
+  ChangeFeed(ChangeFeed const&) = delete;
+  ChangeFeed& operator=(ChangeFeed const&) = delete;
+
+  /// append @c change with the next sequence number and return it
+  tl::expected<uint64_t, Error> Append(Change change);
+
+  uint64_t GetLastSequence() const;
+
+  /// changes following @c since, up to @c max_bytes but at least one change
+  /// if there is any
+  tl::expected<Batch, Error> Read(uint64_t since, size_t max_bytes) const;
+
+  /// wait until there are changes following @c since, false on timeout
+  bool WaitForChanges(uint64_t since, std::chrono::milliseconds timeout) const;
+
+ private:
+  void Load();
+
+  /// rewrite the version 1 log at @c path_ in the current format, or create
+  /// an empty log if there is none
+  void Migrate();
+
+  std::filesystem::path path_;
+  int fd_{-1};
+  /// offset of the change with sequence i + 1
+  std::vector<uint64_t> offsets_;
+  uint64_t end_offset_{0};
+  mutable std::mutex mutex_;
+  mutable std::condition_variable appended_;
+};
+
+}  // namespace cppfs::storage
@@ -0,0 +1,95 @@
+#include "replication/partition_archive.hpp"
+
+#include <format>
+#include <sstream>
+#include <utility>
+
+#include "partition/partition_id.hpp"
+
+namespace cppfs::storage {
+
+PartitionExporter::PartitionExporter(Partition* partition, std::string uuid)
+    : partition_(partition), uuid_(CanonicalUuid(std::move(uuid))) {}
+
+tl::expected<std::string, Error> PartitionExporter::Next(size_t max_bytes) {
+  std::string data;
+  while (data.empty() || data.size() < max_bytes) {
+    auto change = NextChange();
+    if (!change) return tl::unexpected(change.error());
+    if (!change->has_value()) break;
+    auto record = EncodeChange(**change);
+    if (!record) return tl::unexpected(record.error());
+    data += *record;
+    ++exported_;
+  }
+  return data;
+}
+
+tl::expected<std::optional<Change>, Error> PartitionExporter::NextChange() {
+  if (!started_) {
+    started_ = true;
+    pending_dirs_.emplace_back("/");
+    return Change{.op = ChangeOp::kCreatePartition, .partition = uuid_};
+  }
+
+  while (next_entry_ == entries_.size()) {
+    if (pending_dirs_.empty()) return std::nullopt;
+    dir_path_ = std::move(pending_dirs_.back());
+    pending_dirs_.pop_back();
+    auto dir = partition_->OpenDir(dir_path_);
+    if (!dir) return tl::unexpected(dir.error());
+    entries_ = dir.value()->GetDirEntries();
+    next_entry_ = 0;
+  }
+
+  Directory::DirEntry const& entry = entries_[next_entry_++];
+  std::filesystem::path const path = dir_path_ / entry.name;
+  if (entry.type == FileType::Directory) {
+    pending_dirs_.push_back(path);
+    return Change{.op = ChangeOp::kCreateDirectory,
+                  .partition = uuid_,
+                  .path = dir_path_.string(),
+                  .name = entry.name};
+  }
+
+  auto file = partition_->OpenRegularFile(path);
+  if (!file) return tl::unexpected(file.error());
+  std::ostringstream data;
+  if (file.value()->PositionalRead(data, 0, file.value()->GetSize()) < 0) {
+    return tl::unexpected(
+        Error{ErrorEnum::kInternalServerError,
+              std::format("Cannot read file '{}' of partition '{}'",
+                          path.string(), uuid_)});
+  }
+  return Change{.op = ChangeOp::kStoreRegularFile,
+                .partition = uuid_,
+                .path = dir_path_.string(),
+                .name = entry.name,
+                .data = std::move(data).str()};
+}
+
+tl::expected<std::string, Error> FilterPartitionChanges(std::string_view data,
+                                                        std::string_view uuid,
+                                                        uint64_t until) {
+  auto const id = PartitionId::Parse(uuid);
+  ChangeDecoder decoder;
+  decoder.Feed(data);
+  std::string filtered;
+  while (true) {
+    auto change = decoder.Next();
+    if (!change) return tl::unexpected(change.error());
+    if (!change->has_value()) break;
+    Change& next = **change;
+    if (next.sequence > until || !id.has_value() ||
+        PartitionId::Parse(next.partition) != id) {
+      continue;
+    }
+    next.partition = id->ToString();
+    auto record = EncodeChange(next);
+    if (!record) return tl::unexpected(record.error());
+    filtered += *record;
+  }
+  return filtered;
+}
+
+}  // namespace cppfs::storage
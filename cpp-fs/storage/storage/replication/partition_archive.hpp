@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+#include <vector>
+
+#include "error_types.h"
+#include "partition/partition.hpp"
+#include "replication/change_feed.hpp"
+
+namespace cppfs::storage {
+
+///
+/// Streams a partition as an archive of changes that recreate it.
+///
+/// The archive uses the encoding of the change feed: a kCreatePartition change
+/// followed by a kCreateDirectory change per directory and a
+/// kStoreRegularFile change per file, every directory before its entries. The
+/// tree is walked lazily, so only the file being exported is held in memory.
+/// Importing the archive is applying its changes with ApplyChange.
+///
+class PartitionExporter {
+ public:
+  PartitionExporter(Partition* partition, std::string uuid);
+
+  /// next encoded changes of about @c max_bytes, at least one change unless
+  /// the whole partition was exported, empty after that
+  tl::expected<std::string, Error> Next(size_t max_bytes);
+
+  /// changes exported so far
+  size_t GetExported() const { return exported_; }
+
+ private:
+  /// next change of the walk, nullopt once it is done
+  tl::expected<std::optional<Change>, Error> NextChange();
+
+  Partition* const partition_;
+  std::string const uuid_;
+  bool started_{false};
+  /// directories whose entries weren't listed yet
+  std::vector<std::filesystem::path> pending_dirs_;
+  /// directory the entries are listed from
+  std::filesystem::path dir_path_;
+  std::vector<Directory::DirEntry> entries_;
+  size_t next_entry_{0};
+  size_t exported_{0};
+};
+
+/// encoded changes of partition @c uuid with sequences up to @c until in
+/// @c data, a batch of encoded changes of the change feed. Partition ids
+/// match whatever their case, the changes name the partition in canonical
+/// form.
+tl::expected<std::string, Error> FilterPartitionChanges(std::string_view data,
+                                                        std::string_view uuid,
+                                                        uint64_t until);
+
+}  // namespace cppfs::storage
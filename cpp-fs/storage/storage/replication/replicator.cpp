@@ -0,0 +1,160 @@
+#include "replication/replicator.hpp"
+
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib.h"
+
+namespace cppfs::storage {
+
+namespace {
+
+/// time to stream a batch on top of the long-poll wait
+constexpr time_t kReadTimeoutMarginS = 10;
+
+uint64_t ParseSequence(std::string_view str) {
+  uint64_t sequence = 0;
+  std::from_chars(str.data(), str.data() + str.size(), sequence);
+  return sequence;
+}
+
+}  // namespace
+
+Replicator::Replicator(ReplicatorConfig config, ApplyFn apply)
+    : config_(std::move(config)), apply_(std::move(apply)) {
+  std::ifstream state(config_.state_path);
+  uint64_t applied = 0;
+  if (state >> applied) applied_.store(applied, std::memory_order_relaxed);
+}
+
+Replicator::~Replicator() { Stop(); }
+
+void Replicator::Start() {
+  thread_ = std::thread([this] { Run(); });
+}
+
+void Replicator::Stop() {
+  {
+    std::lock_guard const lock{mutex_};
+    stopped_ = true;
+  }
+  stop_cv_.notify_all();
+  if (thread_.joinable()) thread_.join();
+}
+
+void Replicator::CollectMetrics(PrometheusWriter& writer) const {
+  writer.Family("cppfs_replication_applied_sequence", "gauge",
+                "Sequence of the last change applied by the replica");
+  writer.Sample("cppfs_replication_applied_sequence", {},
+                GetAppliedSequence());
+
+  writer.Family("cppfs_replication_lag_changes", "gauge",
+                "Changes of the primary the replica hasn't applied yet");
+  uint64_t const primary = GetPrimarySequence();
+  uint64_t const applied = GetAppliedSequence();
+  writer.Sample("cppfs_replication_lag_changes", {},
+                primary > applied ? primary - applied : 0);
+
+  writer.Family("cppfs_replication_errors_total", "counter",
+                "Failed polls of the primary and changes that failed to "
+                "apply");
+  writer.Sample("cppfs_replication_errors_total", {{"type", "poll"}},
+                poll_errors_.Value());
+  writer.Sample("cppfs_replication_errors_total", {{"type", "apply"}},
+                apply_errors_.Value());
+}
+
+void Replicator::Run() {
+  /* polls reuse the connection to the primary */
+  httplib::SSLClient client(config_.host, config_.port);
+  client.set_keep_alive(true);
+  /* the token is only sent to a verified primary, httplib falls back to the
+     system CA store */
+  client.enable_server_certificate_verification(true);
+  if (!config_.ca_cert.empty()) {
+    client.set_ca_cert_path(config_.ca_cert.c_str());
+  }
+  auto const wait_s =
+      std::chrono::ceil<std::chrono::seconds>(config_.poll_wait).count();
+  client.set_read_timeout(static_cast<time_t>(wait_s + kReadTimeoutMarginS));
+
+  while (true) {
+    {
+      std::lock_guard const lock{mutex_};
+      if (stopped_) return;
+    }
+    if (Poll(client)) continue;
+
+    poll_errors_.Inc();
+    std::unique_lock lock{mutex_};
+    stop_cv_.wait_for(lock, config_.retry_delay, [this] { return stopped_; });
+  }
+}
+
+bool Replicator::Poll(httplib::SSLClient& client) {
+  uint64_t const since = GetAppliedSequence();
+  httplib::Params const params{
+      {"since", std::to_string(since)},
+      {"max_bytes", std::to_string(config_.batch_bytes)},
+      {"wait_ms", std::to_string(config_.poll_wait.count())},
+  };
+  httplib::Headers const headers{{kReplicationTokenHeader, config_.token}};
+
+  ChangeDecoder decoder;
+  bool corrupted = false;
+  auto res = client.Get(
+      "/replication/changes", params, headers,
+      [&](char const* data, size_t size) {
+        decoder.Feed({data, size});
+        while (true) {
+          auto change = decoder.Next();
+          if (!change) {
+            std::cerr << "Replication stream is corrupted: "
+                      << change.error().message << "\n";
+            corrupted = true;
+            return false;
+          }
+          if (!change->has_value()) return true;
+          Change const& next = **change;
+          if (next.sequence <= GetAppliedSequence()) continue;
+          if (auto applied = apply_(next); !applied) {
+            /* a change that can't be applied on the replica (e.g. over its
+               quota) must not stall replication of everything after it */
+            apply_errors_.Inc();
+            std::cerr << "Cannot apply change " << next.sequence << ": "
+                      << applied.error().message << "\n";
+          }
+          applied_.store(next.sequence, std::memory_order_relaxed);
+        }
+      });
+
+  if (GetAppliedSequence() != since) SaveState();
+  if (!res || corrupted || res->status != httplib::OK_200) {
+    if (res && res->status != httplib::OK_200) {
+      std::cerr << "Replication poll failed with status " << res->status
+                << "\n";
+    }
+    return false;
+  }
+  primary_.store(ParseSequence(res->get_header_value(kLastSequenceHeader)),
+                 std::memory_order_relaxed);
+  return true;
+}
+
+void Replicator::SaveState() {
+  if (config_.state_path.empty()) return;
+  std::filesystem::path tmp_path = config_.state_path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream state(tmp_path, std::ios::trunc);
+    state << GetAppliedSequence() << "\n";
+    if (!state) return;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, config_.state_path, ec);
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tl/expected.hpp>
+
+#include "error_types.h"
+#include "metrics/metrics.hpp"
+#include "replication/change_feed.hpp"
+#include "storage.hpp"
+
+namespace httplib {
+class SSLClient;
+}
+
+namespace cppfs::storage {
+
+/// header carrying the shared secret of the replication endpoint
+inline constexpr auto kReplicationTokenHeader = "X-Replication-Token";
+/// header with the last sequence in the primary's change feed
+inline constexpr auto kLastSequenceHeader = "X-Last-Sequence";
+
+struct ReplicatorConfig {
+  /// primary to replicate from
+  std::string host;
+  int port{0};
+  /// CA certificate to verify the primary with, the system CA store if empty
+  std::filesystem::path ca_cert{};
+  /// shared secret of the replication endpoint
+  std::string token{};
+  /// file with the sequence of the last applied change
+  std::filesystem::path state_path{};
+  /// encoded changes requested per poll
+  size_t batch_bytes{1 << 20};
+  /// how long the primary holds a poll open when there are no new changes
+  std::chrono::milliseconds poll_wait{5000};
+  /// pause after a failed poll
+  std::chrono::milliseconds retry_delay{1000};
+};
+
+///
+/// Replica side of asynchronous partition replication.
+///
+/// A background thread long-polls the primary's change feed and applies the
+/// streamed changes in order as they arrive. The last applied sequence is
+/// persisted after every batch, so a restarted replica resumes where it left
+/// off. Applying a change is idempotent, changes replayed after a crash
+/// between applying and persisting are harmless.
+///
+class Replicator {
+ public:
+  using ApplyFn = std::function<tl::expected<void, Error>(Change const&)>;
+
+  Replicator(ReplicatorConfig config, ApplyFn apply);
+  ~Replicator();
+
+  Replicator(Replicator const&) = delete;
+  Replicator& operator=(Replicator const&) = delete;
+
+  void Start();
+  void Stop();
+
+  uint64_t GetAppliedSequence() const {
+    return applied_.load(std::memory_order_relaxed);
+  }
+
+  /// last sequence reported by the primary
+  uint64_t GetPrimarySequence() const {
+    return primary_.load(std::memory_order_relaxed);
+  }
+
+  void CollectMetrics(PrometheusWriter& writer) const;
+
+ private:
+  void Run();
+  /// fetch and apply the next batch, false if the primary couldn't be polled
+  bool Poll(httplib::SSLClient& client);
+  void SaveState();
+
+  ReplicatorConfig const config_;
+  ApplyFn const apply_;
+  std::atomic<uint64_t> applied_{0};
+  std::atomic<uint64_t> primary_{0};
+  Counter apply_errors_;
+  Counter poll_errors_;
+  bool stopped_{false};
+  std::mutex mutex_;
+  std::condition_variable stop_cv_;
+  std::thread thread_;
+};
+
+/// apply replicated @c change to @c storage, changes that were already
+/// applied succeed
+template <typename Manager>
+tl::expected<void, Error> ApplyChange(Storage<Manager>& storage,
+                                      Change const& change) {
+  auto ignore_existing = [](auto const& result) -> tl::expected<void, Error> {
+    if (!result.has_value() && result.error().code != ErrorEnum::kAlreadyExists)
+      return tl::unexpected(result.error());
+    return {};
+  };
+
+  switch (change.op) {
+    case ChangeOp::kCreatePartition:
+      return ignore_existing(storage.CreatePartition(change.partition));
+    case ChangeOp::kBindClient: {
+      auto const id = ParsePartitionId(change.partition);
+      if (!id) return tl::unexpected(id.error());
+      return storage.GetManager().BindClient(change.name, *id);
+    }
+    case ChangeOp::kCreateDirectory:
+    case ChangeOp::kStoreRegularFile:
+    case ChangeOp::kWriteRegularFile:
+    case ChangeOp::kTruncateRegularFile:
+      break;
+  }
+
+  auto partition = storage.LookupPartition(change.partition);
+  if (!partition) return tl::unexpected(partition.error());
+  if (change.op == ChangeOp::kWriteRegularFile ||
+      change.op == ChangeOp::kTruncateRegularFile) {
+    auto file = partition.value()->OpenRegularFile(
+        std::filesystem::path{change.path} / change.name);
+    if (!file) return tl::unexpected(file.error());
+    if (change.op == ChangeOp::kWriteRegularFile) {
+      return file.value()->PositionalWrite(change.offset, change.data);
+    }
+    return file.value()->Truncate(change.offset);
+  }
+
+  auto dir = partition.value()->OpenDir(change.path);
+  if (!dir) return tl::unexpected(dir.error());
+  if (change.op == ChangeOp::kCreateDirectory) {
+    return ignore_existing(dir.value()->CreateDirectory(change.name));
+  }
+  return ignore_existing(
+      dir.value()->StoreRegularFile(change.name, std::string{change.data}));
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,72 @@
+#include "scheduling/fair_scheduler.hpp"
+
+#include <algorithm>
+
+namespace cppfs::storage {
+
+namespace {
+/// tenants whose finish tag fell behind the virtual time carry no state, drop
+/// them once there are this many
+constexpr size_t kPruneThreshold = 4096;
+}  // namespace
+
+FairScheduler::Slot FairScheduler::Acquire(std::string const& tenant,
+                                           double cost) {
+  if (!IsEnabled()) return {};
+  double const weight = GetWeight(tenant);
+
+  std::unique_lock lock{mutex_};
+  if (finish_tags_.size() >= kPruneThreshold) {
+    std::erase_if(finish_tags_, [this](auto const& entry) {
+      return entry.second <= virtual_time_;
+    });
+  }
+  double& finish_tag = finish_tags_[tenant];
+  double const start_tag = std::max(virtual_time_, finish_tag);
+  finish_tag = start_tag + cost / weight;
+
+  if (running_ < config_.concurrency && queue_.empty()) {
+    ++running_;
+    virtual_time_ = start_tag;
+    return Slot{this};
+  }
+
+  Waiter waiter{.start_tag = start_tag, .sequence = next_sequence_++};
+  queue_.push(&waiter);
+  ++delayed_;
+  waiter.cv.wait(lock, [&waiter] { return waiter.granted; });
+  return Slot{this};
+}
+
+double FairScheduler::GetWeight(std::string const& tenant) const {
+  if (auto it = config_.weights.find(tenant); it != config_.weights.end()) {
+    return it->second;
+  }
+  return config_.default_weight;
+}
+
+size_t FairScheduler::GetQueued() const {
+  std::lock_guard const lock{mutex_};
+  return queue_.size();
+}
+
+uint64_t FairScheduler::GetDelayed() const {
+  std::lock_guard const lock{mutex_};
+  return delayed_;
+}
+
+void FairScheduler::Release() {
+  std::lock_guard const lock{mutex_};
+  if (queue_.empty()) {
+    --running_;
+    return;
+  }
+  /* hand the slot over to the next request, running_ stays the same */
+  Waiter* next = queue_.top();
+  queue_.pop();
+  virtual_time_ = std::max(virtual_time_, next->start_tag);
+  next->granted = true;
+  next->cv.notify_one();
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cppfs::storage {
+
+struct FairSchedulerConfig {
+  /// requests executed at once, 0 disables scheduling
+  size_t concurrency{4};
+  /// weight of tenants missing from @c weights
+  double default_weight{1.0};
+  /// tenant -> share of the execution slots relative to other tenants
+  std::unordered_map<std::string, double> weights{};
+};
+
+///
+/// Weighted fair queuing of request execution between tenants.
+///
+/// Implements start-time fair queuing: a request of a tenant is tagged with
+/// max(virtual time, finish tag of the tenant's previous request) and its
+/// finish tag advances by cost / weight. Free execution slots are given to the
+/// queued request with the smallest tag, and the virtual time follows the tag
+/// of the last started request. A backlogged tenant therefore gets its
+/// weighted share of the slots no matter how many requests it sends, and a
+/// tenant that was idle is served next without accumulating credit.
+///
+class FairScheduler {
+ public:
+  /// execution slot, released on destruction
+  class Slot {
+   public:
+    Slot() = default;
+
+    Slot(Slot&& other) noexcept
+        : scheduler_(std::exchange(other.scheduler_, nullptr)) {}
+
+    Slot& operator=(Slot&& other) noexcept {
+      if (this != &other) {
+        Release();
+        scheduler_ = std::exchange(other.scheduler_, nullptr);
+      }
+      return *this;
+    }
+
+    ~Slot() { Release(); }
+
+    explicit operator bool() const { return scheduler_ != nullptr; }
+
+   private:
+    friend class FairScheduler;
+
+    explicit Slot(FairScheduler* scheduler) : scheduler_(scheduler) {}
+
+    void Release() {
+      if (scheduler_ != nullptr) std::exchange(scheduler_, nullptr)->Release();
+    }
+
+    FairScheduler* scheduler_{nullptr};
+  };
+
+  explicit FairScheduler(FairSchedulerConfig config)
+      : config_(std::move(config)) {}
+
+  FairScheduler(FairScheduler const&) = delete;
+  FairScheduler& operator=(FairScheduler const&) = delete;
+
+  bool IsEnabled() const { return config_.concurrency != 0; }
+
+  /// block until a request of @c tenant costing @c cost may run
+  Slot Acquire(std::string const& tenant, double cost = 1.0);
+
+  double GetWeight(std::string const& tenant) const;
+
+  /// requests waiting for a slot
+  size_t GetQueued() const;
+
+  /// requests that had to wait for a slot
+  uint64_t GetDelayed() const;
+
+ private:
+  struct Waiter {
+    double start_tag;
+    uint64_t sequence;
+    bool granted{false};
+    std::condition_variable cv{};
+  };
+
+  struct LaterWaiter {
+    bool operator()(Waiter const* lhs, Waiter const* rhs) const {
+      if (lhs->start_tag != rhs->start_tag) {
+        return lhs->start_tag > rhs->start_tag;
+      }
+      return lhs->sequence > rhs->sequence;
+    }
+  };
+
+  void Release();
+
+  FairSchedulerConfig const config_;
+  double virtual_time_{0};
+  size_t running_{0};
+  uint64_t next_sequence_{0};
+  uint64_t delayed_{0};
+  /// finish tag of the last request of each tenant
+  std::unordered_map<std::string, double> finish_tags_;
+  std::priority_queue<Waiter*, std::vector<Waiter*>, LaterWaiter> queue_;
+  mutable std::mutex mutex_;
+};
+
+}  // namespace cppfs::storage
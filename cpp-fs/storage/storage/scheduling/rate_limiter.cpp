@@ -0,0 +1,118 @@
+#include "scheduling/rate_limiter.hpp"
+
+#include <algorithm>
+
+namespace cppfs::storage {
+
+namespace {
+/// prune the buckets of idle tenants once there are this many, then
+/// whenever their number doubled since
+constexpr size_t kPruneThreshold = 4096;
+}  // namespace
+
+TokenBucket::TokenBucket(double rate, double burst, Clock::time_point now)
+    : rate_(rate), burst_(std::max(burst, 1.0)), tokens_(burst_),
+      updated_(now) {}
+
+bool TokenBucket::TryTake(double tokens, Clock::time_point now) {
+  if (IsUnlimited()) return true;
+  Refill(now);
+  if (tokens_ < tokens) return false;
+  tokens_ -= tokens;
+  return true;
+}
+
+void TokenBucket::Charge(double tokens, Clock::time_point now) {
+  if (IsUnlimited()) return;
+  Refill(now);
+  tokens_ -= tokens;
+}
+
+TokenBucket::Clock::duration TokenBucket::GetWaitTime(double tokens,
+                                                      Clock::time_point now) {
+  if (IsUnlimited()) return Clock::duration::zero();
+  Refill(now);
+  if (tokens_ >= tokens) return Clock::duration::zero();
+  return std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>((tokens - tokens_) / rate_));
+}
+
+bool TokenBucket::IsFull(Clock::time_point now) const {
+  if (IsUnlimited()) return true;
+  double const elapsed_s =
+      now > updated_ ? std::chrono::duration<double>(now - updated_).count()
+                     : 0;
+  return tokens_ + elapsed_s * rate_ >= burst_;
+}
+
+void TokenBucket::Refill(Clock::time_point now) {
+  if (now <= updated_) return;
+  double const elapsed_s =
+      std::chrono::duration<double>(now - updated_).count();
+  tokens_ = std::min(burst_, tokens_ + elapsed_s * rate_);
+  updated_ = now;
+}
+
+RateLimiter::RateLimiter(RateLimits const& limits)
+    : limits_(limits), prune_size_(kPruneThreshold) {}
+
+std::optional<RateLimiter::Clock::duration> RateLimiter::Admit(
+    std::string const& tenant, Clock::time_point now) {
+  if (!IsEnabled()) return std::nullopt;
+  std::lock_guard const lock{mutex_};
+  Buckets& buckets = GetBuckets(tenant, now);
+  /* bytes are charged after the response, so only require to be out of debt */
+  Clock::duration const bytes_wait = buckets.bytes.GetWaitTime(0, now);
+  if (bytes_wait > Clock::duration::zero()) {
+    rejected_.Inc();
+    return bytes_wait;
+  }
+  if (!buckets.requests.TryTake(1, now)) {
+    rejected_.Inc();
+    return buckets.requests.GetWaitTime(1, now);
+  }
+  return std::nullopt;
+}
+
+void RateLimiter::Charge(std::string const& tenant, uint64_t bytes,
+                         Clock::time_point now) {
+  if (limits_.bytes_per_s == 0) return;
+  std::lock_guard const lock{mutex_};
+  GetBuckets(tenant, now).bytes.Charge(static_cast<double>(bytes), now);
+}
+
+size_t RateLimiter::GetTenantCount() {
+  std::lock_guard const lock{mutex_};
+  return buckets_.size();
+}
+
+RateLimiter::Buckets& RateLimiter::GetBuckets(std::string const& tenant,
+                                              Clock::time_point now) {
+  if (auto it = buckets_.find(tenant); it != buckets_.end()) {
+    return it->second;
+  }
+  if (buckets_.size() >= prune_size_) Prune(now);
+  return buckets_
+      .try_emplace(tenant,
+                   Buckets{
+                       .requests = TokenBucket{limits_.requests_per_s,
+                                               limits_.requests_per_s *
+                                                   limits_.burst_s,
+                                               now},
+                       .bytes = TokenBucket{limits_.bytes_per_s,
+                                            limits_.bytes_per_s *
+                                                limits_.burst_s,
+                                            now},
+                   })
+      .first->second;
+}
+
+void RateLimiter::Prune(Clock::time_point now) {
+  std::erase_if(buckets_, [now](auto const& entry) {
+    Buckets const& buckets = entry.second;
+    return buckets.requests.IsFull(now) && buckets.bytes.IsFull(now);
+  });
+  prune_size_ = std::max(kPruneThreshold, 2 * buckets_.size());
+}
+
+}  // namespace cppfs::storage
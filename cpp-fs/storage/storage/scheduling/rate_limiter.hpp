@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "metrics/metrics.hpp"
+
+namespace cppfs::storage {
+
+///
+/// Classic token bucket.
+///
+/// Tokens are refilled continuously with a fixed rate up to the burst size.
+/// Costs that are only known after the fact (e.g. response bytes) are charged
+/// unconditionally and may leave the bucket in debt, which delays the
+/// following requests instead.
+///
+/// Not thread-safe.
+///
+class TokenBucket {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /// refill @c rate tokens per second, a rate of 0 means unlimited
+  TokenBucket(double rate, double burst, Clock::time_point now = Clock::now());
+
+  /// take @c tokens if the bucket holds that many
+  bool TryTake(double tokens, Clock::time_point now = Clock::now());
+
+  /// take @c tokens, possibly going into debt
+  void Charge(double tokens, Clock::time_point now = Clock::now());
+
+  /// time until the bucket holds @c tokens, zero if it already does
+  Clock::duration GetWaitTime(double tokens,
+                              Clock::time_point now = Clock::now());
+
+  /// true if the bucket refilled up to its burst size, it then behaves like
+  /// a new bucket
+  bool IsFull(Clock::time_point now = Clock::now()) const;
+
+  bool IsUnlimited() const { return rate_ == 0; }
+
+ private:
+  void Refill(Clock::time_point now);
+
+  double const rate_;
+  double const burst_;
+  double tokens_;
+  Clock::time_point updated_;
+};
+
+struct RateLimits {
+  /// requests per second of a single partition, 0 means unlimited
+  double requests_per_s{0};
+  /// request and response payload bytes per second of a single partition,
+  /// 0 means unlimited
+  double bytes_per_s{0};
+  /// seconds of traffic a partition may send at once after being idle
+  double burst_s{1.0};
+};
+
+///
+/// Per-partition request and bandwidth limits.
+///
+/// Tenants are expected to be validated partition ids. The buckets of
+/// tenants that were idle long enough to refill completely are dropped, so
+/// memory is bounded by the tenants active within the burst interval.
+///
+class RateLimiter {
+ public:
+  using Clock = TokenBucket::Clock;
+
+  explicit RateLimiter(RateLimits const& limits);
+
+  bool IsEnabled() const {
+    return limits_.requests_per_s != 0 || limits_.bytes_per_s != 0;
+  }
+
+  /// admit a request of @c tenant, if it is over its limits return the time
+  /// after which it may retry
+  std::optional<Clock::duration> Admit(std::string const& tenant,
+                                       Clock::time_point now = Clock::now());
+
+  /// account @c bytes transferred by a request of @c tenant
+  void Charge(std::string const& tenant, uint64_t bytes,
+              Clock::time_point now = Clock::now());
+
+  uint64_t GetRejected() const { return rejected_.Value(); }
+
+  /// tenants with buckets, including idle ones not dropped yet
+  size_t GetTenantCount();
+
+ private:
+  struct Buckets {
+    TokenBucket requests;
+    TokenBucket bytes;
+  };
+
+  Buckets& GetBuckets(std::string const& tenant, Clock::time_point now);
+
+  /// drop the buckets that refilled completely
+  void Prune(Clock::time_point now);
+
+  RateLimits const limits_;
+  std::unordered_map<std::string, Buckets> buckets_;
+  /// tenants with buckets at which they are pruned next
+  size_t prune_size_;
+  std::mutex mutex_;
+  Counter rejected_;
+};
+
+}  // namespace cppfs::storage
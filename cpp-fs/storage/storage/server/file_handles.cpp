@@ -0,0 +1,120 @@
+#include "server/file_handles.hpp"
+
+#include <format>
+#include <iterator>
+#include <utility>
+
+#include <boost/uuid/random_generator.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+namespace cppfs::storage {
+
+namespace {
+
+/// random, handles of other clients can't be guessed
+std::string GenerateHandleId() {
+  static thread_local boost::uuids::random_generator generator;
+  return boost::uuids::to_string(generator());
+}
+
+Error HandleNotFound(std::string_view id) {
+  return Error{ErrorEnum::kNotFound,
+               std::format("File handle '{}' not found or expired", id)};
+}
+
+}  // namespace
+
+FileHandleTable::FileHandleTable(FileHandleConfig config) : config_(config) {}
+
+tl::expected<std::string, Error> FileHandleTable::Open(std::string client,
+                                                       Partition* partition,
+                                                       RegularFile* file,
+                                                       std::string path) {
+  auto handle = std::make_shared<Handle>();
+  handle->client = std::move(client);
+  handle->partition = partition;
+  handle->file = file;
+  handle->path = std::move(path);
+
+  auto const now = std::chrono::steady_clock::now();
+  std::lock_guard const lock{mutex_};
+  /* a client at its limit may hold expired handles */
+  if (now - last_expired_ >= kExpireInterval ||
+      GetClientHandlesLocked(handle->client) >= config_.max_per_client) {
+    ExpireLocked(now);
+  }
+  if (size_t const open = GetClientHandlesLocked(handle->client);
+      open >= config_.max_per_client) {
+    return tl::unexpected(
+        Error{ErrorEnum::kRateLimited,
+              std::format("Client '{}' has {} file handles open already",
+                          handle->client, open)});
+  }
+  ++client_handles_[handle->client];
+  std::string id = GenerateHandleId();
+  handles_.emplace(id, Entry{.handle = std::move(handle), .last_used = now});
+  return id;
+}
+
+tl::expected<std::shared_ptr<FileHandleTable::Handle>, Error>
+FileHandleTable::Acquire(std::string_view id) {
+  auto const now = std::chrono::steady_clock::now();
+  std::lock_guard const lock{mutex_};
+  auto it = handles_.find(std::string{id});
+  if (it == handles_.end()) return tl::unexpected(HandleNotFound(id));
+  if (now - it->second.last_used > config_.idle_timeout) {
+    EraseLocked(it);
+    return tl::unexpected(HandleNotFound(id));
+  }
+  it->second.last_used = now;
+  return it->second.handle;
+}
+
+bool FileHandleTable::Close(std::string_view id) {
+  std::lock_guard const lock{mutex_};
+  auto it = handles_.find(std::string{id});
+  if (it == handles_.end()) return false;
+  EraseLocked(it);
+  return true;
+}
+
+size_t FileHandleTable::Expire(std::chrono::steady_clock::time_point now) {
+  std::lock_guard const lock{mutex_};
+  return ExpireLocked(now);
+}
+
+size_t FileHandleTable::GetSize() const {
+  std::lock_guard const lock{mutex_};
+  return handles_.size();
+}
+
+size_t FileHandleTable::GetClientHandlesLocked(
+    std::string const& client) const {
+  auto it = client_handles_.find(client);
+  return it == client_handles_.end() ? 0 : it->second;
+}
+
+size_t FileHandleTable::ExpireLocked(
+    std::chrono::steady_clock::time_point now) {
+  last_expired_ = now;
+  size_t expired = 0;
+  for (auto it = handles_.begin(); it != handles_.end();) {
+    auto const next = std::next(it);
+    if (now - it->second.last_used > config_.idle_timeout) {
+      EraseLocked(it);
+      ++expired;
+    }
+    it = next;
+  }
+  return expired;
+}
+
+void FileHandleTable::EraseLocked(
+    std::unordered_map<std::string, Entry>::const_iterator it) {
+  auto client = client_handles_.find(it->second.handle->client);
+  if (--client->second == 0) client_handles_.erase(client);
+  handles_.erase(it);
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+#include <unordered_map>
+
+#include "error_types.h"
+#include "partition/partition.hpp"
+
+namespace cppfs::storage {
+
+struct FileHandleConfig {
+  /// handles unused for this long are closed
+  std::chrono::seconds idle_timeout{60};
+  /// handles a client may hold open at once
+  size_t max_per_client{64};
+};
+
+///
+/// Files opened by clients for a sequence of reads.
+///
+/// A handle pins the file object and its partition, resolved once when the
+/// file is opened, and has a cursor of its own, so chunked reads skip the
+/// lookups and concurrent readers of a file don't move each other's
+/// position. Reads see the file as it is then, writes and truncations
+/// made since it was opened included. Handles are
+/// closed by their client or after being idle for the configured timeout;
+/// expired handles are dropped as they are found and by periodic sweeps
+/// when handles are opened.
+///
+class FileHandleTable {
+ public:
+  struct Handle {
+    /// the client, the partition uuid of the request that opened the handle
+    std::string client;
+    Partition* partition{nullptr};
+    RegularFile* file{nullptr};
+    std::string path{};
+    /// reads of a handle are serialized, they move the cursor
+    std::mutex mutex{};
+    size_t offset{0};
+  };
+
+  explicit FileHandleTable(FileHandleConfig config = {});
+
+  FileHandleTable(FileHandleTable const&) = delete;
+  FileHandleTable& operator=(FileHandleTable const&) = delete;
+
+  /// open a handle of @c client for @c file of @c partition and return its
+  /// id, fails if the client has too many handles open
+  tl::expected<std::string, Error> Open(std::string client,
+                                        Partition* partition,
+                                        RegularFile* file, std::string path);
+
+  /// the handle @c id, marked as used
+  tl::expected<std::shared_ptr<Handle>, Error> Acquire(std::string_view id);
+
+  /// false if there is no such handle
+  bool Close(std::string_view id);
+
+  /// close the handles idle for longer than the timeout
+  size_t Expire(std::chrono::steady_clock::time_point now =
+                    std::chrono::steady_clock::now());
+
+  size_t GetSize() const;
+
+ private:
+  struct Entry {
+    std::shared_ptr<Handle> handle;
+    std::chrono::steady_clock::time_point last_used;
+  };
+
+  /// opening a handle sweeps the table at most this often
+  static constexpr std::chrono::seconds kExpireInterval{1};
+
+  size_t GetClientHandlesLocked(std::string const& client) const;
+  size_t ExpireLocked(std::chrono::steady_clock::time_point now);
+  void EraseLocked(
+      std::unordered_map<std::string, Entry>::const_iterator it);
+
+  FileHandleConfig const config_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Entry> handles_;
+  /// open handles per client
+  std::unordered_map<std::string, size_t> client_handles_;
+  std::chrono::steady_clock::time_point last_expired_{};
+};
+
+}  // namespace cppfs::storage
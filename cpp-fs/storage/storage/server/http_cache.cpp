@@ -0,0 +1,76 @@
+#include "server/http_cache.hpp"
+
+#include <ctime>
+#include <format>
+
+namespace cppfs::storage {
+
+namespace {
+
+constexpr auto kHttpDateFormat = "%a, %d %b %Y %H:%M:%S GMT";
+
+/// remove leading and trailing spaces and tabs
+std::string_view Trim(std::string_view value) {
+  size_t const begin = value.find_first_not_of(" \t");
+  if (begin == std::string_view::npos) return {};
+  size_t const end = value.find_last_not_of(" \t");
+  return value.substr(begin, end - begin + 1);
+}
+
+/// If-None-Match uses the weak comparison, W/ prefixes are ignored
+bool MatchesETag(std::string_view if_none_match, std::string_view etag) {
+  while (!if_none_match.empty()) {
+    size_t const comma = if_none_match.find(',');
+    std::string_view tag = Trim(if_none_match.substr(0, comma));
+    if_none_match = comma == std::string_view::npos
+                        ? std::string_view{}
+                        : if_none_match.substr(comma + 1);
+    if (tag == "*") return true;
+    if (tag.starts_with("W/")) tag.remove_prefix(2);
+    if (tag == etag) return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+std::string FormatETag(FileVersion const& version) {
+  return std::format("\"{:x}\"", version.tag);
+}
+
+std::string FormatHttpDate(std::chrono::system_clock::time_point time) {
+  std::time_t const seconds = std::chrono::system_clock::to_time_t(time);
+  std::tm tm{};
+  ::gmtime_r(&seconds, &tm);
+  char buffer[32];
+  size_t const size =
+      std::strftime(buffer, sizeof(buffer), kHttpDateFormat, &tm);
+  return {buffer, size};
+}
+
+std::optional<std::chrono::system_clock::time_point> ParseHttpDate(
+    std::string_view date) {
+  std::string const text{Trim(date)};
+  std::tm tm{};
+  char const* const end = ::strptime(text.c_str(), kHttpDateFormat, &tm);
+  if (end == nullptr || *end != '\0') return std::nullopt;
+  std::time_t const seconds = ::timegm(&tm);
+  if (seconds == -1) return std::nullopt;
+  return std::chrono::system_clock::from_time_t(seconds);
+}
+
+bool IsNotModified(std::string_view if_none_match,
+                   std::string_view if_modified_since,
+                   FileVersion const& version) {
+  if (version.tag == 0) return false;
+  if (!if_none_match.empty()) {
+    return MatchesETag(if_none_match, FormatETag(version));
+  }
+  if (if_modified_since.empty()) return false;
+  auto const since = ParseHttpDate(if_modified_since);
+  /* dates have a resolution of seconds */
+  return since.has_value() &&
+         std::chrono::floor<std::chrono::seconds>(version.modified) <= *since;
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "partition/partition.hpp"
+
+namespace cppfs::storage {
+
+/// strong entity tag of @c version, quoted
+std::string FormatETag(FileVersion const& version);
+
+/// IMF-fixdate, e.g. `Sun, 06 Nov 1994 08:49:37 GMT`
+std::string FormatHttpDate(std::chrono::system_clock::time_point time);
+
+/// parse an IMF-fixdate, nullopt for other or malformed dates
+std::optional<std::chrono::system_clock::time_point> ParseHttpDate(
+    std::string_view date);
+
+/// Evaluate the preconditions of a conditional GET (RFC 9110, 13.2.2).
+/// If-None-Match takes precedence, If-Modified-Since is only evaluated
+/// without it. Empty headers are absent, a version with an unknown tag never
+/// matches.
+bool IsNotModified(std::string_view if_none_match,
+                   std::string_view if_modified_since,
+                   FileVersion const& version);
+
+}  // namespace cppfs::storage
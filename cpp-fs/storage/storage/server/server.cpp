@@ -1,19 +1,47 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #include <boost/json.hpp>
-#include <boost/uuid/uuid.hpp>
-#include <boost/uuid/uuid_generators.hpp>
-#include <boost/uuid/uuid_io.hpp>
 
+#include "archive/gzip.hpp"
+#include "archive/tar_export.hpp"
+#include "archive/tar_import.hpp"
 #include "error_types.h"
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include "httplib.h"
+#include "metrics/metrics.hpp"
+#include "metrics/system_stats.hpp"
+#include "partition/backend.hpp"
+#include "partition/checksum.hpp"
+#include "partition/dedup.hpp"
 #include "partition/in_memory_partition.hpp"
+#include "partition/name_index.hpp"
 #include "partition/on_disk_partition.hpp"
 #include "partition/partition.hpp"
+#include "partition/usage.hpp"
+#include "partition/watch_log.hpp"
+#include "replication/change_feed.hpp"
+#include "replication/partition_archive.hpp"
+#include "replication/replicator.hpp"
+#include "scheduling/fair_scheduler.hpp"
+#include "scheduling/rate_limiter.hpp"
+#include "server/file_handles.hpp"
+#include "server/http_cache.hpp"
+#include "server/server.hpp"
+#include "server/tls.hpp"
 #include "storage.hpp"
+#include "tracing/tracing.hpp"
 
 namespace cppfs::storage {
 
@@ -23,7 +51,67 @@ cppfs::storage::Storage<T>* CreateDefaultStorage() {
   return new cppfs::storage::Storage<T>(std::make_unique<T>());
 }
 
-constexpr auto kValidUUID = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+/// Routes served by the storage, used to label request metrics
+constexpr std::array kRoutes = {
+    "/ping",
+    "/metrics",
+    "/stats",
+    "/debug/traces",
+    "/partition/:id",
+    "/partition/:id/freeze",
+    "/partition/:id/unfreeze",
+    "/ls",
+    "/find",
+    "/watch",
+    "/cat",
+    "/open",
+    "/read",
+    "/close",
+    "/mkdir",
+    "/store",
+    "/write",
+    "/append",
+    "/truncate",
+    "/create_client",
+    "/replication/changes",
+    "/export",
+    "/import",
+    "/untar",
+    "/archive",
+};
+
+/// Start time of the request handled by the current worker thread. httplib
+/// runs the pre-routing handler, the route handler and the post-routing
+/// handler of a request on the same thread.
+thread_local std::chrono::steady_clock::time_point request_start;
+
+/// Whether the pre-routing handler counted the request handled by the
+/// current worker thread. httplib also runs the post-routing handler for
+/// the responses to requests it failed to parse, which were never counted.
+thread_local bool request_counted{false};
+
+void BeginRequestMetrics() {
+  request_start = std::chrono::steady_clock::now();
+  request_counted = true;
+  GlobalMetrics().InFlight().Add(1);
+  GlobalMetrics().Requests().Mark(request_start);
+}
+
+void EndRequestMetrics(httplib::Request const& req,
+                       httplib::Response const& res) {
+  if (!request_counted) return;
+  request_counted = false;
+  GlobalMetrics().MatchRoute(req.path).Record(
+      std::chrono::steady_clock::now() - request_start, res.status);
+  GlobalMetrics().InFlight().Add(-1);
+}
+
+/// invoke @c fn and account its time to @c stage of the traced request
+template <typename Fn>
+decltype(auto) Traced(TraceStage stage, Fn&& fn) {
+  ScopedTraceStage const trace_stage{stage};
+  return std::forward<Fn>(fn)();
+}
 
 httplib::StatusCode ErrorEnumToStatusCode(ErrorEnum internal_code) {
   using namespace cppfs::storage;
@@ -35,9 +123,13 @@ httplib::StatusCode ErrorEnumToStatusCode(ErrorEnum internal_code) {
     case ErrorEnum::kAlreadyExists:
       return httplib::BadRequest_400;
     case ErrorEnum::kOutOfMemory:
-      return httplib::NotFound_404;
+      return httplib::InsufficientStorage_507;
     case ErrorEnum::kDirectory:
       return httplib::Forbidden_403;
+    case ErrorEnum::kRateLimited:
+      return httplib::TooManyRequests_429;
+    case ErrorEnum::kReadOnly:
+      return httplib::Forbidden_403;
     default:
       return httplib::InternalServerError_500;
   }
@@ -57,15 +149,33 @@ void SetError(
   };
   res.status = status;
   res.set_content(boost::json::serialize(error_info), "text/json");
+  GlobalMetrics().RecordError(error.code);
 }
 
-using ClientId = std::string;
+/// Listings and file contents may change any time: clients may keep them,
+/// but have to revalidate them, shared caches must not store them
+constexpr auto kCacheControl = "private, no-cache";
 
-std::unordered_map<ClientId, std::string> client_id_to_uuid_;
+/// set the validators of a file of @c version, reply with 304 and return
+/// true if the client's copy is current
+bool ServeNotModified(httplib::Request const& req, httplib::Response& res,
+                      FileVersion const& version) {
+  res.set_header("Cache-Control", kCacheControl);
+  if (version.tag == 0) return false;
+  res.set_header("ETag", FormatETag(version));
+  res.set_header("Last-Modified", FormatHttpDate(version.modified));
+  if (!IsNotModified(req.get_header_value("If-None-Match"),
+                     req.get_header_value("If-Modified-Since"), version)) {
+    return false;
+  }
+  res.status = httplib::NotModified_304;
+  return true;
+}
 
 template <typename T>
-tl::expected<Partition*, Error> LookupPartitionForRequest(
+tl::expected<PartitionOf<T>*, Error> LookupPartitionForRequest(
     httplib::Request const& req, Storage<T>* storage) {
+  ScopedTraceStage const trace_stage{TraceStage::kLookupPartition};
   std::string uuid = req.get_param_value("uuid");
   if (uuid.empty()) {
     return tl::unexpected(
@@ -82,6 +192,284 @@ tl::expected<Partition*, Error> LookupPartitionForRequest(
       .message = "couldn't find partition with specified uuid: " + req.body});
 }
 
+/// canonical form of the request's `uuid`. Partition ids are case
+/// insensitive, changes, file handles and tenants name partitions by this
+/// form only.
+std::string RequestUuid(httplib::Request const& req) {
+  return CanonicalUuid(req.get_param_value("uuid"));
+}
+
+/// Writes rejected by admission control
+struct AdmissionRejections {
+  /// node is above its high watermark
+  Counter shed;
+  /// partition quota would be exceeded
+  Counter over_quota;
+};
+
+AdmissionRejections& GetAdmissionRejections() {
+  static AdmissionRejections rejections;
+  return rejections;
+}
+
+/// url-encoded payload takes at most 3 bytes per byte, leave some room for
+/// the other form fields
+constexpr uint64_t kFormOverheadBytes = 1024;
+
+/// whether @c req is one of the writes admission control applies to
+bool IsAdmittedWrite(httplib::Request const& req) {
+  return req.method == "POST" &&
+         (req.path == "/store" || req.path == "/mkdir" ||
+          req.path == "/write" || req.path == "/append" ||
+          req.path == "/untar");
+}
+
+/// Reject a write to @c partition with 507 if the partition is already full
+/// or the payload can't fit into its quota. The payload size is estimated
+/// from the Content-Length, so this works before the body is read.
+bool AdmitPartitionWrite(httplib::Request const& req, httplib::Response& res,
+                         Partition* partition) {
+  if (!IsAdmittedWrite(req)) return true;
+
+  UsageTracker const& usage = partition->GetUsage();
+  Usage const used = usage.GetUsage();
+  Quota const& quota = usage.GetQuota();
+  bool const is_store = req.path == "/store";
+  bool const adds_bytes = is_store || req.path == "/append";
+  std::string const length_str = req.get_header_value("Content-Length");
+  uint64_t content_length = 0;
+  std::from_chars(length_str.data(), length_str.data() + length_str.size(),
+                  content_length);
+  uint64_t const min_payload =
+      content_length > kFormOverheadBytes
+          ? (content_length - kFormOverheadBytes) / 3
+          : 0;
+  /* archives also hold headers and padding, their contents are only
+     checked against a partition that is already full */
+  bool const full =
+      (adds_bytes && (usage.GetAvailableBytes() == 0 ||
+                      min_payload > usage.GetAvailableBytes())) ||
+      (req.path == "/untar" && usage.GetAvailableBytes() == 0) ||
+      (is_store && quota.files != 0 && used.files >= quota.files) ||
+      (req.path == "/mkdir" && quota.directories != 0 &&
+       used.directories >= quota.directories);
+  if (!full) return true;
+
+  GetAdmissionRejections().over_quota.Inc();
+  SetError(res, Error{.code = ErrorEnum::kOutOfMemory,
+                      .message = std::format(
+                          "Partition '{}' has no room for the write",
+                          req.get_param_value("uuid"))});
+  return false;
+}
+
+/// Admission control for writes, runs before the request body is read.
+///
+/// Writes are shed with 503 while the node is above its high watermark and
+/// rejected with 507 if the partition is already full or the payload can't
+/// fit into its quota, so a single tenant filling up its quota or the node
+/// doesn't make the server buffer payloads it is going to reject anyway.
+/// Truncation may free space and is never rejected, positional writes may
+/// overwrite data in place and are left to the partition's own accounting.
+/// The partition of a form-encoded write is only known once its body is
+/// parsed, BeginWrite() admits those.
+template <typename T>
+bool AdmitWrite(httplib::Request const& req, httplib::Response& res,
+                Storage<T>* storage, std::shared_mutex* backend_mutex) {
+  if (!IsAdmittedWrite(req)) return true;
+
+  NodeUsage const& node = storage->GetManager().GetNodeUsage();
+  if (node.IsAboveHighWatermark()) {
+    GetAdmissionRejections().shed.Inc();
+    res.set_header("Retry-After", "1");
+    SetError(res,
+             Error{.code = ErrorEnum::kOutOfMemory,
+                   .message = "Node is above its storage high watermark"},
+             httplib::ServiceUnavailable_503);
+    return false;
+  }
+
+  std::string const uuid = req.get_param_value("uuid");
+  if (uuid.empty()) return true;
+  /* admission runs before the request locks the backend */
+  std::shared_lock<std::shared_mutex> backend_lock;
+  if (backend_mutex != nullptr) backend_lock = std::shared_lock{*backend_mutex};
+  auto partition = storage->LookupPartition(uuid);
+  /* let the route report invalid partitions */
+  if (!partition.has_value()) return true;
+  return AdmitPartitionWrite(req, res, partition.value());
+}
+
+/// Scheduler slot held by the request served by the current worker thread,
+/// released by the post-routing handler.
+thread_local FairScheduler::Slot request_slot;
+
+/// bytes of a request that cost as much as handling one more request
+constexpr uint64_t kCostUnitBytes = 64 * 1024;
+
+/// scheduling cost of handling @c bytes, large reads and writes cost more
+double BytesCost(uint64_t bytes) {
+  return 1.0 + static_cast<double>(bytes) / kCostUnitBytes;
+}
+
+/// bytes a request reads or writes as far as its parameters and headers
+/// tell
+uint64_t RequestBytes(httplib::Request const& req) {
+  std::string const size_str = req.has_param("size")
+                                   ? req.get_param_value("size")
+                                   : req.get_header_value("Content-Length");
+  uint64_t size = 0;
+  std::from_chars(size_str.data(), size_str.data() + size_str.size(), size);
+  return size;
+}
+
+/// Partition the request served by the current worker thread is charged
+/// to, empty for requests without one. Set by the pre-routing handler, or
+/// once the body is read if the partition is only named there.
+thread_local std::string request_tenant;
+
+/// canonical id of the partition the request is charged to: its `uuid` or
+/// the partition of the file handle it uses, empty if it has none or it
+/// isn't a valid partition id
+std::string RequestTenant(httplib::Request const& req,
+                          FileHandleTable* handles) {
+  std::string uuid;
+  if (req.has_param("uuid")) {
+    uuid = RequestUuid(req);
+  } else if (std::string const id = req.get_param_value("handle");
+             !id.empty()) {
+    auto handle = handles->Acquire(id);
+    if (handle.has_value()) uuid = handle.value()->client;
+  }
+  return IsUUIDValid(uuid) ? uuid : std::string{};
+}
+
+/// Reject the request with 429 if its partition exceeded its rate limits.
+/// Requests without a partition (pings, metrics, client creation) are not
+/// limited.
+bool LimitRequest(httplib::Response& res, RateLimiter* limiter) {
+  std::string const& tenant = request_tenant;
+  if (tenant.empty()) return true;
+  auto retry_after = limiter->Admit(tenant);
+  if (!retry_after.has_value()) return true;
+
+  auto const retry_s =
+      std::chrono::ceil<std::chrono::seconds>(*retry_after).count();
+  res.set_header("Retry-After", std::to_string(std::max<int64_t>(retry_s, 1)));
+  SetError(res, Error{.code = ErrorEnum::kRateLimited,
+                      .message = std::format(
+                          "Partition '{}' exceeded its rate limit", tenant)});
+  return false;
+}
+
+/// wait for a slot of the fair scheduler costing @c bytes for the request of
+/// the current worker thread, no-op for requests without a partition
+void ScheduleRequest(FairScheduler* scheduler, uint64_t bytes) {
+  if (request_tenant.empty()) return;
+  request_slot = Traced(TraceStage::kQueue, [&] {
+    return scheduler->Acquire(request_tenant, BytesCost(bytes));
+  });
+}
+
+/// release the scheduler slot and charge the transferred bytes
+void FinishScheduledRequest(httplib::Request const& req,
+                            httplib::Response const& res,
+                            RateLimiter* limiter) {
+  request_slot = {};
+  if (request_tenant.empty()) return;
+  limiter->Charge(std::exchange(request_tenant, {}),
+                  req.body.size() + res.body.size());
+}
+
+/// Lock of a backend that isn't thread-safe held by the request served by
+/// the current worker thread: shared by reads, exclusive for anything else.
+/// Taken once the request is scheduled, so a request waiting for a slot
+/// doesn't block the others, and released by the post-routing handler.
+thread_local std::shared_lock<std::shared_mutex> backend_read_lock;
+thread_local std::unique_lock<std::shared_mutex> backend_write_lock;
+
+/// lock the backend for the request, no-op for thread-safe backends, which
+/// have no @c mutex
+void LockBackend(httplib::Request const& req, std::shared_mutex* mutex) {
+  if (mutex == nullptr) return;
+  if (req.method == "GET" || req.method == "HEAD") {
+    backend_read_lock = std::shared_lock{*mutex};
+  } else {
+    backend_write_lock = std::unique_lock{*mutex};
+  }
+}
+
+void UnlockBackend() {
+  backend_read_lock = {};
+  backend_write_lock = {};
+}
+
+/// Schedules a streamed request body or chunked response of @c tenant chunk
+/// by chunk instead of as a whole, so a slow client doesn't hold a slot
+/// between chunks. Chunked responses are sent after the post-routing
+/// handler released the request's slot and charged its buffered bytes,
+/// their chunks are charged here.
+class ChunkScheduler {
+ public:
+  ChunkScheduler(std::string tenant, FairScheduler* scheduler,
+                 RateLimiter* limiter)
+      : tenant_(std::move(tenant)), scheduler_(scheduler), limiter_(limiter) {}
+
+  /// wait for a slot for a chunk of @c bytes, no slot without a partition
+  FairScheduler::Slot Schedule(uint64_t bytes) const {
+    if (tenant_.empty()) return {};
+    return scheduler_->Acquire(tenant_, BytesCost(bytes));
+  }
+
+  /// account @c bytes of a chunk sent or received
+  void Charge(uint64_t bytes) const {
+    if (!tenant_.empty()) limiter_->Charge(tenant_, bytes);
+  }
+
+ private:
+  std::string tenant_;
+  FairScheduler* scheduler_;
+  RateLimiter* limiter_;
+};
+
+void CollectSchedulingMetrics(PrometheusWriter& writer,
+                              RateLimiter const& limiter,
+                              FairScheduler const& scheduler) {
+  writer.Family("cppfs_rate_limited_total", "counter",
+                "Requests rejected by per-partition rate limits");
+  writer.Sample("cppfs_rate_limited_total", {}, limiter.GetRejected());
+
+  writer.Family("cppfs_scheduler_queued_requests", "gauge",
+                "Requests waiting for the fair scheduler");
+  writer.Sample("cppfs_scheduler_queued_requests", {},
+                static_cast<int64_t>(scheduler.GetQueued()));
+
+  writer.Family("cppfs_scheduler_delayed_total", "counter",
+                "Requests that had to wait for the fair scheduler");
+  writer.Sample("cppfs_scheduler_delayed_total", {}, scheduler.GetDelayed());
+}
+
+void CollectUsageMetrics(PrometheusWriter& writer, NodeUsage const& node) {
+  Usage const usage = node.GetUsage();
+  writer.Family("cppfs_node_usage", "gauge",
+                "Resources used by all loaded partitions of the node");
+  writer.Sample("cppfs_node_usage", {{"resource", "bytes"}}, usage.bytes);
+  writer.Sample("cppfs_node_usage", {{"resource", "files"}}, usage.files);
+  writer.Sample("cppfs_node_usage", {{"resource", "directories"}},
+                usage.directories);
+
+  writer.Family("cppfs_node_capacity_bytes", "gauge",
+                "Bytes the node may store, 0 if unlimited");
+  writer.Sample("cppfs_node_capacity_bytes", {}, node.GetCapacityBytes());
+
+  writer.Family("cppfs_admission_rejections_total", "counter",
+                "Writes rejected before reading their payload");
+  writer.Sample("cppfs_admission_rejections_total", {{"reason", "shed"}},
+                GetAdmissionRejections().shed.Value());
+  writer.Sample("cppfs_admission_rejections_total", {{"reason", "quota"}},
+                GetAdmissionRejections().over_quota.Value());
+}
+
 }  // namespace
 
 void SetCorsHeaders(httplib::Response& res) {
@@ -93,63 +481,1024 @@ void SetCorsHeaders(httplib::Response& res) {
       "Origin, X-Requested-With, Content-Type, Accept, Authorization");
 }
 
-int StartFS(std::string const& host, int port,
-            std::filesystem::path const& cert,
-            std::filesystem::path const& key) {
-  /* Init some test data */
-  auto storage = CreateDefaultStorage<cppfs::storage::OnDiskPartitionManager>();
+namespace {
 
-  if (!std::filesystem::is_regular_file(cert)) {
-    std::cout << "Certificate file " << cert
-              << " is not a regular file or doesn't exist.\n";
-    return EXIT_FAILURE;
+/// split `host:port`
+std::optional<std::pair<std::string, int>> ParseHostPort(
+    std::string const& address) {
+  size_t const colon = address.rfind(':');
+  if (colon == std::string::npos || colon == 0) return std::nullopt;
+  int port = 0;
+  char const* const end = address.data() + address.size();
+  auto [ptr, ec] = std::from_chars(address.data() + colon + 1, end, port);
+  if (ec != std::errc{} || ptr != end || port <= 0 || port > 65535) {
+    return std::nullopt;
   }
-  if (!std::filesystem::is_regular_file(key)) {
-    std::cout << "Key file " << key
-              << " is not a regular file or doesn't exist.\n";
-    return EXIT_FAILURE;
+  return std::pair{address.substr(0, colon), port};
+}
+
+/// State of the node shared by the routes of all listeners
+template <typename Manager>
+struct NodeContext {
+  Storage<Manager>* storage;
+  RateLimiter* limiter;
+  FairScheduler* scheduler;
+  /// mutations are recorded here for replicas, nullptr if disabled
+  ChangeFeed* feed;
+  /// replicas only apply the changes of their primary
+  bool read_only;
+  /// shared secret of the replication endpoints, disabled if empty
+  std::string replication_token;
+  /// directories with the partitions, their filesystems are reported by
+  /// `/stats`
+  std::vector<std::filesystem::path> data_dirs;
+  FileHandleTable* handles;
+  /// threads storing the files of a `/untar` archive, 0 if the backend
+  /// isn't thread-safe
+  size_t untar_writers;
+  /// threads reading the files of an `/archive` stream ahead, 0 if the
+  /// backend isn't thread-safe
+  size_t archive_readers;
+  /// serializes mutations with all other requests, nullptr if the backend
+  /// is thread-safe
+  std::shared_mutex* backend_mutex;
+};
+
+/// reject mutations on a read-only replica
+bool AdmitOnReplica(httplib::Request const& req, httplib::Response& res,
+                    bool read_only) {
+  /* closing a file handle doesn't modify the partition */
+  if (!read_only || req.method == "GET" || req.method == "HEAD" ||
+      req.method == "OPTIONS" || req.path == "/close") {
+    return true;
   }
+  SetError(res, Error{.code = ErrorEnum::kReadOnly,
+                      .message = "Node is a read-only replica"});
+  return false;
+}
 
-  httplib::SSLServer server(cert.c_str(), key.c_str());
-  if (!server.is_valid()) {
-    std::cout << "Cannot start storage server" << std::endl;
-    return EXIT_FAILURE;
+/// Record @c change for replicas, sets an error on @c res on failure.
+///
+/// Changes are recorded after the mutation, before it is acknowledged, so
+/// the feed orders mutations of a client the way the client observed them.
+bool RecordChange(ChangeFeed* feed, Change change, httplib::Response& res) {
+  if (feed == nullptr) return true;
+  if (auto recorded = feed->Append(std::move(change)); !recorded) {
+    SetError(res, recorded.error());
+    return false;
+  }
+  return true;
+}
+
+/// bytes of the change feed sent per chunk of a streamed batch
+constexpr size_t kFeedChunkBytes = 256 * 1024;
+constexpr size_t kFeedDefaultBatchBytes = 1 << 20;
+constexpr size_t kFeedMaxBatchBytes = 64 << 20;
+constexpr std::chrono::milliseconds kFeedMaxWait{30000};
+
+uint64_t ParseUnsigned(std::string const& str, uint64_t default_value) {
+  uint64_t value = default_value;
+  std::from_chars(str.data(), str.data() + str.size(), value);
+  return value;
+}
+
+/// endpoints moving partition data between nodes require the replication
+/// token, they expose every partition and are disabled without one
+bool CheckReplicationToken(httplib::Request const& req, httplib::Response& res,
+                           std::string const& token) {
+  if (token.empty()) {
+    SetError(res,
+             Error{.code = ErrorEnum::kInvalidInput,
+                   .message = "Replication endpoints are disabled, the node "
+                              "has no replication token"},
+             httplib::Forbidden_403);
+    return false;
+  }
+  if (req.get_header_value(kReplicationTokenHeader) == token) return true;
+  SetError(res,
+           Error{.code = ErrorEnum::kInvalidInput,
+                 .message = "Invalid replication token"},
+           httplib::Forbidden_403);
+  return false;
+}
+
+/// Stream changes following `since`, holding the request open for up to
+/// `wait_ms` if there are none yet.
+void ServeChangeFeed(httplib::Request const& req, httplib::Response& res,
+                     ChangeFeed* feed, std::string const& token) {
+  if (feed == nullptr) {
+    SetError(res, Error{.code = ErrorEnum::kNotFound,
+                        .message = "Node doesn't record a change feed"});
+    return;
+  }
+  if (!CheckReplicationToken(req, res, token)) return;
+
+  uint64_t const since = ParseUnsigned(req.get_param_value("since"), 0);
+  size_t const max_bytes =
+      std::min<size_t>(ParseUnsigned(req.get_param_value("max_bytes"),
+                                     kFeedDefaultBatchBytes),
+                       kFeedMaxBatchBytes);
+  std::chrono::milliseconds const wait = std::min(
+      std::chrono::milliseconds{static_cast<int64_t>(
+          ParseUnsigned(req.get_param_value("wait_ms"), 0))},
+      kFeedMaxWait);
+  if (feed->GetLastSequence() <= since) {
+    /* a replica waiting for changes doesn't hold a scheduler slot and
+       doesn't block the writes it waits for */
+    request_slot = {};
+    UnlockBackend();
+    feed->WaitForChanges(since, wait);
+  }
+
+  res.set_header(kLastSequenceHeader,
+                 std::to_string(feed->GetLastSequence()));
+  struct Cursor {
+    uint64_t since;
+    size_t remaining;
+  };
+  auto cursor = std::make_shared<Cursor>(since, max_bytes);
+  res.set_chunked_content_provider(
+      "application/octet-stream",
+      [feed, cursor](size_t offset [[maybe_unused]], httplib::DataSink& sink) {
+        if (cursor->remaining == 0 ||
+            cursor->since >= feed->GetLastSequence()) {
+          sink.done();
+          return true;
+        }
+        auto batch = feed->Read(cursor->since,
+                                std::min(cursor->remaining, kFeedChunkBytes));
+        if (!batch) return false;
+        cursor->since = batch->last_sequence;
+        cursor->remaining -= std::min(cursor->remaining, batch->data.size());
+        return sink.write(batch->data.data(), batch->data.size());
+      });
+}
+
+/// Stream partition `uuid` as an archive for `/import` on another node.
+///
+/// The last sequence of the change feed is taken before the partition is
+/// walked and returned in a header. Writes made during the transfer are
+/// streamed by a follow-up export with that sequence as `since`, which only
+/// contains the changes of the partition recorded after it, and so on until
+/// the partition is frozen and the last catch-up is empty.
+template <typename Manager>
+void ServeExport(httplib::Request const& req, httplib::Response& res,
+                 NodeContext<Manager> const* node) {
+  if (!CheckReplicationToken(req, res, node->replication_token)) return;
+  auto partition = LookupPartitionForRequest(req, node->storage);
+  if (!partition.has_value()) {
+    SetError(res, partition.error());
+    return;
+  }
+  std::string uuid = RequestUuid(req);
+
+  ChangeFeed* const feed = node->feed;
+  uint64_t const until = feed != nullptr ? feed->GetLastSequence() : 0;
+  if (feed != nullptr) {
+    res.set_header(kLastSequenceHeader, std::to_string(until));
+  }
+  /* the body is sent after the request released its slot and the backend,
+     each chunk takes them again */
+  ChunkScheduler const chunks{request_tenant, node->scheduler, node->limiter};
+
+  if (!req.has_param("since")) {
+    auto exporter =
+        std::make_shared<PartitionExporter>(partition.value(), std::move(uuid));
+    res.set_chunked_content_provider(
+        "application/octet-stream",
+        [exporter, chunks, backend_mutex = node->backend_mutex](
+            size_t offset [[maybe_unused]], httplib::DataSink& sink) {
+          tl::expected<std::string, Error> chunk;
+          {
+            FairScheduler::Slot const slot = chunks.Schedule(kFeedChunkBytes);
+            std::shared_lock<std::shared_mutex> backend_lock;
+            if (backend_mutex != nullptr) {
+              backend_lock = std::shared_lock{*backend_mutex};
+            }
+            chunk = exporter->Next(kFeedChunkBytes);
+          }
+          if (!chunk) {
+            std::cerr << "Partition export failed: " << chunk.error().message
+                      << "\n";
+            return false;
+          }
+          if (chunk->empty()) {
+            sink.done();
+            return true;
+          }
+          chunks.Charge(chunk->size());
+          return sink.write(chunk->data(), chunk->size());
+        });
+    return;
+  }
+
+  if (feed == nullptr) {
+    SetError(res, Error{.code = ErrorEnum::kNotFound,
+                        .message = "Node doesn't record a change feed, "
+                                   "exports can't be caught up"});
+    return;
+  }
+  auto since = std::make_shared<uint64_t>(
+      ParseUnsigned(req.get_param_value("since"), 0));
+  res.set_chunked_content_provider(
+      "application/octet-stream",
+      [feed, since, until, chunks, uuid = std::move(uuid)](
+          size_t offset [[maybe_unused]], httplib::DataSink& sink) {
+        /* skip batches without changes of the partition */
+        while (*since < until) {
+          tl::expected<std::string, Error> changes;
+          {
+            FairScheduler::Slot const slot = chunks.Schedule(kFeedChunkBytes);
+            auto batch = feed->Read(*since, kFeedChunkBytes);
+            if (!batch) return false;
+            *since = batch->last_sequence;
+            changes = FilterPartitionChanges(batch->data, uuid, until);
+          }
+          if (!changes) return false;
+          if (!changes->empty()) {
+            chunks.Charge(changes->size());
+            return sink.write(changes->data(), changes->size());
+          }
+        }
+        sink.done();
+        return true;
+      });
+}
+
+/// Apply an archive streamed by `/export` to partition `uuid`, creating the
+/// partition if needed.
+///
+/// The body is applied while it is received. Applying a change twice is
+/// harmless, so catch-up archives overlapping the previous import and
+/// retries of a failed import are fine. Applied changes are recorded for the
+/// replicas of this node.
+template <typename Manager>
+void ServeImport(httplib::Request const& req, httplib::Response& res,
+                 httplib::ContentReader const& content_reader,
+                 NodeContext<Manager> const* node) {
+  if (!CheckReplicationToken(req, res, node->replication_token)) return;
+  auto const id = ParsePartitionId(req.get_param_value("uuid"));
+  if (!id) {
+    SetError(res, id.error());
+    return;
+  }
+  std::string const uuid = id->ToString();
+
+  ChangeDecoder decoder;
+  std::optional<Error> error;
+  size_t applied = 0;
+  ChunkScheduler const chunks{request_tenant, node->scheduler, node->limiter};
+  content_reader([&](char const* data, size_t size) {
+    /* a slow upload holds neither a slot nor the backend between chunks */
+    FairScheduler::Slot const slot = chunks.Schedule(size);
+    std::unique_lock<std::shared_mutex> backend_lock;
+    if (node->backend_mutex != nullptr) {
+      backend_lock = std::unique_lock{*node->backend_mutex};
+    }
+    chunks.Charge(size);
+    decoder.Feed({data, size});
+    while (true) {
+      auto change = decoder.Next();
+      if (!change) {
+        error = change.error();
+        return false;
+      }
+      if (!change->has_value()) return true;
+      Change& next = **change;
+      if (PartitionId::Parse(next.partition) != *id) {
+        error = Error{.code = ErrorEnum::kInvalidInput,
+                      .message = std::format(
+                          "Archive contains a change of partition '{}'",
+                          next.partition)};
+        return false;
+      }
+      next.partition = uuid;
+      if (auto result = ApplyChange(*node->storage, next); !result) {
+        error = result.error();
+        return false;
+      }
+      if (node->feed != nullptr) {
+        if (auto recorded = node->feed->Append(std::move(next)); !recorded) {
+          error = recorded.error();
+          return false;
+        }
+      }
+      ++applied;
+    }
+  });
+  if (!error.has_value() && decoder.GetPending() != 0) {
+    error = Error{.code = ErrorEnum::kInvalidInput,
+                  .message = "Archive is truncated"};
+  }
+  if (error.has_value()) {
+    SetError(res, *error);
+    return;
+  }
+
+  boost::json::object import_res{{"uuid", uuid}, {"changes", applied}};
+  res.set_content(boost::json::serialize(import_res), "application/json");
+}
+
+/// Freeze or unfreeze a partition, replying with the last sequence of the
+/// change feed. Once frozen, the feed up to that sequence contains every
+/// write of the partition, so an export caught up to it is complete.
+template <typename Manager>
+void ServeFreeze(httplib::Request const& req, httplib::Response& res,
+                 NodeContext<Manager> const* node, bool frozen) {
+  if (!CheckReplicationToken(req, res, node->replication_token)) return;
+  std::string const& uuid = req.path_params.at("id");
+  auto partition = node->storage->LookupPartition(uuid);
+  if (!partition.has_value()) {
+    SetError(res, partition.error());
+    return;
+  }
+
+  if (frozen) {
+    /* waits for the writes in flight, a streamed `/untar` among them needs
+       a slot and the backend for its next chunk */
+    request_slot = {};
+    UnlockBackend();
+    partition.value()->Freeze();
+  } else {
+    partition.value()->Unfreeze();
+  }
+  uint64_t const last_sequence =
+      node->feed != nullptr ? node->feed->GetLastSequence() : 0;
+  boost::json::object freeze_res{
+      {"uuid", uuid}, {"frozen", frozen}, {"last_sequence", last_sequence}};
+  res.set_content(boost::json::serialize(freeze_res), "application/json");
+}
+
+/// Load of the node for placing new partitions: the data it stores, how much
+/// room is left and how busy it is.
+template <typename Manager>
+void ServeStats(httplib::Response& res, NodeContext<Manager> const* node) {
+  Manager const& manager = node->storage->GetManager();
+  NodeUsage const& node_usage = manager.GetNodeUsage();
+  Usage const usage = node_usage.GetUsage();
+  SystemStats const system = ReadSystemStats(node->data_dirs);
+  /* the stats request itself isn't load */
+  int64_t const in_flight = GlobalMetrics().InFlight().Value() - 1;
+
+  boost::json::object stats{
+      {"partitions", manager.GetPartitionCount()},
+      {"usage",
+       {{"bytes", usage.bytes},
+        {"files", usage.files},
+        {"directories", usage.directories}}},
+      {"capacity_bytes", node_usage.GetCapacityBytes()},
+      {"above_high_watermark", node_usage.IsAboveHighWatermark()},
+      {"disk",
+       {{"total_bytes", system.disk_total_bytes},
+        {"available_bytes", system.disk_available_bytes}}},
+      {"memory",
+       {{"total_bytes", system.memory_total_bytes},
+        {"available_bytes", system.memory_available_bytes},
+        {"rss_bytes", system.process_rss_bytes}}},
+      {"requests_per_s",
+       GlobalMetrics().Requests().GetRate(std::chrono::steady_clock::now())},
+      {"in_flight", std::max<int64_t>(in_flight, 0)},
+      {"read_only", node->read_only},
+  };
+  res.set_content(boost::json::serialize(stats), "application/json");
+}
+
+/// lock @c partition for a mutation, sets an error on @c res while the
+/// partition is frozen or if it has no room for the write
+std::optional<Partition::WriteLock> BeginWrite(httplib::Request const& req,
+                                               Partition* partition,
+                                               httplib::Response& res) {
+  /* admitted again with the partition of a form-encoded body */
+  if (!AdmitPartitionWrite(req, res, partition)) return std::nullopt;
+  auto lock = partition->BeginWrite();
+  if (!lock.has_value()) {
+    res.set_header("Retry-After", "1");
+    SetError(res,
+             Error{.code = ErrorEnum::kReadOnly,
+                   .message = "Partition is frozen for migration"},
+             httplib::ServiceUnavailable_503);
+  }
+  return lock;
+}
+
+/// Expand a tar archive streamed as the body into directory `dir` of
+/// partition `uuid` while it is received.
+///
+/// Parsing overlaps with storing the files, which a pool of writers does in
+/// parallel if the backend is thread-safe. Replies with the number of
+/// directories and files created, the files are recorded for replicas.
+template <typename Manager>
+void ServeUntar(httplib::Request const& req, httplib::Response& res,
+                httplib::ContentReader const& content_reader,
+                NodeContext<Manager> const* node) {
+  /* a slow upload holds neither a slot nor the backend between chunks, the
+     lookup, each chunk and the end of the archive are scheduled on their
+     own */
+  ChunkScheduler const chunks{request_tenant, node->scheduler, node->limiter};
+  auto const lock_backend = [node] {
+    std::unique_lock<std::shared_mutex> backend_lock;
+    if (node->backend_mutex != nullptr) {
+      backend_lock = std::unique_lock{*node->backend_mutex};
+    }
+    return backend_lock;
+  };
+  FairScheduler::Slot slot = chunks.Schedule(0);
+  std::unique_lock<std::shared_mutex> backend_lock = lock_backend();
+
+  auto partition = LookupPartitionForRequest(req, node->storage);
+  if (!partition.has_value()) {
+    SetError(res, partition.error());
+    return;
+  }
+  auto const write = BeginWrite(req, partition.value(), res);
+  if (!write.has_value()) return;
+
+  std::filesystem::path dir_path{req.get_param_value("dir")};
+  if (dir_path.empty()) dir_path = "/";
+
+  TarImporter importer{partition.value(), RequestUuid(req), dir_path,
+                       node->feed,
+                       TarImportConfig{.writers = node->untar_writers}};
+  backend_lock = {};
+  slot = {};
+  std::optional<Error> error;
+  content_reader([&](char const* data, size_t size) {
+    FairScheduler::Slot const chunk_slot = chunks.Schedule(size);
+    auto const chunk_lock = lock_backend();
+    chunks.Charge(size);
+    if (auto fed = importer.Feed({data, size}); !fed) {
+      error = fed.error();
+      return false;
+    }
+    return true;
+  });
+  slot = chunks.Schedule(0);
+  backend_lock = lock_backend();
+  auto stats = importer.Finish();
+  if (!error.has_value() && !stats.has_value()) error = stats.error();
+  if (error.has_value()) {
+    SetError(res, *error);
+    return;
+  }
+
+  GlobalMetrics().BytesWritten().Inc(stats->bytes);
+  boost::json::object untar_res{
+      {"dir", dir_path.c_str()},
+      {"directories", stats->directories},
+      {"files", stats->files},
+      {"bytes", stats->bytes},
+      {"skipped", stats->skipped},
+  };
+  res.set_content(boost::json::serialize(untar_res), "application/json");
+}
+
+/// bytes of the tar stream of `/archive` produced per chunk
+constexpr size_t kArchiveChunkBytes = 256 * 1024;
+
+/// Stream directory `path` of partition `uuid` and everything below it as a
+/// tar archive, gzip-compressed with `gzip=1`.
+///
+/// The archive is produced while it is sent, the files are read ahead by a
+/// pool of readers if the backend is thread-safe. Memory stays bounded
+/// whatever the size of the tree, a whole partition is one sequential
+/// download.
+template <typename Manager>
+void ServeArchive(httplib::Request const& req, httplib::Response& res,
+                  NodeContext<Manager> const* node) {
+  auto partition = LookupPartitionForRequest(req, node->storage);
+  if (!partition.has_value()) {
+    SetError(res, partition.error());
+    return;
+  }
+
+  std::filesystem::path dir_path{req.get_param_value("path")};
+  if (dir_path.empty()) dir_path = "/";
+  /* fail before the stream starts if there is no such directory */
+  tl::expected<DirectoryOf<Manager>*, Error> dir_expected =
+      Traced(TraceStage::kOpen, [&] {
+        return OpenBackendDir<Manager>(*partition.value(), dir_path);
+      });
+  if (!dir_expected.has_value()) {
+    SetError(res, dir_expected.error());
+    return;
+  }
+
+  auto exporter = std::make_shared<TarExporter>(
+      partition.value(), dir_path,
+      TarExportConfig{.readers = node->archive_readers});
+  std::shared_ptr<GzipCompressor> gzip;
+  if (req.get_param_value("gzip") == "1") {
+    gzip = std::make_shared<GzipCompressor>();
+  }
+  res.set_chunked_content_provider(
+      gzip != nullptr ? "application/gzip" : "application/x-tar",
+      [exporter, gzip, backend_mutex = node->backend_mutex,
+       chunks = ChunkScheduler{request_tenant, node->scheduler,
+                               node->limiter}](
+          size_t offset [[maybe_unused]], httplib::DataSink& sink) {
+        /* deflate may hold back the output of a whole chunk */
+        while (true) {
+          tl::expected<std::string, Error> chunk;
+          {
+            /* the body is sent after the request released its slot and
+               the backend */
+            FairScheduler::Slot const slot =
+                chunks.Schedule(kArchiveChunkBytes);
+            std::shared_lock<std::shared_mutex> backend_lock;
+            if (backend_mutex != nullptr) {
+              backend_lock = std::shared_lock{*backend_mutex};
+            }
+            chunk = exporter->Next(kArchiveChunkBytes);
+          }
+          bool const done = chunk.has_value() && chunk->empty();
+          if (chunk.has_value()) GlobalMetrics().BytesRead().Inc(chunk->size());
+          if (chunk.has_value() && gzip != nullptr) {
+            chunk = done ? gzip->Finish() : gzip->Compress(*chunk);
+          }
+          if (!chunk) {
+            std::cerr << "Archive stream failed: " << chunk.error().message
+                      << "\n";
+            return false;
+          }
+          chunks.Charge(chunk->size());
+          if (!chunk->empty() && !sink.write(chunk->data(), chunk->size())) {
+            return false;
+          }
+          if (done) {
+            sink.done();
+            return true;
+          }
+          if (!chunk->empty()) return true;
+        }
+      });
+}
+
+/// files can't grow past the largest offset of the filesystem
+constexpr auto kMaxFileSize =
+    static_cast<uint64_t>(std::numeric_limits<off_t>::max());
+
+/// Shared part of `/write`, `/append` and `/truncate`: open regular file
+/// `path` of the request's partition, apply @c mutate to it and record the
+/// change @c mutate describes for replicas.
+template <typename T, typename Mutate>
+void MutateRegularFile(httplib::Request const& req, httplib::Response& res,
+                       Storage<T>* storage, ChangeFeed* feed,
+                       Mutate&& mutate) {
+  auto partition = LookupPartitionForRequest(req, storage);
+  if (!partition.has_value()) {
+    SetError(res, partition.error());
+    return;
+  }
+  auto const write = BeginWrite(req, partition.value(), res);
+  if (!write.has_value()) return;
+
+  std::filesystem::path const path{req.get_param_value("path")};
+  tl::expected<RegularFileOf<T>*, Error> reg_file_expected =
+      Traced(TraceStage::kOpen, [&] {
+        return OpenBackendRegularFile<T>(*partition.value(), path);
+      });
+  if (!reg_file_expected.has_value()) {
+    SetError(res, reg_file_expected.error());
+    return;
+  }
+
+  RegularFileOf<T>* reg_file = reg_file_expected.value();
+  Change change{.partition = RequestUuid(req),
+                .path = path.parent_path().string(),
+                .name = path.filename().string()};
+  tl::expected<void, Error> mutated =
+      Traced(TraceStage::kIo, [&] { return mutate(reg_file, change); });
+  if (!mutated.has_value()) {
+    SetError(res, mutated.error());
+    return;
+  }
+  if (!RecordChange(feed, std::move(change), res)) return;
+
+  boost::json::object mutate_res{
+      {"path", path.c_str()},
+      {"size", reg_file->GetSize()},
+      {"type_id", static_cast<int>(reg_file->GetType())},
+      {"type", FileTypeToString(reg_file->GetType())},
+  };
+  res.set_content(boost::json::serialize(mutate_res), "application/json");
+}
+
+/// unsigned request parameter @c name, sets an error on @c res if it is
+/// missing or invalid
+std::optional<uint64_t> GetUnsignedParam(httplib::Request const& req,
+                                         httplib::Response& res,
+                                         std::string const& name) {
+  std::string const str = req.get_param_value(name);
+  uint64_t value = 0;
+  auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (str.empty() || ec != std::errc{} || ptr != str.data() + str.size()) {
+    SetError(res, Error{.code = ErrorEnum::kInvalidInput,
+                        .message = std::format(
+                            "Parameter '{}' is missing or invalid", name)});
+    return std::nullopt;
+  }
+  return value;
+}
+
+constexpr size_t kFindDefaultLimit = 100;
+constexpr size_t kFindMaxLimit = 1000;
+
+/// Files of the request's partition whose name starts with `prefix` or
+/// matches the shell pattern `glob`, a page of up to `limit` entries after
+/// the path `after`.
+template <typename T>
+void ServeFind(httplib::Request const& req, httplib::Response& res,
+               Storage<T>* storage) {
+  auto partition = LookupPartitionForRequest(req, storage);
+  if (!partition.has_value()) {
+    SetError(res, partition.error());
+    return;
+  }
+
+  NameIndex::Query query{.prefix = req.get_param_value("prefix"),
+                         .glob = req.get_param_value("glob"),
+                         .after = req.get_param_value("after")};
+  if (query.prefix.empty() == query.glob.empty()) {
+    SetError(res, Error{.code = ErrorEnum::kInvalidInput,
+                        .message = "Expected either 'prefix' or 'glob'"});
+    return;
+  }
+  query.limit = std::clamp<size_t>(
+      ParseUnsigned(req.get_param_value("limit"), kFindDefaultLimit), 1,
+      kFindMaxLimit);
+
+  NameIndex::Page const page = Traced(TraceStage::kIo, [&] {
+    return partition.value()->GetNameIndex().Find(query);
+  });
+
+  ScopedTraceStage const serialize_stage{TraceStage::kSerialize};
+  boost::json::array entries;
+  for (NameIndex::Entry const& entry : page.entries) {
+    entries.push_back(boost::json::value{
+        {"path", entry.path},
+        {"name", std::filesystem::path{entry.path}.filename().string()},
+        {"type_id", static_cast<int>(entry.type)},
+        {"type", FileTypeToString(entry.type)}});
+  }
+  boost::json::object find_res{{"entries", std::move(entries)}};
+  if (page.next.empty()) {
+    find_res["next"] = nullptr;
+  } else {
+    find_res["next"] = page.next;
+  }
+  res.set_content(boost::json::serialize(find_res), "application/json");
+}
+
+constexpr std::chrono::milliseconds kWatchDefaultWait{25000};
+constexpr std::chrono::milliseconds kWatchMaxWait{60000};
+
+/// Changes of the request's partition following the sequence `since`,
+/// holding the request open for up to `wait_ms` if there are none yet. A
+/// `gap` tells the client that it fell behind the kept events and has to
+/// list the partition again.
+template <typename T>
+void ServeWatch(httplib::Request const& req, httplib::Response& res,
+                Storage<T>* storage) {
+  auto partition = LookupPartitionForRequest(req, storage);
+  if (!partition.has_value()) {
+    SetError(res, partition.error());
+    return;
+  }
+
+  uint64_t const since = ParseUnsigned(req.get_param_value("since"), 0);
+  std::chrono::milliseconds const wait = std::min(
+      std::chrono::milliseconds{static_cast<int64_t>(
+          ParseUnsigned(req.get_param_value("wait_ms"),
+                        static_cast<uint64_t>(kWatchDefaultWait.count())))},
+      kWatchMaxWait);
+  /* an idle watch doesn't hold a slot of the partition's scheduler share
+     and doesn't block the mutations it waits for */
+  request_slot = {};
+  UnlockBackend();
+  WatchLog::Batch const batch =
+      partition.value()->GetWatchLog().Read(since, wait);
+
+  ScopedTraceStage const serialize_stage{TraceStage::kSerialize};
+  boost::json::array events;
+  for (WatchEvent const& event : batch.events) {
+    events.push_back(
+        boost::json::value{{"sequence", event.sequence},
+                           {"op", WatchEventKindToString(event.kind)},
+                           {"path", event.path}});
+  }
+  boost::json::object watch_res{
+      {"events", std::move(events)},
+      {"gap", batch.gap},
+      {"last_sequence", batch.last_sequence},
+  };
+  res.set_content(boost::json::serialize(watch_res), "application/json");
+}
+
+constexpr size_t kHandleDefaultReadBytes = 1 << 20;
+
+/// Open regular file `path` of the request's partition for `/read`.
+template <typename T>
+void ServeOpen(httplib::Request const& req, httplib::Response& res,
+               Storage<T>* storage, FileHandleTable* handles) {
+  auto partition = LookupPartitionForRequest(req, storage);
+  if (!partition.has_value()) {
+    SetError(res, partition.error());
+    return;
+  }
+
+  std::string path = req.get_param_value("path");
+  tl::expected<RegularFileOf<T>*, Error> reg_file_expected =
+      Traced(TraceStage::kOpen, [&] {
+        return OpenBackendRegularFile<T>(*partition.value(), path);
+      });
+  if (!reg_file_expected.has_value()) {
+    SetError(res, reg_file_expected.error());
+    return;
+  }
+
+  RegularFileOf<T>* reg_file = reg_file_expected.value();
+  tl::expected<size_t, Error> const size = GetDataSize(*reg_file);
+  if (!size.has_value()) {
+    SetError(res, size.error());
+    return;
+  }
+  auto id = handles->Open(RequestUuid(req), partition.value(), reg_file, path);
+  if (!id.has_value()) {
+    SetError(res, id.error());
+    return;
+  }
+  boost::json::object open_res{
+      {"handle", *id},
+      {"path", path},
+      {"size", *size},
+  };
+  res.set_content(boost::json::serialize(open_res), "application/json");
+}
+
+/// Read up to `size` bytes at the cursor of file handle `handle` and move
+/// the cursor past the bytes read, `offset` moves the cursor before the
+/// read. Reads are clamped to the current size of the file. The cursor after
+/// the read is returned in `X-Offset`, the body is empty at the end of the
+/// file.
+template <typename T>
+void ServeHandleRead(httplib::Request const& req, httplib::Response& res,
+                     Storage<T>* storage, FileHandleTable* handles) {
+  auto handle_expected = handles->Acquire(req.get_param_value("handle"));
+  if (!handle_expected.has_value()) {
+    SetError(res, handle_expected.error());
+    return;
+  }
+  FileHandleTable::Handle& handle = *handle_expected.value();
+  /* the partition object, and with it the file, is gone if the partition
+     was destroyed */
+  auto partition = storage->LookupPartition(handle.client);
+  if (!partition.has_value() || partition.value() != handle.partition) {
+    handles->Close(req.get_param_value("handle"));
+    SetError(res, Error{.code = ErrorEnum::kNotFound,
+                        .message = std::format(
+                            "Partition of file handle '{}' doesn't exist",
+                            req.get_param_value("handle"))});
+    return;
+  }
+
+  std::lock_guard const lock{handle.mutex};
+  /* the handle was opened by a route of this backend */
+  auto* const file = static_cast<RegularFileOf<T>*>(handle.file);
+  /* the file may have been truncated or extended since it was opened */
+  tl::expected<size_t, Error> const file_size = GetDataSize(*file);
+  if (!file_size.has_value()) {
+    SetError(res, file_size.error());
+    return;
+  }
+  if (req.has_param("offset")) {
+    handle.offset = std::min<size_t>(
+        ParseUnsigned(req.get_param_value("offset"), handle.offset),
+        *file_size);
   }
+  size_t const size = std::min<size_t>(
+      ParseUnsigned(req.get_param_value("size"), kHandleDefaultReadBytes),
+      *file_size - std::min(handle.offset, *file_size));
+
+  std::stringstream ss;
+  ssize_t const read_bytes =
+      size == 0 ? 0 : Traced(TraceStage::kIo, [&] {
+        return file->PositionalRead(ss, handle.offset, size);
+      });
+  if (read_bytes == -1) {
+    SetError(res,
+             Error{.code = ErrorEnum::kInternalServerError,
+                   .message = std::format(
+                       "Cannot read {} bytes from offset {} from file {}",
+                       size, handle.offset, handle.path)});
+    return;
+  }
+  std::string data = ss.str();
+  handle.offset += data.size();
+  GlobalMetrics().BytesRead().Inc(data.size());
+
+  res.set_header("X-Offset", std::to_string(handle.offset));
+  res.set_content(std::move(data), "application/text");
+}
 
-  server.Options("/(.*)", [&](httplib::Request const& req [[maybe_unused]],
-                              httplib::Response& res) { SetCorsHeaders(res); });
+/// Bytes @c req reads or writes. A `/cat` without `size` returns the rest of
+/// the file, it is looked up so reading a large file whole doesn't cost as
+/// little as a ping.
+template <typename Manager>
+uint64_t ScheduledRequestBytes(httplib::Request const& req,
+                               NodeContext<Manager> const* node) {
+  if (req.path != "/cat" || req.has_param("size")) return RequestBytes(req);
+
+  /* the request locks the backend once it is scheduled */
+  std::shared_lock<std::shared_mutex> backend_lock;
+  if (node->backend_mutex != nullptr) {
+    backend_lock = std::shared_lock{*node->backend_mutex};
+  }
+  auto partition = LookupPartitionForRequest(req, node->storage);
+  /* let the route report invalid partitions and files */
+  if (!partition.has_value()) return 0;
+  std::filesystem::path const path{req.get_param_value("path")};
+  auto file = OpenBackendRegularFile<Manager>(*partition.value(), path);
+  if (!file.has_value()) return 0;
+  uint64_t const size = file.value()->GetSize();
+  uint64_t const offset = ParseUnsigned(req.get_param_value("offset"), 0);
+  return size - std::min(offset, size);
+}
+
+/// Handler running @c handler once the request body was read. A partition
+/// only named in a form-encoded body is rate limited now, then the request
+/// waits for its scheduler slot and locks the backend, so neither is held
+/// while a slow client uploads the body.
+template <typename Manager, typename Handler>
+httplib::Server::Handler Scheduled(NodeContext<Manager> const* node,
+                                   Handler handler) {
+  return [node, handler = std::move(handler)](httplib::Request const& req,
+                                              httplib::Response& res) {
+    if (request_tenant.empty()) {
+      request_tenant = RequestTenant(req, node->handles);
+      if (!LimitRequest(res, node->limiter)) return;
+    }
+    ScheduleRequest(node->scheduler, ScheduledRequestBytes(req, node));
+    LockBackend(req, node->backend_mutex);
+    handler(req, res);
+  };
+}
+
+/// registers the routes with a request body read by httplib on @c server,
+/// their handlers run through Scheduled()
+template <typename Manager>
+struct ScheduledRoutes {
+  template <typename Handler>
+  void Get(std::string const& pattern, Handler handler) {
+    server.Get(pattern, Scheduled(node, std::move(handler)));
+  }
+
+  template <typename Handler>
+  void Post(std::string const& pattern, Handler handler) {
+    server.Post(pattern, Scheduled(node, std::move(handler)));
+  }
+
+  httplib::Server& server;
+  NodeContext<Manager> const* node;
+};
+
+/// register the storage API on @c server
+template <typename Manager>
+void RegisterRoutes(httplib::Server& server,
+                    NodeContext<Manager> const* node) {
+  Storage<Manager>* const storage = node->storage;
+  ScheduledRoutes<Manager> routes{server, node};
+  server.Options("/(.*)", [](httplib::Request const& req [[maybe_unused]],
+                             httplib::Response& res) { SetCorsHeaders(res); });
+
+  /* the partition of a form-encoded body is only known once it is read */
+  server.set_pre_routing_handler(
+      [node](httplib::Request const& req, httplib::Response& res) {
+        BeginRequestMetrics();
+        GlobalTracer().Begin(req.path);
+        request_tenant = RequestTenant(req, node->handles);
+        if (!AdmitOnReplica(req, res, node->read_only) ||
+            !AdmitWrite(req, res, node->storage, node->backend_mutex) ||
+            !LimitRequest(res, node->limiter)) {
+          return httplib::Server::HandlerResponse::Handled;
+        }
+        /* routes are scheduled once the body is read, or per chunk of a
+           streamed body */
+        return httplib::Server::HandlerResponse::Unhandled;
+      });
 
   server.set_post_routing_handler(
-      [](httplib::Request const& req [[maybe_unused]], httplib::Response& res) {
+      [limiter = node->limiter](httplib::Request const& req,
+                                httplib::Response& res) {
+        UnlockBackend();
+        FinishScheduledRequest(req, res, limiter);
         SetCorsHeaders(res);
+        EndRequestMetrics(req, res);
+        GlobalTracer().End(res.status);
       });
 
-  server.Get("/ping", [](httplib::Request const& req [[maybe_unused]],
+  routes.Get("/ping", [](httplib::Request const& req [[maybe_unused]],
                          httplib::Response& res) {
     res.set_content("pong\n", "text/plain");
   });
 
-  server.Get("/partition/:id", [&](httplib::Request const& req,
-                                   httplib::Response& res) {
+  routes.Get("/metrics", [](httplib::Request const& req [[maybe_unused]],
+                            httplib::Response& res) {
+    res.set_content(GlobalMetrics().RenderPrometheus(),
+                    "text/plain; version=0.0.4");
+  });
+
+  routes.Get("/stats", [node](httplib::Request const& req [[maybe_unused]],
+                              httplib::Response& res) {
+    ServeStats(res, node);
+  });
+
+  routes.Get("/debug/traces", [](httplib::Request const& req,
+                                 httplib::Response& res) {
+    std::chrono::milliseconds const min_duration{static_cast<int64_t>(
+        ParseUnsigned(req.get_param_value("min_ms"), 0))};
+    size_t const limit = ParseUnsigned(req.get_param_value("limit"), 100);
+
+    std::vector<TraceRecord> const records =
+        GlobalTracer().CollectSlow(min_duration, limit);
+    if (req.get_param_value("format") == "chrome") {
+      res.set_content(TracesToChromeJson(records), "application/json");
+      return;
+    }
+    res.set_content(TracesToJson(records), "application/json");
+  });
+
+  routes.Get("/replication/changes",
+             [node](httplib::Request const& req, httplib::Response& res) {
+               ServeChangeFeed(req, res, node->feed, node->replication_token);
+             });
+
+  routes.Get("/export",
+             [node](httplib::Request const& req, httplib::Response& res) {
+               ServeExport(req, res, node);
+             });
+
+  server.Post("/import", [node](httplib::Request const& req,
+                                httplib::Response& res,
+                                httplib::ContentReader const& content_reader) {
+    ServeImport(req, res, content_reader, node);
+  });
+
+  routes.Get("/archive",
+             [node](httplib::Request const& req, httplib::Response& res) {
+               ServeArchive(req, res, node);
+             });
+
+  server.Post("/untar", [node](httplib::Request const& req,
+                               httplib::Response& res,
+                               httplib::ContentReader const& content_reader) {
+    ServeUntar(req, res, content_reader, node);
+  });
+
+  routes.Post("/partition/:id/freeze",
+              [node](httplib::Request const& req, httplib::Response& res) {
+                ServeFreeze(req, res, node, true);
+              });
+
+  routes.Post("/partition/:id/unfreeze",
+              [node](httplib::Request const& req, httplib::Response& res) {
+                ServeFreeze(req, res, node, false);
+              });
+
+  routes.Get("/partition/:id", [storage](httplib::Request const& req,
+                                         httplib::Response& res) {
     std::string const& partition_id = req.path_params.at("id");
 
-    tl::expected<Partition*, Error> partition_expected =
-        storage->LookupPartition(partition_id);
+    tl::expected<PartitionOf<Manager>*, Error> partition_expected =
+        Traced(TraceStage::kLookupPartition,
+               [&] { return storage->LookupPartition(partition_id); });
 
     if (!partition_expected.has_value()) {
       SetError(res, partition_expected.error());
       return;
     }
 
+    UsageTracker const& usage = partition_expected.value()->GetUsage();
+    Usage const used = usage.GetUsage();
+    Quota const& quota = usage.GetQuota();
     boost::json::object partition_info = {
         {"uuid", partition_id},
         {"is_valid", true},
+        {"frozen", partition_expected.value()->IsFrozen()},
+        {"usage",
+         {{"bytes", used.bytes},
+          {"files", used.files},
+          {"directories", used.directories}}},
+        {"quota",
+         {{"bytes", quota.bytes},
+          {"files", quota.files},
+          {"directories", quota.directories}}},
     };
 
     res.set_content(boost::json::serialize(partition_info), "application/json");
   });
 
-  server.Get("/ls", [&](httplib::Request const& req, httplib::Response& res) {
+  routes.Get("/ls", [storage](httplib::Request const& req,
+                              httplib::Response& res) {
     auto partition = LookupPartitionForRequest(req, storage);
     if (!partition.has_value()) {
       SetError(res, partition.error());
@@ -159,16 +1508,23 @@ int StartFS(std::string const& host, int port,
     std::filesystem::path path{req.get_param_value("path")};
     if (path.empty()) path = "/";
 
-    tl::expected<Directory*, Error> dir_expected =
-        partition.value()->OpenDir(path);
+    tl::expected<DirectoryOf<Manager>*, Error> dir_expected =
+        Traced(TraceStage::kOpen, [&] {
+          return OpenBackendDir<Manager>(*partition.value(), path);
+        });
     if (!dir_expected.has_value()) {
       SetError(res, dir_expected.error());
       return;
     }
 
-    Directory* dir = dir_expected.value();
+    DirectoryOf<Manager>* dir = dir_expected.value();
+    if (ServeNotModified(req, res, dir->GetVersion())) return;
+    std::vector<Directory::DirEntry> const entries =
+        Traced(TraceStage::kIo, [&] { return dir->GetDirEntries(); });
+
+    ScopedTraceStage const serialize_stage{TraceStage::kSerialize};
     boost::json::array direntries;
-    for (Directory::DirEntry const& direntry : dir->GetDirEntries())
+    for (Directory::DirEntry const& direntry : entries)
       direntries.push_back(
           boost::json::value{{"name", direntry.name},
                              {"size", direntry.size},
@@ -186,7 +1542,18 @@ int StartFS(std::string const& host, int port,
     res.set_content(boost::json::serialize(ls_res), "application/json");
   });
 
-  server.Get("/cat", [&](httplib::Request const& req, httplib::Response& res) {
+  routes.Get("/find", [storage](httplib::Request const& req,
+                                httplib::Response& res) {
+    ServeFind(req, res, storage);
+  });
+
+  routes.Get("/watch", [storage](httplib::Request const& req,
+                                 httplib::Response& res) {
+    ServeWatch(req, res, storage);
+  });
+
+  routes.Get("/cat", [storage](httplib::Request const& req,
+                               httplib::Response& res) {
     auto partition = LookupPartitionForRequest(req, storage);
     if (!partition.has_value()) {
       SetError(res, partition.error());
@@ -195,14 +1562,17 @@ int StartFS(std::string const& host, int port,
 
     std::filesystem::path path{req.get_param_value("path")};
 
-    tl::expected<RegularFile*, Error> reg_file_expected =
-        partition.value()->OpenRegularFile(path);
+    tl::expected<RegularFileOf<Manager>*, Error> reg_file_expected =
+        Traced(TraceStage::kOpen, [&] {
+          return OpenBackendRegularFile<Manager>(*partition.value(), path);
+        });
     if (!reg_file_expected.has_value()) {
       SetError(res, reg_file_expected.error());
       return;
     }
 
-    RegularFile* reg_file = reg_file_expected.value();
+    RegularFileOf<Manager>* reg_file = reg_file_expected.value();
+    if (ServeNotModified(req, res, reg_file->GetVersion())) return;
     std::stringstream ss;
     std::string offset_str =
         req.has_param("offset") ? req.get_param_value("offset") : "";
@@ -230,7 +1600,9 @@ int StartFS(std::string const& host, int port,
       return;
     }
 
-    ssize_t read_bytes = reg_file->PositionalRead(ss, offset, size);
+    ssize_t read_bytes = Traced(TraceStage::kIo, [&] {
+      return reg_file->PositionalRead(ss, offset, size);
+    });
     if (read_bytes == -1) {
       SetError(res,
                Error{.code = ErrorEnum::kInternalServerError,
@@ -239,17 +1611,44 @@ int StartFS(std::string const& host, int port,
                          size, offset, path.c_str())});
       return;
     }
+    GlobalMetrics().BytesRead().Inc(size);
 
+    ScopedTraceStage const serialize_stage{TraceStage::kSerialize};
     res.set_content(ss.str(), "application/text");
   });
 
-  server.Post(
-      "/mkdir", [&](httplib::Request const& req, httplib::Response& res) {
+  routes.Get("/open", [storage, handles = node->handles](
+                         httplib::Request const& req, httplib::Response& res) {
+    ServeOpen(req, res, storage, handles);
+  });
+
+  routes.Get("/read", [storage, handles = node->handles](
+                         httplib::Request const& req, httplib::Response& res) {
+    ServeHandleRead(req, res, storage, handles);
+  });
+
+  routes.Post("/close", [handles = node->handles](httplib::Request const& req,
+                                                  httplib::Response& res) {
+    if (!handles->Close(req.get_param_value("handle"))) {
+      SetError(res, Error{.code = ErrorEnum::kNotFound,
+                          .message = std::format(
+                              "File handle '{}' not found or expired",
+                              req.get_param_value("handle"))});
+      return;
+    }
+    res.set_content("{}", "application/json");
+  });
+
+  routes.Post(
+      "/mkdir", [storage, feed = node->feed](httplib::Request const& req,
+                                            httplib::Response& res) {
         auto partition = LookupPartitionForRequest(req, storage);
         if (!partition.has_value()) {
           SetError(res, partition.error());
           return;
         }
+        auto const write = BeginWrite(req, partition.value(), res);
+        if (!write.has_value()) return;
 
         std::filesystem::path dir_path{req.get_param_value("at")};
         if (dir_path.empty()) dir_path = "/";
@@ -262,20 +1661,30 @@ int StartFS(std::string const& host, int port,
           return;
         }
 
-        tl::expected<Directory*, Error> dir_expected =
-            partition.value()->OpenDir(dir_path);
+        tl::expected<DirectoryOf<Manager>*, Error> dir_expected =
+            Traced(TraceStage::kOpen, [&] {
+              return OpenBackendDir<Manager>(*partition.value(), dir_path);
+            });
         if (!dir_expected.has_value()) {
           SetError(res, dir_expected.error());
           return;
         }
 
-        Directory* dir = dir_expected.value();
-        tl::expected<Directory*, Error> new_dir_expected =
-            dir->CreateDirectory(file_name);
+        DirectoryOf<Manager>* dir = dir_expected.value();
+        tl::expected<Directory*, Error> new_dir_expected = Traced(
+            TraceStage::kIo, [&] { return dir->CreateDirectory(file_name); });
         if (!new_dir_expected.has_value()) {
           SetError(res, new_dir_expected.error());
           return;
         }
+        if (!RecordChange(feed,
+                          Change{.op = ChangeOp::kCreateDirectory,
+                                 .partition = RequestUuid(req),
+                                 .path = dir_path.string(),
+                                 .name = file_name},
+                          res)) {
+          return;
+        }
 
         Directory* new_dir = new_dir_expected.value();
         boost::json::object mkdir_res{
@@ -288,13 +1697,16 @@ int StartFS(std::string const& host, int port,
         res.set_content(boost::json::serialize(mkdir_res), "application/json");
       });
 
-  server.Post("/store", [&](httplib::Request const& req,
+  routes.Post("/store", [storage, feed = node->feed](
+                            httplib::Request const& req,
                             httplib::Response& res) {
     auto partition = LookupPartitionForRequest(req, storage);
     if (!partition.has_value()) {
       SetError(res, partition.error());
       return;
     }
+    auto const write = BeginWrite(req, partition.value(), res);
+    if (!write.has_value()) return;
 
     std::filesystem::path dir_path{req.get_param_value("dir")};
     if (dir_path.empty()) dir_path = "/";
@@ -315,20 +1727,37 @@ int StartFS(std::string const& host, int port,
       return;
     }
 
-    tl::expected<Directory*, Error> dir_expected =
-        partition.value()->OpenDir(dir_path);
+    tl::expected<DirectoryOf<Manager>*, Error> dir_expected =
+        Traced(TraceStage::kOpen, [&] {
+          return OpenBackendDir<Manager>(*partition.value(), dir_path);
+        });
     if (!dir_expected.has_value()) {
       SetError(res, dir_expected.error());
       return;
     }
 
-    Directory* dir = dir_expected.value();
+    DirectoryOf<Manager>* dir = dir_expected.value();
+    size_t const data_size = data.size();
+    /* the payload is moved into the partition, keep a copy for replicas */
+    std::string change_data = feed != nullptr ? data : std::string{};
     tl::expected<RegularFile*, Error> reg_file_expected =
-        dir->StoreRegularFile(file_name, std::move(data));
+        Traced(TraceStage::kIo, [&] {
+          return dir->StoreRegularFile(file_name, std::move(data));
+        });
     if (!reg_file_expected.has_value()) {
       SetError(res, reg_file_expected.error());
       return;
     }
+    if (!RecordChange(feed,
+                      Change{.op = ChangeOp::kStoreRegularFile,
+                             .partition = RequestUuid(req),
+                             .path = dir_path.string(),
+                             .name = file_name,
+                             .data = std::move(change_data)},
+                      res)) {
+      return;
+    }
+    GlobalMetrics().BytesWritten().Inc(data_size);
     RegularFile* reg_file = reg_file_expected.value();
     boost::json::object store_res{
         {"dir", dir_path.c_str()},
@@ -340,7 +1769,83 @@ int StartFS(std::string const& host, int port,
     res.set_content(boost::json::serialize(store_res), "application/json");
   });
 
-  server.Post("/create_client", [&](httplib::Request const& req,
+  routes.Post("/write", [storage, feed = node->feed](
+                            httplib::Request const& req,
+                            httplib::Response& res) {
+    std::optional<uint64_t> const offset = GetUnsignedParam(req, res, "offset");
+    if (!offset.has_value()) return;
+    std::string data{req.get_param_value("data")};
+    if (data.empty() || *offset > kMaxFileSize - data.size()) {
+      SetError(res, Error{.code = ErrorEnum::kInvalidInput,
+                          .message = "Write is empty or past the maximum file "
+                                     "size"});
+      return;
+    }
+
+    MutateRegularFile(
+        req, res, storage, feed,
+        [&](auto* file, Change& change) -> tl::expected<void, Error> {
+          if (auto written = file->PositionalWrite(*offset, data); !written) {
+            return written;
+          }
+          GlobalMetrics().BytesWritten().Inc(data.size());
+          change.op = ChangeOp::kWriteRegularFile;
+          change.offset = *offset;
+          if (feed != nullptr) change.data = std::move(data);
+          return {};
+        });
+  });
+
+  routes.Post("/append", [storage, feed = node->feed](
+                             httplib::Request const& req,
+                             httplib::Response& res) {
+    std::string data{req.get_param_value("data")};
+    if (data.empty()) {
+      SetError(res, Error{.code = ErrorEnum::kInvalidInput,
+                          .message = "Cannot append empty data"});
+      return;
+    }
+
+    MutateRegularFile(
+        req, res, storage, feed,
+        [&](auto* file, Change& change) -> tl::expected<void, Error> {
+          auto offset = file->Append(data);
+          if (!offset) return tl::unexpected(offset.error());
+          GlobalMetrics().BytesWritten().Inc(data.size());
+          /* replaying a write at the offset the data landed at is
+             idempotent, replaying an append isn't */
+          change.op = ChangeOp::kWriteRegularFile;
+          change.offset = *offset;
+          if (feed != nullptr) change.data = std::move(data);
+          return {};
+        });
+  });
+
+  routes.Post("/truncate", [storage, feed = node->feed](
+                               httplib::Request const& req,
+                               httplib::Response& res) {
+    std::optional<uint64_t> const size = GetUnsignedParam(req, res, "size");
+    if (!size.has_value()) return;
+    if (*size > kMaxFileSize) {
+      SetError(res, Error{.code = ErrorEnum::kInvalidInput,
+                          .message = "Size is past the maximum file size"});
+      return;
+    }
+
+    MutateRegularFile(
+        req, res, storage, feed,
+        [&](auto* file, Change& change) -> tl::expected<void, Error> {
+          if (auto truncated = file->Truncate(*size); !truncated) {
+            return truncated;
+          }
+          change.op = ChangeOp::kTruncateRegularFile;
+          change.offset = *size;
+          return {};
+        });
+  });
+
+  routes.Post("/create_client", [storage, feed = node->feed](
+                                    httplib::Request const& req,
                                     httplib::Response& res) {
     std::error_code ec;
     boost::json::value body = boost::json::parse(req.body, ec);
@@ -352,27 +1857,234 @@ int StartFS(std::string const& host, int port,
     }
     std::string client_id = body.at("client_id").as_string().c_str();
 
-    auto it = client_id_to_uuid_.find(client_id);
-    std::string uuid;
-    if (it == client_id_to_uuid_.end()) {
-      boost::uuids::uuid new_uuid = boost::uuids::random_generator()();
-      uuid = boost::uuids::to_string(new_uuid);
-      storage->CreatePartition(uuid);
-      client_id_to_uuid_.emplace(client_id, uuid);
-    } else if (storage->LookupPartition(it->second).has_value()) {
-      uuid = it->second;
-    } else {
-      SetError(res, Error{.code = ErrorEnum::kInternalServerError,
-                          .message = "Couldn't generate uuid"});
+    tl::expected<ClientPartition, Error> client_expected =
+        storage->GetOrCreateClientPartition(client_id);
+    if (!client_expected.has_value()) {
+      SetError(res, client_expected.error());
+      return;
+    }
+    std::string const& uuid = client_expected->uuid;
+    /* only the request that created the partition records it */
+    if (client_expected->created &&
+        (!RecordChange(feed,
+                       Change{.op = ChangeOp::kCreatePartition,
+                              .partition = uuid},
+                       res) ||
+         !RecordChange(feed,
+                       Change{.op = ChangeOp::kBindClient,
+                              .partition = uuid,
+                              .name = client_id},
+                       res))) {
       return;
     }
 
     boost::json::object create_res{{"client_id", client_id}, {"uuid", uuid}};
     res.set_content(boost::json::serialize(create_res), "application/json");
   });
+}
+
+/// the partition manager of the backend @c Manager configured by @c config
+template <typename Manager>
+std::unique_ptr<Manager> CreateManager(ServerConfig const& config) {
+  UsageLimits const limits{.partition_quota = config.partition_quota,
+                           .node_capacity_bytes = config.node_capacity_bytes,
+                           .high_watermark = config.high_watermark};
+  ReclaimerConfig const reclaim{.files_per_s = config.reclaim_files_per_s};
+  DedupConfig const dedup{.enabled = config.dedup};
+  if constexpr (std::is_same_v<Manager, OnDiskPartitionManager>) {
+    return std::make_unique<Manager>(
+        config.data_dir, limits, reclaim,
+        ScrubberConfig{
+            .bytes_per_s = config.scrub_bytes_per_s,
+            .interval = std::chrono::seconds{config.scrub_interval_s}},
+        dedup, config.volumes);
+  } else {
+    return std::make_unique<Manager>(limits, reclaim, dedup);
+  }
+}
+
+template <typename Manager>
+void CollectBackendMetrics(PrometheusWriter& writer, Manager& manager) {
+  if constexpr (std::is_same_v<Manager, OnDiskPartitionManager>) {
+    typename Manager::CacheStats const stats = manager.GetCacheStats();
+    writer.Family("cppfs_partition_cache_hits_total", "counter",
+                  "Partition lookups served from the partition object cache");
+    writer.Sample("cppfs_partition_cache_hits_total",
+                  {{"backend", Manager::kName}}, stats.hits);
+    writer.Family("cppfs_partition_cache_misses_total", "counter",
+                  "Partition lookups that had to construct a partition");
+    writer.Sample("cppfs_partition_cache_misses_total",
+                  {{"backend", Manager::kName}}, stats.misses);
+    CollectChecksumMetrics(writer);
+  }
+  CollectUsageMetrics(writer, manager.GetNodeUsage());
+  manager.GetReclaimer().CollectMetrics(writer, Manager::kName);
+  CollectDedupMetrics(writer, manager.GetDedupStats(), Manager::kName);
+}
 
-  server.listen(host, port);
+/// serve the storage API with the partitions of backend @c Manager, the
+/// routes are instantiated for it and reach its partitions and files
+/// without virtual calls
+template <typename Manager>
+int Serve(ServerConfig const& config) {
+  auto const& cert = config.cert_path;
+  auto const& key = config.key_path;
+
+  GlobalTracer().SetSampleRate(config.trace_sample_rate);
+  auto storage = new Storage<Manager>(CreateManager<Manager>(config));
+  std::shared_mutex* backend_mutex =
+      Manager::kThreadSafe ? nullptr : new std::shared_mutex;
+  std::vector<std::filesystem::path> data_dirs;
+  if constexpr (std::is_same_v<Manager, OnDiskPartitionManager>) {
+    data_dirs = storage->GetManager().GetVolumes();
+  }
+
+  for (auto const* route : kRoutes) {
+    GlobalMetrics().RegisterRoute(route, Manager::kName);
+  }
+  GlobalMetrics().AddCollector([storage](PrometheusWriter& writer) {
+    CollectBackendMetrics(writer, storage->GetManager());
+  });
+
+  if (!std::filesystem::is_regular_file(cert)) {
+    std::cout << "Certificate file " << cert
+              << " is not a regular file or doesn't exist.\n";
+    return EXIT_FAILURE;
+  }
+  if (!std::filesystem::is_regular_file(key)) {
+    std::cout << "Key file " << key
+              << " is not a regular file or doesn't exist.\n";
+    return EXIT_FAILURE;
+  }
+
+  httplib::SSLServer server(cert.c_str(), key.c_str());
+  if (!server.is_valid()) {
+    std::cout << "Cannot start storage server" << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto tls_sessions = new TlsSessions(TlsSessionConfig{
+      .session_cache_size = config.tls_session_cache_size,
+      .ticket_key_rotation =
+          std::chrono::seconds{config.tls_ticket_key_rotation_s}});
+  tls_sessions->Install(server.ssl_context());
+  GlobalMetrics().AddCollector([tls_sessions](PrometheusWriter& writer) {
+    tls_sessions->CollectMetrics(writer);
+  });
+  auto limiter = new RateLimiter(
+      RateLimits{.requests_per_s = config.rate_limit_rps,
+                 .bytes_per_s = config.rate_limit_bytes_per_s,
+                 .burst_s = config.rate_limit_burst_s});
+  FairSchedulerConfig scheduler_config{
+      .concurrency = config.scheduler_concurrency};
+  /* tenants are canonical partition ids */
+  for (auto const& [uuid, weight] : config.tenant_weights) {
+    scheduler_config.weights.emplace(CanonicalUuid(uuid), weight);
+  }
+  auto scheduler = new FairScheduler(std::move(scheduler_config));
+  GlobalMetrics().AddCollector([limiter, scheduler](PrometheusWriter& writer) {
+    CollectSchedulingMetrics(writer, *limiter, *scheduler);
+  });
+  auto handles = new FileHandleTable(FileHandleConfig{
+      .idle_timeout = std::chrono::seconds{config.file_handle_idle_s},
+      .max_per_client = config.max_file_handles_per_client});
+  GlobalMetrics().AddCollector([handles](PrometheusWriter& writer) {
+    writer.Family("cppfs_open_file_handles", "gauge",
+                  "File handles open for chunked reads");
+    writer.Sample("cppfs_open_file_handles", {}, handles->GetSize());
+  });
+
+  bool const is_replica = !config.replicate_from.empty();
+  /* the node state is kept in the data directory with any backend */
+  std::filesystem::create_directories(config.data_dir);
+  ChangeFeed* feed = nullptr;
+  if (config.change_feed && !is_replica) {
+    feed = new ChangeFeed(config.data_dir / "changes.log");
+    GlobalMetrics().AddCollector([feed](PrometheusWriter& writer) {
+      writer.Family("cppfs_replication_last_sequence", "gauge",
+                    "Sequence of the last change recorded for replicas");
+      writer.Sample("cppfs_replication_last_sequence", {},
+                    feed->GetLastSequence());
+    });
+  }
+  std::unique_ptr<Replicator> replicator;
+  if (is_replica) {
+    auto primary = ParseHostPort(config.replicate_from);
+    if (!primary.has_value()) {
+      std::cout << "Invalid primary address " << config.replicate_from
+                << ", expected host:port" << std::endl;
+      return EXIT_FAILURE;
+    }
+    replicator = std::make_unique<Replicator>(
+        ReplicatorConfig{.host = primary->first,
+                         .port = primary->second,
+                         .ca_cert = config.replication_ca_cert,
+                         .token = config.replication_token,
+                         .state_path = config.data_dir / "replica.state"},
+        [storage, backend_mutex](Change const& change) {
+          std::unique_lock<std::shared_mutex> lock;
+          if (backend_mutex != nullptr) {
+            lock = std::unique_lock{*backend_mutex};
+          }
+          return ApplyChange(*storage, change);
+        });
+    GlobalMetrics().AddCollector(
+        [replicator = replicator.get()](PrometheusWriter& writer) {
+          replicator->CollectMetrics(writer);
+        });
+    replicator->Start();
+  }
+
+  auto node = new NodeContext<Manager>{
+      .storage = storage,
+      .limiter = limiter,
+      .scheduler = scheduler,
+      .feed = feed,
+      .read_only = is_replica,
+      .replication_token = config.replication_token,
+      .data_dirs = std::move(data_dirs),
+      .handles = handles,
+      .untar_writers = Manager::kThreadSafe ? config.untar_writers : 0,
+      .archive_readers = Manager::kThreadSafe ? config.archive_readers : 0,
+      .backend_mutex = backend_mutex,
+  };
+  RegisterRoutes(server, node);
+
+  /* plain HTTP for trusted local proxies that terminate TLS themselves */
+  std::unique_ptr<httplib::Server> plain_server;
+  std::thread plain_thread;
+  if (config.plain_port != 0) {
+    plain_server = std::make_unique<httplib::Server>();
+    RegisterRoutes(*plain_server, node);
+    if (!plain_server->bind_to_port(config.plain_address, config.plain_port)) {
+      std::cout << "Cannot bind plaintext listener to " << config.plain_address
+                << ":" << config.plain_port << std::endl;
+      return EXIT_FAILURE;
+    }
+    plain_thread = std::thread([&plain_server] {
+      plain_server->listen_after_bind();
+    });
+  }
+
+  server.listen(config.ip_address, config.port);
+  if (plain_server) {
+    plain_server->stop();
+    plain_thread.join();
+  }
+  if (replicator) replicator->Stop();
   return 0;
 }
 
+}  // namespace
+
+int StartFS(ServerConfig const& config) {
+  if (config.backend == OnDiskPartitionManager::kName) {
+    return Serve<OnDiskPartitionManager>(config);
+  }
+  if (config.backend == InMemoryPartitionManager::kName) {
+    return Serve<InMemoryPartitionManager>(config);
+  }
+  std::cout << "Unknown backend " << config.backend << std::endl;
+  return EXIT_FAILURE;
+}
+
 }  // namespace cppfs::storage
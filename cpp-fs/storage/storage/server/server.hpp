@@ -1,11 +1,87 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <map>
 #include <string>
+#include <vector>
+
+#include "partition/usage.hpp"
 
 namespace cppfs::storage {
 
-int StartFS(std::string const& host, int port,
-            std::filesystem::path const& cert,
-            std::filesystem::path const& key);
+struct ServerConfig {
+  std::string ip_address;
+  int port;
+  std::filesystem::path cert_path;
+  std::filesystem::path key_path;
+  /// partition backend, `on_disk` or `in_memory`
+  std::string backend{"on_disk"};
+  /// root directory of the on-disk partitions and their manifest, and of
+  /// the replication state with either backend
+  std::filesystem::path data_dir{"./partitions"};
+  /// more directories new partitions are spread across by free space,
+  /// typically on other disks
+  std::vector<std::filesystem::path> volumes{};
+  /// trace every N-th request served by a worker thread, 0 disables tracing
+  uint32_t trace_sample_rate{16};
+  /// sessions kept for TLS 1.2 session id resumption
+  size_t tls_session_cache_size{20480};
+  /// session ticket key rotation interval, tickets stay valid for two
+  /// intervals
+  uint32_t tls_ticket_key_rotation_s{3600};
+  /// serve plain HTTP on this address for trusted local proxies terminating
+  /// TLS themselves, disabled if the port is 0
+  std::string plain_address{"127.0.0.1"};
+  int plain_port{0};
+  /// limits of every partition, 0 means unlimited
+  Quota partition_quota{};
+  /// bytes all partitions may store together, 0 means unlimited
+  uint64_t node_capacity_bytes{0};
+  /// fraction of the node capacity above which writes are shed
+  double high_watermark{0.9};
+  /// files of destroyed partitions removed per second in the background, 0
+  /// means unlimited
+  double reclaim_files_per_s{0};
+  /// bytes of file data verified per second by the background scrubber, 0
+  /// disables scrubbing
+  double scrub_bytes_per_s{0};
+  /// seconds between two scrubs of all partitions
+  uint32_t scrub_interval_s{86400};
+  /// store identical payloads once, shared by all partitions
+  bool dedup{false};
+  /// seconds after which an unused file handle is closed
+  uint32_t file_handle_idle_s{60};
+  /// file handles a partition may hold open at once
+  size_t max_file_handles_per_client{64};
+  /// threads storing the files of an archive uploaded to `/untar`
+  size_t untar_writers{8};
+  /// threads reading the files of an `/archive` download ahead of the
+  /// stream
+  size_t archive_readers{4};
+  /// requests of partitions executed at once by the fair scheduler, 0
+  /// disables scheduling
+  size_t scheduler_concurrency{4};
+  /// partition uuid -> scheduling weight, partitions missing here weigh 1
+  std::map<std::string, double> tenant_weights{};
+  /// requests and payload bytes per second of a single partition, 0 means
+  /// unlimited
+  double rate_limit_rps{0};
+  double rate_limit_bytes_per_s{0};
+  /// seconds of traffic a partition may send at once after being idle
+  double rate_limit_burst_s{1.0};
+  /// record mutations in a change feed replicas can pull from
+  bool change_feed{false};
+  /// `host:port` of the primary to replicate from, makes the node a
+  /// read-only replica
+  std::string replicate_from{};
+  /// shared secret of the replication endpoints, which are disabled if it
+  /// is empty
+  std::string replication_token{};
+  /// CA certificate to verify the primary with, the system CA store if empty
+  std::filesystem::path replication_ca_cert{};
+};
+
+int StartFS(ServerConfig const& config);
 }
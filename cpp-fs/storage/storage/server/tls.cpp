@@ -0,0 +1,215 @@
+#include "server/tls.hpp"
+
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/params.h>
+#include <openssl/rand.h>
+
+#include "tracing/tracing.hpp"
+
+namespace cppfs::storage {
+
+namespace {
+
+std::optional<TicketKeyRing::Key> GenerateKey() {
+  TicketKeyRing::Key key;
+  if (RAND_bytes(key.name.data(), static_cast<int>(key.name.size())) != 1 ||
+      RAND_bytes(key.hmac_key.data(), static_cast<int>(key.hmac_key.size())) !=
+          1 ||
+      RAND_bytes(key.aes_key.data(), static_cast<int>(key.aes_key.size())) !=
+          1) {
+    return std::nullopt;
+  }
+  return key;
+}
+
+void Cleanse(TicketKeyRing::Key& key) { OPENSSL_cleanse(&key, sizeof(key)); }
+
+bool SetMacKey(EVP_MAC_CTX* mac_ctx, TicketKeyRing::Key& key) {
+  std::array<OSSL_PARAM, 3> params = {
+      OSSL_PARAM_construct_octet_string(
+          OSSL_MAC_PARAM_KEY, key.hmac_key.data(), key.hmac_key.size()),
+      OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                       const_cast<char*>("SHA256"), 0),
+      OSSL_PARAM_construct_end(),
+  };
+  return EVP_MAC_CTX_set_params(mac_ctx, params.data()) == 1;
+}
+
+/// index of TlsSessions in SSL_CTX application data
+int ContextIndex() {
+  static int const index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+}  // namespace
+
+TicketKeyRing::TicketKeyRing(std::chrono::seconds rotation_interval,
+                             Clock::time_point now)
+    : rotation_interval_(rotation_interval), rotated_at_(now) {
+  std::optional<Key> key = GenerateKey();
+  if (!key.has_value()) {
+    throw std::runtime_error("Cannot generate TLS session ticket key");
+  }
+  current_ = *key;
+  Cleanse(*key);
+}
+
+TicketKeyRing::~TicketKeyRing() {
+  Cleanse(current_);
+  if (previous_.has_value()) Cleanse(*previous_);
+}
+
+TicketKeyRing::Key TicketKeyRing::GetEncryptionKey(Clock::time_point now) {
+  RotateIfExpired(now);
+  std::shared_lock const lock{mutex_};
+  return current_;
+}
+
+std::optional<TicketKeyRing::Lookup> TicketKeyRing::FindDecryptionKey(
+    unsigned char const* name, Clock::time_point now) {
+  RotateIfExpired(now);
+  std::shared_lock const lock{mutex_};
+  if (std::memcmp(name, current_.name.data(), kNameSize) == 0) {
+    return Lookup{.key = current_, .renew = false};
+  }
+  if (previous_.has_value() &&
+      std::memcmp(name, previous_->name.data(), kNameSize) == 0) {
+    return Lookup{.key = *previous_, .renew = true};
+  }
+  return std::nullopt;
+}
+
+void TicketKeyRing::RotateIfExpired(Clock::time_point now) {
+  {
+    std::shared_lock const lock{mutex_};
+    if (now - rotated_at_ < rotation_interval_) return;
+  }
+
+  std::unique_lock const lock{mutex_};
+  if (now - rotated_at_ < rotation_interval_) return;
+  std::optional<Key> key = GenerateKey();
+  /* keep using the current key, the next handshake will retry */
+  if (!key.has_value()) return;
+
+  if (previous_.has_value()) Cleanse(*previous_);
+  /* after a long idle period the current key is too old to be kept */
+  if (now - rotated_at_ < 2 * rotation_interval_) {
+    previous_ = current_;
+  } else {
+    previous_.reset();
+  }
+  current_ = *key;
+  Cleanse(*key);
+  rotated_at_ = now;
+  rotations_.fetch_add(1, std::memory_order_relaxed);
+}
+
+TlsSessions::TlsSessions(TlsSessionConfig const& config)
+    : config_(config), ticket_keys_(config.ticket_key_rotation) {}
+
+void TlsSessions::Install(SSL_CTX* ctx) {
+  static constexpr unsigned char kSessionIdContext[] = "cppfs";
+
+  ctx_ = ctx;
+  SSL_CTX_set_ex_data(ctx, ContextIndex(), this);
+
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_sess_set_cache_size(ctx,
+                              static_cast<long>(config_.session_cache_size));
+  SSL_CTX_set_timeout(
+      ctx, static_cast<long>(2 * config_.ticket_key_rotation.count()));
+  SSL_CTX_set_session_id_context(ctx, kSessionIdContext,
+                                 sizeof(kSessionIdContext) - 1);
+
+  SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+  SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, OnTicketKey);
+  SSL_CTX_set_info_callback(ctx, OnInfo);
+}
+
+void TlsSessions::CollectMetrics(PrometheusWriter& writer) const {
+  writer.Family("cppfs_tls_handshakes_total", "counter",
+                "Completed TLS handshakes, resumed ones skip the key exchange");
+  writer.Sample("cppfs_tls_handshakes_total", {{"type", "full"}},
+                GetFullHandshakes());
+  writer.Sample("cppfs_tls_handshakes_total", {{"type", "resumed"}},
+                GetResumedHandshakes());
+
+  writer.Family("cppfs_tls_ticket_key_rotations_total", "counter",
+                "Rotations of the session ticket encryption key");
+  writer.Sample("cppfs_tls_ticket_key_rotations_total", {},
+                ticket_keys_.GetRotations());
+
+  if (ctx_ == nullptr) return;
+  writer.Family("cppfs_tls_session_cache_sessions", "gauge",
+                "Sessions in the server-side TLS session cache");
+  writer.Sample("cppfs_tls_session_cache_sessions", {},
+                static_cast<int64_t>(SSL_CTX_sess_number(ctx_)));
+}
+
+TlsSessions* TlsSessions::FromSSL(SSL const* ssl) {
+  return static_cast<TlsSessions*>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ContextIndex()));
+}
+
+/// The handshake runs on the worker thread that then serves the connection,
+/// so its timings are attached to the next request traced on the thread.
+void TlsSessions::OnInfo(SSL const* ssl, int where, int ret [[maybe_unused]]) {
+  thread_local Tracer::Clock::time_point handshake_start;
+  thread_local bool in_handshake = false;
+  if ((where & SSL_CB_HANDSHAKE_START) != 0) {
+    handshake_start = Tracer::Clock::now();
+    in_handshake = true;
+  }
+  /* TLS 1.3 post-handshake messages report a handshake without a start */
+  if ((where & SSL_CB_HANDSHAKE_DONE) != 0 && in_handshake) {
+    in_handshake = false;
+    Tracer::RecordHandshake(handshake_start, Tracer::Clock::now());
+    TlsSessions* sessions = FromSSL(ssl);
+    if (sessions == nullptr) return;
+    if (SSL_session_reused(ssl) == 1) {
+      sessions->resumed_handshakes_.Inc();
+    } else {
+      sessions->full_handshakes_.Inc();
+    }
+  }
+}
+
+int TlsSessions::OnTicketKey(SSL* ssl, unsigned char* key_name,
+                             unsigned char* iv, EVP_CIPHER_CTX* cipher_ctx,
+                             EVP_MAC_CTX* mac_ctx, int enc) {
+  TlsSessions* sessions = FromSSL(ssl);
+  if (sessions == nullptr) return -1;
+  EVP_CIPHER const* cipher = EVP_aes_256_cbc();
+
+  if (enc == 1) {
+    TicketKeyRing::Key key = sessions->ticket_keys_.GetEncryptionKey();
+    bool const ok =
+        RAND_bytes(iv, EVP_CIPHER_get_iv_length(cipher)) == 1 &&
+        EVP_EncryptInit_ex(cipher_ctx, cipher, nullptr, key.aes_key.data(),
+                           iv) == 1 &&
+        SetMacKey(mac_ctx, key);
+    std::memcpy(key_name, key.name.data(), TicketKeyRing::kNameSize);
+    Cleanse(key);
+    return ok ? 1 : -1;
+  }
+
+  std::optional<TicketKeyRing::Lookup> lookup =
+      sessions->ticket_keys_.FindDecryptionKey(key_name);
+  /* unknown or expired key, fall back to a full handshake */
+  if (!lookup.has_value()) return 0;
+  bool const ok = SetMacKey(mac_ctx, lookup->key) &&
+                  EVP_DecryptInit_ex(cipher_ctx, cipher, nullptr,
+                                     lookup->key.aes_key.data(), iv) == 1;
+  Cleanse(lookup->key);
+  if (!ok) return -1;
+  return lookup->renew ? 2 : 1;
+}
+
+}  // namespace cppfs::storage
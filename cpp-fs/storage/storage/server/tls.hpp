@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+
+#include <openssl/ssl.h>
+
+#include "metrics/metrics.hpp"
+
+namespace cppfs::storage {
+
+///
+/// Keys protecting TLS session tickets.
+///
+/// New tickets are always encrypted with the current key. The key is replaced
+/// once per rotation interval, the previous one is kept for another interval
+/// so tickets issued shortly before a rotation stay usable. Tickets encrypted
+/// with the previous key are accepted and reissued with the current one.
+///
+class TicketKeyRing {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t kNameSize = 16;
+  static constexpr size_t kSecretSize = 32;
+
+  struct Key {
+    std::array<unsigned char, kNameSize> name;
+    std::array<unsigned char, kSecretSize> hmac_key;
+    std::array<unsigned char, kSecretSize> aes_key;
+  };
+
+  struct Lookup {
+    Key key;
+    /// ticket was encrypted with the previous key and should be reissued
+    bool renew;
+  };
+
+  explicit TicketKeyRing(std::chrono::seconds rotation_interval,
+                         Clock::time_point now = Clock::now());
+
+  ~TicketKeyRing();
+
+  TicketKeyRing(TicketKeyRing const&) = delete;
+  TicketKeyRing& operator=(TicketKeyRing const&) = delete;
+
+  /// key for new tickets
+  Key GetEncryptionKey(Clock::time_point now = Clock::now());
+
+  /// key that encrypted ticket with key name @c name, if it is still valid
+  std::optional<Lookup> FindDecryptionKey(unsigned char const* name,
+                                          Clock::time_point now = Clock::now());
+
+  uint64_t GetRotations() const {
+    return rotations_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void RotateIfExpired(Clock::time_point now);
+
+  std::chrono::seconds const rotation_interval_;
+  Key current_;
+  std::optional<Key> previous_;
+  Clock::time_point rotated_at_;
+  std::atomic<uint64_t> rotations_{0};
+  mutable std::shared_mutex mutex_;
+};
+
+struct TlsSessionConfig {
+  /// sessions kept in the server-side session cache
+  size_t session_cache_size{20480};
+  /// ticket keys are rotated with this interval, a session can be resumed
+  /// for at most two intervals
+  std::chrono::seconds ticket_key_rotation{3600};
+};
+
+///
+/// TLS session resumption for a server context.
+///
+/// Enables the shared server-side session cache (used by TLS 1.2 session ids)
+/// and stateless session tickets with rotating keys (used by TLS 1.2 and 1.3).
+/// Also counts full and abbreviated handshakes and reports handshake timings
+/// to the tracer.
+///
+class TlsSessions {
+ public:
+  explicit TlsSessions(TlsSessionConfig const& config);
+
+  TlsSessions(TlsSessions const&) = delete;
+  TlsSessions& operator=(TlsSessions const&) = delete;
+
+  /// configure @c ctx, the object must outlive all connections of @c ctx
+  void Install(SSL_CTX* ctx);
+
+  uint64_t GetFullHandshakes() const { return full_handshakes_.Value(); }
+
+  uint64_t GetResumedHandshakes() const { return resumed_handshakes_.Value(); }
+
+  TicketKeyRing& GetTicketKeys() { return ticket_keys_; }
+
+  void CollectMetrics(PrometheusWriter& writer) const;
+
+ private:
+  static void OnInfo(SSL const* ssl, int where, int ret);
+
+  static int OnTicketKey(SSL* ssl, unsigned char* key_name, unsigned char* iv,
+                         EVP_CIPHER_CTX* cipher_ctx, EVP_MAC_CTX* mac_ctx,
+                         int enc);
+
+  static TlsSessions* FromSSL(SSL const* ssl);
+
+  TlsSessionConfig const config_;
+  TicketKeyRing ticket_keys_;
+  SSL_CTX* ctx_{nullptr};
+  Counter full_handshakes_;
+  Counter resumed_handshakes_;
+};
+
+}  // namespace cppfs::storage
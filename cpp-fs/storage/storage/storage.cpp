@@ -1,22 +1,19 @@
 #include "storage.hpp"
 
-#include <stdexcept>
+#include <algorithm>
+#include <array>
 
-#include <boost/uuid/string_generator.hpp>
+#include <boost/uuid/random_generator.hpp>
 #include <boost/uuid/uuid.hpp>
-#include <boost/uuid/uuid_io.hpp>
 
 namespace cppfs::storage {
 
-/// This function is a modification of the function from
-/// https://stackoverflow.com/a/28685177
-bool IsUUIDValid(std::string const& str) noexcept {
-  using namespace boost::uuids;
-  try {
-    return string_generator()(str).version() != uuid::version_unknown;
-  } catch (std::runtime_error const& error [[maybe_unused]]) {
-    return false;
-  }
+PartitionId GeneratePartitionId() {
+  static thread_local boost::uuids::random_generator generator;
+  boost::uuids::uuid const uuid = generator();
+  std::array<uint8_t, PartitionId::kSize> bytes;
+  std::copy(uuid.begin(), uuid.end(), bytes.begin());
+  return PartitionId{bytes};
 }
 
 }  // namespace cppfs::storage
@@ -4,63 +4,123 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <tl/expected.hpp>
-#include <type_traits>
 
 #include "error_types.h"
+#include "partition/backend.hpp"
 #include "partition/partition.hpp"
+#include "partition/partition_id.hpp"
 
 namespace cppfs::storage {
 
 /// check if provided string is valid uuid
-bool IsUUIDValid(std::string const& str) noexcept;
+inline bool IsUUIDValid(std::string_view str) noexcept {
+  return PartitionId::Parse(str).has_value();
+}
+
+/// parse partition id @c uuid received in a request
+inline tl::expected<PartitionId, Error> ParsePartitionId(
+    std::string_view uuid) {
+  auto id = PartitionId::Parse(uuid);
+  if (!id.has_value()) {
+    return tl::unexpected(
+        Error{ErrorEnum::kInvalidInput,
+              std::format("Received incorrect partition id '{}'", uuid)});
+  }
+  return *id;
+}
+
+/// generate random (version 4) uuid
+PartitionId GeneratePartitionId();
+
+/// partition bound to a client
+struct ClientPartition {
+  std::string uuid;
+  /// the partition was created and bound by this call
+  bool created{false};
+};
 
 ///
 /// The main class that provides an interface for interacting with the storage.
 ///
+/// Partitions are returned with the concrete type of the backend, see
+/// PartitionBackend.
+///
 template <typename Manager>
 class Storage {
  public:
-  static_assert(std::is_base_of_v<PartitionManager, Manager>,
-                "Manager Type should be derived from PartitionManager");
+  static_assert(PartitionBackend<Manager>,
+                "Manager Type should be a PartitionManager exposing the "
+                "final types of its partitions and files");
+
+  using PartitionType = PartitionOf<Manager>;
 
   explicit Storage(std::unique_ptr<Manager> manager)
       : manager_(std::move(manager)) {}
 
   /// try to find partition by partition uuid
-  tl::expected<Partition*, Error> LookupPartition(std::string const& uuid) {
-    if (!IsUUIDValid(uuid)) {
-      return tl::unexpected(
-          Error{ErrorEnum::kInvalidInput,
-                std::format("Received incorrect partition id '{}'", uuid)});
-    }
-    Partition* const partition = manager_->LookupPartition(uuid);
+  tl::expected<PartitionType*, Error> LookupPartition(std::string_view uuid) {
+    auto const id = ParsePartitionId(uuid);
+    if (!id) return tl::unexpected(id.error());
+    return LookupPartition(*id);
+  }
+
+  tl::expected<PartitionType*, Error> LookupPartition(PartitionId const& id) {
+    PartitionType* const partition = manager_->LookupPartition(id);
     if (partition == nullptr) {
-      return tl::unexpected(
-          Error{ErrorEnum::kNotFound,
-                std::format("Partition with id '{}' not found", uuid)});
+      return tl::unexpected(Error{
+          ErrorEnum::kNotFound,
+          std::format("Partition with id '{}' not found", id.ToString())});
     }
 
     return partition;
   }
 
   /// try to create new partition
-  tl::expected<Partition*, Error> CreatePartition(std::string const& uuid) {
-    auto const lookup = LookupPartition(uuid);
-    if (lookup) {
+  tl::expected<Partition*, Error> CreatePartition(std::string_view uuid) {
+    auto const id = ParsePartitionId(uuid);
+    if (!id) return tl::unexpected(id.error());
+    if (manager_->ContainsPartition(*id)) {
       return tl::unexpected(
           Error{ErrorEnum::kAlreadyExists,
                 std::format("Partition with id '{}' already exists", uuid)});
     }
-    if (lookup.error().code != ErrorEnum::kNotFound) {
-      return tl::unexpected(lookup.error());
-    }
     std::lock_guard const lock_guard{mutex_};
-    return manager_->CreatePartition(uuid);
+    return manager_->CreatePartition(*id);
+  }
+
+  /// return uuid of the partition bound to @c client_id, creating a new
+  /// partition and binding on the first call. Of concurrent first calls
+  /// exactly one creates the partition.
+  tl::expected<ClientPartition, Error> GetOrCreateClientPartition(
+      std::string const& client_id) {
+    std::lock_guard const lock_guard{mutex_};
+    if (auto id = manager_->LookupClient(client_id); id.has_value()) {
+      if (manager_->LookupPartition(*id) == nullptr) {
+        return tl::unexpected(Error{
+            ErrorEnum::kInternalServerError,
+            std::format("Partition '{}' bound to client '{}' is missing",
+                        id->ToString(), client_id)});
+      }
+      return ClientPartition{.uuid = id->ToString()};
+    }
+
+    PartitionId const id = GeneratePartitionId();
+    if (auto partition = manager_->CreatePartition(id); !partition) {
+      return tl::unexpected(partition.error());
+    }
+    if (auto bound = manager_->BindClient(client_id, id); !bound) {
+      manager_->DestroyPartition(id);
+      return tl::unexpected(bound.error());
+    }
+    return ClientPartition{.uuid = id.ToString(), .created = true};
   }
 
   void Clear() { manager_->Clear(); }
 
+  Manager& GetManager() { return *manager_; }
+
  private:
   std::unique_ptr<Manager> const manager_;
   std::mutex mutex_;
@@ -0,0 +1,265 @@
+#include "tracing/tracing.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <boost/json.hpp>
+
+namespace cppfs::storage {
+
+namespace {
+
+int64_t ToNanoseconds(Tracer::Clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+      .count();
+}
+
+double ToMicroseconds(int64_t ns) { return static_cast<double>(ns) / 1e3; }
+
+/// Tracing state of the current thread
+struct ThreadTraceState {
+  uint32_t requests{0};
+  bool active{false};
+  bool routed{false};
+  Tracer::Clock::time_point start;
+  TraceRecord record{};
+
+  bool has_handshake{false};
+  Tracer::Clock::time_point handshake_begin;
+  Tracer::Clock::time_point handshake_end;
+
+  /// ring of the tracer this thread publishes to
+  uint64_t tracer_id{0};
+  TraceRing* ring{nullptr};
+};
+
+thread_local ThreadTraceState thread_state;
+
+std::atomic<uint64_t> next_tracer_id{1};
+std::atomic<uint32_t> next_thread_index{0};
+
+void AccumulateSpan(TraceSpan& span, int64_t begin_ns, int64_t end_ns) {
+  if (span.duration_ns == 0) span.begin_ns = begin_ns;
+  span.duration_ns += std::max<int64_t>(end_ns - begin_ns, 1);
+}
+
+}  // namespace
+
+std::string_view TraceStageToString(TraceStage stage) {
+  switch (stage) {
+    case TraceStage::kTlsHandshake:
+      return "tls_handshake";
+    case TraceStage::kRouting:
+      return "routing";
+    case TraceStage::kQueue:
+      return "queue";
+    case TraceStage::kLookupPartition:
+      return "lookup_partition";
+    case TraceStage::kOpen:
+      return "open";
+    case TraceStage::kIo:
+      return "io";
+    case TraceStage::kSerialize:
+      return "serialize";
+    case TraceStage::kCount:
+      break;
+  }
+  return "unknown";
+}
+
+void TraceRing::Push(TraceRecord const& record) {
+  uint64_t const head = head_.load(std::memory_order_relaxed);
+  Slot& slot = slots_[head % kCapacity];
+  uint64_t const sequence = slot.sequence.load(std::memory_order_relaxed);
+
+  std::array<uint64_t, kWords> words;
+  std::memcpy(words.data(), &record, sizeof(TraceRecord));
+
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < kWords; ++i) {
+    slot.words[i].store(words[i], std::memory_order_relaxed);
+  }
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+  head_.store(head + 1, std::memory_order_release);
+}
+
+void TraceRing::Collect(std::vector<TraceRecord>& out) const {
+  for (Slot const& slot : slots_) {
+    uint64_t const before = slot.sequence.load(std::memory_order_acquire);
+    if (before == 0 || before % 2 == 1) continue;
+
+    std::array<uint64_t, kWords> words;
+    for (size_t i = 0; i < kWords; ++i) {
+      words[i] = slot.words[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != before) continue;
+
+    TraceRecord& record = out.emplace_back();
+    std::memcpy(&record, words.data(), sizeof(TraceRecord));
+  }
+}
+
+Tracer::Tracer()
+    : id_(next_tracer_id.fetch_add(1, std::memory_order_relaxed)) {}
+
+void Tracer::Begin(std::string_view path) {
+  ThreadTraceState& state = thread_state;
+  state.active = false;
+
+  uint32_t const rate = GetSampleRate();
+  bool const sampled = rate != 0 && ++state.requests % rate == 0;
+  bool const has_handshake = state.has_handshake;
+  state.has_handshake = false;
+  if (!sampled) return;
+
+  state.active = true;
+  state.routed = false;
+  state.start = Clock::now();
+  state.record = TraceRecord{};
+  state.record.id = next_id_.fetch_add(1, std::memory_order_relaxed);
+  state.record.start_ns = ToNanoseconds(state.start.time_since_epoch());
+  state.record.path_length = static_cast<uint8_t>(
+      std::min(path.size(), TraceRecord::kMaxPathLength));
+  std::copy_n(path.begin(), state.record.path_length,
+              state.record.path.begin());
+  if (has_handshake) {
+    AddStage(TraceStage::kTlsHandshake, state.handshake_begin,
+             state.handshake_end);
+  }
+}
+
+void Tracer::End(int status) {
+  ThreadTraceState& state = thread_state;
+  if (!state.active) return;
+  state.active = false;
+  state.record.duration_ns = ToNanoseconds(Clock::now() - state.start);
+  state.record.status = status;
+  TraceRing& ring = ThisThreadRing();
+  state.record.thread_index = ring.GetThreadIndex();
+  ring.Push(state.record);
+}
+
+void Tracer::RecordHandshake(Clock::time_point begin, Clock::time_point end) {
+  thread_state.has_handshake = true;
+  thread_state.handshake_begin = begin;
+  thread_state.handshake_end = end;
+}
+
+bool Tracer::IsActive() { return thread_state.active; }
+
+void Tracer::AddStage(TraceStage stage, Clock::time_point begin,
+                      Clock::time_point end) {
+  ThreadTraceState& state = thread_state;
+  if (!state.active) return;
+
+  int64_t const begin_ns = ToNanoseconds(begin - state.start);
+  int64_t const end_ns = ToNanoseconds(end - state.start);
+  if (!state.routed && stage != TraceStage::kTlsHandshake) {
+    /* everything before the first handler stage is spent in routing */
+    state.routed = true;
+    AccumulateSpan(
+        state.record.stages[static_cast<size_t>(TraceStage::kRouting)], 0,
+        begin_ns);
+  }
+  AccumulateSpan(state.record.stages[static_cast<size_t>(stage)], begin_ns,
+                 end_ns);
+}
+
+std::vector<TraceRecord> Tracer::CollectSlow(
+    std::chrono::nanoseconds min_duration, size_t limit) const {
+  std::vector<TraceRecord> records;
+  {
+    std::lock_guard const lock{mutex_};
+    records.reserve(rings_.size() * TraceRing::kCapacity);
+    for (auto const& ring : rings_) ring->Collect(records);
+  }
+  std::erase_if(records, [min_duration](TraceRecord const& record) {
+    return record.duration_ns < min_duration.count();
+  });
+  std::sort(records.begin(), records.end(),
+            [](TraceRecord const& lhs, TraceRecord const& rhs) {
+              return lhs.duration_ns > rhs.duration_ns;
+            });
+  if (records.size() > limit) records.resize(limit);
+  return records;
+}
+
+TraceRing& Tracer::ThisThreadRing() {
+  ThreadTraceState& state = thread_state;
+  if (state.ring == nullptr || state.tracer_id != id_) {
+    std::lock_guard const lock{mutex_};
+    auto& ring = rings_.emplace_back(std::make_unique<TraceRing>(
+        next_thread_index.fetch_add(1, std::memory_order_relaxed)));
+    state.ring = ring.get();
+    state.tracer_id = id_;
+  }
+  return *state.ring;
+}
+
+Tracer& GlobalTracer() {
+  static Tracer tracer;
+  return tracer;
+}
+
+std::string TracesToJson(std::vector<TraceRecord> const& records) {
+  boost::json::array traces;
+  traces.reserve(records.size());
+  for (TraceRecord const& record : records) {
+    boost::json::object stages;
+    for (size_t i = 0; i < kTraceStages; ++i) {
+      auto const stage = static_cast<TraceStage>(i);
+      if (!record.HasStage(stage)) continue;
+      stages[TraceStageToString(stage)] = {
+          {"begin_us", ToMicroseconds(record.stages[i].begin_ns)},
+          {"duration_us", ToMicroseconds(record.stages[i].duration_ns)},
+      };
+    }
+    traces.push_back(boost::json::object{
+        {"id", record.id},
+        {"path", record.GetPath()},
+        {"status", record.status},
+        {"thread", record.thread_index},
+        {"duration_us", ToMicroseconds(record.duration_ns)},
+        {"stages", std::move(stages)},
+    });
+  }
+  return boost::json::serialize(boost::json::object{{"traces", traces}});
+}
+
+std::string TracesToChromeJson(std::vector<TraceRecord> const& records) {
+  boost::json::array events;
+  for (TraceRecord const& record : records) {
+    events.push_back(boost::json::object{
+        {"name", record.GetPath()},
+        {"cat", "request"},
+        {"ph", "X"},
+        {"pid", 1},
+        {"tid", record.thread_index},
+        {"ts", ToMicroseconds(record.start_ns)},
+        {"dur", ToMicroseconds(record.duration_ns)},
+        {"args", {{"id", record.id}, {"status", record.status}}},
+    });
+    for (size_t i = 0; i < kTraceStages; ++i) {
+      auto const stage = static_cast<TraceStage>(i);
+      if (!record.HasStage(stage)) continue;
+      events.push_back(boost::json::object{
+          {"name", TraceStageToString(stage)},
+          {"cat", "stage"},
+          {"ph", "X"},
+          {"pid", 1},
+          {"tid", record.thread_index},
+          {"ts",
+           ToMicroseconds(record.start_ns + record.stages[i].begin_ns)},
+          {"dur", ToMicroseconds(record.stages[i].duration_ns)},
+      });
+    }
+  }
+  return boost::json::serialize(boost::json::object{
+      {"traceEvents", std::move(events)},
+      {"displayTimeUnit", "ms"},
+  });
+}
+
+}  // namespace cppfs::storage
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace cppfs::storage {
+
+/// Request processing stages measured by the tracer
+enum class TraceStage : uint8_t {
+  kTlsHandshake,
+  kRouting,
+  /// waiting for the fair scheduler
+  kQueue,
+  kLookupPartition,
+  kOpen,
+  kIo,
+  kSerialize,
+  kCount,
+};
+
+std::string_view TraceStageToString(TraceStage stage);
+
+inline constexpr size_t kTraceStages = static_cast<size_t>(TraceStage::kCount);
+
+/// Time spent in a single stage, relative to the request start
+struct TraceSpan {
+  int64_t begin_ns;
+  int64_t duration_ns;
+};
+
+/// Timings of a single sampled request
+struct TraceRecord {
+  static constexpr size_t kMaxPathLength = 55;
+
+  uint64_t id;
+  /// steady clock timestamp of the request start
+  int64_t start_ns;
+  int64_t duration_ns;
+  int32_t status;
+  uint32_t thread_index;
+  std::array<TraceSpan, kTraceStages> stages;
+  uint8_t path_length;
+  std::array<char, kMaxPathLength> path;
+
+  std::string_view GetPath() const { return {path.data(), path_length}; }
+
+  bool HasStage(TraceStage stage) const {
+    return stages[static_cast<size_t>(stage)].duration_ns > 0;
+  }
+};
+
+static_assert(std::is_trivially_copyable_v<TraceRecord>);
+static_assert(sizeof(TraceRecord) % sizeof(uint64_t) == 0);
+
+///
+/// Fixed-size ring of trace records written by a single thread.
+///
+/// Each slot is guarded by a sequence lock, so the owning thread never waits
+/// for readers and readers simply skip slots that are being overwritten.
+///
+class TraceRing {
+ public:
+  static constexpr size_t kCapacity = 512;
+
+  explicit TraceRing(uint32_t thread_index) : thread_index_(thread_index) {}
+
+  uint32_t GetThreadIndex() const { return thread_index_; }
+
+  /// append @c record, only called by the owning thread
+  void Push(TraceRecord const& record);
+
+  /// copy consistent records currently stored in the ring
+  void Collect(std::vector<TraceRecord>& out) const;
+
+ private:
+  static constexpr size_t kWords = sizeof(TraceRecord) / sizeof(uint64_t);
+
+  struct Slot {
+    /// odd while the slot is being written
+    std::atomic<uint64_t> sequence{0};
+    std::array<std::atomic<uint64_t>, kWords> words{};
+  };
+
+  uint32_t const thread_index_;
+  std::atomic<uint64_t> head_{0};
+  std::array<Slot, kCapacity> slots_{};
+};
+
+///
+/// Process-wide request tracer.
+///
+/// Every N-th request on a thread is sampled. Sampled requests collect per
+/// stage timings in a thread-local record which is published to the thread's
+/// ring buffer when the request completes. Requests that are not sampled only
+/// pay for a thread-local counter increment.
+///
+class Tracer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  Tracer();
+
+  /// sample every @c rate-th request, 0 disables tracing
+  void SetSampleRate(uint32_t rate) {
+    sample_rate_.store(rate, std::memory_order_relaxed);
+  }
+
+  uint32_t GetSampleRate() const {
+    return sample_rate_.load(std::memory_order_relaxed);
+  }
+
+  /// start tracing request to @c path on the current thread
+  void Begin(std::string_view path);
+  /// finish the current request and publish it if it was sampled
+  void End(int status);
+
+  /// remember TLS handshake timings of the connection served by this thread,
+  /// they are attached to the next request on the connection
+  static void RecordHandshake(Clock::time_point begin, Clock::time_point end);
+
+  /// true if the request served by this thread is being traced
+  static bool IsActive();
+
+  static void AddStage(TraceStage stage, Clock::time_point begin,
+                       Clock::time_point end);
+
+  /// all published records with duration of at least @c min_duration,
+  /// slowest first
+  std::vector<TraceRecord> CollectSlow(std::chrono::nanoseconds min_duration,
+                                       size_t limit) const;
+
+ private:
+  TraceRing& ThisThreadRing();
+
+  /// distinguishes rings of different tracers in thread-local state
+  uint64_t const id_;
+  std::atomic<uint32_t> sample_rate_{0};
+  std::atomic<uint64_t> next_id_{0};
+  std::vector<std::unique_ptr<TraceRing>> rings_;
+  mutable std::mutex mutex_;
+};
+
+/// tracer of the running server
+Tracer& GlobalTracer();
+
+/// Measures a stage of the traced request for the lifetime of the object
+class ScopedTraceStage {
+ public:
+  explicit ScopedTraceStage(TraceStage stage)
+      : stage_(stage), active_(Tracer::IsActive()) {
+    if (active_) begin_ = Tracer::Clock::now();
+  }
+
+  ~ScopedTraceStage() {
+    if (active_) Tracer::AddStage(stage_, begin_, Tracer::Clock::now());
+  }
+
+  ScopedTraceStage(ScopedTraceStage const&) = delete;
+  ScopedTraceStage& operator=(ScopedTraceStage const&) = delete;
+
+ private:
+  TraceStage const stage_;
+  bool const active_;
+  Tracer::Clock::time_point begin_;
+};
+
+/// render @c records as JSON
+std::string TracesToJson(std::vector<TraceRecord> const& records);
+/// render @c records in the Chrome trace-event format (chrome://tracing,
+/// Perfetto)
+std::string TracesToChromeJson(std::vector<TraceRecord> const& records);
+
+}  // namespace cppfs::storage
@@ -0,0 +1,210 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "partition/checksum.hpp"
+#include "partition/on_disk_partition.hpp"
+#include "partition/scrubber.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+
+constexpr auto kValidUUID = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+constexpr PartitionId kValidId = *PartitionId::Parse(kValidUUID);
+
+std::filesystem::path TempRoot() {
+  return std::filesystem::temp_directory_path() / "cppfs-test-checksum";
+}
+
+/// data of @c size bytes that differs between blocks
+std::string MakeData(size_t size) {
+  std::string data(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<char>('a' + (i * 7 + i / 1000) % 26);
+  }
+  return data;
+}
+
+/// overwrite a byte of @c path behind the back of the partition
+void Corrupt(std::filesystem::path const& path, size_t offset) {
+  std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(static_cast<std::streamoff>(offset));
+  file.put('#');
+}
+
+class OnDiskChecksumTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::filesystem::remove_all(TempRoot());
+    manager_ = std::make_unique<OnDiskPartitionManager>(TempRoot());
+    partition_ = *manager_->CreatePartition(kValidId);
+  }
+
+  void TearDown() override {
+    manager_.reset();
+    std::filesystem::remove_all(TempRoot());
+  }
+
+  RegularFile* Store(std::string const& name, std::string data) {
+    return *(*partition_->OpenDir("/"))
+                ->StoreRegularFile(name, std::move(data));
+  }
+
+  std::filesystem::path DataPath(std::string const& name) const {
+    return TempRoot() / kValidUUID / name;
+  }
+
+  std::unique_ptr<OnDiskPartitionManager> manager_;
+  Partition* partition_{nullptr};
+};
+}  // namespace
+
+TEST(Crc32cTest, KnownValues) {
+  ASSERT_EQ(Crc32c(""), 0u);
+  ASSERT_EQ(Crc32c("123456789"), 0xE3069283u);
+  ASSERT_EQ(Crc32cPortable("123456789"), 0xE3069283u);
+  /* continuing a crc is the crc of the concatenation */
+  ASSERT_EQ(Crc32c("56789", Crc32c("1234")), 0xE3069283u);
+  ASSERT_EQ(Crc32cPortable("56789", Crc32cPortable("1234")), 0xE3069283u);
+}
+
+TEST(Crc32cTest, PortableMatchesHardware) {
+  std::string const data = MakeData(3 * kChecksumBlockSize + 13);
+  for (size_t size : {0u, 1u, 7u, 8u, 9u, 63u, 4096u, 12301u}) {
+    std::string_view const prefix{data.data(), size};
+    ASSERT_EQ(Crc32c(prefix), Crc32cPortable(prefix)) << size;
+  }
+}
+
+TEST(BlockChecksumsTest, VerifiesBlocks) {
+  std::filesystem::remove_all(TempRoot());
+  std::filesystem::path const sidecar = TempRoot() / "sidecar";
+  BlockChecksums const checksums{sidecar};
+  std::string data = MakeData(2 * kChecksumBlockSize + 100);
+
+  ASSERT_EQ(checksums.Verify(0, data), BlockChecksums::Verification::kMissing);
+  checksums.Rewrite(data);
+  ASSERT_EQ(std::filesystem::file_size(sidecar), 3 * sizeof(uint32_t));
+  ASSERT_EQ(checksums.Verify(0, data), BlockChecksums::Verification::kOk);
+  ASSERT_EQ(checksums.Verify(kChecksumBlockSize,
+                             std::string_view{data}.substr(kChecksumBlockSize)),
+            BlockChecksums::Verification::kOk);
+
+  data[kChecksumBlockSize + 1] ^= 1;
+  ASSERT_EQ(checksums.Verify(0, data), BlockChecksums::Verification::kMismatch);
+  /* the corrupted block isn't covered */
+  ASSERT_EQ(checksums.Verify(2 * kChecksumBlockSize,
+                             std::string_view{data}.substr(
+                                 2 * kChecksumBlockSize)),
+            BlockChecksums::Verification::kOk);
+  std::filesystem::remove_all(TempRoot());
+}
+
+TEST_F(OnDiskChecksumTest, VerifiesReads) {
+  std::string const data = MakeData(3 * kChecksumBlockSize);
+  RegularFile* file = Store("file", data);
+
+  ChecksumCounters const& counters = GetChecksumCounters();
+  uint64_t const verified = counters.blocks_verified.Value();
+  std::ostringstream out;
+  ASSERT_EQ(file->PositionalRead(out, kChecksumBlockSize - 10, 20), 20);
+  ASSERT_EQ(out.str(), data.substr(kChecksumBlockSize - 10, 20));
+  ASSERT_EQ(counters.blocks_verified.Value(), verified + 2);
+
+  uint64_t const mismatches = counters.read_mismatches.Value();
+  Corrupt(DataPath("file"), 2 * kChecksumBlockSize + 5);
+  out.str("");
+  ASSERT_EQ(file->PositionalRead(out, 2 * kChecksumBlockSize, 10), -1);
+  ASSERT_EQ(counters.read_mismatches.Value(), mismatches + 1);
+  /* other blocks are still readable */
+  ASSERT_EQ(file->PositionalRead(out, 0, kChecksumBlockSize),
+            static_cast<ssize_t>(kChecksumBlockSize));
+}
+
+TEST_F(OnDiskChecksumTest, FollowsWrites) {
+  std::string data = MakeData(kChecksumBlockSize + 100);
+  RegularFile* file = Store("file", data);
+
+  ASSERT_TRUE(file->PositionalWrite(50, "overwritten").has_value());
+  data.replace(50, 11, "overwritten");
+  ASSERT_TRUE(file->Append(MakeData(5000)).has_value());
+  data += MakeData(5000);
+  /* a gap past the end is filled with zeros */
+  ASSERT_TRUE(file->PositionalWrite(data.size() + 10, "tail").has_value());
+  data += std::string(10, '\0') + "tail";
+
+  std::ostringstream out;
+  ASSERT_EQ(file->PositionalRead(out, 0, data.size() + 1),
+            static_cast<ssize_t>(data.size()));
+  ASSERT_EQ(out.str(), data);
+
+  ASSERT_TRUE(file->Truncate(kChecksumBlockSize + 1).has_value());
+  ASSERT_TRUE(file->Append("more").has_value());
+  data = data.substr(0, kChecksumBlockSize + 1) + "more";
+  out.str("");
+  ASSERT_EQ(file->PositionalRead(out, 0, data.size()),
+            static_cast<ssize_t>(data.size()));
+  ASSERT_EQ(out.str(), data);
+}
+
+TEST_F(OnDiskChecksumTest, ReadsFilesWithoutChecksums) {
+  /* files written before checksums were introduced */
+  std::ofstream{DataPath("legacy")} << "legacy data";
+  auto file = partition_->OpenRegularFile("/legacy");
+  ASSERT_TRUE(file.has_value());
+  std::ostringstream out;
+  ASSERT_EQ((*file)->PositionalRead(out, 0, 100), 11);
+  ASSERT_EQ(out.str(), "legacy data");
+  ASSERT_TRUE((*file)->Append(" and more").has_value());
+}
+
+TEST_F(OnDiskChecksumTest, ScrubberFindsCorruption) {
+  (*(*partition_->OpenDir("/"))->CreateDirectory("dir"))
+      ->StoreRegularFile("nested", MakeData(100000));
+  Store("file", MakeData(10));
+
+  Scrubber& scrubber = manager_->GetScrubber();
+  Scrubber::PassStats stats = scrubber.ScrubPass();
+  ASSERT_TRUE(stats.complete);
+  ASSERT_EQ(stats.files, 2);
+  ASSERT_EQ(stats.bytes, 100010);
+  ASSERT_EQ(stats.corrupted_files, 0);
+
+  uint64_t const mismatches = GetChecksumCounters().scrub_mismatches.Value();
+  Corrupt(DataPath("dir/nested"), 99999);
+  stats = scrubber.ScrubPass();
+  ASSERT_EQ(stats.files, 2);
+  ASSERT_EQ(stats.corrupted_files, 1);
+  ASSERT_EQ(GetChecksumCounters().scrub_mismatches.Value(), mismatches + 1);
+}
+
+TEST(ScrubberTest, StopsWhileThrottled) {
+  std::filesystem::remove_all(TempRoot());
+  std::string const data = MakeData(300000);
+  std::filesystem::create_directories(TempRoot() / "partition");
+  std::ofstream{TempRoot() / "partition" / "file"} << data;
+  BlockChecksums{TempRoot() / ".checksums" / "partition" / "file"}.Rewrite(
+      data);
+
+  /* the pass would take seconds at this rate */
+  Counter const& scrubbed = GetChecksumCounters().scrubbed_bytes;
+  uint64_t const scrubbed_before = scrubbed.Value();
+  auto const start = std::chrono::steady_clock::now();
+  {
+    Scrubber scrubber{{TempRoot()}, TempRoot() / ".checksums",
+                      {.bytes_per_s = 65536}};
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+  ASSERT_GT(scrubbed.Value(), scrubbed_before);
+  ASSERT_LT(scrubbed.Value(), scrubbed_before + data.size());
+  std::filesystem::remove_all(TempRoot());
+}
+
+}  // namespace tests::storage
@@ -0,0 +1,267 @@
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+#include "partition/dedup.hpp"
+#include "partition/in_memory_partition.hpp"
+#include "partition/on_disk_partition.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+
+constexpr auto kFirstUUID = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+constexpr auto kSecondUUID = "5b0f2a4e-8f67-4c4b-9a43-3c3c1a6f1d7e";
+constexpr PartitionId kFirstId = *PartitionId::Parse(kFirstUUID);
+constexpr PartitionId kSecondId = *PartitionId::Parse(kSecondUUID);
+
+std::filesystem::path TempRoot() {
+  return std::filesystem::temp_directory_path() / "cppfs-test-dedup";
+}
+
+/// incompressible data, chunk boundaries depend on the content
+std::string RandomData(size_t size, uint32_t seed) {
+  std::mt19937 generator{seed};
+  std::string data(size, '\0');
+  for (char& c : data) c = static_cast<char>(generator());
+  return data;
+}
+
+std::string ReadAll(RegularFile* file) {
+  std::ostringstream out;
+  file->PositionalRead(out, 0, file->GetSize());
+  return out.str();
+}
+
+uint64_t LinkCount(std::filesystem::path const& path) {
+  struct stat st{};
+  return ::stat(path.c_str(), &st) == 0 ? st.st_nlink : 0;
+}
+}  // namespace
+
+TEST(ChunkingTest, ContentDefinedBoundaries) {
+  std::string const data = RandomData(1 << 20, 1);
+  auto const chunks = SplitChunks(data);
+  size_t total = 0;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (i + 1 < chunks.size()) {
+      ASSERT_GE(chunks[i].size(), kMinChunkSize);
+    }
+    ASSERT_LE(chunks[i].size(), kMaxChunkSize);
+    total += chunks[i].size();
+  }
+  ASSERT_EQ(total, data.size());
+  /* about 10 KiB on average */
+  ASSERT_GT(chunks.size(), 50);
+  ASSERT_LT(chunks.size(), 200);
+
+  /* an insertion only changes the chunks around it */
+  std::string shifted = data;
+  shifted.insert(100000, "inserted");
+  auto const shifted_chunks = SplitChunks(shifted);
+  ASSERT_EQ(shifted_chunks.back(), chunks.back());
+  ASSERT_EQ(shifted_chunks.front(), chunks.front());
+  ASSERT_TRUE(SplitChunks("").empty());
+}
+
+TEST(ChunkStoreTest, SharesChunks) {
+  ChunkStore store;
+  std::string const data = RandomData(100000, 2);
+  {
+    auto const first = store.Store(data);
+    DedupStats stats = store.GetStats();
+    ASSERT_EQ(stats.stored_bytes, data.size());
+    ASSERT_EQ(stats.logical_bytes, data.size());
+
+    auto const second = store.Store(data);
+    stats = store.GetStats();
+    ASSERT_EQ(stats.chunks, first.size());
+    ASSERT_EQ(stats.stored_bytes, data.size());
+    ASSERT_EQ(stats.logical_bytes, 2 * data.size());
+    for (size_t i = 0; i < first.size(); ++i) {
+      ASSERT_EQ(first[i].get(), second[i].get());
+    }
+  }
+  /* freed with the last reference */
+  DedupStats const stats = store.GetStats();
+  ASSERT_EQ(stats.chunks, 0);
+  ASSERT_EQ(stats.stored_bytes, 0);
+  ASSERT_EQ(stats.logical_bytes, 0);
+}
+
+TEST(InMemoryDedupTest, FilesShareChunksAcrossPartitions) {
+  InMemoryPartitionManager manager{{}, {}, {.enabled = true}};
+  std::string const data = RandomData(200000, 3);
+  Directory* first = (*manager.CreatePartition(kFirstId))->OpenRoot();
+  Directory* second = (*manager.CreatePartition(kSecondId))->OpenRoot();
+  RegularFile* a = *first->StoreRegularFile("a", std::string{data});
+  RegularFile* b = *second->StoreRegularFile("b", std::string{data});
+
+  DedupStats stats = manager.GetDedupStats();
+  ASSERT_EQ(stats.stored_bytes, data.size());
+  ASSERT_EQ(stats.logical_bytes, 2 * data.size());
+  ASSERT_EQ(ReadAll(a), data);
+  ASSERT_EQ(ReadAll(b), data);
+  std::ostringstream out;
+  ASSERT_EQ(b->PositionalRead(out, 150000, 20000), 0);
+  ASSERT_EQ(out.str(), data.substr(150000, 20000));
+
+  /* modifications don't leak into the files sharing the chunks */
+  std::string modified = data;
+  ASSERT_TRUE(a->PositionalWrite(100000, "modified").has_value());
+  modified.replace(100000, 8, "modified");
+  ASSERT_TRUE(a->Append("appended").has_value());
+  modified += "appended";
+  ASSERT_EQ(ReadAll(a), modified);
+  ASSERT_EQ(ReadAll(b), data);
+  /* only the chunks around the modification are new */
+  stats = manager.GetDedupStats();
+  ASSERT_LT(stats.stored_bytes, data.size() + 3 * kMaxChunkSize);
+
+  ASSERT_TRUE(a->Truncate(10).has_value());
+  ASSERT_EQ(ReadAll(a), data.substr(0, 10));
+  ASSERT_TRUE(a->Truncate(20).has_value());
+  ASSERT_EQ(ReadAll(a), data.substr(0, 10) + std::string(10, '\0'));
+
+  manager.Clear();
+  manager.GetReclaimer().WaitIdle();
+  ASSERT_EQ(manager.GetDedupStats().stored_bytes, 0);
+}
+
+TEST(InMemoryDedupTest, AppendsKeepChunksLarge) {
+  InMemoryPartitionManager manager{{}, {}, {.enabled = true}};
+  Directory* root = (*manager.CreatePartition(kFirstId))->OpenRoot();
+  RegularFile* file = *root->StoreRegularFile("log", "");
+  std::string const data = RandomData(100000, 4);
+  for (size_t offset = 0; offset < data.size(); offset += 100) {
+    ASSERT_TRUE(file->Append(data.substr(offset, 100)).has_value());
+  }
+  ASSERT_EQ(ReadAll(file), data);
+  ASSERT_EQ(manager.GetDedupStats().chunks, SplitChunks(data).size());
+}
+
+TEST(InMemoryDedupTest, WritesRechunkUntilBoundariesLineUp) {
+  InMemoryPartitionManager manager{{}, {}, {.enabled = true}};
+  Directory* root = (*manager.CreatePartition(kFirstId))->OpenRoot();
+  std::string data = RandomData(1 << 20, 6);
+  RegularFile* file = *root->StoreRegularFile("file", std::string{data});
+
+  /* the chunks are those of the whole modified data, however the writes
+     moved the boundaries */
+  std::vector<std::pair<size_t, std::string>> const writes{
+      {500000, "modified"},
+      {0, RandomData(100000, 7)},
+      {700000, RandomData(200000, 8)},
+      {(1 << 20) - 4, "past the end"},
+  };
+  for (auto const& [offset, payload] : writes) {
+    ASSERT_TRUE(file->PositionalWrite(offset, payload).has_value());
+    if (data.size() < offset + payload.size()) {
+      data.resize(offset + payload.size());
+    }
+    data.replace(offset, payload.size(), payload);
+    ASSERT_EQ(ReadAll(file), data);
+    DedupStats const stats = manager.GetDedupStats();
+    ASSERT_EQ(stats.chunks, SplitChunks(data).size());
+    ASSERT_EQ(stats.stored_bytes, data.size());
+  }
+}
+
+class OnDiskDedupTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::filesystem::remove_all(TempRoot());
+    manager_ = std::make_unique<OnDiskPartitionManager>(
+        TempRoot(), UsageLimits{}, ReclaimerConfig{}, ScrubberConfig{},
+        DedupConfig{.enabled = true});
+  }
+
+  void TearDown() override {
+    manager_.reset();
+    std::filesystem::remove_all(TempRoot());
+  }
+
+  std::unique_ptr<OnDiskPartitionManager> manager_;
+};
+
+TEST_F(OnDiskDedupTest, LinksIdenticalFiles) {
+  std::string const data = RandomData(10000, 5);
+  Directory* first = (*manager_->CreatePartition(kFirstId))->OpenRoot();
+  Directory* second = (*manager_->CreatePartition(kSecondId))->OpenRoot();
+  RegularFile* a = *first->StoreRegularFile("a", std::string{data});
+  RegularFile* b = *second->StoreRegularFile("b", std::string{data});
+  ASSERT_TRUE(first->StoreRegularFile("other", "other").has_value());
+
+  std::filesystem::path const a_path = TempRoot() / kFirstUUID / "a";
+  /* the blob and both files */
+  ASSERT_EQ(LinkCount(a_path), 3);
+  DedupStats stats = manager_->GetDedupStats();
+  ASSERT_EQ(stats.chunks, 2);
+  ASSERT_EQ(stats.stored_bytes, data.size() + 5);
+  ASSERT_EQ(stats.logical_bytes, 2 * data.size() + 5);
+  ASSERT_EQ(ReadAll(b), data);
+
+  /* copy on write */
+  ASSERT_TRUE(a->PositionalWrite(0, "modified").has_value());
+  ASSERT_EQ(LinkCount(a_path), 1);
+  ASSERT_EQ(ReadAll(b), data);
+  ASSERT_EQ(ReadAll(a), "modified" + data.substr(8));
+
+  /* the blob goes away with the last file linking it */
+  ASSERT_TRUE(b->Append("appended").has_value());
+  stats = manager_->GetDedupStats();
+  ASSERT_EQ(stats.chunks, 1);
+  ASSERT_EQ(stats.stored_bytes, 5);
+}
+
+TEST_F(OnDiskDedupTest, CollectsBlobsOfDestroyedPartitions) {
+  std::string const data = RandomData(10000, 6);
+  Directory* root = (*manager_->CreatePartition(kFirstId))->OpenRoot();
+  ASSERT_TRUE(root->StoreRegularFile("a", std::string{data}).has_value());
+  ASSERT_TRUE(root->StoreRegularFile("b", std::string{data}).has_value());
+  ASSERT_EQ(manager_->GetDedupStats().logical_bytes, 2 * data.size());
+
+  manager_->DestroyPartition(kFirstId);
+  manager_->GetReclaimer().WaitIdle();
+  DedupStats const stats = manager_->GetDedupStats();
+  ASSERT_EQ(stats.chunks, 0);
+  ASSERT_EQ(stats.logical_bytes, 0);
+  ASSERT_TRUE(std::filesystem::is_empty(
+      TempRoot() / OnDiskPartitionManager::kBlobDirName));
+}
+
+TEST_F(OnDiskDedupTest, LinksFilesAfterClear) {
+  std::string const data = RandomData(10000, 8);
+  Directory* root = (*manager_->CreatePartition(kFirstId))->OpenRoot();
+  ASSERT_TRUE(root->StoreRegularFile("a", std::string{data}).has_value());
+  manager_->Clear();
+  manager_->GetReclaimer().WaitIdle();
+  ASSERT_EQ(manager_->GetDedupStats().chunks, 0);
+
+  /* the blob store is still in place */
+  root = (*manager_->CreatePartition(kSecondId))->OpenRoot();
+  RegularFile* a = *root->StoreRegularFile("a", std::string{data});
+  ASSERT_TRUE(root->StoreRegularFile("b", std::string{data}).has_value());
+  ASSERT_EQ(LinkCount(TempRoot() / kSecondUUID / "a"), 3);
+  ASSERT_EQ(manager_->GetDedupStats().stored_bytes, data.size());
+  ASSERT_EQ(ReadAll(a), data);
+}
+
+TEST_F(OnDiskDedupTest, OverwritesLinkedFiles) {
+  std::string const data = RandomData(10000, 7);
+  Directory* root = (*manager_->CreatePartition(kFirstId))->OpenRoot();
+  RegularFile* a = *root->StoreRegularFile("a", std::string{data});
+  ASSERT_TRUE(root->StoreRegularFile("b", std::string{data}).has_value());
+  ASSERT_TRUE(root->StoreRegularFile("a", "replaced").has_value());
+  ASSERT_EQ(ReadAll(a), "replaced");
+  RegularFile* b = *manager_->LookupPartition(kFirstId)->OpenRegularFile("/b");
+  ASSERT_EQ(ReadAll(b), data);
+}
+
+}  // namespace tests::storage
@@ -0,0 +1,77 @@
+#include <chrono>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "partition/in_memory_partition.hpp"
+#include "server/file_handles.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+using namespace std::chrono_literals;
+
+constexpr auto kClient = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+constexpr auto kOtherClient = "5b0f2a4e-8f67-4c4b-9a43-3c3c1a6f1d7e";
+}  // namespace
+
+TEST(FileHandleTableTest, OpenReadClose) {
+  InMemoryPartition partition;
+  RegularFile* file =
+      *partition.OpenRoot()->StoreRegularFile("file", "0123456789");
+  FileHandleTable table;
+
+  auto first = table.Open(kClient, &partition, file, "/file");
+  auto second = table.Open(kClient, &partition, file, "/file");
+  ASSERT_TRUE(first.has_value());
+  ASSERT_TRUE(second.has_value());
+  ASSERT_NE(*first, *second);
+  ASSERT_EQ(table.GetSize(), 2);
+
+  /* every handle has a cursor of its own */
+  auto handle = table.Acquire(*first);
+  ASSERT_TRUE(handle.has_value());
+  ASSERT_EQ(handle.value()->file, file);
+  handle.value()->offset = 4;
+  ASSERT_EQ(table.Acquire(*second).value()->offset, 0);
+
+  ASSERT_TRUE(table.Close(*first));
+  ASSERT_FALSE(table.Close(*first));
+  ASSERT_EQ(table.Acquire(*first).error().code, ErrorEnum::kNotFound);
+  /* a closed handle still in use stays valid for its reader */
+  ASSERT_EQ(handle.value()->offset, 4);
+  ASSERT_EQ(table.GetSize(), 1);
+}
+
+TEST(FileHandleTableTest, LimitsHandlesPerClient) {
+  InMemoryPartition partition;
+  RegularFile* file = *partition.OpenRoot()->StoreRegularFile("file", "data");
+  FileHandleTable table{{.max_per_client = 2}};
+
+  auto first = table.Open(kClient, &partition, file, "/file");
+  ASSERT_TRUE(table.Open(kClient, &partition, file, "/file").has_value());
+  auto rejected = table.Open(kClient, &partition, file, "/file");
+  ASSERT_FALSE(rejected.has_value());
+  ASSERT_EQ(rejected.error().code, ErrorEnum::kRateLimited);
+  /* other clients have limits of their own */
+  ASSERT_TRUE(table.Open(kOtherClient, &partition, file, "/file").has_value());
+
+  ASSERT_TRUE(table.Close(*first));
+  ASSERT_TRUE(table.Open(kClient, &partition, file, "/file").has_value());
+}
+
+TEST(FileHandleTableTest, ExpiresIdleHandles) {
+  InMemoryPartition partition;
+  RegularFile* file = *partition.OpenRoot()->StoreRegularFile("file", "data");
+  FileHandleTable table{{.idle_timeout = 10s, .max_per_client = 1}};
+
+  auto id = table.Open(kClient, &partition, file, "/file");
+  ASSERT_EQ(table.Expire(std::chrono::steady_clock::now() + 5s), 0);
+  ASSERT_TRUE(table.Acquire(*id).has_value());
+  ASSERT_EQ(table.Expire(std::chrono::steady_clock::now() + 11s), 1);
+  ASSERT_FALSE(table.Acquire(*id).has_value());
+  /* the expired handle doesn't count against the limit */
+  ASSERT_TRUE(table.Open(kClient, &partition, file, "/file").has_value());
+}
+
+}  // namespace tests::storage
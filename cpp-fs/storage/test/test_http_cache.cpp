@@ -0,0 +1,55 @@
+#include <chrono>
+#include <gtest/gtest.h>
+
+#include "partition/partition.hpp"
+#include "server/http_cache.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+using namespace std::chrono_literals;
+
+/// Sun, 06 Nov 1994 08:49:37 GMT
+constexpr std::chrono::sys_seconds kDate{784111777s};
+}  // namespace
+
+TEST(HttpCacheTest, HttpDate) {
+  ASSERT_EQ(FormatHttpDate(kDate), "Sun, 06 Nov 1994 08:49:37 GMT");
+  ASSERT_EQ(ParseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT"), kDate);
+  /* sub-second precision is dropped */
+  ASSERT_EQ(FormatHttpDate(kDate + 999ms), "Sun, 06 Nov 1994 08:49:37 GMT");
+
+  ASSERT_FALSE(ParseHttpDate("").has_value());
+  ASSERT_FALSE(ParseHttpDate("yesterday").has_value());
+  ASSERT_FALSE(ParseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT+1").has_value());
+}
+
+TEST(HttpCacheTest, IfNoneMatch) {
+  FileVersion const version{.tag = 0xabc, .modified = kDate};
+  std::string const etag = FormatETag(version);
+  ASSERT_EQ(etag, "\"abc\"");
+
+  ASSERT_TRUE(IsNotModified(etag, "", version));
+  ASSERT_TRUE(IsNotModified("\"1\", W/\"abc\"", "", version));
+  ASSERT_TRUE(IsNotModified("*", "", version));
+  ASSERT_FALSE(IsNotModified("\"abd\"", "", version));
+  ASSERT_FALSE(IsNotModified("", "", version));
+
+  /* If-None-Match takes precedence over If-Modified-Since */
+  ASSERT_FALSE(IsNotModified("\"abd\"", FormatHttpDate(kDate), version));
+
+  /* unknown versions never match */
+  ASSERT_FALSE(IsNotModified("*", "", FileVersion{}));
+}
+
+TEST(HttpCacheTest, IfModifiedSince) {
+  FileVersion const version{.tag = 1, .modified = kDate + 500ms};
+  ASSERT_TRUE(IsNotModified("", FormatHttpDate(kDate), version));
+  ASSERT_TRUE(IsNotModified("", FormatHttpDate(kDate + 1h), version));
+  ASSERT_FALSE(IsNotModified("", FormatHttpDate(kDate - 1s), version));
+  /* malformed dates are ignored */
+  ASSERT_FALSE(IsNotModified("", "not a date", version));
+}
+
+}  // namespace tests::storage
@@ -0,0 +1,177 @@
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+#include "partition/manifest.hpp"
+#include "partition/on_disk_partition.hpp"
+#include "storage.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+
+constexpr auto kValidUUID = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+constexpr auto kOtherUUID = "6a1f3c4e-2b7d-4e8a-9c0f-1d2e3f4a5b6c";
+constexpr PartitionId kValidId = *PartitionId::Parse(kValidUUID);
+constexpr PartitionId kOtherId = *PartitionId::Parse(kOtherUUID);
+
+class ManifestTest : public testing::Test {
+ protected:
+  void SetUp() final {
+    root_ = std::filesystem::temp_directory_path() /
+            ("cppfs-manifest-" +
+             std::string{testing::UnitTest::GetInstance()
+                             ->current_test_info()
+                             ->name()});
+    std::filesystem::remove_all(root_);
+    std::filesystem::create_directories(root_);
+  }
+
+  void TearDown() final { std::filesystem::remove_all(root_); }
+
+  std::filesystem::path ManifestPath() const { return root_ / "MANIFEST"; }
+
+  std::filesystem::path root_;
+};
+}  // namespace
+
+TEST_F(ManifestTest, PutGetErase) {
+  Manifest manifest{ManifestPath()};
+  ASSERT_TRUE(manifest.Put(Manifest::Table::kPartitions, kValidUUID));
+  ASSERT_TRUE(manifest.Put(Manifest::Table::kClients, "client", kValidUUID));
+
+  ASSERT_TRUE(manifest.Contains(Manifest::Table::kPartitions, kValidUUID));
+  ASSERT_FALSE(manifest.Contains(Manifest::Table::kClients, kValidUUID));
+  ASSERT_EQ(manifest.Get(Manifest::Table::kClients, "client"), kValidUUID);
+
+  ASSERT_TRUE(manifest.Erase(Manifest::Table::kPartitions, kValidUUID));
+  ASSERT_FALSE(manifest.Contains(Manifest::Table::kPartitions, kValidUUID));
+}
+
+TEST_F(ManifestTest, ReloadFromLog) {
+  {
+    Manifest manifest{ManifestPath()};
+    ASSERT_TRUE(manifest.Put(Manifest::Table::kPartitions, kValidUUID));
+    ASSERT_TRUE(manifest.Put(Manifest::Table::kPartitions, kOtherUUID));
+    ASSERT_TRUE(manifest.Erase(Manifest::Table::kPartitions, kOtherUUID));
+    ASSERT_TRUE(manifest.Put(Manifest::Table::kClients, "client", kValidUUID));
+  }
+
+  Manifest manifest{ManifestPath()};
+  ASSERT_EQ(manifest.Size(Manifest::Table::kPartitions), 1);
+  ASSERT_TRUE(manifest.Contains(Manifest::Table::kPartitions, kValidUUID));
+  ASSERT_EQ(manifest.Get(Manifest::Table::kClients, "client"), kValidUUID);
+}
+
+TEST_F(ManifestTest, TornTailIsDropped) {
+  {
+    Manifest manifest{ManifestPath()};
+    ASSERT_TRUE(manifest.Put(Manifest::Table::kPartitions, kValidUUID));
+  }
+  auto const valid_size = std::filesystem::file_size(ManifestPath());
+  {
+    std::ofstream file(ManifestPath(), std::ios::binary | std::ios::app);
+    file << "garbage";
+  }
+
+  {
+    Manifest manifest{ManifestPath()};
+    ASSERT_EQ(std::filesystem::file_size(ManifestPath()), valid_size);
+    ASSERT_TRUE(manifest.Put(Manifest::Table::kPartitions, kOtherUUID));
+  }
+
+  Manifest manifest{ManifestPath()};
+  ASSERT_TRUE(manifest.Contains(Manifest::Table::kPartitions, kValidUUID));
+  ASSERT_TRUE(manifest.Contains(Manifest::Table::kPartitions, kOtherUUID));
+}
+
+TEST_F(ManifestTest, Compaction) {
+  Manifest manifest{ManifestPath()};
+  for (int i = 0; i < 2048; ++i) {
+    ASSERT_TRUE(manifest.Put(Manifest::Table::kClients, "client",
+                             std::to_string(i)));
+  }
+  ASSERT_LT(manifest.GetRecordCount(), 1024);
+  ASSERT_EQ(manifest.Get(Manifest::Table::kClients, "client"), "2047");
+}
+
+TEST_F(ManifestTest, Clear) {
+  {
+    Manifest manifest{ManifestPath()};
+    ASSERT_TRUE(manifest.Put(Manifest::Table::kPartitions, kValidUUID));
+    ASSERT_TRUE(manifest.Put(Manifest::Table::kClients, "client", kValidUUID));
+    ASSERT_TRUE(manifest.Clear());
+    ASSERT_EQ(manifest.Size(Manifest::Table::kPartitions), 0);
+    ASSERT_EQ(manifest.Size(Manifest::Table::kClients), 0);
+    ASSERT_TRUE(manifest.Put(Manifest::Table::kPartitions, kOtherUUID));
+  }
+
+  Manifest manifest{ManifestPath()};
+  ASSERT_EQ(manifest.GetRecordCount(), 1);
+  ASSERT_TRUE(manifest.Contains(Manifest::Table::kPartitions, kOtherUUID));
+  ASSERT_FALSE(manifest.Get(Manifest::Table::kClients, "client"));
+}
+
+TEST_F(ManifestTest, OnDiskManagerRestart) {
+  {
+    Storage<OnDiskPartitionManager> storage{
+        std::make_unique<OnDiskPartitionManager>(root_)};
+    ASSERT_TRUE(storage.CreatePartition(kValidUUID));
+    auto client = storage.GetOrCreateClientPartition("client");
+    ASSERT_TRUE(client.has_value() && client->created);
+    auto again = storage.GetOrCreateClientPartition("client");
+    ASSERT_TRUE(again.has_value() && !again->created);
+    ASSERT_EQ(again->uuid, client->uuid);
+  }
+
+  OnDiskPartitionManager manager{root_};
+  ASSERT_TRUE(manager.ContainsPartition(kValidId));
+  auto client_uuid = manager.LookupClient("client");
+  ASSERT_TRUE(client_uuid.has_value());
+  ASSERT_TRUE(manager.ContainsPartition(*client_uuid));
+  ASSERT_NE(manager.LookupPartition(*client_uuid), nullptr);
+}
+
+TEST_F(ManifestTest, OnDiskManagerImportsLegacyPartitions) {
+  std::filesystem::create_directories(root_ / kValidUUID);
+
+  OnDiskPartitionManager manager{root_};
+  ASSERT_TRUE(manager.ContainsPartition(kValidId));
+  ASSERT_FALSE(manager.ContainsPartition(kOtherId));
+}
+
+TEST_F(ManifestTest, OnDiskManagerClearWhileLookingUp) {
+  OnDiskPartitionManager manager{root_};
+  std::filesystem::path const feed_path = root_ / "changes.log";
+  std::ofstream{feed_path} << "feed";
+
+  std::atomic<bool> stop{false};
+  std::thread reader{[&] {
+    while (!stop) {
+      static_cast<void>(manager.ContainsPartition(kValidId));
+      static_cast<void>(manager.LookupClient("client"));
+      static_cast<void>(manager.GetPartitionCount());
+      static_cast<void>(manager.BindClient("other", kOtherId));
+    }
+  }};
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(manager.CreatePartition(kValidId));
+    ASSERT_TRUE(manager.BindClient("client", kValidId));
+    manager.Clear();
+  }
+  stop = true;
+  reader.join();
+  manager.GetReclaimer().WaitIdle();
+
+  ASSERT_FALSE(manager.ContainsPartition(kValidId));
+  ASSERT_FALSE(manager.LookupClient("client"));
+  ASSERT_TRUE(std::filesystem::exists(feed_path));
+  ASSERT_TRUE(manager.CreatePartition(kValidId));
+  ASSERT_NE(manager.LookupPartition(kValidId), nullptr);
+}
+
+}  // namespace tests::storage
@@ -0,0 +1,97 @@
+#include <chrono>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics/metrics.hpp"
+#include "metrics/system_stats.hpp"
+
+namespace tests::storage {
+
+using namespace cppfs::storage;
+using namespace std::chrono_literals;
+
+TEST(MetricsTest, CounterSumsShards) {
+  Counter counter;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&counter] {
+      for (int j = 0; j < 1000; ++j) counter.Inc();
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  ASSERT_EQ(counter.Value(), 4000);
+}
+
+TEST(MetricsTest, RateMeterWindow) {
+  RateMeter meter;
+  std::chrono::steady_clock::time_point const start{1000s};
+  for (int i = 0; i < 50; ++i) meter.Mark(start);
+  for (int i = 0; i < 30; ++i) meter.Mark(start + 1s);
+  /* the current second isn't complete yet */
+  ASSERT_DOUBLE_EQ(meter.GetRate(start), 0.0);
+  ASSERT_DOUBLE_EQ(meter.GetRate(start + 1s), 5.0);
+  ASSERT_DOUBLE_EQ(meter.GetRate(start + 2s), 8.0);
+  ASSERT_DOUBLE_EQ(meter.GetRate(start + 11s), 3.0);
+  ASSERT_DOUBLE_EQ(meter.GetRate(start + 12s), 0.0);
+
+  /* a bucket is reused for the same slot of a later lap */
+  meter.Mark(start + 11s);
+  ASSERT_DOUBLE_EQ(meter.GetRate(start + 12s), 0.1);
+}
+
+TEST(MetricsTest, SystemStats) {
+  SystemStats const stats =
+      ReadSystemStats(std::filesystem::temp_directory_path());
+  ASSERT_GT(stats.disk_total_bytes, 0);
+  ASSERT_LE(stats.disk_available_bytes, stats.disk_total_bytes);
+  ASSERT_GT(stats.memory_total_bytes, 0);
+  ASSERT_LE(stats.memory_available_bytes, stats.memory_total_bytes);
+  ASSERT_GT(stats.process_rss_bytes, 0);
+}
+
+TEST(MetricsTest, HistogramBucketBounds) {
+  for (uint64_t value : {0UL, 1UL, 7UL, 8UL, 15UL, 16UL, 1000UL, 123456789UL}) {
+    size_t const index = LatencyHistogram::BucketIndex(value);
+    ASSERT_LT(value, LatencyHistogram::BucketUpperBound(index));
+    if (index > 0) {
+      ASSERT_GE(value, LatencyHistogram::BucketUpperBound(index - 1));
+    }
+  }
+  ASSERT_EQ(LatencyHistogram::BucketIndex(uint64_t{1} << 50),
+            LatencyHistogram::kBuckets - 1);
+}
+
+TEST(MetricsTest, HistogramQuantiles) {
+  LatencyHistogram histogram;
+  for (int i = 0; i < 99; ++i) histogram.Record(1ms);
+  histogram.Record(1s);
+
+  auto const snapshot = histogram.GetSnapshot();
+  ASSERT_EQ(snapshot.count, 100);
+  ASSERT_GE(snapshot.Quantile(0.5), 1ms);
+  ASSERT_LT(snapshot.Quantile(0.5), 1125us);
+  ASSERT_GE(snapshot.Quantile(0.999), 1s);
+}
+
+TEST(MetricsTest, RenderPrometheus) {
+  MetricsRegistry registry;
+  registry.RegisterRoute("/partition/:id", "in_memory");
+  registry.MatchRoute("/partition/a2c59f5c").Record(2ms, 200);
+  registry.MatchRoute("/unknown").Record(1ms, 404);
+  registry.RecordError(ErrorEnum::kNotFound);
+
+  std::string const text = registry.RenderPrometheus();
+  ASSERT_NE(text.find("cppfs_http_request_duration_seconds_count{route=\""
+                      "/partition/:id\",backend=\"in_memory\"} 1"),
+            std::string::npos);
+  ASSERT_NE(text.find("cppfs_http_responses_total{route=\"unmatched\","
+                      "backend=\"\",code=\"4xx\"} 1"),
+            std::string::npos);
+  ASSERT_NE(text.find("cppfs_errors_total{code=\"NotFound\"} 1"),
+            std::string::npos);
+}
+
+}  // namespace tests::storage
@@ -0,0 +1,142 @@
+#include <filesystem>
+#include <format>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "partition/in_memory_partition.hpp"
+#include "partition/name_index.hpp"
+#include "partition/on_disk_partition.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+
+constexpr auto kUUID = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+constexpr PartitionId kId = *PartitionId::Parse(kUUID);
+
+std::filesystem::path TempRoot() {
+  return std::filesystem::temp_directory_path() / "cppfs-test-name-index";
+}
+
+std::vector<std::string> Paths(NameIndex::Page const& page) {
+  std::vector<std::string> paths;
+  for (NameIndex::Entry const& entry : page.entries) {
+    paths.push_back(entry.path);
+  }
+  return paths;
+}
+
+/// dir/, dir/notes.txt, dir/sub/, dir/sub/notes.md, readme.txt
+void FillPartition(Partition* partition) {
+  Directory* root = partition->OpenRoot();
+  Directory* dir = *root->CreateDirectory("dir");
+  Directory* sub = *dir->CreateDirectory("sub");
+  ASSERT_TRUE(dir->StoreRegularFile("notes.txt", "a").has_value());
+  ASSERT_TRUE(sub->StoreRegularFile("notes.md", "b").has_value());
+  ASSERT_TRUE(root->StoreRegularFile("readme.txt", "c").has_value());
+}
+
+void ExpectFilled(NameIndex const& index) {
+  ASSERT_EQ(index.GetSize(), 5);
+  NameIndex::Page const notes = index.Find({.prefix = "notes"});
+  ASSERT_EQ(Paths(notes),
+            (std::vector<std::string>{"/dir/sub/notes.md", "/dir/notes.txt"}));
+  ASSERT_EQ(notes.entries[0].type, FileType::Regular);
+  NameIndex::Page const dirs = index.Find({.glob = "[ds]*"});
+  ASSERT_EQ(Paths(dirs), (std::vector<std::string>{"/dir", "/dir/sub"}));
+  ASSERT_EQ(dirs.entries[1].type, FileType::Directory);
+  ASSERT_EQ(Paths(index.Find({.glob = "*.txt"})),
+            (std::vector<std::string>{"/dir/notes.txt", "/readme.txt"}));
+}
+}  // namespace
+
+TEST(GlobMatchTest, Patterns) {
+  ASSERT_TRUE(GlobMatch("*", ""));
+  ASSERT_TRUE(GlobMatch("*.txt", "notes.txt"));
+  ASSERT_FALSE(GlobMatch("*.txt", "notes.txt.bak"));
+  ASSERT_TRUE(GlobMatch("a*b*c", "aXbYbZc"));
+  ASSERT_FALSE(GlobMatch("a*b*c", "aXbYbZ"));
+  ASSERT_TRUE(GlobMatch("file?.log", "file1.log"));
+  ASSERT_FALSE(GlobMatch("file?.log", "file.log"));
+  ASSERT_TRUE(GlobMatch("[a-c]x", "bx"));
+  ASSERT_FALSE(GlobMatch("[a-c]x", "dx"));
+  ASSERT_TRUE(GlobMatch("[!a-c]x", "dx"));
+  ASSERT_TRUE(GlobMatch("[]]", "]"));
+  ASSERT_TRUE(GlobMatch("\\*", "*"));
+  ASSERT_FALSE(GlobMatch("\\*", "a"));
+  /* an unterminated set is literal */
+  ASSERT_TRUE(GlobMatch("[ab", "[ab"));
+}
+
+TEST(NameIndexTest, PaginatesInNameOrder) {
+  NameIndex index;
+  for (int i = 0; i < 25; ++i) {
+    index.Add(std::format("/dir{}/file{:02}", i % 3, i), FileType::Regular);
+  }
+  index.Add("/other", FileType::Regular);
+  /* adding again is a no-op */
+  index.Add("/dir0/file00", FileType::Regular);
+  ASSERT_EQ(index.GetSize(), 26);
+
+  std::vector<std::string> found;
+  NameIndex::Query query{.prefix = "file", .limit = 10};
+  size_t pages = 0;
+  while (true) {
+    NameIndex::Page const page = index.Find(query);
+    ++pages;
+    for (NameIndex::Entry const& entry : page.entries) {
+      found.push_back(entry.path);
+    }
+    if (page.next.empty()) break;
+    query.after = page.next;
+  }
+  ASSERT_EQ(pages, 3);
+  ASSERT_EQ(found.size(), 25);
+  for (size_t i = 0; i < found.size(); ++i) {
+    ASSERT_EQ(found[i], std::format("/dir{}/file{:02}", i % 3, i));
+  }
+
+  /* a glob is paginated over its matches only */
+  NameIndex::Page page = index.Find({.glob = "file1?", .limit = 5});
+  ASSERT_EQ(page.entries.size(), 5);
+  ASSERT_EQ(page.next, "/dir2/file14");
+  page = index.Find({.glob = "file1?", .after = page.next, .limit = 5});
+  ASSERT_EQ(page.entries.size(), 5);
+  ASSERT_TRUE(page.next.empty());
+  ASSERT_TRUE(index.Find({.prefix = "missing"}).entries.empty());
+}
+
+TEST(NameIndexTest, InMemoryPartition) {
+  InMemoryPartitionManager manager;
+  Partition* partition = *manager.CreatePartition(kId);
+  FillPartition(partition);
+  ExpectFilled(partition->GetNameIndex());
+}
+
+TEST(NameIndexTest, OnDiskPartitionIsIndexedOnLoad) {
+  std::filesystem::remove_all(TempRoot());
+  {
+    OnDiskPartitionManager manager{TempRoot()};
+    Partition* partition = *manager.CreatePartition(kId);
+    FillPartition(partition);
+    ExpectFilled(partition->GetNameIndex());
+    /* directories opened by path add to the index with their full path */
+    Directory* sub = *partition->OpenDir("/dir/sub");
+    ASSERT_TRUE(sub->StoreRegularFile("late.txt", "d").has_value());
+    ASSERT_EQ(Paths(partition->GetNameIndex().Find({.prefix = "late"})),
+              (std::vector<std::string>{"/dir/sub/late.txt"}));
+  }
+  {
+    OnDiskPartitionManager manager{TempRoot()};
+    NameIndex const& index = manager.LookupPartition(kId)->GetNameIndex();
+    ASSERT_EQ(index.GetSize(), 6);
+    ASSERT_EQ(Paths(index.Find({.glob = "*.txt"})),
+              (std::vector<std::string>{"/dir/sub/late.txt", "/dir/notes.txt",
+                                        "/readme.txt"}));
+  }
+  std::filesystem::remove_all(TempRoot());
+}
+
+}  // namespace tests::storage
@@ -1,8 +1,13 @@
+#include <format>
 #include <gtest/gtest.h>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include "error_types.h"
+#include "partition/backend.hpp"
 #include "partition/in_memory_partition.hpp"
+#include "partition/on_disk_partition.hpp"
 #include "partition/partition.hpp"
 #include "storage.hpp"
 
@@ -43,6 +48,12 @@ constexpr bool operator==(Directory::DirEntry const& lhs,
   };
   return create_tuple(lhs) == create_tuple(rhs);
 }
+
+std::string ReadAll(RegularFile* file) {
+  std::stringstream ss;
+  EXPECT_GE(file->PositionalRead(ss, 0, file->GetSize()), 0);
+  return ss.str();
+}
 }  // namespace
 
 using PartitionManagers = testing::Types<InMemoryPartitionManager>;
@@ -107,4 +118,189 @@ TYPED_TEST(PartitionTest, CreateDirectory) {
   ASSERT_TRUE(file_expected.has_value());
 }
 
+template <typename T>
+class RegularFileWriteTest : public PartitionTest<T> {};
+
+using WritablePartitionManagers =
+    testing::Types<InMemoryPartitionManager, OnDiskPartitionManager>;
+
+TYPED_TEST_SUITE(RegularFileWriteTest, WritablePartitionManagers);
+
+TYPED_TEST(RegularFileWriteTest, WriteAppendTruncate) {
+  Directory* root = this->partition_->OpenRoot();
+  auto file_expected = root->StoreRegularFile("log", "0123456789");
+  ASSERT_TRUE(file_expected.has_value());
+  RegularFile* file = file_expected.value();
+  UsageTracker const& usage = this->partition_->GetUsage();
+  ASSERT_EQ(usage.GetUsage().bytes, 10);
+
+  ASSERT_TRUE(file->PositionalWrite(2, "ab").has_value());
+  ASSERT_EQ(ReadAll(file), "01ab456789");
+  ASSERT_EQ(usage.GetUsage().bytes, 10);
+
+  /* a write past the end extends the file */
+  ASSERT_TRUE(file->PositionalWrite(8, "xyz").has_value());
+  ASSERT_EQ(ReadAll(file), "01ab4567xyz");
+  ASSERT_EQ(usage.GetUsage().bytes, 11);
+
+  auto offset = file->Append("++");
+  ASSERT_TRUE(offset.has_value());
+  ASSERT_EQ(*offset, 11);
+  ASSERT_EQ(ReadAll(file), "01ab4567xyz++");
+
+  ASSERT_EQ(GetDataSize(*file), 13);
+  ASSERT_TRUE(file->Truncate(4).has_value());
+  ASSERT_EQ(ReadAll(file), "01ab");
+  ASSERT_EQ(GetDataSize(*file), 4);
+  ASSERT_EQ(usage.GetUsage().bytes, 4);
+
+  /* gaps are filled with zeros */
+  ASSERT_TRUE(file->Truncate(6).has_value());
+  ASSERT_TRUE(file->PositionalWrite(8, "!").has_value());
+  ASSERT_EQ(ReadAll(file), std::string("01ab\0\0\0\0!", 9));
+  ASSERT_EQ(usage.GetUsage().bytes, 9);
+
+  /* a reopened file sees the changes */
+  auto reopened = this->partition_->OpenRegularFile("/log");
+  ASSERT_TRUE(reopened.has_value());
+  ASSERT_EQ(ReadAll(reopened.value()), ReadAll(file));
+}
+
+TYPED_TEST(RegularFileWriteTest, VersionsChangeWithData) {
+  Directory* root = this->partition_->OpenRoot();
+  FileVersion const empty_root = root->GetVersion();
+  ASSERT_NE(empty_root.tag, 0);
+
+  auto file_expected = root->StoreRegularFile("file", "0123456789");
+  ASSERT_TRUE(file_expected.has_value());
+  RegularFile* file = file_expected.value();
+  FileVersion const stored = file->GetVersion();
+  FileVersion const root_with_file = root->GetVersion();
+  ASSERT_NE(stored.tag, 0);
+  ASSERT_NE(root_with_file.tag, empty_root.tag);
+
+  /* reads and reopening don't change the versions */
+  ASSERT_EQ(ReadAll(file), "0123456789");
+  auto reopened = this->partition_->OpenRegularFile("/file");
+  ASSERT_TRUE(reopened.has_value());
+  ASSERT_EQ(reopened.value()->GetVersion().tag, stored.tag);
+  ASSERT_EQ(this->partition_->OpenRoot()->GetVersion().tag,
+            root_with_file.tag);
+
+  /* an overwrite of the same size changes the file, but not the listing */
+  ASSERT_TRUE(file->PositionalWrite(0, "ab").has_value());
+  FileVersion const written = file->GetVersion();
+  ASSERT_NE(written.tag, stored.tag);
+  ASSERT_GE(written.modified, stored.modified);
+
+  /* the listing shows the sizes of the files */
+  ASSERT_TRUE(file->Append("x").has_value());
+  ASSERT_NE(file->GetVersion().tag, written.tag);
+  ASSERT_NE(root->GetVersion().tag, root_with_file.tag);
+  FileVersion const root_appended = root->GetVersion();
+  ASSERT_TRUE(root->CreateDirectory("dir").has_value());
+  ASSERT_NE(root->GetVersion().tag, root_appended.tag);
+}
+
+TYPED_TEST(RegularFileWriteTest, GrowthRespectsQuota) {
+  UsageLimits const limits{.partition_quota = {.bytes = 8}};
+  std::unique_ptr<TypeParam> manager;
+  if constexpr (std::is_same_v<TypeParam, OnDiskPartitionManager>) {
+    manager = std::make_unique<TypeParam>("./quota-partitions", limits);
+  } else {
+    manager = std::make_unique<TypeParam>(limits);
+  }
+  Storage<TypeParam> storage{std::move(manager)};
+  auto partition = storage.CreatePartition(kValidUUID);
+  ASSERT_TRUE(partition.has_value());
+  auto file_expected =
+      partition.value()->OpenRoot()->StoreRegularFile("file", "0123456");
+  ASSERT_TRUE(file_expected.has_value());
+  RegularFile* file = file_expected.value();
+
+  ASSERT_FALSE(file->Append("ab").has_value());
+  ASSERT_FALSE(file->PositionalWrite(7, "ab").has_value());
+  ASSERT_FALSE(file->Truncate(9).has_value());
+  ASSERT_EQ(ReadAll(file), "0123456");
+
+  /* overwriting in place and filling the quota up are fine */
+  ASSERT_TRUE(file->PositionalWrite(0, "abc").has_value());
+  ASSERT_TRUE(file->Append("z").has_value());
+  ASSERT_EQ(ReadAll(file), "abc3456z");
+  ASSERT_EQ(partition.value()->GetUsage().GetUsage().bytes, 8);
+  storage.Clear();
+}
+
+TYPED_TEST(RegularFileWriteTest, OpensBackendTypes) {
+  Directory* root = this->partition_->OpenRoot();
+  ASSERT_TRUE(root->CreateDirectory("dir").has_value());
+  ASSERT_TRUE(root->StoreRegularFile("file", "0123456789").has_value());
+
+  auto partition = this->storage_->LookupPartition(kValidUUID);
+  ASSERT_TRUE(partition.has_value());
+  PartitionOf<TypeParam>& typed = *partition.value();
+  tl::expected<DirectoryOf<TypeParam>*, Error> dir =
+      OpenBackendDir<TypeParam>(typed, "/dir");
+  ASSERT_TRUE(dir.has_value());
+  ASSERT_TRUE(dir.value()->GetDirEntries().empty());
+  tl::expected<RegularFileOf<TypeParam>*, Error> file =
+      OpenBackendRegularFile<TypeParam>(typed, "/file");
+  ASSERT_TRUE(file.has_value());
+  ASSERT_EQ(ReadAll(file.value()), "0123456789");
+
+  /* same errors as through the interfaces */
+  ASSERT_EQ(OpenBackendDir<TypeParam>(typed, "/file").error().code,
+            ErrorEnum::kDirectory);
+  ASSERT_EQ(OpenBackendRegularFile<TypeParam>(typed, "/dir").error().code,
+            ErrorEnum::kDirectory);
+  ASSERT_EQ(OpenBackendRegularFile<TypeParam>(typed, "/missing").error().code,
+            this->partition_->OpenRegularFile("/missing").error().code);
+}
+
+TEST(InMemoryDirectoryTest, ManyEntries) {
+  InMemoryDirectory dir;
+  constexpr size_t kEntries = 5000;
+  for (size_t i = 0; i < kEntries; ++i) {
+    std::string const name = std::format("entry-{}", i);
+    if (i % 10 == 0) {
+      ASSERT_TRUE(dir.CreateDirectory(name).has_value());
+    } else {
+      ASSERT_TRUE(
+          dir.StoreRegularFile(name, std::string(i % 7, 'x')).has_value());
+    }
+  }
+  ASSERT_EQ(dir.StoreRegularFile("entry-42", "").error().code,
+            ErrorEnum::kAlreadyExists);
+  ASSERT_EQ(dir.CreateDirectory("entry-40").error().code,
+            ErrorEnum::kAlreadyExists);
+
+  /* listed in creation order */
+  std::vector<Directory::DirEntry> const entries = dir.GetDirEntries();
+  ASSERT_EQ(entries.size(), kEntries);
+  for (size_t i = 0; i < kEntries; ++i) {
+    ASSERT_EQ(entries[i].name, std::format("entry-{}", i));
+    if (i % 10 == 0) {
+      ASSERT_EQ(entries[i].type, FileType::Directory);
+    } else {
+      ASSERT_EQ(entries[i].type, FileType::Regular);
+      ASSERT_EQ(entries[i].size, i % 7 + 1);
+    }
+  }
+  ASSERT_EQ(dir.Lookup("entry-4999")->GetType(), FileType::Regular);
+  ASSERT_EQ(dir.Lookup("entry-4990")->GetType(), FileType::Directory);
+  ASSERT_EQ(dir.Lookup("entry-5000"), nullptr);
+  ASSERT_EQ(dir.Lookup(""), nullptr);
+}
+
+TEST(InMemoryDirectoryTest, OpenMissingIntermediateDirectory) {
+  InMemoryPartition partition;
+  Directory* root = partition.OpenRoot();
+  ASSERT_TRUE(root->StoreRegularFile("file", "data").has_value());
+  /* the lookup doesn't skip the missing component */
+  auto missing = partition.Open("/missing/file");
+  ASSERT_FALSE(missing.has_value());
+  ASSERT_EQ(missing.error().code, ErrorEnum::kNotFound);
+  ASSERT_TRUE(partition.Open("/file").has_value());
+}
+
 }  // namespace tests::storage
@@ -0,0 +1,156 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "partition/in_memory_partition.hpp"
+#include "partition/on_disk_partition.hpp"
+#include "partition/reclaimer.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+
+constexpr auto kValidUUID = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+constexpr PartitionId kValidId = *PartitionId::Parse(kValidUUID);
+
+std::filesystem::path TempRoot() {
+  return std::filesystem::temp_directory_path() / "cppfs-test-reclaimer";
+}
+
+/// @c dirs directories of @c files files of 10 bytes each
+void MakeTree(std::filesystem::path const& root, int dirs, int files) {
+  for (int dir = 0; dir < dirs; ++dir) {
+    std::filesystem::path const path = root / std::to_string(dir) / "nested";
+    std::filesystem::create_directories(path);
+    for (int file = 0; file < files; ++file) {
+      std::ofstream{path / std::to_string(file)} << "0123456789";
+    }
+  }
+}
+
+size_t CountEntries(std::filesystem::path const& path) {
+  size_t count = 0;
+  for ([[maybe_unused]] auto const& entry :
+       std::filesystem::directory_iterator(path)) {
+    ++count;
+  }
+  return count;
+}
+}  // namespace
+
+TEST(ReclaimerTest, RemovesTreeThrottled) {
+  std::filesystem::remove_all(TempRoot());
+  std::filesystem::path const tree = TempRoot() / "tree";
+  MakeTree(tree, 3, 10);
+
+  Reclaimer reclaimer{{.files_per_s = 100}};
+  auto const start = std::chrono::steady_clock::now();
+  reclaimer.RemoveTree(tree);
+  reclaimer.WaitIdle();
+  auto const elapsed = std::chrono::steady_clock::now() - start;
+
+  ASSERT_FALSE(std::filesystem::exists(tree));
+  /* all 30 files fit into the initial burst */
+  ASSERT_LT(elapsed, std::chrono::seconds(2));
+  Reclaimer::Stats const stats = reclaimer.GetStats();
+  ASSERT_EQ(stats.pending, 0);
+  ASSERT_EQ(stats.reclaimed, 1);
+  ASSERT_EQ(stats.files, 30);
+  ASSERT_EQ(stats.bytes, 300);
+  std::filesystem::remove_all(TempRoot());
+}
+
+TEST(ReclaimerTest, RateLimitsRemoval) {
+  std::filesystem::remove_all(TempRoot());
+  std::filesystem::path const tree = TempRoot() / "tree";
+  MakeTree(tree, 1, 30);
+
+  /* a burst of 10 files, the other 20 take at least a second */
+  Reclaimer reclaimer{{.files_per_s = 10}};
+  reclaimer.RemoveTree(tree);
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  ASSERT_TRUE(std::filesystem::exists(tree));
+  ASSERT_EQ(reclaimer.GetStats().pending, 1);
+  reclaimer.WaitIdle();
+  ASSERT_FALSE(std::filesystem::exists(tree));
+  ASSERT_EQ(reclaimer.GetStats().files, 30);
+  std::filesystem::remove_all(TempRoot());
+}
+
+TEST(ReclaimerTest, DestroysObjects) {
+  Reclaimer reclaimer;
+  auto object = std::make_shared<int>(42);
+  std::weak_ptr<int> const observer = object;
+  reclaimer.Destroy(std::move(object), {.bytes = 4, .files = 1});
+  reclaimer.WaitIdle();
+  ASSERT_TRUE(observer.expired());
+  Reclaimer::Stats const stats = reclaimer.GetStats();
+  ASSERT_EQ(stats.reclaimed, 1);
+  ASSERT_EQ(stats.files, 1);
+  ASSERT_EQ(stats.bytes, 4);
+}
+
+TEST(ReclaimerTest, InMemoryDestroyPartition) {
+  InMemoryPartitionManager manager;
+  auto partition = manager.CreatePartition(kValidId);
+  ASSERT_TRUE(partition.has_value());
+  ASSERT_TRUE(partition.value()
+                  ->OpenRoot()
+                  ->StoreRegularFile("file", "0123456789")
+                  .has_value());
+
+  manager.DestroyPartition(kValidId);
+  ASSERT_EQ(manager.LookupPartition(kValidId), nullptr);
+  manager.GetReclaimer().WaitIdle();
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().bytes, 0);
+  ASSERT_EQ(manager.GetReclaimer().GetStats().bytes, 10);
+}
+
+TEST(ReclaimerTest, OnDiskDestroyPartition) {
+  std::filesystem::remove_all(TempRoot());
+  OnDiskPartitionManager manager{TempRoot()};
+  auto partition = manager.CreatePartition(kValidId);
+  ASSERT_TRUE(partition.has_value());
+  Directory* root = partition.value()->OpenRoot();
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(
+        root->StoreRegularFile(std::to_string(i), "0123456789").has_value());
+  }
+
+  manager.DestroyPartition(kValidId);
+  /* unlinked from the tree at once, freed in the background */
+  ASSERT_FALSE(manager.ContainsPartition(kValidId));
+  ASSERT_FALSE(std::filesystem::exists(TempRoot() / kValidUUID));
+  ASSERT_TRUE(manager.CreatePartition(kValidId).has_value());
+
+  manager.GetReclaimer().WaitIdle();
+  ASSERT_EQ(CountEntries(TempRoot() / OnDiskPartitionManager::kTrashDirName),
+            0);
+  /* the files and their checksums */
+  ASSERT_EQ(manager.GetReclaimer().GetStats().files, 20);
+  ASSERT_EQ(manager.GetReclaimer().GetStats().bytes, 140);
+  manager.Clear();
+  manager.GetReclaimer().WaitIdle();
+  std::filesystem::remove_all(TempRoot());
+}
+
+TEST(ReclaimerTest, OnDiskReclaimsTrashOnRestart) {
+  std::filesystem::remove_all(TempRoot());
+  std::filesystem::path const trash =
+      TempRoot() / OnDiskPartitionManager::kTrashDirName;
+  /* left over by a node that stopped before reclaiming */
+  MakeTree(trash / "partition", 2, 5);
+
+  OnDiskPartitionManager manager{TempRoot()};
+  manager.GetReclaimer().WaitIdle();
+  ASSERT_EQ(CountEntries(trash), 0);
+  ASSERT_EQ(manager.GetReclaimer().GetStats().files, 10);
+  std::filesystem::remove_all(TempRoot());
+}
+
+}  // namespace tests::storage
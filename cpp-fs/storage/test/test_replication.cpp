@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <boost/crc.hpp>
+
+#include "partition/in_memory_partition.hpp"
+#include "partition/on_disk_partition.hpp"
+#include "replication/change_feed.hpp"
+#include "replication/partition_archive.hpp"
+#include "replication/replicator.hpp"
+#include "storage.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+using namespace std::chrono_literals;
+
+constexpr auto kValidUUID = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+
+std::filesystem::path TempLog() {
+  return std::filesystem::temp_directory_path() / "cppfs-test-changes.log";
+}
+
+std::vector<Change> DecodeAll(std::string const& data) {
+  ChangeDecoder decoder;
+  decoder.Feed(data);
+  std::vector<Change> changes;
+  while (true) {
+    auto change = decoder.Next();
+    EXPECT_TRUE(change.has_value());
+    if (!change.has_value() || !change->has_value()) break;
+    changes.push_back(std::move(**change));
+  }
+  return changes;
+}
+
+std::vector<Change> ExampleChanges() {
+  return {
+      Change{.op = ChangeOp::kCreatePartition, .partition = kValidUUID},
+      Change{.op = ChangeOp::kBindClient,
+             .partition = kValidUUID,
+             .name = "client"},
+      Change{.op = ChangeOp::kCreateDirectory,
+             .partition = kValidUUID,
+             .path = "/",
+             .name = "dir"},
+      Change{.op = ChangeOp::kStoreRegularFile,
+             .partition = kValidUUID,
+             .path = "/dir",
+             .name = "file",
+             .data = "0123456789"},
+  };
+}
+
+std::string ExportAll(Partition* partition, size_t chunk_bytes) {
+  PartitionExporter exporter{partition, kValidUUID};
+  std::string archive;
+  while (true) {
+    auto chunk = exporter.Next(chunk_bytes);
+    EXPECT_TRUE(chunk.has_value());
+    if (!chunk.has_value() || chunk->empty()) break;
+    archive += *chunk;
+  }
+  return archive;
+}
+
+/// archive changes without their order, which depends on the backend
+std::set<std::tuple<ChangeOp, std::string, std::string, std::string>>
+ArchiveContents(std::string const& archive) {
+  std::set<std::tuple<ChangeOp, std::string, std::string, std::string>>
+      contents;
+  for (Change const& change : DecodeAll(archive)) {
+    contents.emplace(change.op, change.path, change.name, change.data);
+  }
+  return contents;
+}
+
+template <typename Manager>
+std::unique_ptr<Manager> MakeManager(std::string const& name) {
+  if constexpr (std::is_same_v<Manager, OnDiskPartitionManager>) {
+    std::filesystem::path root =
+        std::filesystem::temp_directory_path() / ("cppfs-test-" + name);
+    std::filesystem::remove_all(root);
+    return std::make_unique<Manager>(std::move(root));
+  } else {
+    return std::make_unique<Manager>();
+  }
+}
+}  // namespace
+
+TEST(ChangeDecoderTest, IncrementalDecoding) {
+  Change const change{.sequence = 42,
+                      .op = ChangeOp::kStoreRegularFile,
+                      .partition = kValidUUID,
+                      .path = "/a/b",
+                      .name = "file",
+                      .data = std::string(1000, 'x')};
+  auto encoded = EncodeChange(change);
+  ASSERT_TRUE(encoded.has_value());
+
+  /* records may be split at any byte by the transport */
+  ChangeDecoder decoder;
+  for (size_t i = 0; i + 1 < encoded->size(); ++i) {
+    decoder.Feed(std::string_view{*encoded}.substr(i, 1));
+    auto next = decoder.Next();
+    ASSERT_TRUE(next.has_value());
+    ASSERT_FALSE(next->has_value());
+  }
+  decoder.Feed(std::string_view{*encoded}.substr(encoded->size() - 1));
+  auto next = decoder.Next();
+  ASSERT_TRUE(next.has_value() && next->has_value());
+  Change const& decoded = **next;
+  ASSERT_EQ(decoded.sequence, 42);
+  ASSERT_EQ(decoded.op, ChangeOp::kStoreRegularFile);
+  ASSERT_EQ(decoded.partition, change.partition);
+  ASSERT_EQ(decoded.path, change.path);
+  ASSERT_EQ(decoded.name, change.name);
+  ASSERT_EQ(decoded.data, change.data);
+  ASSERT_EQ(decoder.GetPending(), 0);
+}
+
+TEST(ChangeDecoderTest, Corruption) {
+  auto encoded = EncodeChange(ExampleChanges().back());
+  ASSERT_TRUE(encoded.has_value());
+  encoded->back() ^= 1;
+  ChangeDecoder decoder;
+  decoder.Feed(*encoded);
+  ASSERT_FALSE(decoder.Next().has_value());
+}
+
+TEST(ChangeFeedTest, AppendReadReopen) {
+  std::filesystem::remove(TempLog());
+  {
+    ChangeFeed feed{TempLog()};
+    ASSERT_EQ(feed.GetLastSequence(), 0);
+    for (Change const& change : ExampleChanges()) {
+      ASSERT_TRUE(feed.Append(change).has_value());
+    }
+    ASSERT_EQ(feed.GetLastSequence(), 4);
+
+    auto all = feed.Read(0, 1 << 20);
+    ASSERT_TRUE(all.has_value());
+    ASSERT_EQ(all->changes, 4);
+    ASSERT_EQ(all->last_sequence, 4);
+    std::vector<Change> const changes = DecodeAll(all->data);
+    ASSERT_EQ(changes.size(), 4);
+    for (size_t i = 0; i < changes.size(); ++i) {
+      ASSERT_EQ(changes[i].sequence, i + 1);
+    }
+
+    /* a batch contains at least one change */
+    auto first = feed.Read(0, 1);
+    ASSERT_TRUE(first.has_value());
+    ASSERT_EQ(first->changes, 1);
+    auto rest = feed.Read(2, 1 << 20);
+    ASSERT_TRUE(rest.has_value());
+    ASSERT_EQ(rest->changes, 2);
+    ASSERT_EQ(DecodeAll(rest->data).front().sequence, 3);
+    auto none = feed.Read(4, 1 << 20);
+    ASSERT_TRUE(none.has_value());
+    ASSERT_EQ(none->changes, 0);
+  }
+
+  /* a torn record at the end is dropped on reopen */
+  {
+    std::ofstream log(TempLog(), std::ios::binary | std::ios::app);
+    log << "torn";
+  }
+  ChangeFeed feed{TempLog()};
+  ASSERT_EQ(feed.GetLastSequence(), 4);
+  auto appended = feed.Append(ExampleChanges().front());
+  ASSERT_TRUE(appended.has_value());
+  ASSERT_EQ(*appended, 5);
+  auto last = feed.Read(4, 1 << 20);
+  ASSERT_TRUE(last.has_value());
+  ASSERT_EQ(DecodeAll(last->data).size(), 1);
+  std::filesystem::remove(TempLog());
+}
+
+TEST(ChangeFeedTest, MigratesVersion1Log) {
+  /* version 1 records had no offset and the log had no header */
+  std::filesystem::remove(TempLog());
+  {
+    std::ofstream log(TempLog(), std::ios::binary);
+    uint64_t sequence = 0;
+    for (Change change : ExampleChanges()) {
+      change.sequence = ++sequence;
+      std::string record = EncodeChange(change).value();
+      record.erase(24, sizeof(uint64_t));
+      boost::crc_32_type crc;
+      crc.process_bytes(record.data() + 4, record.size() - 4);
+      uint32_t const checksum = crc.checksum();
+      std::memcpy(record.data(), &checksum, sizeof(checksum));
+      log << record;
+    }
+    log << "torn";
+  }
+
+  for (int reopen = 0; reopen < 2; ++reopen) {
+    ChangeFeed feed{TempLog()};
+    ASSERT_EQ(feed.GetLastSequence(), 4);
+    auto all = feed.Read(0, 1 << 20);
+    ASSERT_TRUE(all.has_value());
+    std::vector<Change> const changes = DecodeAll(all->data);
+    ASSERT_EQ(changes.size(), 4);
+    ASSERT_EQ(changes.back().data, ExampleChanges().back().data);
+    ASSERT_EQ(changes.back().sequence, 4);
+  }
+  ChangeFeed feed{TempLog()};
+  ASSERT_EQ(feed.Append(ExampleChanges().front()).value(), 5);
+  std::filesystem::remove(TempLog());
+}
+
+TEST(ChangeFeedTest, RejectsUnknownVersion) {
+  std::filesystem::remove(TempLog());
+  {
+    ChangeFeed feed{TempLog()};
+    ASSERT_TRUE(feed.Append(ExampleChanges().front()).has_value());
+  }
+  {
+    /* the version follows the magic */
+    std::fstream log(TempLog(),
+                     std::ios::binary | std::ios::in | std::ios::out);
+    log.seekp(8);
+    uint32_t const version = 99;
+    log.write(reinterpret_cast<char const*>(&version), sizeof(version));
+  }
+  auto const size = std::filesystem::file_size(TempLog());
+  ASSERT_THROW(ChangeFeed{TempLog()}, std::runtime_error);
+  ASSERT_EQ(std::filesystem::file_size(TempLog()), size);
+  std::filesystem::remove(TempLog());
+}
+
+TEST(ChangeFeedTest, WaitForChanges) {
+  std::filesystem::remove(TempLog());
+  ChangeFeed feed{TempLog()};
+  ASSERT_FALSE(feed.WaitForChanges(0, 1ms));
+
+  std::thread writer{[&feed] {
+    std::this_thread::sleep_for(10ms);
+    static_cast<void>(feed.Append(ExampleChanges().front()));
+  }};
+  ASSERT_TRUE(feed.WaitForChanges(0, 10s));
+  writer.join();
+  std::filesystem::remove(TempLog());
+}
+
+TEST(ReplicationTest, ApplyChanges) {
+  Storage<InMemoryPartitionManager> replica{
+      std::make_unique<InMemoryPartitionManager>()};
+  for (int round = 0; round < 2; ++round) {
+    /* replaying changes is harmless */
+    for (Change const& change : ExampleChanges()) {
+      ASSERT_TRUE(ApplyChange(replica, change).has_value());
+    }
+  }
+
+  ASSERT_EQ(replica.GetManager().LookupClient("client"),
+            PartitionId::Parse(kValidUUID));
+  auto partition = replica.LookupPartition(kValidUUID);
+  ASSERT_TRUE(partition.has_value());
+  auto file = partition.value()->OpenRegularFile("/dir/file");
+  ASSERT_TRUE(file.has_value());
+  std::stringstream ss;
+  ASSERT_EQ(file.value()->Read(ss, 10), 0);
+  ASSERT_EQ(ss.str(), "0123456789");
+
+  /* changes of unknown partitions fail */
+  Change orphan = ExampleChanges().back();
+  orphan.partition = "0b7c2f1e-3f5a-4d2b-9c1e-6a8d4e2f1b3c";
+  ASSERT_FALSE(ApplyChange(replica, orphan).has_value());
+}
+
+TEST(ReplicationTest, ApplyFileWrites) {
+  Storage<InMemoryPartitionManager> replica{
+      std::make_unique<InMemoryPartitionManager>()};
+  std::vector<Change> changes = ExampleChanges();
+  changes.push_back(Change{.op = ChangeOp::kWriteRegularFile,
+                           .partition = kValidUUID,
+                           .path = "/dir",
+                           .name = "file",
+                           .data = "abc",
+                           .offset = 8});
+  changes.push_back(Change{.op = ChangeOp::kTruncateRegularFile,
+                           .partition = kValidUUID,
+                           .path = "/dir",
+                           .name = "file",
+                           .offset = 9});
+  for (Change const& change : changes) {
+    /* the offset survives encoding */
+    auto encoded = EncodeChange(change);
+    ASSERT_TRUE(encoded.has_value());
+    std::vector<Change> const decoded = DecodeAll(*encoded);
+    ASSERT_EQ(decoded.size(), 1);
+    ASSERT_EQ(decoded.front().offset, change.offset);
+  }
+
+  for (int round = 0; round < 2; ++round) {
+    for (Change const& change : changes) {
+      ASSERT_TRUE(ApplyChange(replica, change).has_value());
+    }
+  }
+  auto file = replica.LookupPartition(kValidUUID).value()->OpenRegularFile(
+      "/dir/file");
+  ASSERT_TRUE(file.has_value());
+  std::stringstream ss;
+  ASSERT_EQ(file.value()->PositionalRead(ss, 0, 9), 0);
+  ASSERT_EQ(ss.str(), "01234567a");
+}
+
+template <typename Managers>
+class PartitionArchiveTest : public ::testing::Test {};
+
+using ManagerPairs = ::testing::Types<
+    std::pair<InMemoryPartitionManager, OnDiskPartitionManager>,
+    std::pair<OnDiskPartitionManager, InMemoryPartitionManager>>;
+TYPED_TEST_SUITE(PartitionArchiveTest, ManagerPairs);
+
+TYPED_TEST(PartitionArchiveTest, RoundTrip) {
+  using Source = typename TypeParam::first_type;
+  using Target = typename TypeParam::second_type;
+  Storage<Source> source{MakeManager<Source>("archive-source")};
+  Storage<Target> target{MakeManager<Target>("archive-target")};
+
+  ASSERT_TRUE(source.CreatePartition(kValidUUID).has_value());
+  Partition* partition = source.LookupPartition(kValidUUID).value();
+  Directory* root = partition->OpenRoot();
+  ASSERT_TRUE(root->StoreRegularFile("top", "top level").has_value());
+  auto a = root->CreateDirectory("a");
+  ASSERT_TRUE(a.has_value());
+  ASSERT_TRUE(a.value()->CreateDirectory("empty").has_value());
+  auto b = a.value()->CreateDirectory("b");
+  ASSERT_TRUE(b.has_value());
+  ASSERT_TRUE(b.value()
+                  ->StoreRegularFile("large", std::string(100000, 'x'))
+                  .has_value());
+
+  /* tiny chunks still make progress, one change at a time */
+  std::string const archive = ExportAll(partition, 1);
+  ASSERT_EQ(archive, ExportAll(partition, 1 << 20));
+  std::vector<Change> const changes = DecodeAll(archive);
+  ASSERT_EQ(changes.size(), 6);
+  ASSERT_EQ(changes.front().op, ChangeOp::kCreatePartition);
+
+  /* importing twice is harmless */
+  for (int round = 0; round < 2; ++round) {
+    for (Change const& change : changes) {
+      ASSERT_TRUE(ApplyChange(target, change).has_value());
+    }
+  }
+  Partition* imported = target.LookupPartition(kValidUUID).value();
+  ASSERT_EQ(ArchiveContents(ExportAll(imported, 1 << 20)),
+            ArchiveContents(archive));
+  ASSERT_EQ(imported->GetUsage().GetUsage().files, 2);
+  ASSERT_EQ(imported->GetUsage().GetUsage().bytes, 100009);
+}
+
+TEST(PartitionArchiveTest, CatchUpChanges) {
+  constexpr auto kOtherUUID = "0b7c2f1e-3f5a-4d2b-9c1e-6a8d4e2f1b3c";
+  std::string batch;
+  uint64_t sequence = 0;
+  for (Change change : ExampleChanges()) {
+    for (auto uuid : {kValidUUID, kOtherUUID}) {
+      change.sequence = ++sequence;
+      change.partition = uuid;
+      batch += EncodeChange(change).value();
+    }
+  }
+
+  auto filtered = FilterPartitionChanges(batch, kValidUUID, 5);
+  ASSERT_TRUE(filtered.has_value());
+  std::vector<Change> const changes = DecodeAll(*filtered);
+  ASSERT_EQ(changes.size(), 3);
+  for (size_t i = 0; i < changes.size(); ++i) {
+    ASSERT_EQ(changes[i].partition, kValidUUID);
+    ASSERT_EQ(changes[i].sequence, 2 * i + 1);
+  }
+
+  batch.back() ^= 1;
+  ASSERT_FALSE(FilterPartitionChanges(batch, kValidUUID, 100).has_value());
+}
+
+TEST(PartitionArchiveTest, MixedCaseIds) {
+  std::string upper = kValidUUID;
+  std::ranges::transform(upper, upper.begin(), [](char c) {
+    return static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  });
+  Storage<InMemoryPartitionManager> source{
+      std::make_unique<InMemoryPartitionManager>()};
+  ASSERT_TRUE(source.CreatePartition(upper).has_value());
+  Partition* partition = source.LookupPartition(kValidUUID).value();
+  ASSERT_TRUE(
+      partition->OpenRoot()->StoreRegularFile("file", "data").has_value());
+
+  /* writes recorded under either case are caught up */
+  std::filesystem::remove(TempLog());
+  ChangeFeed feed{TempLog()};
+  std::vector<Change> writes = ExampleChanges();
+  for (size_t i = 0; i < writes.size(); ++i) {
+    if (i % 2 == 0) writes[i].partition = upper;
+    ASSERT_TRUE(feed.Append(writes[i]).has_value());
+  }
+  auto batch = feed.Read(0, 1 << 20);
+  ASSERT_TRUE(batch.has_value());
+  auto filtered = FilterPartitionChanges(batch->data, upper, 100);
+  ASSERT_TRUE(filtered.has_value());
+  std::vector<Change> const caught_up = DecodeAll(*filtered);
+  ASSERT_EQ(caught_up.size(), writes.size());
+  for (Change const& change : caught_up) {
+    ASSERT_EQ(change.partition, kValidUUID);
+  }
+  std::filesystem::remove(TempLog());
+
+  /* the export names the partition in canonical form */
+  PartitionExporter exporter{partition, upper};
+  auto archive = exporter.Next(1 << 20);
+  ASSERT_TRUE(archive.has_value());
+  std::vector<Change> const exported = DecodeAll(*archive);
+  ASSERT_EQ(exported.size(), 2);
+  Storage<InMemoryPartitionManager> target{
+      std::make_unique<InMemoryPartitionManager>()};
+  for (Change const& change : exported) {
+    ASSERT_EQ(change.partition, kValidUUID);
+    ASSERT_TRUE(ApplyChange(target, change).has_value());
+  }
+  ASSERT_TRUE(target.LookupPartition(upper).value()->OpenRegularFile("/file"));
+}
+
+TEST(PartitionArchiveTest, Freeze) {
+  InMemoryPartition partition;
+  ASSERT_FALSE(partition.IsFrozen());
+  {
+    auto write = partition.BeginWrite();
+    ASSERT_TRUE(write.has_value());
+    /* freezing waits for the writes in flight */
+    std::atomic<bool> frozen{false};
+    std::thread freezer{[&] {
+      partition.Freeze();
+      frozen = true;
+    }};
+    std::this_thread::sleep_for(10ms);
+    bool const frozen_early = frozen;
+    write.reset();
+    freezer.join();
+    ASSERT_FALSE(frozen_early);
+  }
+  ASSERT_TRUE(partition.IsFrozen());
+  ASSERT_FALSE(partition.BeginWrite().has_value());
+  partition.Unfreeze();
+  ASSERT_TRUE(partition.BeginWrite().has_value());
+}
+
+}  // namespace tests::storage
@@ -0,0 +1,149 @@
+#include <chrono>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scheduling/fair_scheduler.hpp"
+#include "scheduling/rate_limiter.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+using namespace std::chrono_literals;
+
+///
+/// Runs requests through a scheduler with a single slot, which is held by
+/// the fixture until all requests are queued, and records the order in which
+/// they got the slot.
+///
+class SchedulingOrder {
+ public:
+  explicit SchedulingOrder(FairSchedulerConfig config)
+      : scheduler_(std::move(config)), blocker_(scheduler_.Acquire("")) {}
+
+  ~SchedulingOrder() {
+    for (std::thread& thread : threads_) thread.join();
+  }
+
+  /// queue a request of @c tenant, returns once it is waiting for the slot
+  void Queue(std::string const& tenant) {
+    size_t const queued = scheduler_.GetQueued();
+    threads_.emplace_back([this, tenant] {
+      FairScheduler::Slot const slot = scheduler_.Acquire(tenant);
+      std::lock_guard const lock{mutex_};
+      order_.push_back(tenant);
+    });
+    while (scheduler_.GetQueued() == queued) std::this_thread::yield();
+  }
+
+  std::vector<std::string> Run() {
+    blocker_ = {};
+    for (std::thread& thread : threads_) thread.join();
+    threads_.clear();
+    return order_;
+  }
+
+ private:
+  FairScheduler scheduler_;
+  FairScheduler::Slot blocker_;
+  std::vector<std::thread> threads_;
+  std::vector<std::string> order_;
+  std::mutex mutex_;
+};
+}  // namespace
+
+TEST(TokenBucketTest, RefillAndDebt) {
+  auto const start = TokenBucket::Clock::now();
+  TokenBucket bucket{10, 2, start};
+  ASSERT_TRUE(bucket.TryTake(1, start));
+  ASSERT_TRUE(bucket.TryTake(1, start));
+  ASSERT_FALSE(bucket.TryTake(1, start));
+  ASSERT_EQ(bucket.GetWaitTime(1, start), 100ms);
+  ASSERT_TRUE(bucket.TryTake(1, start + 100ms));
+
+  /* refill is capped by the burst size */
+  ASSERT_FALSE(bucket.TryTake(3, start + 10s));
+  bucket.Charge(5, start + 10s);
+  ASSERT_EQ(bucket.GetWaitTime(0, start + 10s), 300ms);
+
+  TokenBucket unlimited{0, 0, start};
+  ASSERT_TRUE(unlimited.TryTake(1e9, start));
+}
+
+TEST(RateLimiterTest, RequestsPerSecond) {
+  auto const start = RateLimiter::Clock::now();
+  RateLimiter limiter{RateLimits{.requests_per_s = 2, .burst_s = 1}};
+  ASSERT_FALSE(limiter.Admit("a", start).has_value());
+  ASSERT_FALSE(limiter.Admit("a", start).has_value());
+  auto retry_after = limiter.Admit("a", start);
+  ASSERT_TRUE(retry_after.has_value());
+  ASSERT_EQ(*retry_after, 500ms);
+  /* partitions are limited independently */
+  ASSERT_FALSE(limiter.Admit("b", start).has_value());
+  ASSERT_FALSE(limiter.Admit("a", start + 500ms).has_value());
+  ASSERT_EQ(limiter.GetRejected(), 1);
+}
+
+TEST(RateLimiterTest, BytesPerSecond) {
+  auto const start = RateLimiter::Clock::now();
+  RateLimiter limiter{RateLimits{.bytes_per_s = 1000, .burst_s = 1}};
+  ASSERT_FALSE(limiter.Admit("a", start).has_value());
+  /* a large response is let through and delays the following requests */
+  limiter.Charge("a", 3000, start);
+  auto retry_after = limiter.Admit("a", start);
+  ASSERT_TRUE(retry_after.has_value());
+  ASSERT_EQ(*retry_after, 2s);
+  ASSERT_FALSE(limiter.Admit("a", start + 2s).has_value());
+}
+
+TEST(RateLimiterTest, IdleTenantsAreDropped) {
+  auto const start = RateLimiter::Clock::now();
+  RateLimiter limiter{RateLimits{.requests_per_s = 10, .burst_s = 1}};
+  for (size_t i = 0; i < 4096; ++i) {
+    ASSERT_FALSE(limiter.Admit(std::to_string(i), start).has_value());
+  }
+  ASSERT_EQ(limiter.GetTenantCount(), 4096);
+
+  /* a tenant that used up its burst keeps its bucket until it refilled */
+  for (size_t i = 0; i < 9; ++i) {
+    ASSERT_FALSE(limiter.Admit("0", start).has_value());
+  }
+  ASSERT_FALSE(limiter.Admit("new", start + 500ms).has_value());
+  ASSERT_EQ(limiter.GetTenantCount(), 2);
+  ASSERT_FALSE(limiter.Admit("0", start + 500ms).has_value());
+  ASSERT_EQ(limiter.GetRejected(), 0);
+}
+
+TEST(FairSchedulerTest, IdleTenantIsServedFirst) {
+  SchedulingOrder order{FairSchedulerConfig{.concurrency = 1}};
+  order.Queue("heavy");
+  order.Queue("heavy");
+  order.Queue("heavy");
+  order.Queue("light");
+  std::vector<std::string> const expected = {"heavy", "light", "heavy",
+                                             "heavy"};
+  ASSERT_EQ(order.Run(), expected);
+}
+
+TEST(FairSchedulerTest, Weights) {
+  SchedulingOrder order{FairSchedulerConfig{
+      .concurrency = 1, .weights = {{"a", 2.0}, {"b", 1.0}}}};
+  for (int i = 0; i < 4; ++i) order.Queue("a");
+  for (int i = 0; i < 4; ++i) order.Queue("b");
+  std::vector<std::string> const expected = {"a", "b", "a", "a",
+                                             "b", "a", "b", "b"};
+  ASSERT_EQ(order.Run(), expected);
+}
+
+TEST(FairSchedulerTest, Disabled) {
+  FairScheduler scheduler{FairSchedulerConfig{.concurrency = 0}};
+  FairScheduler::Slot const first = scheduler.Acquire("a");
+  FairScheduler::Slot const second = scheduler.Acquire("a");
+  ASSERT_FALSE(first);
+  ASSERT_FALSE(second);
+}
+
+}  // namespace tests::storage
@@ -1,8 +1,13 @@
+#include <algorithm>
 #include <gtest/gtest.h>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 #include "error_types.h"
 #include "partition/in_memory_partition.hpp"
 #include "partition/on_disk_partition.hpp"
+#include "partition/partition_id.hpp"
 #include "storage.hpp"
 
 namespace tests::storage {
@@ -62,4 +67,68 @@ TYPED_TEST(StorageTest, CreatePartitionAlreadyExists) {
   ASSERT_EQ(partition.error().code, cppfs::storage::ErrorEnum::kAlreadyExists);
 }
 
+TYPED_TEST(StorageTest, PartitionIdsAreCaseInsensitive) {
+  ASSERT_TRUE(this->storage_->CreatePartition(kValidUUID).has_value());
+  ASSERT_TRUE(this->storage_
+                  ->LookupPartition("A2C59F5C-6C9B-4800-AFB8-282FC5E743CC")
+                  .has_value());
+}
+
+TYPED_TEST(StorageTest, ConcurrentClientCreation) {
+  std::vector<cppfs::storage::ClientPartition> clients(8);
+  std::vector<std::thread> threads;
+  for (auto& client : clients) {
+    threads.emplace_back([this, &client] {
+      client = this->storage_->GetOrCreateClientPartition("client").value();
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+
+  /* a single call creates the partition, the others find it */
+  ASSERT_EQ(std::ranges::count_if(
+                clients, &cppfs::storage::ClientPartition::created),
+            1);
+  for (auto const& client : clients) {
+    ASSERT_EQ(client.uuid, clients.front().uuid);
+  }
+}
+
+TEST(PartitionIdTest, Parse) {
+  using cppfs::storage::PartitionId;
+  static_assert(PartitionId::Parse(kValidUUID).has_value());
+  static_assert(!PartitionId::Parse(kInvalidUUID).has_value());
+
+  auto const id = PartitionId::Parse(kValidUUID);
+  ASSERT_TRUE(id.has_value());
+  ASSERT_EQ(id->ToString(), kValidUUID);
+  ASSERT_EQ(id->GetBytes()[0], 0xa2);
+  ASSERT_EQ(id->GetBytes()[15], 0xcc);
+  ASSERT_EQ(PartitionId::Parse("A2C59F5C-6C9B-4800-AFB8-282FC5E743CC"), id);
+
+  for (char const* invalid : {
+           "",
+           "a2c59f5c-6c9b-4800-afb8-282fc5e743c",
+           "a2c59f5c-6c9b-4800-afb8-282fc5e743ccc",
+           "a2c59f5c6c9b-4800-afb8-282fc5e743cc-",
+           "a2c59f5c-6c9b-4800-afb8-282fc5e743cg",
+           "{a2c59f5c-6c9b-4800-afb8-282fc5e743}",
+           /* version 0 and 6 */
+           "a2c59f5c-6c9b-0800-afb8-282fc5e743cc",
+           "a2c59f5c-6c9b-6800-afb8-282fc5e743cc",
+       }) {
+    ASSERT_FALSE(PartitionId::Parse(invalid).has_value()) << invalid;
+    ASSERT_FALSE(cppfs::storage::IsUUIDValid(invalid)) << invalid;
+  }
+}
+
+TEST(PartitionIdTest, GeneratedIdsAreUnique) {
+  using cppfs::storage::PartitionId;
+  std::unordered_set<PartitionId, PartitionId::Hash> ids;
+  for (int i = 0; i < 1000; ++i) {
+    PartitionId const id = cppfs::storage::GeneratePartitionId();
+    ASSERT_EQ(PartitionId::Parse(id.ToString()), id);
+    ASSERT_TRUE(ids.insert(id).second);
+  }
+}
+
 }  // namespace tests::storage
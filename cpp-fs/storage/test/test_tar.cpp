@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <gtest/gtest.h>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+
+#include "archive/gzip.hpp"
+#include "archive/tar.hpp"
+#include "archive/tar_export.hpp"
+#include "archive/tar_import.hpp"
+#include "partition/in_memory_partition.hpp"
+#include "partition/on_disk_partition.hpp"
+#include "replication/change_feed.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+
+constexpr auto kValidUUID = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+
+std::filesystem::path TempRoot() {
+  return std::filesystem::temp_directory_path() / "cppfs-test-tar";
+}
+
+void PutField(std::string& header, size_t offset, std::string_view value) {
+  header.replace(offset, value.size(), value);
+}
+
+/// ustar header of an entry with @c size bytes of contents
+std::string Header(std::string_view name, char type, size_t size,
+                   std::string_view prefix = {}) {
+  std::string header(TarReader::kBlockSize, '\0');
+  PutField(header, 0, name);
+  PutField(header, 100, "0000644");
+  PutField(header, 124, std::format("{:011o}", size));
+  PutField(header, 136, std::format("{:011o}", 0));
+  header[156] = type;
+  PutField(header, 257, std::string_view{"ustar\0" "00", 8});
+  PutField(header, 345, prefix);
+
+  PutField(header, 148, "        ");
+  unsigned sum = 0;
+  for (char c : header) sum += static_cast<unsigned char>(c);
+  PutField(header, 148, std::format("{:06o}", sum));
+  header[154] = '\0';
+  return header;
+}
+
+/// header and contents padded to the block size
+std::string Entry(std::string_view name, char type, std::string_view data = {},
+                  std::string_view prefix = {}) {
+  std::string entry = Header(name, type, data.size(), prefix);
+  entry += data;
+  entry.resize((entry.size() + TarReader::kBlockSize - 1) /
+               TarReader::kBlockSize * TarReader::kBlockSize);
+  return entry;
+}
+
+/// pax record, its length counts the digits of the length
+std::string PaxRecord(std::string_view key, std::string_view value) {
+  size_t const size = key.size() + value.size() + 3;
+  size_t length = size + std::to_string(size).size();
+  length = size + std::to_string(length).size();
+  return std::format("{} {}={}\n", length, key, value);
+}
+
+std::string EndOfArchive() {
+  return std::string(2 * TarReader::kBlockSize, '\0');
+}
+
+std::vector<TarEntry> ReadAll(TarReader& reader, std::string_view archive,
+                              size_t chunk_size) {
+  std::vector<TarEntry> entries;
+  for (size_t offset = 0; offset < archive.size(); offset += chunk_size) {
+    reader.Feed(archive.substr(offset, chunk_size));
+    while (true) {
+      auto entry = reader.Next();
+      EXPECT_TRUE(entry.has_value());
+      if (!entry.has_value() || !entry->has_value()) break;
+      entries.push_back(std::move(**entry));
+    }
+  }
+  return entries;
+}
+
+/// the whole archive of @c exporter, taken in pieces of @c chunk_size
+std::string ExportAll(TarExporter& exporter, size_t chunk_size) {
+  std::string archive;
+  while (true) {
+    auto chunk = exporter.Next(chunk_size);
+    EXPECT_TRUE(chunk.has_value());
+    if (!chunk.has_value() || chunk->empty()) return archive;
+    archive += *chunk;
+  }
+}
+
+std::string Gunzip(std::string_view compressed) {
+  z_stream stream{};
+  EXPECT_EQ(inflateInit2(&stream, 15 + 16), Z_OK);
+  std::string data(1 << 20, '\0');
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = static_cast<uInt>(compressed.size());
+  stream.next_out = reinterpret_cast<Bytef*>(data.data());
+  stream.avail_out = static_cast<uInt>(data.size());
+  EXPECT_EQ(inflate(&stream, Z_FINISH), Z_STREAM_END);
+  data.resize(stream.total_out);
+  inflateEnd(&stream);
+  return data;
+}
+
+std::string Read(Partition* partition, std::string const& path) {
+  std::ostringstream out;
+  RegularFile* file = *partition->OpenRegularFile(path);
+  file->PositionalRead(out, 0, file->GetSize());
+  return out.str();
+}
+}  // namespace
+
+TEST(TarReaderTest, ReadsEntries) {
+  std::string const archive = Entry("dir/", '5') +
+                              Entry("dir/file", '0', "contents") +
+                              Entry("dir/link", '2') + EndOfArchive() +
+                              "ignored after the end";
+
+  for (size_t chunk_size : {archive.size(), size_t{1}, size_t{100}}) {
+    TarReader reader;
+    std::vector<TarEntry> const entries = ReadAll(reader, archive, chunk_size);
+    ASSERT_EQ(entries.size(), 3);
+    ASSERT_EQ(entries[0].type, TarEntry::Type::kDirectory);
+    ASSERT_EQ(entries[0].path, "dir/");
+    ASSERT_EQ(entries[1].type, TarEntry::Type::kRegularFile);
+    ASSERT_EQ(entries[1].path, "dir/file");
+    ASSERT_EQ(entries[1].data, "contents");
+    ASSERT_EQ(entries[2].type, TarEntry::Type::kOther);
+    ASSERT_TRUE(reader.IsDone());
+  }
+}
+
+TEST(TarReaderTest, ReadsLongPaths) {
+  std::string const long_name(150, 'n');
+  std::string const archive =
+      Entry("file", '0', "ustar", "prefix/dir") +
+      Entry("PaxHeaders/file", 'x',
+            PaxRecord("path", long_name + "/pax") + PaxRecord("mtime", "1")) +
+      Entry("truncated", '0', "pax") +
+      Entry("././@LongLink", 'L', long_name + "/gnu") +
+      Entry("truncated", '0', "gnu") + Entry("plain", '0', "plain");
+
+  TarReader reader;
+  std::vector<TarEntry> const entries =
+      ReadAll(reader, archive, archive.size());
+  ASSERT_EQ(entries.size(), 4);
+  ASSERT_EQ(entries[0].path, "prefix/dir/file");
+  ASSERT_EQ(entries[1].path, long_name + "/pax");
+  ASSERT_EQ(entries[1].data, "pax");
+  ASSERT_EQ(entries[2].path, long_name + "/gnu");
+  ASSERT_EQ(entries[2].data, "gnu");
+  /* the extended attributes apply to a single entry */
+  ASSERT_EQ(entries[3].path, "plain");
+  ASSERT_FALSE(reader.IsDone());
+  ASSERT_EQ(reader.GetPending(), 0);
+}
+
+TEST(TarReaderTest, RejectsInvalidArchives) {
+  std::string corrupted = Entry("file", '0', "data");
+  corrupted[0] = 'F';
+  TarReader reader;
+  reader.Feed(corrupted);
+  auto entry = reader.Next();
+  ASSERT_FALSE(entry.has_value());
+  ASSERT_EQ(entry.error().code, ErrorEnum::kInvalidInput);
+
+  /* large entries are rejected before they are buffered */
+  TarReader limited{4};
+  limited.Feed(Header("file", '0', 5));
+  entry = limited.Next();
+  ASSERT_FALSE(entry.has_value());
+  ASSERT_EQ(entry.error().code, ErrorEnum::kInvalidInput);
+}
+
+TEST(TarReaderTest, ReadsEncodedHeaders) {
+  std::string const long_path = std::string(120, 'd') + "/file";
+  std::string const archive =
+      EncodeTarHeader(TarEntry::Type::kDirectory, "dir/", 0, 1) +
+      EncodeTarHeader(TarEntry::Type::kRegularFile, long_path, 3, 1) + "abc" +
+      std::string(GetTarPadding(3), '\0');
+
+  TarReader reader;
+  std::vector<TarEntry> const entries =
+      ReadAll(reader, archive, archive.size());
+  ASSERT_EQ(entries.size(), 2);
+  ASSERT_EQ(entries[0].type, TarEntry::Type::kDirectory);
+  ASSERT_EQ(entries[0].path, "dir/");
+  ASSERT_EQ(entries[1].path, long_path);
+  ASSERT_EQ(entries[1].data, "abc");
+  /* sizes past the octal field are carried by a pax record */
+  TarReader big_reader;
+  big_reader.Feed(EncodeTarHeader(TarEntry::Type::kRegularFile, "big",
+                                  uint64_t{1} << 34, 1));
+  auto big = big_reader.Next();
+  ASSERT_FALSE(big.has_value());
+  ASSERT_EQ(big.error().message,
+            "Tar entry of 17179869184 bytes is larger than the limit of "
+            "1073741824");
+}
+
+class TarImporterTest : public testing::Test {
+ protected:
+  void SetUp() override { std::filesystem::remove_all(TempRoot()); }
+  void TearDown() override { std::filesystem::remove_all(TempRoot()); }
+};
+
+TEST_F(TarImporterTest, ExpandsIntoDirectory) {
+  InMemoryPartition partition;
+  ASSERT_TRUE(partition.OpenRoot()->CreateDirectory("dst").has_value());
+  ASSERT_TRUE((*partition.OpenDir("/dst"))->CreateDirectory("a").has_value());
+
+  TarImporter importer{&partition, kValidUUID, "/dst", nullptr,
+                       TarImportConfig{.writers = 0}};
+  std::string const archive =
+      Entry("./a/", '5') + Entry("./a/b/", '5') + Entry("a/b/file", '0', "1") +
+      Entry("/c/d/file", '0', "22") + Entry("a/fifo", '6') + EndOfArchive();
+  ASSERT_TRUE(importer.Feed(archive).has_value());
+  auto stats = importer.Finish();
+  ASSERT_TRUE(stats.has_value());
+
+  /* the existing directory is reused, the missing parents are created */
+  ASSERT_EQ(stats->directories, 3);
+  ASSERT_EQ(stats->files, 2);
+  ASSERT_EQ(stats->bytes, 3);
+  ASSERT_EQ(stats->skipped, 1);
+  ASSERT_EQ(Read(&partition, "/dst/a/b/file"), "1");
+  ASSERT_EQ(Read(&partition, "/dst/c/d/file"), "22");
+}
+
+TEST_F(TarImporterTest, StoresFilesInParallel) {
+  OnDiskPartitionManager manager{TempRoot()};
+  Partition* partition =
+      *manager.CreatePartition(*PartitionId::Parse(kValidUUID));
+  ChangeFeed feed{TempRoot() / "changes.log"};
+
+  constexpr size_t kDirs = 8;
+  constexpr size_t kFilesPerDir = 64;
+  std::string archive;
+  for (size_t dir = 0; dir < kDirs; ++dir) {
+    for (size_t file = 0; file < kFilesPerDir; ++file) {
+      archive += Entry(std::format("{}/{}", dir, file), '0',
+                       std::format("{}-{}", dir, file));
+    }
+  }
+  archive += EndOfArchive();
+
+  /* a small queue makes the parser wait for the writers */
+  TarImporter importer{partition, kValidUUID, "/", &feed,
+                       TarImportConfig{.writers = 4, .max_queued_bytes = 64}};
+  for (size_t offset = 0; offset < archive.size(); offset += 1000) {
+    ASSERT_TRUE(importer.Feed(archive.substr(offset, 1000)).has_value());
+  }
+  auto stats = importer.Finish();
+  ASSERT_TRUE(stats.has_value());
+  ASSERT_EQ(stats->directories, kDirs);
+  ASSERT_EQ(stats->files, kDirs * kFilesPerDir);
+
+  for (size_t dir = 0; dir < kDirs; ++dir) {
+    for (size_t file = 0; file < kFilesPerDir; ++file) {
+      ASSERT_EQ(Read(partition, std::format("/{}/{}", dir, file)),
+                std::format("{}-{}", dir, file));
+    }
+  }
+  ASSERT_EQ(partition->GetUsage().GetUsage().files, kDirs * kFilesPerDir);
+  ASSERT_EQ(feed.GetLastSequence(), kDirs + kDirs * kFilesPerDir);
+}
+
+TEST_F(TarImporterTest, RejectsInvalidArchives) {
+  InMemoryPartition partition;
+  TarImporter escaping{&partition, kValidUUID, "/", nullptr,
+                       TarImportConfig{.writers = 0}};
+  auto fed = escaping.Feed(Entry("a/../../file", '0', "data"));
+  ASSERT_FALSE(fed.has_value());
+  ASSERT_EQ(fed.error().code, ErrorEnum::kInvalidInput);
+  ASSERT_FALSE(escaping.Finish().has_value());
+  ASSERT_FALSE(partition.Open("/file").has_value());
+
+  TarImporter truncated{&partition, kValidUUID, "/", nullptr,
+                        TarImportConfig{.writers = 2}};
+  std::string const entry = Entry("file", '0', "data");
+  ASSERT_TRUE(truncated.Feed(entry.substr(0, 600)).has_value());
+  auto stats = truncated.Finish();
+  ASSERT_FALSE(stats.has_value());
+  ASSERT_EQ(stats.error().code, ErrorEnum::kInvalidInput);
+}
+
+TEST_F(TarImporterTest, ImportsExportedTree) {
+  OnDiskPartitionManager manager{TempRoot()};
+  Partition* partition =
+      *manager.CreatePartition(*PartitionId::Parse(kValidUUID));
+  Directory* src = *partition->OpenRoot()->CreateDirectory("src");
+  Directory* nested = *(*src->CreateDirectory("a"))->CreateDirectory("b");
+  std::string large(10000, '\0');
+  for (size_t i = 0; i < large.size(); ++i) {
+    large[i] = static_cast<char>('a' + i % 26);
+  }
+  std::string const long_name(120, 'n');
+  ASSERT_TRUE(src->StoreRegularFile("large", std::string{large}).has_value());
+  ASSERT_TRUE(nested->StoreRegularFile(long_name, "long").has_value());
+  ASSERT_TRUE(nested->StoreRegularFile("small", "small").has_value());
+  ASSERT_TRUE(partition->OpenRoot()->CreateDirectory("dst").has_value());
+
+  /* small pieces and read-ahead make the readers wait for the stream */
+  TarExporter exporter{partition, "/src",
+                       TarExportConfig{.readers = 4,
+                                       .max_read_ahead_bytes = 4096,
+                                       .read_bytes = 1000}};
+  std::string const archive = ExportAll(exporter, 700);
+  ASSERT_EQ(exporter.GetExported(), 5);
+  ASSERT_EQ(archive.size() % TarReader::kBlockSize, 0);
+
+  TarImporter importer{partition, kValidUUID, "/dst", nullptr};
+  ASSERT_TRUE(importer.Feed(archive).has_value());
+  auto stats = importer.Finish();
+  ASSERT_TRUE(stats.has_value());
+  ASSERT_EQ(stats->directories, 2);
+  ASSERT_EQ(stats->files, 3);
+  ASSERT_EQ(Read(partition, "/dst/large"), large);
+  ASSERT_EQ(Read(partition, "/dst/a/b/" + long_name), "long");
+  ASSERT_EQ(Read(partition, "/dst/a/b/small"), "small");
+}
+
+TEST(TarExporterTest, ExportsInMemoryFiles) {
+  InMemoryPartition partition;
+  Directory* dir = *partition.OpenRoot()->CreateDirectory("dir");
+  ASSERT_TRUE(dir->StoreRegularFile("file", "contents").has_value());
+  ASSERT_TRUE(dir->StoreRegularFile("empty", "").has_value());
+
+  TarExporter exporter{&partition, "/", TarExportConfig{.readers = 0}};
+  std::string const archive = ExportAll(exporter, 1 << 20);
+  TarReader reader;
+  std::vector<TarEntry> entries = ReadAll(reader, archive, archive.size());
+  ASSERT_TRUE(reader.IsDone());
+  ASSERT_EQ(entries.size(), 3);
+  ASSERT_EQ(entries[0].path, "dir/");
+  std::sort(entries.begin() + 1, entries.end(),
+            [](TarEntry const& lhs, TarEntry const& rhs) {
+              return lhs.path < rhs.path;
+            });
+  ASSERT_EQ(entries[1].path, "dir/empty");
+  ASSERT_EQ(entries[1].data, "");
+  ASSERT_EQ(entries[2].path, "dir/file");
+  ASSERT_EQ(entries[2].data, "contents");
+}
+
+TEST(GzipCompressorTest, CompressesStream) {
+  std::string data;
+  for (int i = 0; i < 10000; ++i) data += std::format("line {}\n", i);
+
+  GzipCompressor gzip;
+  std::string compressed;
+  for (size_t offset = 0; offset < data.size(); offset += 1000) {
+    auto chunk = gzip.Compress(std::string_view{data}.substr(offset, 1000));
+    ASSERT_TRUE(chunk.has_value());
+    compressed += *chunk;
+  }
+  auto rest = gzip.Finish();
+  ASSERT_TRUE(rest.has_value());
+  compressed += *rest;
+
+  ASSERT_LT(compressed.size(), data.size() / 2);
+  ASSERT_EQ(Gunzip(compressed), data);
+  ASSERT_FALSE(gzip.Compress("more").has_value());
+}
+
+}  // namespace tests::storage
@@ -0,0 +1,180 @@
+#include <array>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory>
+
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "server/tls.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+using namespace std::chrono_literals;
+
+template <typename T, void (*Free)(T*)>
+struct Deleter {
+  void operator()(T* ptr) const { Free(ptr); }
+};
+
+using SslCtxPtr = std::unique_ptr<SSL_CTX, Deleter<SSL_CTX, SSL_CTX_free>>;
+using SslPtr = std::unique_ptr<SSL, Deleter<SSL, SSL_free>>;
+using SessionPtr =
+    std::unique_ptr<SSL_SESSION, Deleter<SSL_SESSION, SSL_SESSION_free>>;
+using PkeyPtr = std::unique_ptr<EVP_PKEY, Deleter<EVP_PKEY, EVP_PKEY_free>>;
+using X509Ptr = std::unique_ptr<X509, Deleter<X509, X509_free>>;
+
+/// server context with a freshly generated self-signed certificate
+SslCtxPtr CreateServerContext() {
+  PkeyPtr key{EVP_EC_gen("P-256")};
+  X509Ptr cert{X509_new()};
+  X509_set_version(cert.get(), 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert.get()), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert.get()), 3600);
+  X509_set_pubkey(cert.get(), key.get());
+  X509_NAME* name = X509_get_subject_name(cert.get());
+  constexpr std::array<unsigned char, 10> kCommonName = {"localhost"};
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, kCommonName.data(), -1,
+                             -1, 0);
+  X509_set_issuer_name(cert.get(), name);
+  X509_sign(cert.get(), key.get(), EVP_sha256());
+
+  SslCtxPtr ctx{SSL_CTX_new(TLS_server_method())};
+  SSL_CTX_use_certificate(ctx.get(), cert.get());
+  SSL_CTX_use_PrivateKey(ctx.get(), key.get());
+  return ctx;
+}
+
+struct Connection {
+  SslPtr client;
+  SslPtr server;
+};
+
+/// run handshake between @c client_ctx and @c server_ctx over a memory BIO
+/// pair, resuming @c session if provided
+Connection Handshake(SSL_CTX* client_ctx, SSL_CTX* server_ctx,
+                     SSL_SESSION* session = nullptr) {
+  Connection conn{SslPtr{SSL_new(client_ctx)}, SslPtr{SSL_new(server_ctx)}};
+  BIO* client_bio = nullptr;
+  BIO* server_bio = nullptr;
+  BIO_new_bio_pair(&client_bio, 0, &server_bio, 0);
+  SSL_set_bio(conn.client.get(), client_bio, client_bio);
+  SSL_set_bio(conn.server.get(), server_bio, server_bio);
+  SSL_set_connect_state(conn.client.get());
+  SSL_set_accept_state(conn.server.get());
+  if (session != nullptr) SSL_set_session(conn.client.get(), session);
+
+  for (int i = 0; i < 16; ++i) {
+    int const client_done = SSL_do_handshake(conn.client.get());
+    int const server_done = SSL_do_handshake(conn.server.get());
+    if (client_done == 1 && server_done == 1) break;
+  }
+
+  /* TLS 1.3 tickets arrive after the handshake, let the client read them */
+  std::array<char, 1> byte{'x'};
+  SSL_write(conn.server.get(), byte.data(), 1);
+  SSL_read(conn.client.get(), byte.data(), 1);
+  return conn;
+}
+
+SslCtxPtr CreateClientContext(int max_version, bool tickets) {
+  SslCtxPtr ctx{SSL_CTX_new(TLS_client_method())};
+  SSL_CTX_set_max_proto_version(ctx.get(), max_version);
+  if (!tickets) SSL_CTX_set_options(ctx.get(), SSL_OP_NO_TICKET);
+  return ctx;
+}
+}  // namespace
+
+TEST(TicketKeyRingTest, Rotation) {
+  auto const start = TicketKeyRing::Clock::now();
+  TicketKeyRing keys{1h, start};
+
+  TicketKeyRing::Key const first = keys.GetEncryptionKey(start);
+  auto lookup = keys.FindDecryptionKey(first.name.data(), start + 30min);
+  ASSERT_TRUE(lookup.has_value());
+  ASSERT_FALSE(lookup->renew);
+  ASSERT_EQ(keys.GetRotations(), 0);
+
+  /* rotated, the old key is still accepted but tickets should be renewed */
+  lookup = keys.FindDecryptionKey(first.name.data(), start + 90min);
+  ASSERT_TRUE(lookup.has_value());
+  ASSERT_TRUE(lookup->renew);
+  ASSERT_EQ(keys.GetRotations(), 1);
+  TicketKeyRing::Key const second = keys.GetEncryptionKey(start + 90min);
+  ASSERT_NE(first.name, second.name);
+
+  /* rotated again, the first key is gone */
+  ASSERT_FALSE(
+      keys.FindDecryptionKey(first.name.data(), start + 180min).has_value());
+  ASSERT_TRUE(
+      keys.FindDecryptionKey(second.name.data(), start + 180min).has_value());
+  ASSERT_EQ(keys.GetRotations(), 2);
+}
+
+TEST(TicketKeyRingTest, LongIdleDropsPreviousKey) {
+  auto const start = TicketKeyRing::Clock::now();
+  TicketKeyRing keys{1h, start};
+  TicketKeyRing::Key const first = keys.GetEncryptionKey(start);
+  ASSERT_FALSE(
+      keys.FindDecryptionKey(first.name.data(), start + 5h).has_value());
+}
+
+TEST(TlsSessionsTest, ResumeWithTicket) {
+  SslCtxPtr server_ctx = CreateServerContext();
+  TlsSessions sessions{TlsSessionConfig{}};
+  sessions.Install(server_ctx.get());
+  SslCtxPtr client_ctx = CreateClientContext(TLS1_3_VERSION, true);
+
+  Connection first = Handshake(client_ctx.get(), server_ctx.get());
+  ASSERT_FALSE(SSL_session_reused(first.client.get()));
+  SessionPtr session{SSL_get1_session(first.client.get())};
+  ASSERT_NE(session, nullptr);
+
+  Connection second =
+      Handshake(client_ctx.get(), server_ctx.get(), session.get());
+  ASSERT_TRUE(SSL_session_reused(second.client.get()));
+
+  ASSERT_EQ(sessions.GetFullHandshakes(), 1);
+  ASSERT_EQ(sessions.GetResumedHandshakes(), 1);
+}
+
+TEST(TlsSessionsTest, ResumeFromSessionCache) {
+  SslCtxPtr server_ctx = CreateServerContext();
+  TlsSessions sessions{TlsSessionConfig{}};
+  sessions.Install(server_ctx.get());
+  /* TLS 1.2 without tickets resumes by session id */
+  SslCtxPtr client_ctx = CreateClientContext(TLS1_2_VERSION, false);
+
+  Connection first = Handshake(client_ctx.get(), server_ctx.get());
+  SessionPtr session{SSL_get1_session(first.client.get())};
+  ASSERT_NE(session, nullptr);
+
+  Connection second =
+      Handshake(client_ctx.get(), server_ctx.get(), session.get());
+  ASSERT_TRUE(SSL_session_reused(second.client.get()));
+  ASSERT_EQ(sessions.GetFullHandshakes(), 1);
+  ASSERT_EQ(sessions.GetResumedHandshakes(), 1);
+
+  PrometheusWriter writer;
+  sessions.CollectMetrics(writer);
+  ASSERT_NE(writer.GetText().find("cppfs_tls_session_cache_sessions 1"),
+            std::string::npos);
+}
+
+TEST(TlsSessionsTest, WithoutResumption) {
+  SslCtxPtr server_ctx = CreateServerContext();
+  TlsSessions sessions{TlsSessionConfig{}};
+  sessions.Install(server_ctx.get());
+  SslCtxPtr client_ctx = CreateClientContext(TLS1_3_VERSION, true);
+
+  Connection first = Handshake(client_ctx.get(), server_ctx.get());
+  Connection second = Handshake(client_ctx.get(), server_ctx.get());
+  ASSERT_FALSE(SSL_session_reused(second.client.get()));
+  ASSERT_EQ(sessions.GetFullHandshakes(), 2);
+  ASSERT_EQ(sessions.GetResumedHandshakes(), 0);
+}
+
+}  // namespace tests::storage
@@ -0,0 +1,77 @@
+#include <chrono>
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "tracing/tracing.hpp"
+
+namespace tests::storage {
+
+using namespace cppfs::storage;
+using namespace std::chrono_literals;
+
+TEST(TracingTest, DisabledByDefault) {
+  Tracer tracer;
+  tracer.Begin("/cat");
+  ASSERT_FALSE(Tracer::IsActive());
+  tracer.End(200);
+  ASSERT_TRUE(tracer.CollectSlow(0ns, 10).empty());
+}
+
+TEST(TracingTest, RecordsStages) {
+  Tracer tracer;
+  tracer.SetSampleRate(1);
+
+  tracer.Begin("/cat");
+  ASSERT_TRUE(Tracer::IsActive());
+  {
+    ScopedTraceStage const stage{TraceStage::kOpen};
+    std::this_thread::sleep_for(1ms);
+  }
+  {
+    ScopedTraceStage const stage{TraceStage::kIo};
+  }
+  tracer.End(200);
+  ASSERT_FALSE(Tracer::IsActive());
+
+  auto const records = tracer.CollectSlow(0ns, 10);
+  ASSERT_EQ(records.size(), 1);
+  TraceRecord const& record = records.front();
+  ASSERT_EQ(record.GetPath(), "/cat");
+  ASSERT_EQ(record.status, 200);
+  ASSERT_TRUE(record.HasStage(TraceStage::kRouting));
+  ASSERT_TRUE(record.HasStage(TraceStage::kOpen));
+  ASSERT_TRUE(record.HasStage(TraceStage::kIo));
+  ASSERT_FALSE(record.HasStage(TraceStage::kSerialize));
+  ASSERT_GE(record.stages[static_cast<size_t>(TraceStage::kOpen)].duration_ns,
+            std::chrono::nanoseconds{1ms}.count());
+  ASSERT_GE(record.duration_ns,
+            record.stages[static_cast<size_t>(TraceStage::kOpen)].duration_ns);
+}
+
+TEST(TracingTest, SamplingAndSlowFilter) {
+  Tracer tracer;
+  tracer.SetSampleRate(2);
+  for (int i = 0; i < 10; ++i) {
+    tracer.Begin("/ls");
+    tracer.End(200);
+  }
+  ASSERT_EQ(tracer.CollectSlow(0ns, 100).size(), 5);
+  ASSERT_TRUE(tracer.CollectSlow(1h, 100).empty());
+  ASSERT_EQ(tracer.CollectSlow(0ns, 3).size(), 3);
+}
+
+TEST(TracingTest, RingWrapsAround) {
+  Tracer tracer;
+  tracer.SetSampleRate(1);
+  std::thread writer([&tracer] {
+    for (size_t i = 0; i < 3 * TraceRing::kCapacity; ++i) {
+      tracer.Begin("/store");
+      tracer.End(200);
+    }
+  });
+  writer.join();
+  ASSERT_EQ(tracer.CollectSlow(0ns, 10 * TraceRing::kCapacity).size(),
+            TraceRing::kCapacity);
+}
+
+}  // namespace tests::storage
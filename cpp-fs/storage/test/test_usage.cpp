@@ -0,0 +1,198 @@
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "error_types.h"
+#include "partition/in_memory_partition.hpp"
+#include "partition/on_disk_partition.hpp"
+#include "partition/usage.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+
+constexpr auto kValidUUID = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+constexpr auto kOtherUUID = "0b7c2f1e-3f5a-4d2b-9c1e-6a8d4e2f1b3c";
+constexpr PartitionId kValidId = *PartitionId::Parse(kValidUUID);
+constexpr PartitionId kOtherId = *PartitionId::Parse(kOtherUUID);
+
+std::filesystem::path TempRoot() {
+  return std::filesystem::temp_directory_path() / "cppfs-test-usage";
+}
+}  // namespace
+
+TEST(UsageTrackerTest, PartitionQuota) {
+  UsageTracker usage{Quota{.bytes = 100, .files = 2}};
+  ASSERT_TRUE(usage.Reserve({.bytes = 60, .files = 1}).has_value());
+  ASSERT_EQ(usage.GetAvailableBytes(), 40);
+
+  auto over_bytes = usage.Reserve({.bytes = 41, .files = 1});
+  ASSERT_FALSE(over_bytes.has_value());
+  ASSERT_EQ(over_bytes.error().code, ErrorEnum::kOutOfMemory);
+
+  ASSERT_TRUE(usage.Reserve({.bytes = 40, .files = 1}).has_value());
+  /* failed reservations don't leak partial usage */
+  ASSERT_FALSE(usage.Reserve({.files = 1}).has_value());
+  ASSERT_EQ(usage.GetUsage().bytes, 100);
+  ASSERT_EQ(usage.GetUsage().files, 2);
+
+  usage.Release({.bytes = 60, .files = 1});
+  ASSERT_EQ(usage.GetAvailableBytes(), 60);
+}
+
+TEST(UsageTrackerTest, NodeCapacity) {
+  NodeUsage node{100, 0.5};
+  {
+    UsageTracker first{Quota{}, &node};
+    UsageTracker second{Quota{}, &node};
+    ASSERT_TRUE(first.Reserve({.bytes = 40}).has_value());
+    ASSERT_FALSE(node.IsAboveHighWatermark());
+    ASSERT_TRUE(second.Reserve({.bytes = 40}).has_value());
+    ASSERT_TRUE(node.IsAboveHighWatermark());
+    ASSERT_EQ(second.GetAvailableBytes(), 20);
+
+    auto over_capacity = second.Reserve({.bytes = 21});
+    ASSERT_FALSE(over_capacity.has_value());
+    ASSERT_EQ(over_capacity.error().code, ErrorEnum::kOutOfMemory);
+    ASSERT_EQ(second.GetUsage().bytes, 40);
+  }
+  /* destroyed partitions give their usage back to the node */
+  ASSERT_EQ(node.GetUsage().bytes, 0);
+  ASSERT_FALSE(node.IsAboveHighWatermark());
+}
+
+TEST(UsageTest, InMemoryQuota) {
+  InMemoryPartitionManager manager{UsageLimits{
+      .partition_quota = {.bytes = 16, .directories = 1}}};
+  auto partition = manager.CreatePartition(kValidId);
+  ASSERT_TRUE(partition.has_value());
+  Directory* root = partition.value()->OpenRoot();
+
+  ASSERT_TRUE(root->StoreRegularFile("a", "0123456789").has_value());
+  auto too_big = root->StoreRegularFile("b", "0123456789");
+  ASSERT_FALSE(too_big.has_value());
+  ASSERT_EQ(too_big.error().code, ErrorEnum::kOutOfMemory);
+  ASSERT_EQ(root->GetDirEntries().size(), 1);
+
+  auto dir = root->CreateDirectory("dir");
+  ASSERT_TRUE(dir.has_value());
+  ASSERT_FALSE(root->CreateDirectory("other").has_value());
+  /* nested directories share the partition quota */
+  ASSERT_TRUE(dir.value()->StoreRegularFile("c", "012345").has_value());
+  ASSERT_FALSE(dir.value()->StoreRegularFile("d", "0").has_value());
+
+  Usage const usage = partition.value()->GetUsage().GetUsage();
+  ASSERT_EQ(usage.bytes, 16);
+  ASSERT_EQ(usage.files, 2);
+  ASSERT_EQ(usage.directories, 1);
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().bytes, 16);
+
+  manager.DestroyPartition(kValidId);
+  manager.GetReclaimer().WaitIdle();
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().bytes, 0);
+}
+
+TEST(UsageTest, InMemoryNodeCapacity) {
+  InMemoryPartitionManager manager{UsageLimits{.node_capacity_bytes = 16}};
+  auto first = manager.CreatePartition(kValidId);
+  auto second = manager.CreatePartition(kOtherId);
+  ASSERT_TRUE(first.has_value() && second.has_value());
+
+  ASSERT_TRUE(first.value()
+                  ->OpenRoot()
+                  ->StoreRegularFile("a", "0123456789")
+                  .has_value());
+  ASSERT_FALSE(manager.GetNodeUsage().IsAboveHighWatermark());
+  auto rejected =
+      second.value()->OpenRoot()->StoreRegularFile("b", "0123456789");
+  ASSERT_FALSE(rejected.has_value());
+  ASSERT_EQ(rejected.error().code, ErrorEnum::kOutOfMemory);
+  ASSERT_TRUE(
+      second.value()->OpenRoot()->StoreRegularFile("b", "01234").has_value());
+  ASSERT_TRUE(manager.GetNodeUsage().IsAboveHighWatermark());
+
+  manager.Clear();
+  /* the partitions release their usage once the reclaimer frees them */
+  manager.GetReclaimer().WaitIdle();
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().bytes, 0);
+}
+
+TEST(UsageTest, OnDiskUsageSurvivesRestart) {
+  std::filesystem::remove_all(TempRoot());
+  UsageLimits const limits{.partition_quota = {.bytes = 32},
+                           .node_capacity_bytes = 1024};
+  {
+    OnDiskPartitionManager manager{TempRoot(), limits};
+    auto partition = manager.CreatePartition(kValidId);
+    ASSERT_TRUE(partition.has_value());
+    Directory* root = partition.value()->OpenRoot();
+    auto dir = root->CreateDirectory("dir");
+    ASSERT_TRUE(dir.has_value());
+    ASSERT_TRUE(dir.value()->StoreRegularFile("a", "0123456789").has_value());
+    /* overwriting a file only accounts the size difference */
+    ASSERT_TRUE(dir.value()->StoreRegularFile("a", "01234").has_value());
+    ASSERT_TRUE(root->StoreRegularFile("b", "0123456789").has_value());
+    ASSERT_EQ(partition.value()->GetUsage().GetUsage().bytes, 15);
+  }
+
+  /* the node usage starts from the snapshot, usage is recomputed from the
+     data on disk once the partition is loaded */
+  OnDiskPartitionManager manager{TempRoot(), limits};
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().bytes, 15);
+  ASSERT_EQ(manager.GetCacheStats().misses, 0);
+  Partition* partition = manager.LookupPartition(kValidId);
+  ASSERT_NE(partition, nullptr);
+  Usage const usage = partition->GetUsage().GetUsage();
+  ASSERT_EQ(usage.bytes, 15);
+  ASSERT_EQ(usage.files, 2);
+  ASSERT_EQ(usage.directories, 1);
+
+  auto rejected = partition->OpenRoot()->StoreRegularFile(
+      "c", std::string(18, 'x'));
+  ASSERT_FALSE(rejected.has_value());
+  ASSERT_EQ(rejected.error().code, ErrorEnum::kOutOfMemory);
+
+  manager.Clear();
+  /* the partitions release their usage once the reclaimer frees them */
+  manager.GetReclaimer().WaitIdle();
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().bytes, 0);
+  std::filesystem::remove_all(TempRoot());
+}
+
+TEST(UsageTest, OnDiskStartupUsesUsageSnapshots) {
+  std::filesystem::remove_all(TempRoot());
+  UsageLimits const limits{.node_capacity_bytes = 1024};
+  {
+    OnDiskPartitionManager manager{TempRoot(), limits};
+    auto partition = manager.CreatePartition(kValidId);
+    ASSERT_TRUE(partition.has_value());
+    ASSERT_TRUE(manager.CreatePartition(kOtherId).has_value());
+    ASSERT_TRUE(partition.value()
+                    ->OpenRoot()
+                    ->StoreRegularFile("a", "0123456789")
+                    .has_value());
+  }
+  /* a write the snapshot missed, e.g. made just before a crash */
+  std::ofstream{TempRoot() / kValidUUID / "b"} << "01234";
+
+  OnDiskPartitionManager manager{TempRoot(), limits};
+  ASSERT_EQ(manager.GetCacheStats().misses, 0);
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().bytes, 10);
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().files, 1);
+
+  ASSERT_NE(manager.LookupPartition(kValidId), nullptr);
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().bytes, 15);
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().files, 2);
+
+  /* partitions destroyed before they were loaded release their snapshot */
+  manager.DestroyPartition(kOtherId);
+  manager.DestroyPartition(kValidId);
+  manager.GetReclaimer().WaitIdle();
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().bytes, 0);
+  ASSERT_EQ(manager.GetNodeUsage().GetUsage().files, 0);
+  std::filesystem::remove_all(TempRoot());
+}
+
+}  // namespace tests::storage
@@ -0,0 +1,120 @@
+#include <filesystem>
+#include <format>
+#include <gtest/gtest.h>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "partition/on_disk_partition.hpp"
+#include "partition/scrubber.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+
+constexpr auto kValidUUID = "a2c59f5c-6c9b-4800-afb8-282fc5e743cc";
+constexpr PartitionId kValidId = *PartitionId::Parse(kValidUUID);
+
+std::filesystem::path TempRoot() {
+  return std::filesystem::temp_directory_path() / "cppfs-test-volumes";
+}
+
+class VolumesTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    std::filesystem::remove_all(TempRoot());
+    Restart();
+  }
+
+  void TearDown() override {
+    manager_.reset();
+    std::filesystem::remove_all(TempRoot());
+  }
+
+  void Restart() {
+    manager_.reset();
+    manager_.emplace(Root(), UsageLimits{}, ReclaimerConfig{},
+                     ScrubberConfig{}, DedupConfig{},
+                     std::vector{Extra(), Extra() / "."});
+  }
+
+  static std::filesystem::path Root() { return TempRoot() / "root"; }
+  static std::filesystem::path Extra() { return TempRoot() / "extra"; }
+
+  /// volumes holding a directory of the partition
+  static size_t CountCopies(std::string const& uuid) {
+    return std::filesystem::exists(Root() / uuid) +
+           std::filesystem::exists(Extra() / uuid);
+  }
+
+  static std::string Read(Partition* partition, std::string const& path) {
+    std::ostringstream out;
+    RegularFile* file = *partition->OpenRegularFile(path);
+    file->PositionalRead(out, 0, file->GetSize());
+    return out.str();
+  }
+
+  std::optional<OnDiskPartitionManager> manager_;
+};
+}  // namespace
+
+TEST_F(VolumesTest, ListsVolumesOnce) {
+  ASSERT_EQ(manager_->GetVolumes(), (std::vector{Root(), Extra()}));
+  ASSERT_TRUE(std::filesystem::is_directory(Extra()));
+}
+
+TEST_F(VolumesTest, PlacesPartitionsOnOneVolume) {
+  std::vector<std::string> uuids;
+  for (int i = 0; i < 8; ++i) {
+    std::string const uuid =
+        std::format("a2c59f5c-6c9b-4800-afb8-282fc5e743c{}", i);
+    Partition* partition =
+        *manager_->CreatePartition(*PartitionId::Parse(uuid));
+    ASSERT_TRUE(partition->OpenRoot()
+                    ->StoreRegularFile("file", std::string{uuid})
+                    .has_value());
+    ASSERT_EQ(CountCopies(uuid), 1);
+    uuids.push_back(uuid);
+  }
+
+  Restart();
+  for (std::string const& uuid : uuids) {
+    Partition* partition =
+        manager_->LookupPartition(*PartitionId::Parse(uuid));
+    ASSERT_NE(partition, nullptr);
+    ASSERT_EQ(Read(partition, "/file"), uuid);
+  }
+}
+
+TEST_F(VolumesTest, FindsPartitionsOnExtraVolume) {
+  Partition* partition = *manager_->CreatePartition(kValidId);
+  ASSERT_TRUE(
+      partition->OpenRoot()->StoreRegularFile("file", "data").has_value());
+  manager_.reset();
+  /* as if it was placed there when created */
+  if (!std::filesystem::exists(Extra() / kValidUUID)) {
+    std::filesystem::rename(Root() / kValidUUID, Extra() / kValidUUID);
+  }
+
+  Restart();
+  partition = manager_->LookupPartition(kValidId);
+  ASSERT_NE(partition, nullptr);
+  ASSERT_EQ(Read(partition, "/file"), "data");
+  ASSERT_TRUE(partition->OpenRoot()->StoreRegularFile("new", "x").has_value());
+  ASSERT_TRUE(std::filesystem::exists(Extra() / kValidUUID / "new"));
+
+  /* the checksums of all volumes are kept in the root */
+  Scrubber::PassStats const stats = manager_->GetScrubber().ScrubPass();
+  ASSERT_EQ(stats.files, 2);
+  ASSERT_EQ(stats.corrupted_files, 0);
+
+  manager_->DestroyPartition(kValidId);
+  ASSERT_EQ(CountCopies(kValidUUID), 0);
+  manager_->GetReclaimer().WaitIdle();
+  ASSERT_TRUE(std::filesystem::is_empty(
+      Extra() / OnDiskPartitionManager::kTrashDirName));
+}
+
+}  // namespace tests::storage
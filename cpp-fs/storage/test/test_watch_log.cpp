@@ -0,0 +1,105 @@
+#include <chrono>
+#include <future>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "partition/in_memory_partition.hpp"
+#include "partition/watch_log.hpp"
+
+namespace tests::storage {
+
+namespace {
+using namespace cppfs::storage;
+using namespace std::chrono_literals;
+
+constexpr PartitionId kId =
+    *PartitionId::Parse("a2c59f5c-6c9b-4800-afb8-282fc5e743cc");
+}  // namespace
+
+TEST(WatchLogTest, ReadsEventsAfterSequence) {
+  WatchLog log;
+  ASSERT_EQ(log.Record(WatchEvent::Kind::kCreateDirectory, "/dir"), 1);
+  ASSERT_EQ(log.Record(WatchEvent::Kind::kStoreRegularFile, "/dir/a"), 2);
+
+  WatchLog::Batch batch = log.Read(0);
+  ASSERT_FALSE(batch.gap);
+  ASSERT_EQ(batch.last_sequence, 2);
+  ASSERT_EQ(batch.events.size(), 2);
+  ASSERT_EQ(batch.events[0].kind, WatchEvent::Kind::kCreateDirectory);
+  ASSERT_EQ(batch.events[1].path, "/dir/a");
+
+  batch = log.Read(1);
+  ASSERT_EQ(batch.events.size(), 1);
+  ASSERT_EQ(batch.events[0].sequence, 2);
+  ASSERT_TRUE(log.Read(2).events.empty());
+}
+
+TEST(WatchLogTest, ReportsGaps) {
+  WatchLog log{4};
+  for (int i = 0; i < 10; ++i) {
+    log.Record(WatchEvent::Kind::kStoreRegularFile, std::to_string(i));
+  }
+  /* events 7 to 10 are kept */
+  WatchLog::Batch batch = log.Read(2);
+  ASSERT_TRUE(batch.gap);
+  ASSERT_EQ(batch.events.size(), 4);
+  ASSERT_EQ(batch.events.front().sequence, 7);
+  ASSERT_EQ(batch.events.back().path, "9");
+
+  batch = log.Read(6);
+  ASSERT_FALSE(batch.gap);
+  ASSERT_EQ(batch.events.size(), 4);
+
+  /* a sequence from before a restart */
+  batch = log.Read(20);
+  ASSERT_TRUE(batch.gap);
+  ASSERT_EQ(batch.last_sequence, 10);
+}
+
+TEST(WatchLogTest, WaitsForEvents) {
+  WatchLog log;
+  auto const start = std::chrono::steady_clock::now();
+  ASSERT_TRUE(log.Read(0, 20ms).events.empty());
+  ASSERT_GE(std::chrono::steady_clock::now() - start, 20ms);
+
+  auto reader = std::async(std::launch::async,
+                           [&log] { return log.Read(0, 10s); });
+  std::this_thread::sleep_for(10ms);
+  log.Record(WatchEvent::Kind::kCreateDirectory, "/dir");
+  ASSERT_EQ(reader.wait_for(5s), std::future_status::ready);
+  ASSERT_EQ(reader.get().events.size(), 1);
+}
+
+TEST(WatchLogTest, DestructionWakesReaders) {
+  auto log = std::make_unique<WatchLog>();
+  auto reader = std::async(std::launch::async,
+                           [log = log.get()] { return log->Read(0, 10s); });
+  std::this_thread::sleep_for(50ms);
+  log.reset();
+  ASSERT_EQ(reader.wait_for(5s), std::future_status::ready);
+  ASSERT_TRUE(reader.get().events.empty());
+}
+
+TEST(WatchLogTest, PartitionRecordsChanges) {
+  InMemoryPartitionManager manager;
+  Partition* partition = *manager.CreatePartition(kId);
+  Directory* dir = *partition->OpenRoot()->CreateDirectory("dir");
+  ASSERT_TRUE(dir->StoreRegularFile("file", "data").has_value());
+  /* failed mutations aren't recorded */
+  ASSERT_FALSE(dir->StoreRegularFile("file", "data").has_value());
+  /* writes change files in place, only creations are recorded */
+  ASSERT_TRUE((*partition->OpenRegularFile("/dir/file"))
+                  ->Append("more")
+                  .has_value());
+
+  WatchLog::Batch const batch = partition->GetWatchLog().Read(0);
+  ASSERT_EQ(batch.events.size(), 2);
+  ASSERT_EQ(batch.events[0].kind, WatchEvent::Kind::kCreateDirectory);
+  ASSERT_EQ(batch.events[0].path, "/dir");
+  ASSERT_EQ(batch.events[1].kind, WatchEvent::Kind::kStoreRegularFile);
+  ASSERT_EQ(batch.events[1].path, "/dir/file");
+}
+
+}  // namespace tests::storage
@@ -0,0 +1,78 @@
+#include <array>
+#include <gtest/gtest.h>
+#include <random>
+
+#include "workload.hpp"
+
+namespace tests::loadgen {
+
+namespace {
+using namespace cppfs::loadgen;
+}  // namespace
+
+TEST(OperationMixTest, Parse) {
+  auto mix = OperationMix::Parse("ls=40,cat=40,store=15,mkdir=5");
+  ASSERT_TRUE(mix.has_value());
+  ASSERT_EQ(mix->GetWeight(Operation::kLs), 40);
+  ASSERT_EQ(mix->GetWeight(Operation::kMkdir), 5);
+
+  mix = OperationMix::Parse("cat=1");
+  ASSERT_TRUE(mix.has_value());
+  ASSERT_EQ(mix->GetWeight(Operation::kLs), 0);
+
+  ASSERT_FALSE(OperationMix::Parse("").has_value());
+  ASSERT_FALSE(OperationMix::Parse("ls").has_value());
+  ASSERT_FALSE(OperationMix::Parse("rm=1").has_value());
+  ASSERT_FALSE(OperationMix::Parse("ls=x").has_value());
+  ASSERT_FALSE(OperationMix::Parse("ls=0").has_value());
+}
+
+TEST(OperationMixTest, PickFollowsWeights) {
+  auto mix = OperationMix::Parse("ls=3,store=1");
+  ASSERT_TRUE(mix.has_value());
+
+  std::mt19937_64 rng{1};
+  std::array<int, kOperations> picks{};
+  for (int i = 0; i < 40000; ++i) ++picks[static_cast<size_t>(mix->Pick(rng))];
+
+  ASSERT_EQ(picks[static_cast<size_t>(Operation::kCat)], 0);
+  ASSERT_EQ(picks[static_cast<size_t>(Operation::kMkdir)], 0);
+  ASSERT_NEAR(picks[static_cast<size_t>(Operation::kLs)], 30000, 1000);
+}
+
+TEST(ZipfGeneratorTest, Skewed) {
+  constexpr uint64_t kKeys = 1000;
+  ZipfGenerator zipf{kKeys, 0.99};
+  std::mt19937_64 rng{1};
+
+  std::array<int, kKeys> hits{};
+  for (int i = 0; i < 100000; ++i) {
+    uint64_t const rank = zipf(rng);
+    ASSERT_LT(rank, kKeys);
+    ++hits[rank];
+  }
+  /* with theta close to 1 the most popular key gets ~1/ln(n) of requests */
+  ASSERT_GT(hits[0], 10000);
+  ASSERT_GT(hits[0], hits[1]);
+  ASSERT_GT(hits[1], hits[10]);
+}
+
+TEST(ZipfGeneratorTest, UniformAndSmall) {
+  std::mt19937_64 rng{1};
+  ZipfGenerator uniform{10, 0};
+  std::array<int, 10> hits{};
+  for (int i = 0; i < 10000; ++i) ++hits[uniform(rng)];
+  for (int count : hits) ASSERT_NEAR(count, 1000, 200);
+
+  ZipfGenerator single{1, 0.99};
+  ASSERT_EQ(single(rng), 0);
+}
+
+TEST(ZipfGeneratorTest, ScrambleKeyInRange) {
+  for (uint64_t rank = 0; rank < 1000; ++rank) {
+    ASSERT_LT(ScrambleKey(rank, 7), 7);
+  }
+  ASSERT_NE(ScrambleKey(0, 1000), ScrambleKey(1, 1000));
+}
+
+}  // namespace tests::loadgen
@@ -4,11 +4,13 @@ import { config } from "@config/index"
 const Terminal = () => {
     const [session, setSession] = useState({
         login: "guest",
+        uuid: "",
         cwd: "/",
         protocol: config.fs.protocol,
         host: config.fs.host,
         port: config.fs.port,
         verbose: false,
+        watch: null,
     });
 
     const [history, setHistory] = useState([]);
@@ -40,6 +42,14 @@ const Terminal = () => {
         setSession(session => ({ ...session, verbose }));
     }
 
+    const setUuid = (uuid) => {
+        setSession(session => ({ ...session, uuid }));
+    }
+
+    const setWatch = (watch) => {
+        setSession(session => ({ ...session, watch }));
+    }
+
     const verboseLog = (string) => {
         if (session.verbose)
             addToHistory([`*VERBOSE*: ${string}`]);
@@ -49,19 +59,25 @@ const Terminal = () => {
         setHistory(history => [...history, ...newLines]);
     }
 
-    const sendQuery = async (route, method = "GET") => {
+    const withUuid = (route) =>
+        session.uuid ? `${route}${route.includes('?') ? '&' : '?'}uuid=${session.uuid}` : route;
+
+    const sendQuery = async (route, method = "GET", signal = undefined) => {
         try {
-            const query = `${getFsUrl()}/${route}`;
+            const query = `${getFsUrl()}/${withUuid(route)}`;
             verboseLog(`send query '${query}'`);
             console.log(`send query '${query}'`);
             const response = await fetch(query, {
-                method
+                method,
+                signal
             });
             if (!response.ok)
                 return response.json().then(error => Promise.reject(`${JSON.stringify(error, null, 1)}`));
 
             return response;
         } catch (error) {
+            if (signal?.aborted)
+                return Promise.reject("aborted");
             verboseLog(JSON.stringify(error, null, 1));
             return Promise.reject("internal server error");
         }
@@ -83,14 +99,38 @@ const Terminal = () => {
         sendQuery(`mkdir?at=${at}&dir=${dir}`, "POST")
             .then(response => response.json()).then(object => JSON.stringify(object, null, 1));
 
+    const watch = async (since, wait_ms, signal) =>
+        sendQuery(`watch?since=${since}&wait_ms=${wait_ms}`, "GET", signal)
+            .then(response => response.json());
+
     const squashConsecutiveSlashes = (str) =>  str.replace(/\/+/g, '/');
 
+    const isInside = (path, dir) =>
+        dir === '/' || path === dir || path.startsWith(`${dir}/`);
+
     const ProcessCmd = async (cmd) => {
         const [bin, ...cmds] = cmd.split(' ');
         if (bin == "login") {
             setLogin(cmds[0]);
             return null;
         }
+        if (bin == "uuid") {
+            setUuid(cmds[0] ?? "");
+            return null;
+        }
+        if (bin == "watch") {
+            if (!session.uuid)
+                return "Please, set the partition uuid to watch first";
+
+            let path = session.cwd;
+            if (cmds.length !== 0)
+                path = cmds[0][0] == '/' ? cmds[0] : squashConsecutiveSlashes(`${session.cwd}/${cmds[0]}`);
+            return ls(path).then(entries => { setWatch(path); return entries; });
+        }
+        if (bin == "unwatch") {
+            setWatch(null);
+            return null;
+        }
         if (bin == "cwd") {
             setCwd(cmds[0]);
             return null;
@@ -162,6 +202,38 @@ const Terminal = () => {
         return 'Command not found';
     }
 
+    // follow the changes of the watched directory with /watch long polls
+    // rather than listing it again
+    useEffect(() => {
+        if (!session.watch)
+            return;
+
+        const path = session.watch;
+        const controller = new AbortController();
+        const follow = async () => {
+            // the first poll doesn't wait, it only tells where to start
+            let since = null;
+            while (!controller.signal.aborted) {
+                const batch = await watch(since ?? 0, since === null ? 0 : 25000, controller.signal);
+                if (since !== null) {
+                    if (batch.gap)
+                        addToHistory([`watch: missed changes of '${path}', listing it again`, await ls(path)]);
+                    addToHistory(batch.events
+                        .filter(event => isInside(event.path, path))
+                        .map(event => `watch: ${event.op} ${event.path}`));
+                }
+                since = batch.last_sequence;
+            }
+        };
+        follow().catch(error => {
+            if (controller.signal.aborted)
+                return;
+            addToHistory([`watch: stopped following '${path}': ${error}`]);
+            setWatch(null);
+        });
+        return () => controller.abort();
+    }, [session.watch, session.uuid, session.protocol, session.host, session.port]);
+
     useEffect(() => {
         if (terminalRef.current) {
             terminalRef.current.scrollTop = terminalRef.current.scrollHeight;